@@ -1,6 +1,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <ctype.h>
 #ifndef UNIT_TEST
 #include <esp_log.h>
 #else
@@ -17,13 +18,18 @@
   printf(args);                \
   printf("\n");
 #endif
-#include <map>
 #include "tinyxml2.h"
 #include "../ZipFile/ZipFile.h"
+#include "../RubbishHtmlParser/HtmlTokenizer.h"
+#include "../RubbishHtmlParser/htmlEntities.h"
 #include "Epub.h"
+#include "TocParser.h"
 
 static const char *TAG = "EPUB";
 
+// files bigger than this are streamed through the tokenizer rather than read in one go
+#define MAX_READ_IN_ONE_GO 16384
+
 bool Epub::find_content_opf_file(ZipFile &zip, std::string &content_opf_file)
 {
   // open up the meta data to find where the content.opf file lives
@@ -75,6 +81,22 @@ bool Epub::find_content_opf_file(ZipFile &zip, std::string &content_opf_file)
   return false;
 }
 
+// the properties attribute is a space separated list
+bool has_property(const char *properties, const char *property)
+{
+  size_t length = strlen(property);
+  for (const char *start = strstr(properties, property); start; start = strstr(start + 1, property))
+  {
+    bool starts_word = start == properties || isspace((unsigned char)start[-1]);
+    bool ends_word = start[length] == '\0' || isspace((unsigned char)start[length]);
+    if (starts_word && ends_word)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
 bool Epub::parse_content_opf(ZipFile &zip, std::string &content_opf_file)
 {
   // read in the content.opf file and parse it
@@ -94,7 +116,7 @@ bool Epub::parse_content_opf(ZipFile &zip, std::string &content_opf_file)
     ESP_LOGE(TAG, "Could not find package element in content.opf");
     return false;
   }
-  // get the metadata - title and cover image
+  // get the metadata - title, author and cover image
   auto metadata = package->FirstChildElement("metadata");
   if (!metadata)
   {
@@ -108,8 +130,13 @@ bool Epub::parse_content_opf(ZipFile &zip, std::string &content_opf_file)
     return false;
   }
   m_title = title->GetText();
+  auto creator = metadata->FirstChildElement("dc:creator");
+  if (creator && creator->GetText())
+  {
+    m_author = creator->GetText();
+  }
   auto cover = metadata->FirstChildElement("meta");
-  while (cover && cover->Attribute("name") && strcmp(cover->Attribute("name"), "cover") != 0)
+  while (cover && (!cover->Attribute("name") || strcmp(cover->Attribute("name"), "cover") != 0))
   {
     cover = cover->NextSiblingElement("meta");
   }
@@ -128,25 +155,36 @@ bool Epub::parse_content_opf(ZipFile &zip, std::string &content_opf_file)
     ESP_LOGE(TAG, "Missing manifest");
     return false;
   }
-  // create a mapping from id to file name
+  // index the items by their ids
   auto item = manifest->FirstChildElement("item");
-  std::map<std::string, std::string> items;
-
   while (item)
   {
-    std::string item_id = item->Attribute("id");
-    std::string href = m_base_path + item->Attribute("href");
-    // grab the cover image
-    if (cover_item && item_id == cover_item)
+    const char *item_id = item->Attribute("id");
+    const char *item_href = item->Attribute("href");
+    if (item_id && item_href)
     {
-      m_cover_image_item = href;
-    }
-    // grab the ncx file
-    if (item_id == "ncx")
-    {
-      m_toc_ncx_item = href;
+      // the spine and the table of contents are matched up by these so they need to be in the same form
+      std::string href = normalise_path(m_base_path + item_href);
+      // grab the cover image
+      if (cover_item && strcmp(item_id, cover_item) == 0)
+      {
+        m_cover_image_item = href;
+      }
+      // grab the ncx file and the EPUB3 navigation document
+      const char *media_type = item->Attribute("media-type");
+      if (strcmp(item_id, "ncx") == 0 || (media_type && strcmp(media_type, "application/x-dtbncx+xml") == 0))
+      {
+        m_toc_ncx_item = href;
+      }
+      const char *properties = item->Attribute("properties");
+      if (properties && has_property(properties, "nav"))
+      {
+        m_toc_nav_item = href;
+      }
+      EpubManifestItem manifest_item = {m_strings.intern(item_id, strlen(item_id)), m_strings.intern(href)};
+      m_manifest_by_id.set(manifest_item.id, m_manifest.size());
+      m_manifest.push_back(manifest_item);
     }
-    items[item_id] = href;
     item = item->NextSiblingElement("item");
   }
   // find the spine
@@ -160,78 +198,220 @@ bool Epub::parse_content_opf(ZipFile &zip, std::string &content_opf_file)
   auto itemref = spine->FirstChildElement("itemref");
   while (itemref)
   {
-    auto id = itemref->Attribute("idref");
-    if (items.find(id) != items.end())
+    const char *id = itemref->Attribute("idref");
+    uint32_t id_offset = 0;
+    uint32_t manifest_index = 0;
+    if (id && m_strings.find(id, strlen(id), &id_offset) && m_manifest_by_id.get(id_offset, &manifest_index))
     {
-      m_spine.push_back(std::make_pair(id, items[id]));
+      m_spine_by_href.set(m_manifest[manifest_index].href, m_spine.size());
+      m_spine.push_back(manifest_index);
     }
     itemref = itemref->NextSiblingElement("itemref");
   }
+  m_manifest.shrink_to_fit();
+  m_spine.shrink_to_fit();
+  m_strings.shrink_to_fit();
   return true;
 }
 
-bool Epub::parse_toc_ncx_file(ZipFile &zip)
+// picks the title, author and cover image out of the content.opf file without building a document
+class OpfMetadataHandler : public HtmlTokenHandler
 {
-  // the ncx file should have been specified in the content.opf file
-  if (m_toc_ncx_item.empty())
+private:
+  // the text element we're in the middle of
+  std::string *m_text = nullptr;
+  bool m_has_title = false;
+  bool m_has_author = false;
+  bool m_in_metadata = false;
+  bool m_in_manifest = false;
+  std::string m_cover_id;
+
+  static bool is_tag(const char *name, size_t length, const char *tag)
   {
-    ESP_LOGE(TAG, "No ncx file specified");
-    return false;
+    return length == strlen(tag) && strncmp(name, tag, length) == 0;
   }
-  ESP_LOGI(TAG, "toc path: %s\n", m_toc_ncx_item.c_str());
 
-  char *ncx_data = (char *)zip.read_file_to_memory(m_toc_ncx_item.c_str());
-  if (!ncx_data)
+public:
+  const std::string &base_path;
+  std::string title;
+  std::string author;
+  std::string cover_image_item;
+  // set once we've seen the whole of the metadata and found the cover image
+  bool is_done = false;
+
+  OpfMetadataHandler(const std::string &base_path) : base_path(base_path) {}
+  void on_start_tag(const HtmlTag &tag)
   {
-    ESP_LOGE(TAG, "Could not find %s", m_toc_ncx_item.c_str());
-    return false;
+    if (is_tag(tag.name, tag.name_length, "metadata"))
+    {
+      m_in_metadata = true;
+    }
+    else if (is_tag(tag.name, tag.name_length, "manifest"))
+    {
+      m_in_manifest = true;
+    }
+    else if (m_in_metadata && !m_has_title && is_tag(tag.name, tag.name_length, "dc:title"))
+    {
+      m_text = &title;
+    }
+    else if (m_in_metadata && !m_has_author && is_tag(tag.name, tag.name_length, "dc:creator"))
+    {
+      m_text = &author;
+    }
+    else if (m_in_metadata && m_cover_id.empty() && is_tag(tag.name, tag.name_length, "meta"))
+    {
+      std::string name;
+      if (tag.get_attribute("name", name) && name == "cover")
+      {
+        tag.get_attribute("content", m_cover_id);
+      }
+    }
+    else if (m_in_manifest && is_tag(tag.name, tag.name_length, "item"))
+    {
+      std::string id, href;
+      if (tag.get_attribute("id", id) && id == m_cover_id && tag.get_attribute("href", href))
+      {
+        cover_image_item = normalise_path(base_path + href);
+        is_done = true;
+      }
+    }
   }
-  // Parse the Toc contents
-  tinyxml2::XMLDocument doc;
-  auto result = doc.Parse(ncx_data);
-  free(ncx_data);
-  if (result != tinyxml2::XML_SUCCESS)
+  void on_end_tag(const char *tag_name, size_t tag_name_length)
+  {
+    if (m_text == &title && is_tag(tag_name, tag_name_length, "dc:title"))
+    {
+      m_has_title = true;
+      m_text = nullptr;
+    }
+    else if (m_text == &author && is_tag(tag_name, tag_name_length, "dc:creator"))
+    {
+      m_has_author = true;
+      m_text = nullptr;
+    }
+    else if (is_tag(tag_name, tag_name_length, "metadata"))
+    {
+      m_in_metadata = false;
+      // no cover means there's no need to look through the manifest
+      is_done = m_cover_id.empty();
+    }
+    else if (is_tag(tag_name, tag_name_length, "manifest"))
+    {
+      is_done = true;
+    }
+  }
+  void on_text(const char *text, size_t length)
+  {
+    if (m_text)
+    {
+      m_text->append(text, length);
+    }
+  }
+  bool has_title() { return m_has_title; }
+};
+
+// feed a file from the epub through the tokenizer - is_done can stop the reading early
+static bool tokenize_file(ZipFile &zip, const std::string &filename, HtmlTokenizer &tokenizer, std::function<bool()> is_done)
+{
+  size_t file_size = 0;
+  if (!zip.get_file_size(filename.c_str(), &file_size))
   {
-    ESP_LOGE(TAG, "Error parsing toc %s", doc.ErrorIDToName(result));
+    ESP_LOGE(TAG, "Could not find %s", filename.c_str());
     return false;
   }
-  auto ncx = doc.FirstChildElement("ncx");
-  if (!ncx)
+  // streaming needs a 32K window for the decompression so small files are cheaper to read in one go
+  if (file_size <= MAX_READ_IN_ONE_GO)
   {
-    ESP_LOGE(TAG, "Could not find first child ncx in toc");
+    char *contents = (char *)zip.read_file_to_memory(filename.c_str());
+    if (!contents)
+    {
+      return false;
+    }
+    tokenizer.parse(contents, file_size);
+    free(contents);
+    return true;
+  }
+  // small chunks so we don't decompress much more than we need
+  bool success = zip.read_file_to_callback(
+      filename.c_str(),
+      [&](const uint8_t *data, size_t length)
+      {
+        tokenizer.feed((const char *)data, length);
+        return !is_done();
+      },
+      1024);
+  if (!success)
+  {
+    ESP_LOGE(TAG, "Could not read %s", filename.c_str());
     return false;
   }
+  if (!is_done())
+  {
+    tokenizer.finish();
+  }
+  return true;
+}
 
-  auto navMap = ncx->FirstChildElement("navMap");
-  if (!navMap)
+bool Epub::parse_content_opf_metadata(ZipFile &zip, std::string &content_opf_file)
+{
+  OpfMetadataHandler handler(m_base_path);
+  HtmlTokenizer tokenizer(&handler);
+  if (!tokenize_file(zip, content_opf_file, tokenizer, [&handler]()
+                     { return handler.is_done; }))
   {
-    ESP_LOGE(TAG, "Could not find navMap child in ncx");
     return false;
   }
-
-  auto navPoint = navMap->FirstChildElement("navPoint");
-
-  // Fills toc_index map
-  while (navPoint)
+  if (!handler.has_title())
+  {
+    ESP_LOGE(TAG, "Missing title");
+    return false;
+  }
+  // tinyxml decodes the entities for us when we read the whole file
+  m_title = replace_html_entities(handler.title);
+  m_author = replace_html_entities(handler.author);
+  m_cover_image_item = handler.cover_image_item;
+  if (m_cover_image_item.empty())
   {
-    // navPoint has also an id & playOrder element: navPoint->Attribute("id");
-    auto navLabel = navPoint->FirstChildElement("navLabel")->FirstChildElement("text")->FirstChild();
-    std::string title = navLabel->Value();
-    auto content = navPoint->FirstChildElement("content");
-    std::string href = m_base_path + content->Attribute("src");
-    // split the href on the # to get the href and the anchor
-    size_t pos = href.find('#');
-    std::string anchor = "";
+    ESP_LOGW(TAG, "Missing cover");
+  }
+  return true;
+}
 
-    if (pos != std::string::npos)
+bool Epub::parse_toc(ZipFile &zip)
+{
+  m_toc.clear();
+  // the ncx is the one that's been around longest so it's the most likely to be right - EPUB3
+  // books might only have the navigation document though
+  if (!m_toc_ncx_item.empty())
+  {
+    ESP_LOGI(TAG, "toc path: %s", m_toc_ncx_item.c_str());
+    NcxTocHandler handler(m_strings, m_toc, m_toc_ncx_item);
+    HtmlTokenizer tokenizer(&handler);
+    if (tokenize_file(zip, m_toc_ncx_item, tokenizer, []()
+                      { return false; }))
+    {
+      handler.finish();
+    }
+  }
+  if (m_toc.empty() && !m_toc_nav_item.empty())
+  {
+    ESP_LOGI(TAG, "nav path: %s", m_toc_nav_item.c_str());
+    NavTocHandler handler(m_strings, m_toc, m_toc_nav_item);
+    HtmlTokenizer tokenizer(&handler);
+    if (tokenize_file(zip, m_toc_nav_item, tokenizer, []()
+                      { return false; }))
     {
-      anchor = href.substr(pos + 1);
-      href = href.substr(0, pos);
+      handler.finish();
     }
-    m_toc.push_back(EpubTocEntry(title, href, anchor, 0));
-    // ESP_LOGI(TAG, "%s -> %s#%s", title.c_str(), href.c_str(), anchor.c_str());
-    navPoint = navPoint->NextSiblingElement("navPoint");
   }
+  if (m_toc.empty())
+  {
+    // there's always somewhere to go - the start of the book
+    ESP_LOGW(TAG, "No table of contents");
+    EpubTocEntry entry = {m_strings.intern(m_title), m_spine.empty() ? m_strings.intern("", 0) : m_manifest[m_spine[0]].href, m_strings.intern("", 0), -1, 0};
+    m_toc.push_back(entry);
+  }
+  m_toc.shrink_to_fit();
+  m_strings.shrink_to_fit();
   return true;
 }
 
@@ -239,33 +419,64 @@ Epub::Epub(const std::string &path) : m_path(path)
 {
 }
 
+Epub::~Epub()
+{
+  delete m_zip;
+}
+
+ZipFile &Epub::get_zip()
+{
+  if (!m_zip)
+  {
+    m_zip = new ZipFile(m_path.c_str());
+  }
+  return *m_zip;
+}
+
 // load in the meta data for the epub file
-bool Epub::load()
+bool Epub::load(EpubLoadLevel level)
 {
-  ZipFile zip(m_path.c_str());
-  std::string content_opf_file;
-  if (!find_content_opf_file(zip, content_opf_file))
+  if (m_loaded_level >= level)
+  {
+    return true;
+  }
+  ZipFile &zip = get_zip();
+  if (m_content_opf_file.empty())
   {
-    #ifndef UNIT_TEST
-      #ifdef USE_SPIFFS
-        ESP_LOGI(TAG, "Is SPIFFs data uploaded?\npio run -t uploadfs");
+    if (!find_content_opf_file(zip, m_content_opf_file))
+    {
+      #ifndef UNIT_TEST
+        #ifdef USE_SPIFFS
+          ESP_LOGI(TAG, "Is SPIFFs data uploaded?\npio run -t uploadfs");
+        #endif
+        ESP_LOGE(TAG, "Could not open ePub. Restarting in 10 secs.");
+        vTaskDelay(pdMS_TO_TICKS(1000*10));
+        esp_restart();
       #endif
-      ESP_LOGE(TAG, "Could not open ePub. Restarting in 10 secs.");
-      vTaskDelay(pdMS_TO_TICKS(1000*10));
-      esp_restart();
-    #endif
-    return false;
+      return false;
+    }
+    // get the base path for the content
+    m_base_path = m_content_opf_file.substr(0, m_content_opf_file.find_last_of('/') + 1);
   }
-  // get the base path for the content
-  m_base_path = content_opf_file.substr(0, content_opf_file.find_last_of('/') + 1);
-  if (!parse_content_opf(zip, content_opf_file))
+  if (level == EPUB_LOAD_METADATA)
   {
-    return false;
+    if (!parse_content_opf_metadata(zip, m_content_opf_file))
+    {
+      return false;
+    }
+  }
+  else if (m_loaded_level < EPUB_LOAD_SPINE)
+  {
+    if (!parse_content_opf(zip, m_content_opf_file))
+    {
+      return false;
+    }
   }
-  if (!parse_toc_ncx_file(zip))
+  if (level == EPUB_LOAD_TOC && !parse_toc(zip))
   {
     return false;
   }
+  m_loaded_level = level;
   return true;
 }
 
@@ -274,11 +485,31 @@ const std::string &Epub::get_title()
   return m_title;
 }
 
+const std::string &Epub::get_author()
+{
+  return m_author;
+}
+
 const std::string &Epub::get_cover_image_item()
 {
   return m_cover_image_item;
 }
 
+static void add_path_component(std::vector<std::string> &components, const std::string &component)
+{
+  if (component == "..")
+  {
+    if (!components.empty())
+    {
+      components.pop_back();
+    }
+  }
+  else if (!component.empty() && component != ".")
+  {
+    components.push_back(component);
+  }
+}
+
 std::string normalise_path(const std::string &path)
 {
   std::vector<std::string> components;
@@ -287,31 +518,15 @@ std::string normalise_path(const std::string &path)
   {
     if (c == '/')
     {
-      if (!component.empty())
-      {
-        if (component == "..")
-        {
-          if (!components.empty())
-          {
-            components.pop_back();
-          }
-        }
-        else
-        {
-          components.push_back(component);
-        }
-        component.clear();
-      }
+      add_path_component(components, component);
+      component.clear();
     }
     else
     {
       component += c;
     }
   }
-  if (!component.empty())
-  {
-    components.push_back(component);
-  }
+  add_path_component(components, component);
   std::string result;
   for (auto &component : components)
   {
@@ -326,9 +541,8 @@ std::string normalise_path(const std::string &path)
 
 uint8_t *Epub::get_item_contents(const std::string &item_href, size_t *size)
 {
-  ZipFile zip(m_path.c_str());
   std::string path = normalise_path(item_href);
-  auto content = zip.read_file_to_memory(path.c_str(), size);
+  auto content = get_zip().read_file_to_memory(path.c_str(), size);
   if (!content)
   {
     ESP_LOGE(TAG, "Failed to read item %s", path.c_str());
@@ -337,28 +551,52 @@ uint8_t *Epub::get_item_contents(const std::string &item_href, size_t *size)
   return content;
 }
 
+bool Epub::stream_item_contents(const std::string &item_href, std::function<bool(const uint8_t *data, size_t length)> callback)
+{
+  std::string path = normalise_path(item_href);
+  if (!get_zip().read_file_to_callback(path.c_str(), callback))
+  {
+    ESP_LOGE(TAG, "Failed to stream item %s", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+size_t Epub::get_bytes_extracted()
+{
+  return m_zip ? m_zip->get_bytes_extracted() : 0;
+}
+
 int Epub::get_spine_items_count()
 {
   return m_spine.size();
 }
 
-std::string &Epub::get_spine_item(int spine_index)
+const char *Epub::get_spine_item(int spine_index)
 {
-  try
+  if (spine_index < 0 || spine_index >= (int)m_spine.size())
+  {
+    ESP_LOGI(TAG, "get_spine_item index:%d is out_of_range", spine_index);
+    // go back to the start of the book
+    spine_index = 0;
+    if (m_spine.empty())
     {
-      return m_spine.at(spine_index).second;
-    } catch (const std::out_of_range &oor) {
-      
-      ESP_LOGI(TAG, "get_spine_item index:%d is out_of_range", spine_index);
-      spine_index = 0;
+      return "";
     }
-    // if exception is catched return last page
-    return m_spine.at(spine_index).second;
+  }
+  return m_strings.get(m_manifest[m_spine[spine_index]].href);
 }
 
-EpubTocEntry &Epub::get_toc_item(int toc_index)
+int Epub::get_spine_index(const std::string &href)
 {
-  return m_toc[toc_index];
+  // hrefs are only stored once so if it's not in the pool it can't be in the spine
+  uint32_t href_offset = 0;
+  uint32_t spine_index = 0;
+  if (!m_strings.find(href, &href_offset) || !m_spine_by_href.get(href_offset, &spine_index))
+  {
+    return -1;
+  }
+  return spine_index;
 }
 
 int Epub::get_toc_items_count()
@@ -366,19 +604,41 @@ int Epub::get_toc_items_count()
   return m_toc.size();
 }
 
+const char *Epub::get_toc_item_title(int toc_index)
+{
+  return m_strings.get(m_toc[toc_index].title);
+}
+
+const char *Epub::get_toc_item_href(int toc_index)
+{
+  return m_strings.get(m_toc[toc_index].href);
+}
+
+const char *Epub::get_toc_item_anchor(int toc_index)
+{
+  return m_strings.get(m_toc[toc_index].anchor);
+}
+
+int Epub::get_toc_item_level(int toc_index)
+{
+  return m_toc[toc_index].level;
+}
+
+int Epub::get_toc_item_parent(int toc_index)
+{
+  return m_toc[toc_index].parent;
+}
+
 // work out the section index for a toc index
 int Epub::get_spine_index_for_toc_index(int toc_index)
 {
-  // the toc entry should have an href that matches the spine item
-  // so we can find the spine index by looking for the href
-  for (int i = 0; i < m_spine.size(); i++)
+  // the toc entry's href is in the same string pool as the spine's hrefs so we can look it up directly
+  uint32_t spine_index = 0;
+  if (!m_spine_by_href.get(m_toc[toc_index].href, &spine_index))
   {
-    if (m_spine[i].second == m_toc[toc_index].href)
-    {
-      return i;
-    }
+    ESP_LOGI(TAG, "Section not found");
+    // not found - default to the start of the book
+    return 0;
   }
-  ESP_LOGI(TAG, "Section not found");
-  // not found - default to the start of the book
-  return 0;
+  return spine_index;
 }
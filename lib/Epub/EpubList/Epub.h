@@ -3,6 +3,8 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <functional>
+#include "StringPool.h"
 #ifndef UNIT_TEST
   #include <freertos/FreeRTOS.h>
   #include <freertos/task.h>
@@ -10,55 +12,112 @@
 
 class ZipFile;
 
-class EpubTocEntry
+// an entry in the table of contents - the strings are offsets in the book's string pool
+typedef struct
 {
-public:
-  std::string title;
-  std::string href;
-  std::string anchor;
-  int level;
-  EpubTocEntry(std::string title, std::string href, std::string anchor, int level) : title(title), href(href), anchor(anchor), level(level) {}
-};
+  uint32_t title;
+  // the item the entry points at and the element in it - the anchor is empty for the start of the item
+  uint32_t href;
+  uint32_t anchor;
+  // the entry this one is nested inside - -1 for the top level
+  int32_t parent;
+  uint16_t level;
+} EpubTocEntry;
+
+// how much of the epub to read - each level includes everything from the ones before it
+typedef enum
+{
+  // just the title, author and cover image - enough for the library
+  EPUB_LOAD_METADATA,
+  // the sections of the book in reading order
+  EPUB_LOAD_SPINE,
+  // the table of contents as well
+  EPUB_LOAD_TOC
+} EpubLoadLevel;
+
+// an item from the manifest - the offsets of its id and href in the book's string pool
+typedef struct
+{
+  uint32_t id;
+  uint32_t href;
+} EpubManifestItem;
+
+// the path of an item in the epub with any "." and ".." parts collapsed
+std::string normalise_path(const std::string &path);
+// is property one of the whitespace separated words in properties - e.g. "nav" in "nav scripted"
+bool has_property(const char *properties, const char *property);
 
 class Epub
 {
 private:
   // the title read from the EPUB meta data
   std::string m_title;
+  // the author read from the EPUB meta data - can be empty
+  std::string m_author;
   // the cover image
   std::string m_cover_image_item;
-  // the ncx file
+  // the EPUB2 ncx file and the EPUB3 navigation document - either can be missing
   std::string m_toc_ncx_item;
+  std::string m_toc_nav_item;
   // where is the EPUBfile?
   std::string m_path;
-  // the spine of the EPUB file
-  std::vector<std::pair<std::string, std::string>> m_spine;
-  // the toc of the EPUB file
+  // the ids and hrefs from the content.opf - each one is only stored once
+  StringPool m_strings;
+  std::vector<EpubManifestItem> m_manifest;
+  // manifest index for each id
+  OffsetMap m_manifest_by_id;
+  // the spine of the EPUB file - the manifest index of each section in reading order
+  std::vector<uint32_t> m_spine;
+  // spine index for each href
+  OffsetMap m_spine_by_href;
+  // the toc of the EPUB file - flattened in reading order with each entry's children straight after it
   std::vector<EpubTocEntry> m_toc;
   // the base path for items in the EPUB file
   std::string m_base_path;
+  // where the content.opf file is and how much of the epub we've read so far
+  std::string m_content_opf_file;
+  int m_loaded_level = -1;
+  // the zip file is kept open for the lifetime of the epub so we only read the central directory once
+  ZipFile *m_zip = nullptr;
+  ZipFile &get_zip();
   // find the path for the content.opf file
   bool find_content_opf_file(ZipFile &zip, std::string &content_opf_file);
   bool parse_content_opf(ZipFile &zip, std::string &content_opf_file);
-  bool parse_toc_ncx_file(ZipFile &zip);
+  // read just the metadata from the content.opf file - stops reading as soon as it has everything
+  bool parse_content_opf_metadata(ZipFile &zip, std::string &content_opf_file);
+  bool parse_toc(ZipFile &zip);
 
 public:
   Epub(const std::string &path);
-  ~Epub() {}
+  ~Epub();
   std::string &get_base_path() { return m_base_path; }
-  bool load();
+  // read the epub up to the level needed - loading more later on only reads the extra parts
+  bool load(EpubLoadLevel level = EPUB_LOAD_TOC);
 
   const std::string &get_path() const { return m_path; }
   const std::string &get_title();
+  const std::string &get_author();
   const std::string &get_cover_image_item();
   uint8_t *get_item_contents(const std::string &item_href, size_t *size = nullptr);
+  // stream the contents of an item in chunks - the callback can return false to stop reading
+  bool stream_item_contents(const std::string &item_href, std::function<bool(const uint8_t *data, size_t length)> callback);
+  // the total number of bytes decompressed from the epub file so far
+  size_t get_bytes_extracted();
 
-  std::string &get_spine_item(int spine_index);
-  int get_spine_item_id(std::string spine_key);
+  const char *get_spine_item(int spine_index);
+  // find the section for an href - returns -1 if it's not in the spine
+  int get_spine_index(const std::string &href);
   int get_spine_items_count();
 
-  EpubTocEntry &get_toc_item(int toc_index);
   int get_toc_items_count();
+  // the strings stay valid for as long as the epub is loaded
+  const char *get_toc_item_title(int toc_index);
+  const char *get_toc_item_href(int toc_index);
+  const char *get_toc_item_anchor(int toc_index);
+  // how deeply the entry is nested - 0 for the top level
+  int get_toc_item_level(int toc_index);
+  // the index of the entry this one is nested inside - -1 for the top level
+  int get_toc_item_parent(int toc_index);
   // work out the section index for a toc index
   int get_spine_index_for_toc_index(int toc_index);
 };
\ No newline at end of file
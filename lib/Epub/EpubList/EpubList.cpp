@@ -34,52 +34,12 @@ bool EpubList::load(const char *path)
   renderer->show_busy();
   // trigger a proper redraw
   state.previous_rendered_page = -1;
-  // read in the list of epubs
-  state.num_epubs = 0;
-  DIR *dir;
-  struct dirent *ent;
-  if ((dir = opendir(path)) != NULL)
+  // bring the library index up to date - only new or changed books get opened
+  if (m_index.update(path))
   {
-    while ((ent = readdir(dir)) != NULL)
-    {
-      ESP_LOGD(TAG, "Found file: %s", ent->d_name);
-      // ignore any hidden files starting with "." and any directories
-      if (ent->d_name[0] == '.' || ent->d_type == DT_DIR)
-      {
-        continue;
-      }
-      int name_length = strlen(ent->d_name);
-      if (name_length < 5 || strcmp(ent->d_name + name_length - 5, ".epub") != 0)
-      {
-        continue;
-      }
-      ESP_LOGD(TAG, "Loading epub %s", ent->d_name);
-      Epub *epub = new Epub(std::string("/fs/") + ent->d_name);
-      if (epub->load())
-      {
-        strncpy(state.epub_list[state.num_epubs].path, epub->get_path().c_str(), MAX_PATH_SIZE);
-        strncpy(state.epub_list[state.num_epubs].title, replace_html_entities(epub->get_title()).c_str(), MAX_TITLE_SIZE);
-        state.num_epubs++;
-        if (state.num_epubs == MAX_EPUB_LIST_SIZE)
-        {
-          ESP_LOGE(TAG, "Too many epubs, max is %d", MAX_EPUB_LIST_SIZE);
-          break;
-        }
-      }
-      else
-      {
-        ESP_LOGE(TAG, "Failed to load epub %s", ent->d_name);
-      }
-      delete epub;
-    }
-    closedir(dir);
-    std::sort(
-        state.epub_list,
-        state.epub_list + state.num_epubs,
-        [](const EpubListItem &a, const EpubListItem &b)
-        {
-          return strcmp(a.title, b.title) < 0;
-        });
+    state.num_epubs = m_index.get_count();
+    // the pages of the list will need reading again
+    m_page_entries_page = -1;
   }
   else
   {
@@ -107,6 +67,8 @@ bool EpubList::load(const char *path)
     state.previous_rendered_page = -1;
     state.previous_selected_item = -1;
   }
+  // books that have been deleted don't need their layouts any more
+  m_layout_cache.remove_orphans();
   state.is_loaded = true;
   return true;
 }
@@ -117,6 +79,10 @@ void EpubList::render()
   // what page are we on?
   int current_page = state.selected_item / EPUBS_PER_PAGE;
   // draw a page of epubs
+  if (!load_page(current_page))
+  {
+    ESP_LOGE(TAG, "Failed to read page %d of the library", current_page);
+  }
   int cell_height = renderer->get_page_height() / EPUBS_PER_PAGE;
   ESP_LOGD(TAG, "Cell height is %d", cell_height);
   int start_index = current_page * EPUBS_PER_PAGE;
@@ -132,23 +98,19 @@ void EpubList::render()
     // trigger a redraw of the items
     state.previous_rendered_page = -1;
   }
-  for (int i = start_index; i < start_index + EPUBS_PER_PAGE && i < state.num_epubs; i++)
+  for (int i = start_index; i < start_index + (int)m_page_entries.size(); i++)
   {
+    LibraryEntry &entry = m_page_entries[i - start_index];
     // do we need to draw a new page of items?
     if (current_page != state.previous_rendered_page)
     {
       ESP_LOGI(TAG, "Rendering item %d", i);
-      Epub *epub = new Epub(state.epub_list[i].path);
-      epub->load();
       // draw the cover page
       int image_xpos = PADDING;
       int image_ypos = ypos + PADDING;
       int image_height = cell_height - PADDING * 2;
       int image_width = 2 * image_height / 3;
-      size_t image_data_size = 0;
-      uint8_t *image_data = epub->get_item_contents(epub->get_cover_image_item(), &image_data_size);
-      renderer->draw_image(epub->get_cover_image_item(), image_data, image_data_size, image_xpos, image_ypos, image_width, image_height);
-      free(image_data);
+      m_thumbnails.draw(entry.path, image_xpos, image_ypos, image_width, image_height);
       // draw the title
       int text_xpos = image_xpos + image_width + PADDING;
       int text_ypos = ypos + PADDING / 2;
@@ -156,8 +118,8 @@ void EpubList::render()
       int text_height = cell_height - PADDING * 2;
       // use the text block to layout the title
       TextBlock *title_block = new TextBlock(LEFT_ALIGN);
-      title_block->add_span(state.epub_list[i].title, false, false);
-      title_block->layout(renderer, epub, text_width);
+      title_block->add_span(entry.title.c_str(), false, false);
+      title_block->layout(renderer, nullptr, text_width);
       // work out the height of the title
       int title_height = title_block->line_breaks.size() * renderer->get_line_height();
       // center the title in the cell
@@ -169,7 +131,6 @@ void EpubList::render()
         y_offset += renderer->get_line_height();
       }
       delete title_block;
-      delete epub;
     }
     // clear the selection box around the previous selected item
     if (state.previous_selected_item == i)
@@ -189,6 +150,82 @@ void EpubList::render()
     }
     ypos += cell_height;
   }
+  bool drew_page = current_page != state.previous_rendered_page;
   state.previous_selected_item = state.selected_item;
   state.previous_rendered_page = current_page;
+  if (drew_page)
+  {
+    int image_height = cell_height - PADDING * 2;
+    prefetch_thumbnails(current_page, 2 * image_height / 3, image_height);
+  }
+}
+
+void EpubList::prefetch_thumbnails(int current_page, int image_width, int image_height)
+{
+  // the next page first as that's the way people usually go
+  std::vector<std::string> paths;
+  std::vector<LibraryEntry> entries;
+  int pages[] = {current_page + 1, current_page - 1};
+  for (int page : pages)
+  {
+    if (page >= 0 && m_index.read_entries(page * EPUBS_PER_PAGE, EPUBS_PER_PAGE, entries))
+    {
+      for (auto &entry : entries)
+      {
+        paths.push_back(entry.path);
+      }
+    }
+  }
+  m_thumbnails.prefetch(paths, image_width, image_height);
+}
+
+bool EpubList::load_page(int page)
+{
+  if (page == m_page_entries_page)
+  {
+    return true;
+  }
+  m_page_entries_page = -1;
+  if (!m_index.read_entries(page * EPUBS_PER_PAGE, EPUBS_PER_PAGE, m_page_entries))
+  {
+    return false;
+  }
+  m_page_entries_page = page;
+  return true;
+}
+
+void EpubList::select_current()
+{
+  // remember where we got to in the last book before switching over
+  save_position();
+  std::vector<LibraryEntry> entries;
+  if (!m_index.read_entries(state.selected_item, 1, entries) || entries.empty())
+  {
+    ESP_LOGE(TAG, "Failed to read book %d from the library", state.selected_item);
+    return;
+  }
+  LibraryEntry &entry = entries[0];
+  EpubListItem &selected = state.selected_epub;
+  strncpy(selected.path, entry.path.c_str(), MAX_PATH_SIZE - 1);
+  selected.path[MAX_PATH_SIZE - 1] = '\0';
+  strncpy(selected.title, entry.title.c_str(), MAX_TITLE_SIZE - 1);
+  selected.title[MAX_TITLE_SIZE - 1] = '\0';
+  selected.current_section = entry.current_section;
+  selected.current_page = entry.current_page;
+  selected.pages_in_current_section = entry.pages_in_current_section;
+}
+
+void EpubList::save_position()
+{
+  EpubListItem &selected = state.selected_epub;
+  if (selected.path[0] == '\0')
+  {
+    return;
+  }
+  if (!m_index.save_position(selected.path, selected.current_section, selected.current_page, selected.pages_in_current_section, state.selected_item))
+  {
+    ESP_LOGE(TAG, "Failed to save the position for %s", selected.path);
+  }
+  // the page we have in memory might have the old position
+  m_page_entries_page = -1;
 }
\ No newline at end of file
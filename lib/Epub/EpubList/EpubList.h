@@ -12,6 +12,9 @@ extern "C" {
 #include "../RubbishHtmlParser/blocks/TextBlock.h"
 #include "../RubbishHtmlParser/htmlEntities.h"
 #include "./State.h"
+#include "../ThumbnailCache/ThumbnailCache.h"
+#include "../LibraryIndex/LibraryIndex.h"
+#include "../LayoutCache/LayoutCache.h"
 
 #ifndef UNIT_TEST
   #include <freertos/FreeRTOS.h>
@@ -28,13 +31,33 @@ private:
   Renderer *renderer;
   EpubListState &state;
   bool m_needs_redraw = false;
+  // the covers shrunk down to the size we draw them at
+  ThumbnailCache m_thumbnails;
+  // all the books we know about - only the page being shown is held in memory
+  LibraryIndex m_index;
+  // only used to clear out the layouts of books that have gone
+  LayoutCache m_layout_cache;
+  std::vector<LibraryEntry> m_page_entries;
+  int m_page_entries_page = -1;
+
+  bool load_page(int page);
+
+  // get the covers for the pages either side of the current one ready in the background
+  void prefetch_thumbnails(int current_page, int image_width, int image_height);
 
 public:
-  EpubList(Renderer *renderer, EpubListState &state) : renderer(renderer), state(state){};
+  EpubList(Renderer *renderer, EpubListState &state, const std::string &cache_path = "/fs/")
+      : renderer(renderer), state(state), m_thumbnails(renderer, cache_path), m_index(cache_path + "library.idx"), m_layout_cache(cache_path){};
   ~EpubList() {}
   bool load(const char *path);
   void set_needs_redraw() { m_needs_redraw = true; }
   void next();
   void prev();
   void render();
+  // make the highlighted book the one that's being read
+  void select_current();
+  // write the position in the book being read back to the library index
+  void save_position();
+  // leave the thumbnails that haven't been made yet for later
+  void stop_prefetching() { m_thumbnails.cancel(); }
 };
\ No newline at end of file
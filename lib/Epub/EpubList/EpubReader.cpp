@@ -1,7 +1,6 @@
 #include <string.h>
 #ifndef UNIT_TEST
 #include <esp_log.h>
-#include <esp_system.h>
 #else
 #define ESP_LOGI(args...)
 #define ESP_LOGE(args...)
@@ -11,62 +10,190 @@
 #include "EpubReader.h"
 #include "Epub.h"
 #include "../RubbishHtmlParser/RubbishHtmlParser.h"
+#include "../RubbishHtmlParser/Page.h"
 #include "../Renderer/Renderer.h"
+#include "../Trace/Trace.h"
 
 static const char *TAG = "EREADER";
 
+EpubReader::~EpubReader()
+{
+  // make sure the worker has stopped using the renderer before anything goes away
+  prefetcher.cancel();
+  clear_current_section();
+  delete epub;
+}
+
 bool EpubReader::load()
 {
-  ESP_LOGD(TAG, "Before epub load: %d", esp_get_free_heap_size());
+  TRACE_STAGE("epub load");
   // do we need to load the epub?
   if (!epub || epub->get_path() != state.path)
   {
     renderer->show_busy();
+    prefetcher.cancel();
     delete epub;
-    delete parser;
-    parser = nullptr;
+    clear_current_section();
+    section_count = 0;
     epub = new Epub(state.path);
-    if (epub->load())
+    // the reader works from the spine - the table of contents is only needed for picking a section
+    if (epub->load(EPUB_LOAD_SPINE))
     {
-      ESP_LOGD(TAG, "After epub load: %d", esp_get_free_heap_size());
       return false;
     }
   }
   return true;
 }
 
+bool EpubReader::dehydrate()
+{
+  TRACE_STAGE("reader dehydrate");
+  if (!epub || (!parser && !cached_section))
+  {
+    return false;
+  }
+  // the snapshot points into the layout cache so the section has to be in there
+  CachedSection *section = cached_section;
+  if (!section)
+  {
+    section = layout_cache.load(epub, renderer, state.current_section);
+  }
+  if (!section && parser)
+  {
+    layout_current_section_to(-1);
+    section = layout_cache.load(epub, renderer, state.current_section);
+  }
+  if (!section && layout_cache.save(epub, renderer, state.current_section, parser))
+  {
+    section = layout_cache.load(epub, renderer, state.current_section);
+  }
+  bool success = section && layout_cache.save_snapshot(epub, renderer, state.current_section, get_section_count(), section);
+  if (section != cached_section)
+  {
+    delete section;
+  }
+  return success;
+}
+
+bool EpubReader::hydrate()
+{
+  TRACE_STAGE("reader hydrate");
+  prefetcher.cancel();
+  clear_current_section();
+  delete epub;
+  // nothing is read from the epub until we need more than the pages of the current section
+  epub = new Epub(state.path);
+  int count = 0;
+  cached_section = layout_cache.load_snapshot(epub, renderer, state.current_section, &count);
+  if (!cached_section)
+  {
+    delete epub;
+    epub = nullptr;
+    return false;
+  }
+  ESP_LOGI(TAG, "Carrying on from snapshot of section %d", state.current_section);
+  section_count = count;
+  state.pages_in_current_section = cached_section->get_page_count();
+  return true;
+}
+
+int EpubReader::get_section_count()
+{
+  return section_count > 0 ? section_count : epub->get_spine_items_count();
+}
+
+void EpubReader::clear_current_section()
+{
+  delete parser;
+  parser = nullptr;
+  delete cached_section;
+  cached_section = nullptr;
+  layout_needs_saving = false;
+}
+
 void EpubReader::parse_and_layout_current_section()
 {
-  if (!parser)
+  if (!parser && !cached_section)
   {
+    // the section may have been prepared in the background already
+    parser = prefetcher.take(epub->get_path(), state.current_section);
+    if (parser)
+    {
+      ESP_LOGI(TAG, "Using prefetched section %d", state.current_section);
+      state.pages_in_current_section = parser->get_page_count();
+      return;
+    }
+    // if we've layed this section out before we can skip the parsing and layout completely
+    cached_section = layout_cache.load(epub, renderer, state.current_section);
+    if (cached_section)
+    {
+      ESP_LOGI(TAG, "Using cached layout for section %d", state.current_section);
+      state.pages_in_current_section = cached_section->get_page_count();
+      return;
+    }
     renderer->show_busy();
+    // we may have carried on from a snapshot without reading the spine
+    epub->load(EPUB_LOAD_SPINE);
     ESP_LOGI(TAG, "Parse and render section %d", state.current_section);
-    ESP_LOGD(TAG, "Before read html: %d", esp_get_free_heap_size());
 
     // if spine item is not found here then it will return get_spine_item(0)
     // so it does not crashes when you want to go after last page (out of vector range)
     std::string item = epub->get_spine_item(state.current_section);
     std::string base_path = item.substr(0, item.find_last_of('/') + 1);
-    char *html = reinterpret_cast<char *>(epub->get_item_contents(item));
-    ESP_LOGD(TAG, "After read html: %d", esp_get_free_heap_size());
-    parser = new RubbishHtmlParser(html, strlen(html), base_path);
-    free(html);
-    ESP_LOGD(TAG, "After parse: %d", esp_get_free_heap_size());
-    parser->layout(renderer, epub);
-    ESP_LOGD(TAG, "After layout: %d", esp_get_free_heap_size());
-    state.pages_in_current_section = parser->get_page_count();
+    // the html is streamed out of the epub file straight into the parser
+    parser = new RubbishHtmlParser(epub, item, base_path);
+    ESP_LOGD(TAG, "Section arena: %d allocations in %d chunks", parser->get_arena().get_allocation_count(), parser->get_arena().get_chunk_count());
+    // only lay out enough to show the page - the rest is done as it's needed or while we're waiting for the user
+    parser->start_layout(renderer, epub);
+    layout_needs_saving = true;
+    layout_current_section_to(state.current_page);
+  }
+}
+
+void EpubReader::layout_current_section_to(int page)
+{
+  if (!parser)
+  {
+    return;
+  }
+  if (page < 0)
+  {
+    parser->finish_layout();
+  }
+  else
+  {
+    parser->layout_to_page(page);
+  }
+  // until the layout is complete this is just the pages we know about
+  state.pages_in_current_section = parser->get_page_count();
+  if (layout_needs_saving && parser->is_layout_complete())
+  {
+    layout_needs_saving = false;
+    TRACE_COUNTER("section pages", parser->get_page_count());
+    layout_cache.save(epub, renderer, state.current_section, parser);
   }
 }
 
+bool EpubReader::layout_more()
+{
+  if (!parser || parser->is_layout_complete())
+  {
+    return false;
+  }
+  layout_current_section_to(parser->get_page_count());
+  return true;
+}
+
 void EpubReader::next()
 {
   state.current_page++;
+  // the section may not have been layed out this far yet
+  layout_current_section_to(state.current_page);
   if (state.current_page >= state.pages_in_current_section)
   {
     state.current_section++;
     state.current_page = 0;
-    delete parser;
-    parser = nullptr;
+    clear_current_section();
   }
 }
 
@@ -76,11 +203,12 @@ void EpubReader::prev()
   {
     if (state.current_section > 0)
     {
-      delete parser;
-      parser = nullptr;
+      clear_current_section();
       state.current_section--;
       ESP_LOGD(TAG, "Going to previous section %d", state.current_section);
       parse_and_layout_current_section();
+      // we need to know where the section ends
+      layout_current_section_to(-1);
       state.current_page = state.pages_in_current_section - 1;
       return;
     }
@@ -90,17 +218,59 @@ void EpubReader::prev()
 
 void EpubReader::render()
 {
-  if (!parser)
+  TRACE_SCOPE("page turn");
+  if (!parser && !cached_section)
   {
     parse_and_layout_current_section();
+    // now get the sections either side ready while the user is reading this one
+    prefetcher.prefetch(epub->get_path(), state.current_section, get_section_count());
   }
+  go_to_pending_anchor();
+  if (cached_section)
+  {
+    Page *page = cached_section->load_page(state.current_page);
+    if (page || state.current_page >= cached_section->get_page_count())
+    {
+      RubbishHtmlParser::render_page(page, renderer, epub);
+      delete page;
+      return;
+    }
+    // the cache file has gone bad - fall back to laying out the section again
+    ESP_LOGE(TAG, "Failed to read cached page %d", state.current_page);
+    layout_cache.remove(epub, state.current_section);
+    clear_current_section();
+    parse_and_layout_current_section();
+  }
+  layout_current_section_to(state.current_page);
   ESP_LOGD(TAG, "rendering page %d of %d", state.current_page, parser->get_page_count());
   parser->render_page(state.current_page, renderer, epub);
   ESP_LOGD(TAG, "rendered page %d of %d", state.current_page, parser->get_page_count());
-  ESP_LOGD(TAG, "after render: %d", esp_get_free_heap_size());
 }
 
-void EpubReader::set_state_section(uint16_t current_section) {
+void EpubReader::go_to_pending_anchor()
+{
+  if (pending_anchor.empty())
+  {
+    return;
+  }
+  // the layout knows which page every element ended up on so there's no need to look through the pages
+  int page = parser ? parser->get_anchor_page(pending_anchor) : cached_section->get_anchor_page(pending_anchor);
+  ESP_LOGI(TAG, "anchor %s is on page %d", pending_anchor.c_str(), page);
+  if (page >= 0)
+  {
+    state.current_page = page;
+  }
+  pending_anchor.clear();
+  layout_current_section_to(state.current_page);
+}
+
+void EpubReader::set_state_section(uint16_t current_section, const std::string &anchor) {
   ESP_LOGI(TAG, "go to section:%d", current_section);
+  if (current_section != state.current_section)
+  {
+    clear_current_section();
+  }
   state.current_section = current_section;
+  state.current_page = 0;
+  pending_anchor = anchor;
 }
\ No newline at end of file
@@ -3,8 +3,12 @@
 class Epub;
 class Renderer;
 class RubbishHtmlParser;
+class CachedSection;
 
+#include <string>
 #include "./State.h"
+#include "../LayoutCache/LayoutCache.h"
+#include "SectionPrefetcher.h"
 
 class EpubReader
 {
@@ -13,15 +17,40 @@ private:
   Epub *epub = nullptr;
   Renderer *renderer = nullptr;
   RubbishHtmlParser *parser = nullptr;
+  // the current section when it has been read back from the layout cache
+  CachedSection *cached_section = nullptr;
+  LayoutCache layout_cache;
+  // gets the sections either side of the current one ready in the background
+  SectionPrefetcher prefetcher;
+  // the element to start the section at once it has been layed out - empty for the first page
+  std::string pending_anchor;
+  // the number of sections in the book when it was picked up from a snapshot and the spine hasn't been read
+  int section_count = 0;
+  // the current section was parsed here and goes in the layout cache once it has all been layed out
+  bool layout_needs_saving = false;
 
   void parse_and_layout_current_section();
+  int get_section_count();
+  void clear_current_section();
+  void go_to_pending_anchor();
+  // lay out the current section as far as the page and the one after it - or all of it for a negative page
+  void layout_current_section_to(int page);
 
 public:
-  EpubReader(EpubListItem &state, Renderer *renderer) : state(state), renderer(renderer){};
-  ~EpubReader() {}
+  EpubReader(EpubListItem &state, Renderer *renderer, const std::string &cache_path = "/fs/")
+      : state(state), renderer(renderer), layout_cache(cache_path), prefetcher(renderer, cache_path){};
+  ~EpubReader();
   bool load();
+  // save what's needed to carry on from the current page without parsing anything after a deep sleep
+  bool dehydrate();
+  // carry on from a snapshot - returns false if the book needs to be loaded in the usual way
+  bool hydrate();
   void next();
   void prev();
   void render();
-  void set_state_section(uint16_t current_section);
+  // lay out another page of the current section - returns false once there's nothing left to do
+  bool layout_more();
+  // start reading from a section - at the page with the anchor on it if there is one
+  void set_state_section(uint16_t current_section, const std::string &anchor = "");
+  SectionPrefetcher &get_prefetcher() { return prefetcher; }
 };
\ No newline at end of file
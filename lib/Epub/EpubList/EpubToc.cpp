@@ -3,6 +3,9 @@
 static const char *TAG = "PUBINDEX";
 #define PADDING 14
 #define ITEMS_PER_PAGE 6
+// how far in each level of nesting is drawn
+#define LEVEL_INDENT 20
+#define MAX_INDENT_LEVELS 4
 
 void EpubToc::next()
 {
@@ -34,7 +37,7 @@ bool EpubToc::load()
     delete epub;
 
     epub = new Epub(selected_epub.path);
-    if (epub->load())
+    if (epub->load(EPUB_LOAD_TOC))
     {
       ESP_LOGI(TAG, "Epub index loaded");
       return false;
@@ -66,15 +69,18 @@ void EpubToc::render()
     // trigger a redraw of the items
     state.previous_rendered_page = -1;
   }
+  // only the entries on the current page are looked at - the rest of the toc can be as big as it likes
   for (int i = start_index; i < start_index + ITEMS_PER_PAGE && i < epub->get_toc_items_count(); i++)
   {
     // do we need to draw a new page of items?
     if (current_page != state.previous_rendered_page)
     {
+      // nested entries are indented - but not so far that there's no room for the title
+      int indent = 10 + std::min(epub->get_toc_item_level(i), MAX_INDENT_LEVELS) * LEVEL_INDENT;
       // format the text using a text block
       TextBlock *title_block = new TextBlock(LEFT_ALIGN);
-      title_block->add_span(epub->get_toc_item(i).title.c_str(), false, false);
-      title_block->layout(renderer, epub, renderer->get_page_width());
+      title_block->add_span(epub->get_toc_item_title(i), false, false);
+      title_block->layout(renderer, epub, renderer->get_page_width() - indent);
       // work out the height of the title
       int text_height = cell_height - PADDING;
       int title_height = title_block->line_breaks.size() * renderer->get_line_height();
@@ -84,7 +90,7 @@ void EpubToc::render()
       int height = 0;
       for (int i = 0; i < title_block->line_breaks.size() && height < text_height; i++)
       {
-        title_block->render(renderer, i, 10, ypos + height + y_offset);
+        title_block->render(renderer, i, indent, ypos + height + y_offset);
         height += renderer->get_line_height();
       }
       // clean up the temporary index block
@@ -115,4 +121,9 @@ void EpubToc::render()
 uint16_t EpubToc::get_selected_toc()
 {
   return epub->get_spine_index_for_toc_index(state.selected_item);
+}
+
+std::string EpubToc::get_selected_anchor()
+{
+  return epub->get_toc_item_anchor(state.selected_item);
 }
\ No newline at end of file
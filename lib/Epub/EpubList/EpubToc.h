@@ -42,4 +42,6 @@ public:
   void render();
   void set_needs_redraw() { m_needs_redraw = true; }
   uint16_t get_selected_toc();
+  // the element in the section the selected entry points at - can be empty
+  std::string get_selected_anchor();
 };
\ No newline at end of file
@@ -0,0 +1,274 @@
+#ifndef UNIT_TEST
+#include <esp_log.h>
+#include <esp_system.h>
+#include <esp_pthread.h>
+#else
+#define ESP_LOGI(args...)
+#define ESP_LOGE(args...)
+#define ESP_LOGD(args...)
+#endif
+#include <algorithm>
+#include "SectionPrefetcher.h"
+#include "Epub.h"
+#include "../RubbishHtmlParser/RubbishHtmlParser.h"
+
+static const char *TAG = "PREFETCH";
+
+static size_t get_free_heap()
+{
+#ifndef UNIT_TEST
+  return esp_get_free_heap_size();
+#else
+  return SIZE_MAX;
+#endif
+}
+
+SectionPrefetcher::SectionPrefetcher(Renderer *renderer, const std::string &cache_path, size_t max_bytes, size_t min_free_heap)
+    : m_renderer(renderer), m_layout_cache(cache_path), m_max_bytes(max_bytes), m_min_free_heap(min_free_heap)
+{
+}
+
+SectionPrefetcher::~SectionPrefetcher()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+    m_generation++;
+    m_wanted.clear();
+  }
+  m_changed.notify_all();
+  if (m_worker.joinable())
+  {
+    m_worker.join();
+  }
+  clear_ready();
+}
+
+void SectionPrefetcher::start_worker()
+{
+  if (m_worker.joinable())
+  {
+    return;
+  }
+#ifndef UNIT_TEST
+  // the main task is on core 1 so do the work on core 0 - at the lowest priority so the idle task still gets to run
+  esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
+  cfg.stack_size = 16384;
+  cfg.prio = 0;
+  cfg.pin_to_core = 0;
+  cfg.thread_name = "prefetch";
+  esp_pthread_set_cfg(&cfg);
+#endif
+  m_worker = std::thread(&SectionPrefetcher::worker_loop, this);
+#ifndef UNIT_TEST
+  // don't affect any other threads we start
+  cfg = esp_pthread_get_default_config();
+  esp_pthread_set_cfg(&cfg);
+#endif
+}
+
+// must be called with the mutex held
+void SectionPrefetcher::clear_ready()
+{
+  for (auto &ready : m_ready)
+  {
+    delete ready.second;
+  }
+  m_ready.clear();
+  m_ready_bytes = 0;
+}
+
+bool SectionPrefetcher::is_cancelled(uint32_t generation)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return generation != m_generation;
+}
+
+void SectionPrefetcher::prefetch(const std::string &epub_path, int current_section, int section_count)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (epub_path != m_epub_path)
+    {
+      // a different book - nothing we've done so far is any use
+      m_generation++;
+      clear_ready();
+      m_epub_path = epub_path;
+    }
+    m_current_section = current_section;
+    // the next section is the most likely one to be wanted
+    m_wanted.clear();
+    for (int section : {current_section + 1, current_section - 1})
+    {
+      // the worker only hands over what it's busy with if it hasn't been cancelled since it started
+      bool is_in_progress = section == m_in_progress && m_in_progress_generation == m_generation;
+      if (section >= 0 && section < section_count && m_ready.find(section) == m_ready.end() && !is_in_progress)
+      {
+        m_wanted.push_back(section);
+      }
+    }
+    // throw away anything that isn't next to the current section
+    for (auto it = m_ready.begin(); it != m_ready.end();)
+    {
+      if (!is_adjacent(it->first))
+      {
+        m_ready_bytes -= it->second->get_arena().get_bytes_reserved();
+        delete it->second;
+        it = m_ready.erase(it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+    start_worker();
+  }
+  m_changed.notify_all();
+}
+
+RubbishHtmlParser *SectionPrefetcher::take(const std::string &epub_path, int section)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  // the worker doesn't need to start on it now
+  m_wanted.erase(std::remove(m_wanted.begin(), m_wanted.end(), section), m_wanted.end());
+  // it will be done soon so it's quicker to wait than to start again - this also stops us
+  // writing the same layout cache file as the worker
+  m_changed.wait(lock, [this, section]()
+                 { return m_in_progress != section; });
+  auto ready = m_ready.find(section);
+  if (epub_path != m_epub_path || ready == m_ready.end())
+  {
+    return nullptr;
+  }
+  RubbishHtmlParser *parser = ready->second;
+  m_ready_bytes -= parser->get_arena().get_bytes_reserved();
+  m_ready.erase(ready);
+  ESP_LOGI(TAG, "Handing over section %d", section);
+  return parser;
+}
+
+void SectionPrefetcher::cancel()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_generation++;
+    m_wanted.clear();
+    m_epub_path.clear();
+    m_current_section = -1;
+    clear_ready();
+  }
+  m_changed.notify_all();
+}
+
+void SectionPrefetcher::wait_until_idle()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_changed.wait(lock, [this]()
+                 { return m_stopping || (m_wanted.empty() && m_in_progress == -1); });
+}
+
+size_t SectionPrefetcher::get_prepared_count()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_prepared_count;
+}
+
+size_t SectionPrefetcher::get_dropped_count()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_dropped_count;
+}
+
+void SectionPrefetcher::worker_loop()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true)
+  {
+    m_changed.wait(lock, [this]()
+                   { return m_stopping || !m_wanted.empty(); });
+    if (m_stopping)
+    {
+      break;
+    }
+    int section = m_wanted.front();
+    m_wanted.erase(m_wanted.begin());
+    uint32_t generation = m_generation;
+    std::string epub_path = m_epub_path;
+    m_in_progress = section;
+    m_in_progress_generation = generation;
+    lock.unlock();
+    RubbishHtmlParser *parser = prepare_section(epub_path, section, generation);
+    lock.lock();
+    m_in_progress = -1;
+    if (parser)
+    {
+      size_t bytes = parser->get_arena().get_bytes_reserved();
+      if (generation != m_generation || !is_adjacent(section))
+      {
+        delete parser;
+      }
+      else if (m_ready_bytes + bytes > m_max_bytes)
+      {
+        // too big to keep hold of - the layout cache will still make it quick to load
+        ESP_LOGI(TAG, "Section %d needs %d bytes - not keeping it", section, bytes);
+        m_dropped_count++;
+        delete parser;
+      }
+      else
+      {
+        m_ready[section] = parser;
+        m_ready_bytes += bytes;
+        m_prepared_count++;
+      }
+    }
+    m_changed.notify_all();
+  }
+  lock.unlock();
+  delete m_epub;
+  m_epub = nullptr;
+}
+
+RubbishHtmlParser *SectionPrefetcher::prepare_section(const std::string &epub_path, int section, uint32_t generation)
+{
+  if (!m_epub || m_epub->get_path() != epub_path)
+  {
+    delete m_epub;
+    m_epub = new Epub(epub_path);
+    if (!m_epub->load(EPUB_LOAD_SPINE))
+    {
+      ESP_LOGE(TAG, "Failed to load %s", epub_path.c_str());
+      delete m_epub;
+      m_epub = nullptr;
+      return nullptr;
+    }
+  }
+  if (get_free_heap() < m_min_free_heap)
+  {
+    ESP_LOGI(TAG, "Not enough memory to prefetch section %d", section);
+    return nullptr;
+  }
+  // if it's already been layed out then the reader can load it from the cache without our help
+  CachedSection *cached = m_layout_cache.load(m_epub, m_renderer, section);
+  if (cached)
+  {
+    delete cached;
+    return nullptr;
+  }
+  ESP_LOGI(TAG, "Prefetching section %d", section);
+  std::string item = m_epub->get_spine_item(section);
+  std::string base_path = item.substr(0, item.find_last_of('/') + 1);
+  RubbishHtmlParser *parser = new RubbishHtmlParser(m_epub, item, base_path);
+  if (is_cancelled(generation))
+  {
+    delete parser;
+    return nullptr;
+  }
+  parser->layout(m_renderer, m_epub);
+  if (is_cancelled(generation))
+  {
+    delete parser;
+    return nullptr;
+  }
+  m_layout_cache.save(m_epub, m_renderer, section, parser);
+  return parser;
+}
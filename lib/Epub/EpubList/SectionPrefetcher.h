@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "../LayoutCache/LayoutCache.h"
+
+class Epub;
+class Renderer;
+class RubbishHtmlParser;
+
+// Parses and lays out the sections either side of the one being read on a worker thread (on the
+// other core to the main task on the device) so that there's no stall when the reader turns
+// the page into the next or previous section.
+class SectionPrefetcher
+{
+private:
+  Renderer *m_renderer;
+  // sections we prepare are saved here as well so they're quick to get back later
+  LayoutCache m_layout_cache;
+  // the most memory the sections waiting to be handed over can use
+  size_t m_max_bytes;
+  // don't start on a section if there's less than this free
+  size_t m_min_free_heap;
+
+  std::thread m_worker;
+  std::mutex m_mutex;
+  std::condition_variable m_changed;
+  bool m_stopping = false;
+  // bumped whenever the work we're doing is no longer wanted
+  uint32_t m_generation = 0;
+  // the book and the sections of it to prepare - in the order we want them
+  std::string m_epub_path;
+  int m_current_section = -1;
+  std::vector<int> m_wanted;
+  // the section the worker is busy with - -1 if it's not doing anything
+  int m_in_progress = -1;
+  // the generation it was started in - if that's been cancelled the result will be thrown away
+  uint32_t m_in_progress_generation = 0;
+  // sections that are ready to be handed over and the memory they are using
+  std::map<int, RubbishHtmlParser *> m_ready;
+  size_t m_ready_bytes = 0;
+  size_t m_prepared_count = 0;
+  size_t m_dropped_count = 0;
+  // the worker has its own copy of the book so it doesn't share the zip file with the reader
+  Epub *m_epub = nullptr;
+
+  void start_worker();
+  void worker_loop();
+  RubbishHtmlParser *prepare_section(const std::string &epub_path, int section, uint32_t generation);
+  bool is_cancelled(uint32_t generation);
+  void clear_ready();
+  bool is_adjacent(int section)
+  {
+    return section == m_current_section + 1 || section == m_current_section - 1;
+  }
+
+public:
+  SectionPrefetcher(Renderer *renderer, const std::string &cache_path = "/fs/",
+                    size_t max_bytes = 1024 * 1024, size_t min_free_heap = 256 * 1024);
+  ~SectionPrefetcher();
+  // start preparing the sections either side of the current one - anything already prepared
+  // for other sections or other books is thrown away
+  void prefetch(const std::string &epub_path, int current_section, int section_count);
+  // hand over a section that has been prepared - if the worker is busy with it then this waits
+  // for it to finish. Returns nullptr if the section hasn't been prepared.
+  RubbishHtmlParser *take(const std::string &epub_path, int section);
+  // stop work on everything and throw away anything that has been prepared
+  void cancel();
+  // wait for the worker to finish everything it has been asked to do
+  void wait_until_idle();
+
+  size_t get_prepared_count();
+  size_t get_dropped_count();
+};
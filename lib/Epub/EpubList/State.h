@@ -2,7 +2,6 @@
 
 #include <stdint.h>
 
-const int MAX_EPUB_LIST_SIZE = 20;
 const int MAX_PATH_SIZE = 256;
 const int MAX_TITLE_SIZE = 100;
 
@@ -24,7 +23,8 @@ typedef struct
   int selected_item;
   int num_epubs;
   bool is_loaded;
-  EpubListItem epub_list[MAX_EPUB_LIST_SIZE];
+  // the list itself lives in the library index - we just keep the book that's being read
+  EpubListItem selected_epub;
 } EpubListState;
 
 // this is held in the RTC memory
@@ -0,0 +1,166 @@
+#include <string.h>
+#include "StringPool.h"
+
+// both tables start small and double when they get more than half full
+#define INITIAL_TABLE_SIZE 64
+
+// FNV-1a
+uint32_t StringPool::hash(const char *text, size_t length)
+{
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++)
+  {
+    hash = (hash ^ (uint8_t)text[i]) * 16777619u;
+  }
+  return hash;
+}
+
+StringPool::StringPool() : m_table(INITIAL_TABLE_SIZE, 0)
+{
+}
+
+bool StringPool::matches(uint32_t offset, const char *text, size_t length) const
+{
+  return offset + length < m_data.size() && memcmp(&m_data[offset], text, length) == 0 && m_data[offset + length] == '\0';
+}
+
+size_t StringPool::find_slot(const char *text, size_t length, uint32_t hash_value) const
+{
+  size_t mask = m_table.size() - 1;
+  size_t slot = hash_value & mask;
+  while (m_table[slot] != 0 && !matches(m_table[slot] - 1, text, length))
+  {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+void StringPool::grow()
+{
+  std::vector<uint32_t> old_table;
+  old_table.swap(m_table);
+  m_table.assign(old_table.size() * 2, 0);
+  for (uint32_t entry : old_table)
+  {
+    if (entry != 0)
+    {
+      const char *text = &m_data[entry - 1];
+      size_t length = strlen(text);
+      m_table[find_slot(text, length, hash(text, length))] = entry;
+    }
+  }
+}
+
+uint32_t StringPool::intern(const char *text, size_t length)
+{
+  size_t slot = find_slot(text, length, hash(text, length));
+  if (m_table[slot] != 0)
+  {
+    return m_table[slot] - 1;
+  }
+  uint32_t offset = m_data.size();
+  m_data.insert(m_data.end(), text, text + length);
+  m_data.push_back('\0');
+  m_table[slot] = offset + 1;
+  m_count++;
+  if (m_count * 2 > m_table.size())
+  {
+    grow();
+  }
+  return offset;
+}
+
+bool StringPool::find(const char *text, size_t length, uint32_t *offset) const
+{
+  size_t slot = find_slot(text, length, hash(text, length));
+  if (m_table[slot] == 0)
+  {
+    return false;
+  }
+  *offset = m_table[slot] - 1;
+  return true;
+}
+
+void StringPool::shrink_to_fit()
+{
+  m_data.shrink_to_fit();
+}
+
+void StringPool::clear()
+{
+  m_data.clear();
+  m_table.assign(INITIAL_TABLE_SIZE, 0);
+  m_count = 0;
+}
+
+void OffsetMap::grow()
+{
+  std::vector<uint32_t> old_keys, old_values;
+  old_keys.swap(m_keys);
+  old_values.swap(m_values);
+  m_keys.assign(old_keys.empty() ? INITIAL_TABLE_SIZE : old_keys.size() * 2, 0);
+  m_values.assign(m_keys.size(), 0);
+  m_count = 0;
+  m_shift = 32;
+  for (size_t size = m_keys.size(); size > 1; size >>= 1)
+  {
+    m_shift--;
+  }
+  for (size_t i = 0; i < old_keys.size(); i++)
+  {
+    if (old_keys[i] != 0)
+    {
+      set(old_keys[i] - 1, old_values[i]);
+    }
+  }
+}
+
+void OffsetMap::set(uint32_t key, uint32_t value)
+{
+  if ((m_count + 1) * 2 > m_keys.size())
+  {
+    grow();
+  }
+  size_t mask = m_keys.size() - 1;
+  // neighbouring strings have offsets that are close together so they need mixing up
+  size_t slot = get_slot(key);
+  while (m_keys[slot] != 0)
+  {
+    if (m_keys[slot] == key + 1)
+    {
+      return;
+    }
+    slot = (slot + 1) & mask;
+  }
+  m_keys[slot] = key + 1;
+  m_values[slot] = value;
+  m_count++;
+}
+
+bool OffsetMap::get(uint32_t key, uint32_t *value) const
+{
+  if (m_keys.empty())
+  {
+    return false;
+  }
+  size_t mask = m_keys.size() - 1;
+  size_t slot = get_slot(key);
+  while (m_keys[slot] != 0)
+  {
+    if (m_keys[slot] == key + 1)
+    {
+      *value = m_values[slot];
+      return true;
+    }
+    slot = (slot + 1) & mask;
+  }
+  return false;
+}
+
+void OffsetMap::clear()
+{
+  m_keys.clear();
+  m_values.clear();
+  m_count = 0;
+  m_shift = 32;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// Keeps lots of short strings in one block of memory. Each distinct string is only stored once
+// and is referred to by its offset in the block, so two strings are the same if and only if
+// their offsets are the same.
+class StringPool
+{
+private:
+  // the null terminated strings one after the other
+  std::vector<char> m_data;
+  // open addressing hash table of offset + 1 for each string - zero is an empty slot
+  std::vector<uint32_t> m_table;
+  size_t m_count = 0;
+
+  static uint32_t hash(const char *text, size_t length);
+  bool matches(uint32_t offset, const char *text, size_t length) const;
+  // find the slot for the string - either the one holding it or the empty one where it would go
+  size_t find_slot(const char *text, size_t length, uint32_t hash_value) const;
+  void grow();
+
+public:
+  StringPool();
+  // add the string if it's not already there and return its offset
+  uint32_t intern(const char *text, size_t length);
+  uint32_t intern(const std::string &text) { return intern(text.c_str(), text.size()); }
+  // look up a string without adding it - returns false if it's not in the pool
+  bool find(const char *text, size_t length, uint32_t *offset) const;
+  bool find(const std::string &text, uint32_t *offset) const { return find(text.c_str(), text.size(), offset); }
+  const char *get(uint32_t offset) const { return &m_data[offset]; }
+  size_t size() const { return m_count; }
+  // give back any spare capacity once everything has been added
+  void shrink_to_fit();
+  void clear();
+};
+
+// Maps string pool offsets to integers - used to index things by a string without storing the string again
+class OffsetMap
+{
+private:
+  // offset + 1 for each key - zero is an empty slot
+  std::vector<uint32_t> m_keys;
+  std::vector<uint32_t> m_values;
+  size_t m_count = 0;
+  // 32 - log2 of the table size - the slot comes from the top bits of the hash
+  int m_shift = 32;
+
+  void grow();
+  size_t get_slot(uint32_t key) const
+  {
+    // Fibonacci hashing - the top bits of the product depend on all the bits of the key
+    return (uint32_t)(key * 2654435761u) >> m_shift;
+  }
+
+public:
+  // the first value stored for a key is kept
+  void set(uint32_t key, uint32_t value);
+  bool get(uint32_t key, uint32_t *value) const;
+  size_t size() const { return m_count; }
+  void clear();
+};
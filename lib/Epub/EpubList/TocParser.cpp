@@ -0,0 +1,218 @@
+#include <string.h>
+#include <strings.h>
+#include "TocParser.h"
+#include "../RubbishHtmlParser/htmlEntities.h"
+
+TocHandler::TocHandler(StringPool &strings, std::vector<EpubTocEntry> &toc, const std::string &toc_path)
+    : m_strings(strings), m_toc(toc), m_toc_path(toc_path)
+{
+  m_base_path = toc_path.substr(0, toc_path.find_last_of('/') + 1);
+  m_empty = m_strings.intern("", 0);
+}
+
+bool TocHandler::is_tag(const char *name, size_t length, const char *tag)
+{
+  return length == strlen(tag) && strncasecmp(name, tag, length) == 0;
+}
+
+void TocHandler::start_entry()
+{
+  EpubTocEntry entry;
+  entry.title = m_empty;
+  entry.href = m_empty;
+  entry.anchor = m_empty;
+  entry.parent = m_open.empty() ? -1 : m_open.back();
+  entry.level = m_open.size();
+  m_open.push_back(m_toc.size());
+  m_toc.push_back(entry);
+}
+
+void TocHandler::start_title()
+{
+  m_title.clear();
+  m_in_title = true;
+}
+
+void TocHandler::end_title()
+{
+  if (!m_in_title || m_open.empty())
+  {
+    return;
+  }
+  m_in_title = false;
+  // the title can be spread over several lines of the file
+  std::string title;
+  for (char c : replace_html_entities(m_title))
+  {
+    bool is_space = c == ' ' || c == '\n' || c == '\r' || c == '\t';
+    if (!is_space)
+    {
+      title += c;
+    }
+    else if (!title.empty() && title.back() != ' ')
+    {
+      title += ' ';
+    }
+  }
+  if (!title.empty() && title.back() == ' ')
+  {
+    title.pop_back();
+  }
+  m_toc[m_open.back()].title = m_strings.intern(title);
+}
+
+void TocHandler::set_link(const std::string &link)
+{
+  if (m_open.empty())
+  {
+    return;
+  }
+  EpubTocEntry &entry = m_toc[m_open.back()];
+  size_t hash = link.find('#');
+  std::string path = link.substr(0, hash);
+  // a link to somewhere in the toc file itself
+  if (path.empty())
+  {
+    entry.href = m_strings.intern(m_toc_path);
+  }
+  else
+  {
+    // links starting with a "/" are from the top of the epub
+    entry.href = m_strings.intern(normalise_path(path[0] == '/' ? path : m_base_path + path));
+  }
+  if (hash != std::string::npos)
+  {
+    entry.anchor = m_strings.intern(link.substr(hash + 1));
+  }
+}
+
+void TocHandler::end_entry()
+{
+  end_title();
+  if (!m_open.empty())
+  {
+    m_open.pop_back();
+  }
+}
+
+void TocHandler::on_text(const char *text, size_t length)
+{
+  if (m_in_title)
+  {
+    m_title.append(text, length);
+  }
+}
+
+void TocHandler::finish()
+{
+  while (!m_open.empty())
+  {
+    end_entry();
+  }
+  // headings without a link of their own go to the same place as their first child - working
+  // backwards so this carries up through several levels
+  for (int i = (int)m_toc.size() - 2; i >= 0; i--)
+  {
+    if (m_toc[i].href == m_empty && m_toc[i + 1].parent == i)
+    {
+      m_toc[i].href = m_toc[i + 1].href;
+      m_toc[i].anchor = m_toc[i + 1].anchor;
+    }
+  }
+}
+
+void NcxTocHandler::on_start_tag(const HtmlTag &tag)
+{
+  if (is_tag(tag.name, tag.name_length, "navMap"))
+  {
+    m_in_nav_map = true;
+  }
+  else if (!m_in_nav_map)
+  {
+    return;
+  }
+  else if (is_tag(tag.name, tag.name_length, "navPoint"))
+  {
+    start_entry();
+  }
+  else if (is_tag(tag.name, tag.name_length, "text") && !m_open.empty() && m_toc[m_open.back()].title == m_empty)
+  {
+    start_title();
+  }
+  else if (is_tag(tag.name, tag.name_length, "content") && !has_link())
+  {
+    std::string src;
+    if (tag.get_attribute("src", src))
+    {
+      set_link(src);
+    }
+  }
+}
+
+void NcxTocHandler::on_end_tag(const char *tag_name, size_t tag_name_length)
+{
+  if (!m_in_nav_map)
+  {
+    return;
+  }
+  if (is_tag(tag_name, tag_name_length, "text"))
+  {
+    end_title();
+  }
+  else if (is_tag(tag_name, tag_name_length, "navPoint"))
+  {
+    end_entry();
+  }
+  else if (is_tag(tag_name, tag_name_length, "navMap"))
+  {
+    m_in_nav_map = false;
+  }
+}
+
+void NavTocHandler::on_start_tag(const HtmlTag &tag)
+{
+  if (is_tag(tag.name, tag.name_length, "nav"))
+  {
+    std::string type;
+    // the type can have more than one value in it
+    m_in_toc_nav = tag.get_attribute("epub:type", type) && has_property(type.c_str(), "toc");
+  }
+  else if (!m_in_toc_nav)
+  {
+    return;
+  }
+  else if (is_tag(tag.name, tag.name_length, "li"))
+  {
+    // the title is all the text in the item up to any list of children
+    start_entry();
+    start_title();
+  }
+  else if (is_tag(tag.name, tag.name_length, "ol"))
+  {
+    end_title();
+  }
+  else if (is_tag(tag.name, tag.name_length, "a") && m_in_title && !has_link())
+  {
+    std::string href;
+    if (tag.get_attribute("href", href))
+    {
+      set_link(href);
+    }
+  }
+}
+
+void NavTocHandler::on_end_tag(const char *tag_name, size_t tag_name_length)
+{
+  if (!m_in_toc_nav)
+  {
+    return;
+  }
+  if (is_tag(tag_name, tag_name_length, "li"))
+  {
+    end_entry();
+  }
+  else if (is_tag(tag_name, tag_name_length, "nav"))
+  {
+    m_in_toc_nav = false;
+  }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "../RubbishHtmlParser/HtmlTokenizer.h"
+#include "StringPool.h"
+#include "Epub.h"
+
+// Builds up the flattened table of contents as a toc file is fed through the tokenizer. The
+// entries are added in document order so the children of an entry always come straight after it.
+class TocHandler : public HtmlTokenHandler
+{
+protected:
+  StringPool &m_strings;
+  std::vector<EpubTocEntry> &m_toc;
+  // the toc file and the folder it is in - the links in it are relative to this
+  std::string m_toc_path;
+  std::string m_base_path;
+  // offset of the empty string - for entries that don't have a title or link yet
+  uint32_t m_empty;
+  // the entries we are inside - innermost last
+  std::vector<int> m_open;
+  // the title we are in the middle of reading
+  std::string m_title;
+  bool m_in_title = false;
+
+  static bool is_tag(const char *name, size_t length, const char *tag);
+  bool has_link() { return !m_open.empty() && m_toc[m_open.back()].href != m_empty; }
+  void start_entry();
+  void start_title();
+  void end_title();
+  void set_link(const std::string &link);
+  void end_entry();
+
+public:
+  TocHandler(StringPool &strings, std::vector<EpubTocEntry> &toc, const std::string &toc_path);
+  void on_text(const char *text, size_t length);
+  // tidy up once the whole file has been read
+  void finish();
+};
+
+// reads the navMap from an EPUB2 ncx file
+class NcxTocHandler : public TocHandler
+{
+private:
+  bool m_in_nav_map = false;
+
+public:
+  NcxTocHandler(StringPool &strings, std::vector<EpubTocEntry> &toc, const std::string &toc_path)
+      : TocHandler(strings, toc, toc_path) {}
+  void on_start_tag(const HtmlTag &tag);
+  void on_end_tag(const char *tag_name, size_t tag_name_length);
+};
+
+// reads the <nav epub:type="toc"> element from an EPUB3 navigation document - any other
+// navs (landmarks, page lists) are skipped
+class NavTocHandler : public TocHandler
+{
+private:
+  bool m_in_toc_nav = false;
+
+public:
+  NavTocHandler(StringPool &strings, std::vector<EpubTocEntry> &toc, const std::string &toc_path)
+      : TocHandler(strings, toc, toc_path) {}
+  void on_start_tag(const HtmlTag &tag);
+  void on_end_tag(const char *tag_name, size_t tag_name_length);
+};
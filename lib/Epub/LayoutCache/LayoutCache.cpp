@@ -0,0 +1,527 @@
+#ifndef UNIT_TEST
+#include <esp_log.h>
+#else
+#define ESP_LOGE(args...)
+#define ESP_LOGI(args...)
+#define ESP_LOGD(args...)
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+extern "C"
+{
+#include <dirent.h>
+}
+#include <algorithm>
+#include "LayoutCache.h"
+#include "LayoutFile.h"
+#include "../EpubList/Epub.h"
+#include "../Renderer/Renderer.h"
+#include "../RubbishHtmlParser/RubbishHtmlParser.h"
+#include "../RubbishHtmlParser/Page.h"
+
+static const char *TAG = "LAYOUT";
+
+// "LAYC" - written last so a partially written file is never treated as valid
+static const uint32_t LAYOUT_CACHE_MAGIC = 0x4359414c;
+// "LAYS" - the reader's snapshot of the section it was on
+static const uint32_t LAYOUT_SNAPSHOT_MAGIC = 0x5359414c;
+
+// FNV-1a
+static uint32_t hash_string(const std::string &value)
+{
+  uint32_t hash = 2166136261u;
+  for (char c : value)
+  {
+    hash = (hash ^ (uint8_t)c) * 16777619u;
+  }
+  return hash;
+}
+
+static void write_key(LayoutWriter &writer, const LayoutCacheKey &key)
+{
+  writer.write_string(key.epub_path.c_str(), key.epub_path.size());
+  writer.write_u32(key.epub_size);
+  writer.write_u32(key.epub_mtime);
+  writer.write_u16(key.section);
+  writer.write_u32(key.font_signature);
+  writer.write_u16(key.page_width);
+  writer.write_u16(key.page_height);
+  writer.write_u16(key.margin_top);
+  writer.write_u16(key.margin_bottom);
+  writer.write_u16(key.margin_left);
+  writer.write_u16(key.margin_right);
+}
+
+static bool read_key_matches(LayoutReader &reader, const LayoutCacheKey &key)
+{
+  bool matches = reader.read_string() == key.epub_path;
+  matches &= reader.read_u32() == key.epub_size;
+  matches &= reader.read_u32() == key.epub_mtime;
+  matches &= reader.read_u16() == key.section;
+  matches &= reader.read_u32() == key.font_signature;
+  matches &= reader.read_u16() == key.page_width;
+  matches &= reader.read_u16() == key.page_height;
+  matches &= reader.read_u16() == key.margin_top;
+  matches &= reader.read_u16() == key.margin_bottom;
+  matches &= reader.read_u16() == key.margin_left;
+  matches &= reader.read_u16() == key.margin_right;
+  return matches && reader.ok();
+}
+
+Page *CachedSection::load_page(int page_index)
+{
+  if (page_index < 0 || page_index >= m_page_offsets.size())
+  {
+    return nullptr;
+  }
+  FILE *fp = fopen(m_filename.c_str(), "rb");
+  if (!fp)
+  {
+    ESP_LOGE(TAG, "Failed to open %s", m_filename.c_str());
+    return nullptr;
+  }
+  Page *page = nullptr;
+  if (fseek(fp, m_page_offsets[page_index], SEEK_SET) == 0)
+  {
+    LayoutReader reader(fp);
+    page = Page::deserialize(reader);
+  }
+  fclose(fp);
+  return page;
+}
+
+int CachedSection::get_anchor_page(const std::string &anchor)
+{
+  FILE *fp = fopen(m_filename.c_str(), "rb");
+  if (!fp)
+  {
+    ESP_LOGE(TAG, "Failed to open %s", m_filename.c_str());
+    return -1;
+  }
+  int page = -1;
+  if (fseek(fp, m_anchors_offset, SEEK_SET) == 0)
+  {
+    LayoutReader reader(fp);
+    int anchor_count = reader.read_u16();
+    // they're in document order so the first match is the one we want
+    for (int i = 0; i < anchor_count && reader.ok() && page == -1; i++)
+    {
+      bool matches = reader.read_string() == anchor;
+      uint16_t anchor_page = reader.read_u16();
+      if (matches && reader.ok())
+      {
+        page = anchor_page;
+      }
+    }
+  }
+  fclose(fp);
+  return page;
+}
+
+std::string LayoutCache::get_filename(const std::string &epub_path, int section)
+{
+  // keep the names short - SPIFFS only allows 32 characters
+  char filename[32];
+  snprintf(filename, sizeof(filename), "%08x_%d.lay", hash_string(epub_path), section);
+  return m_cache_path + filename;
+}
+
+bool LayoutCache::get_key(Epub *epub, Renderer *renderer, int section, LayoutCacheKey *key)
+{
+  // if the epub file changes then the cache is no longer valid
+  struct stat epub_stat;
+  if (stat(epub->get_path().c_str(), &epub_stat) != 0)
+  {
+    ESP_LOGE(TAG, "Failed to stat %s", epub->get_path().c_str());
+    return false;
+  }
+  key->epub_path = epub->get_path();
+  key->epub_size = epub_stat.st_size;
+  key->epub_mtime = epub_stat.st_mtime;
+  key->section = section;
+  key->font_signature = renderer->get_font_signature();
+  key->page_width = renderer->get_page_width();
+  key->page_height = renderer->get_page_height();
+  key->margin_top = renderer->get_margin_top();
+  key->margin_bottom = renderer->get_margin_bottom();
+  key->margin_left = renderer->get_margin_left();
+  key->margin_right = renderer->get_margin_right();
+  return true;
+}
+
+bool LayoutCache::save(Epub *epub, Renderer *renderer, int section, RubbishHtmlParser *parser)
+{
+  // a section that's only partly layed out would look like a short one next time
+  if (!parser->is_layout_complete())
+  {
+    return false;
+  }
+  LayoutCacheKey key;
+  if (!get_key(epub, renderer, section, &key))
+  {
+    return false;
+  }
+  std::string filename = get_filename(key.epub_path, section);
+  FILE *fp = fopen(filename.c_str(), "wb");
+  if (!fp)
+  {
+    ESP_LOGE(TAG, "Failed to create %s", filename.c_str());
+    return false;
+  }
+  const ArenaVector<Page *> &pages = parser->get_pages();
+  LayoutWriter writer(fp);
+  // leave space for the magic number - it gets filled in once everything else is written
+  writer.write_u32(0);
+  writer.write_u16(LAYOUT_CACHE_VERSION);
+  write_key(writer, key);
+  writer.write_u16(pages.size());
+  long offsets_position = ftell(fp);
+  // the offset of each page followed by the offset of the anchors and the end of the file
+  std::vector<uint32_t> page_offsets(pages.size() + 2, 0);
+  for (uint32_t offset : page_offsets)
+  {
+    writer.write_u32(offset);
+  }
+  for (int i = 0; i < pages.size(); i++)
+  {
+    page_offsets[i] = ftell(fp);
+    pages[i]->serialize(writer);
+  }
+  // the element ids and the pages they are on so links can go straight to the right page
+  page_offsets[pages.size()] = ftell(fp);
+  int anchor_count = std::min(parser->get_anchor_count(), 0xffff);
+  writer.write_u16(anchor_count);
+  for (int i = 0; i < anchor_count; i++)
+  {
+    int page = 0;
+    const char *anchor = parser->get_anchor(i, &page);
+    writer.write_string(anchor, strlen(anchor));
+    writer.write_u16(page);
+  }
+  page_offsets[pages.size() + 1] = ftell(fp);
+  // now we know where all the pages are we can fill in the offsets and mark the file as valid
+  fseek(fp, offsets_position, SEEK_SET);
+  for (uint32_t offset : page_offsets)
+  {
+    writer.write_u32(offset);
+  }
+  fseek(fp, 0, SEEK_SET);
+  writer.write_u32(LAYOUT_CACHE_MAGIC);
+  bool success = writer.ok();
+  if (fclose(fp) != 0)
+  {
+    success = false;
+  }
+  if (!success)
+  {
+    ESP_LOGE(TAG, "Failed to write %s", filename.c_str());
+    ::remove(filename.c_str());
+  }
+  else
+  {
+    ESP_LOGI(TAG, "Saved %d pages for section %d", pages.size(), section);
+  }
+  // a failed write is most likely the flash filling up so make room either way
+  trim(key.epub_path);
+  return success;
+}
+
+CachedSection *LayoutCache::load(Epub *epub, Renderer *renderer, int section)
+{
+  LayoutCacheKey key;
+  if (!get_key(epub, renderer, section, &key))
+  {
+    return nullptr;
+  }
+  std::string filename = get_filename(key.epub_path, section);
+  FILE *fp = fopen(filename.c_str(), "rb");
+  if (!fp)
+  {
+    // not in the cache
+    return nullptr;
+  }
+  LayoutReader reader(fp);
+  bool is_valid = reader.read_u32() == LAYOUT_CACHE_MAGIC &&
+                  reader.read_u16() == LAYOUT_CACHE_VERSION &&
+                  read_key_matches(reader, key);
+  std::vector<uint32_t> page_offsets;
+  if (is_valid)
+  {
+    int page_count = reader.read_u16();
+    for (int i = 0; i < page_count + 2 && reader.ok(); i++)
+    {
+      page_offsets.push_back(reader.read_u32());
+    }
+    // make sure the file hasn't been cut short
+    fseek(fp, 0, SEEK_END);
+    long file_size = ftell(fp);
+    is_valid = reader.ok() && page_offsets.back() == file_size;
+  }
+  fclose(fp);
+  uint32_t anchors_offset = 0;
+  if (is_valid)
+  {
+    page_offsets.pop_back();
+    anchors_offset = page_offsets.back();
+    page_offsets.pop_back();
+  }
+  if (!is_valid)
+  {
+    // out of date or corrupt - get rid of it so it gets layed out again
+    ESP_LOGI(TAG, "Discarding out of date layout %s", filename.c_str());
+    ::remove(filename.c_str());
+    return nullptr;
+  }
+  return new CachedSection(filename, page_offsets, anchors_offset);
+}
+
+void LayoutCache::remove(Epub *epub, int section)
+{
+  ::remove(get_filename(epub->get_path(), section).c_str());
+}
+
+typedef struct
+{
+  std::string filename;
+  // the hash of the epub path at the start of the name
+  uint32_t book;
+  size_t size;
+  time_t mtime;
+} LayoutFileInfo;
+
+// the layout files in the cache directory - anything else in there is left alone
+static void list_layout_files(const std::string &cache_path, std::vector<LayoutFileInfo> &files)
+{
+  DIR *dir = opendir(cache_path.c_str());
+  if (!dir)
+  {
+    ESP_LOGE(TAG, "Could not open directory %s", cache_path.c_str());
+    return;
+  }
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != NULL)
+  {
+    // names look like 0123abcd_12.lay
+    int name_length = strlen(ent->d_name);
+    unsigned int book = 0;
+    if (name_length < 14 || ent->d_name[8] != '_' || strcmp(ent->d_name + name_length - 4, ".lay") != 0 ||
+        sscanf(ent->d_name, "%8x", &book) != 1)
+    {
+      continue;
+    }
+    LayoutFileInfo info;
+    info.filename = cache_path + ent->d_name;
+    struct stat file_stat;
+    if (stat(info.filename.c_str(), &file_stat) != 0)
+    {
+      continue;
+    }
+    info.book = book;
+    info.size = file_stat.st_size;
+    info.mtime = file_stat.st_mtime;
+    files.push_back(info);
+  }
+  closedir(dir);
+}
+
+void LayoutCache::trim(const std::string &keep_epub_path)
+{
+  std::vector<LayoutFileInfo> files;
+  list_layout_files(m_cache_path, files);
+  size_t total = 0;
+  for (auto &file : files)
+  {
+    total += file.size;
+  }
+  if (total <= m_max_bytes)
+  {
+    return;
+  }
+  std::sort(
+      files.begin(),
+      files.end(),
+      [](const LayoutFileInfo &a, const LayoutFileInfo &b)
+      {
+        return a.mtime < b.mtime || (a.mtime == b.mtime && a.filename < b.filename);
+      });
+  // the book being read is still using its layouts so it keeps all of them
+  uint32_t keep = hash_string(keep_epub_path);
+  for (auto &file : files)
+  {
+    if (total <= m_max_bytes)
+    {
+      break;
+    }
+    if (file.book != keep && ::remove(file.filename.c_str()) == 0)
+    {
+      ESP_LOGI(TAG, "Evicted %s", file.filename.c_str());
+      total -= file.size;
+    }
+  }
+  if (total > m_max_bytes)
+  {
+    ESP_LOGI(TAG, "Layout cache is %d bytes over budget", (int)(total - m_max_bytes));
+  }
+}
+
+void LayoutCache::remove_book(const std::string &epub_path)
+{
+  std::vector<LayoutFileInfo> files;
+  list_layout_files(m_cache_path, files);
+  uint32_t book = hash_string(epub_path);
+  for (auto &file : files)
+  {
+    if (file.book == book)
+    {
+      ::remove(file.filename.c_str());
+    }
+  }
+}
+
+void LayoutCache::remove_orphans()
+{
+  std::vector<LayoutFileInfo> files;
+  list_layout_files(m_cache_path, files);
+  for (auto &file : files)
+  {
+    // the header says which book the layout belongs to
+    FILE *fp = fopen(file.filename.c_str(), "rb");
+    if (!fp)
+    {
+      continue;
+    }
+    LayoutReader reader(fp);
+    bool is_valid = reader.read_u32() == LAYOUT_CACHE_MAGIC;
+    bool is_current = reader.read_u16() == LAYOUT_CACHE_VERSION;
+    std::string epub_path = reader.read_string();
+    fclose(fp);
+    // files that are still being written or can't be read are left for load to deal with
+    if (!is_valid || !reader.ok())
+    {
+      continue;
+    }
+    struct stat epub_stat;
+    if (!is_current || stat(epub_path.c_str(), &epub_stat) != 0)
+    {
+      ESP_LOGI(TAG, "Removing layout of deleted book %s", file.filename.c_str());
+      ::remove(file.filename.c_str());
+    }
+  }
+}
+
+size_t LayoutCache::get_total_size()
+{
+  std::vector<LayoutFileInfo> files;
+  list_layout_files(m_cache_path, files);
+  size_t total = 0;
+  for (auto &file : files)
+  {
+    total += file.size;
+  }
+  return total;
+}
+
+bool LayoutCache::save_snapshot(Epub *epub, Renderer *renderer, int section, int section_count, CachedSection *cached)
+{
+  LayoutCacheKey key;
+  if (!get_key(epub, renderer, section, &key))
+  {
+    return false;
+  }
+  std::string filename = m_cache_path + "reader.snp";
+  FILE *fp = fopen(filename.c_str(), "wb");
+  if (!fp)
+  {
+    ESP_LOGE(TAG, "Failed to create %s", filename.c_str());
+    return false;
+  }
+  LayoutWriter writer(fp);
+  writer.write_u32(0);
+  writer.write_u16(LAYOUT_CACHE_VERSION);
+  write_key(writer, key);
+  writer.write_u16(section_count);
+  writer.write_string(cached->get_filename().c_str(), cached->get_filename().size());
+  writer.write_u16(cached->get_page_count());
+  for (uint32_t offset : cached->get_page_offsets())
+  {
+    writer.write_u32(offset);
+  }
+  writer.write_u32(cached->get_anchors_offset());
+  fseek(fp, 0, SEEK_SET);
+  writer.write_u32(LAYOUT_SNAPSHOT_MAGIC);
+  bool success = writer.ok();
+  if (fclose(fp) != 0)
+  {
+    success = false;
+  }
+  if (!success)
+  {
+    ESP_LOGE(TAG, "Failed to write %s", filename.c_str());
+    ::remove(filename.c_str());
+    return false;
+  }
+  ESP_LOGI(TAG, "Saved snapshot of section %d", section);
+  return true;
+}
+
+// just the start of a layout file - enough to know that it's still there and is for the same layout
+static bool layout_file_matches(const std::string &filename, const LayoutCacheKey &key)
+{
+  FILE *fp = fopen(filename.c_str(), "rb");
+  if (!fp)
+  {
+    return false;
+  }
+  LayoutReader reader(fp);
+  bool matches = reader.read_u32() == LAYOUT_CACHE_MAGIC &&
+                 reader.read_u16() == LAYOUT_CACHE_VERSION &&
+                 read_key_matches(reader, key);
+  fclose(fp);
+  return matches;
+}
+
+CachedSection *LayoutCache::load_snapshot(Epub *epub, Renderer *renderer, int section, int *section_count)
+{
+  LayoutCacheKey key;
+  if (!get_key(epub, renderer, section, &key))
+  {
+    return nullptr;
+  }
+  std::string filename = m_cache_path + "reader.snp";
+  FILE *fp = fopen(filename.c_str(), "rb");
+  if (!fp)
+  {
+    return nullptr;
+  }
+  LayoutReader reader(fp);
+  bool is_valid = reader.read_u32() == LAYOUT_SNAPSHOT_MAGIC &&
+                  reader.read_u16() == LAYOUT_CACHE_VERSION &&
+                  read_key_matches(reader, key);
+  CachedSection *cached = nullptr;
+  if (is_valid)
+  {
+    *section_count = reader.read_u16();
+    std::string layout_filename = reader.read_string();
+    int page_count = reader.read_u16();
+    std::vector<uint32_t> page_offsets;
+    for (int i = 0; i < page_count && reader.ok(); i++)
+    {
+      page_offsets.push_back(reader.read_u32());
+    }
+    uint32_t anchors_offset = reader.read_u32();
+    // the layout file may have been evicted or replaced since the snapshot was taken - its
+    // page table isn't read again though, that's what the snapshot is for
+    if (reader.ok() && layout_file_matches(layout_filename, key))
+    {
+      cached = new CachedSection(layout_filename, page_offsets, anchors_offset);
+    }
+  }
+  fclose(fp);
+  if (!cached)
+  {
+    ESP_LOGI(TAG, "Snapshot is not for section %d", section);
+  }
+  return cached;
+}
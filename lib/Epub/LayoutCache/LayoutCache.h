@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class Epub;
+class Renderer;
+class Page;
+class RubbishHtmlParser;
+
+// bump this whenever the format of the cache files changes
+#define LAYOUT_CACHE_VERSION 2
+// how much space the layout files can take up before the ones for other books get thrown away -
+// they share the flash with the books themselves so they can't be allowed to grow forever
+#ifndef LAYOUT_CACHE_MAX_BYTES
+#define LAYOUT_CACHE_MAX_BYTES (512 * 1024)
+#endif
+
+// everything that affects the layout of a section - if any of these change then
+// the section needs to be layed out again
+typedef struct
+{
+  std::string epub_path;
+  uint32_t epub_size;
+  uint32_t epub_mtime;
+  uint16_t section;
+  uint32_t font_signature;
+  uint16_t page_width;
+  uint16_t page_height;
+  uint16_t margin_top;
+  uint16_t margin_bottom;
+  uint16_t margin_left;
+  uint16_t margin_right;
+} LayoutCacheKey;
+
+// a section that has been read back from the layout cache - only the position of each
+// page is held in memory, the pages and anchors themselves are read from the file when needed
+class CachedSection
+{
+private:
+  std::string m_filename;
+  std::vector<uint32_t> m_page_offsets;
+  uint32_t m_anchors_offset;
+
+public:
+  CachedSection(const std::string &filename, const std::vector<uint32_t> &page_offsets, uint32_t anchors_offset)
+      : m_filename(filename), m_page_offsets(page_offsets), m_anchors_offset(anchors_offset)
+  {
+  }
+  int get_page_count()
+  {
+    return m_page_offsets.size();
+  }
+  // read a page from the cache - returns nullptr if it can't be read
+  Page *load_page(int page_index);
+  // the page an element id is on - -1 if there's no such id or it can't be read
+  int get_anchor_page(const std::string &anchor);
+
+  const std::string &get_filename() const { return m_filename; }
+  const std::vector<uint32_t> &get_page_offsets() const { return m_page_offsets; }
+  uint32_t get_anchors_offset() const { return m_anchors_offset; }
+};
+
+// Stores the pages of each section once they have been layed out so that we can
+// render them again without having to extract and parse the html from the epub
+class LayoutCache
+{
+private:
+  std::string m_cache_path;
+  size_t m_max_bytes;
+
+  bool get_key(Epub *epub, Renderer *renderer, int section, LayoutCacheKey *key);
+  // throw away the oldest layouts of other books until the cache fits in the budget
+  void trim(const std::string &keep_epub_path);
+
+public:
+  // the cache files are written to cache_path which should end in a "/"
+  LayoutCache(const std::string &cache_path = "/fs/", size_t max_bytes = LAYOUT_CACHE_MAX_BYTES)
+      : m_cache_path(cache_path), m_max_bytes(max_bytes) {}
+  // the file the layout of a section is stored in
+  std::string get_filename(const std::string &epub_path, int section);
+  // write out the pages of a section that has been layed out
+  bool save(Epub *epub, Renderer *renderer, int section, RubbishHtmlParser *parser);
+  // read back a section - returns nullptr if it's not in the cache or is out of date
+  CachedSection *load(Epub *epub, Renderer *renderer, int section);
+  // get rid of any cached layout for the section
+  void remove(Epub *epub, int section);
+  // get rid of the layouts of every section of a book
+  void remove_book(const std::string &epub_path);
+  // get rid of the layouts of any book that is no longer on the file system
+  void remove_orphans();
+  // the space taken up by all the layout files
+  size_t get_total_size();
+  // remember where the section being read is in the cache so that after a deep sleep it can be
+  // picked up again without reading the epub or the header of the layout file
+  bool save_snapshot(Epub *epub, Renderer *renderer, int section, int section_count, CachedSection *cached);
+  // read back the snapshot - returns nullptr if it's for a different book, section or page layout
+  CachedSection *load_snapshot(Epub *epub, Renderer *renderer, int section, int *section_count);
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+// writes little endian values out to a layout cache file
+class LayoutWriter
+{
+private:
+  FILE *m_fp;
+  bool m_ok = true;
+
+public:
+  LayoutWriter(FILE *fp) : m_fp(fp) {}
+  void write(const void *data, size_t length)
+  {
+    if (m_ok && length > 0 && fwrite(data, 1, length, m_fp) != length)
+    {
+      m_ok = false;
+    }
+  }
+  void write_u8(uint8_t value)
+  {
+    write(&value, 1);
+  }
+  void write_u16(uint16_t value)
+  {
+    uint8_t data[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+    write(data, 2);
+  }
+  void write_u32(uint32_t value)
+  {
+    uint8_t data[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+    write(data, 4);
+  }
+  void write_string(const char *value, size_t length)
+  {
+    write_u16(length);
+    write(value, length);
+  }
+  // has everything been written successfully?
+  bool ok() { return m_ok; }
+};
+
+// reads back the values written by the LayoutWriter
+class LayoutReader
+{
+private:
+  FILE *m_fp;
+  bool m_ok = true;
+
+public:
+  LayoutReader(FILE *fp) : m_fp(fp) {}
+  void read(void *data, size_t length)
+  {
+    if (length > 0 && (!m_ok || fread(data, 1, length, m_fp) != length))
+    {
+      // make sure we don't return garbage
+      memset(data, 0, length);
+      m_ok = false;
+    }
+  }
+  uint8_t read_u8()
+  {
+    uint8_t value = 0;
+    read(&value, 1);
+    return value;
+  }
+  uint16_t read_u16()
+  {
+    uint8_t data[2];
+    read(data, 2);
+    return data[0] | (data[1] << 8);
+  }
+  uint32_t read_u32()
+  {
+    uint8_t data[4];
+    read(data, 4);
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+  }
+  std::string read_string()
+  {
+    std::string value(read_u16(), '\0');
+    if (!value.empty())
+    {
+      read(&value[0], value.size());
+    }
+    return value;
+  }
+  // has everything been read successfully?
+  bool ok() { return m_ok; }
+};
@@ -0,0 +1,484 @@
+#ifndef UNIT_TEST
+#include <esp_log.h>
+#else
+#define ESP_LOGI(args...)
+#define ESP_LOGE(args...)
+#define ESP_LOGD(args...)
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+extern "C"
+{
+#include <dirent.h>
+}
+#include <algorithm>
+#include <unordered_map>
+#include "LibraryIndex.h"
+#include "../LayoutCache/LayoutFile.h"
+#include "../EpubList/Epub.h"
+
+static const char *TAG = "LIBRARY";
+
+// "LIBX" - written last so a partially written index is never used
+static const uint32_t LIBRARY_INDEX_MAGIC = 0x5842494c;
+// magic, version, the number of entries and the number of books that couldn't be opened
+static const long HEADER_SIZE = 4 + 2 + 4 + 4;
+// how many entries are read at a time when the index is brought up to date
+static const int UPDATE_PAGE_SIZE = 32;
+
+static void write_entry(LayoutWriter &writer, const LibraryEntry &entry)
+{
+  // the reading position has to come first so it can be updated in place
+  writer.write_u16(entry.current_section);
+  writer.write_u16(entry.current_page);
+  writer.write_u16(entry.pages_in_current_section);
+  writer.write_u32(entry.file_size);
+  writer.write_u32(entry.file_time);
+  writer.write_string(entry.path.c_str(), entry.path.size());
+  writer.write_string(entry.title.c_str(), entry.title.size());
+  writer.write_string(entry.author.c_str(), entry.author.size());
+  writer.write_string(entry.cover_image_item.c_str(), entry.cover_image_item.size());
+}
+
+static void read_entry(LayoutReader &reader, LibraryEntry &entry)
+{
+  entry.current_section = reader.read_u16();
+  entry.current_page = reader.read_u16();
+  entry.pages_in_current_section = reader.read_u16();
+  entry.file_size = reader.read_u32();
+  entry.file_time = reader.read_u32();
+  entry.path = reader.read_string();
+  entry.title = reader.read_string();
+  entry.author = reader.read_string();
+  entry.cover_image_item = reader.read_string();
+}
+
+// a book that couldn't be opened - it's remembered so we don't keep trying until the file changes
+static void write_failed(LayoutWriter &writer, const LibraryEntry &entry)
+{
+  writer.write_u32(entry.file_size);
+  writer.write_u32(entry.file_time);
+  writer.write_string(entry.path.c_str(), entry.path.size());
+}
+
+static void read_failed(LayoutReader &reader, LibraryEntry &entry)
+{
+  entry.file_size = reader.read_u32();
+  entry.file_time = reader.read_u32();
+  entry.path = reader.read_string();
+}
+
+static bool is_before(const LibraryEntry &a, const LibraryEntry &b)
+{
+  return strcmp(a.title.c_str(), b.title.c_str()) < 0;
+}
+
+FILE *LibraryIndex::open_index(const char *mode, uint32_t *count, uint32_t *failed_count)
+{
+  FILE *fp = fopen(m_filename.c_str(), mode);
+  if (!fp)
+  {
+    // the power went between removing the old index and renaming the new one
+    if (rename(get_temp_filename().c_str(), m_filename.c_str()) != 0)
+    {
+      return nullptr;
+    }
+    ESP_LOGI(TAG, "Recovered library index from %s", get_temp_filename().c_str());
+    fp = fopen(m_filename.c_str(), mode);
+    if (!fp)
+    {
+      return nullptr;
+    }
+  }
+  LayoutReader reader(fp);
+  bool is_valid = reader.read_u32() == LIBRARY_INDEX_MAGIC && reader.read_u16() == LIBRARY_INDEX_VERSION;
+  *count = reader.read_u32();
+  uint32_t failed = reader.read_u32();
+  if (!is_valid || !reader.ok())
+  {
+    ESP_LOGI(TAG, "Ignoring out of date library index");
+    fclose(fp);
+    return nullptr;
+  }
+  if (failed_count)
+  {
+    *failed_count = failed;
+  }
+  return fp;
+}
+
+bool LibraryIndex::read_failed_books(std::vector<LibraryEntry> &failed)
+{
+  failed.clear();
+  uint32_t count = 0;
+  uint32_t failed_count = 0;
+  FILE *fp = open_index("rb", &count, &failed_count);
+  if (!fp)
+  {
+    return false;
+  }
+  // they come after the last entry
+  LayoutReader reader(fp);
+  if (count > 0)
+  {
+    fseek(fp, HEADER_SIZE + (count - 1) * 4, SEEK_SET);
+    fseek(fp, reader.read_u32(), SEEK_SET);
+    LibraryEntry entry;
+    read_entry(reader, entry);
+  }
+  else
+  {
+    fseek(fp, HEADER_SIZE, SEEK_SET);
+  }
+  failed.resize(failed_count);
+  for (auto &entry : failed)
+  {
+    read_failed(reader, entry);
+  }
+  fclose(fp);
+  if (!reader.ok())
+  {
+    failed.clear();
+    return false;
+  }
+  return true;
+}
+
+bool LibraryIndex::write_index(uint32_t previous_count, uint32_t kept_count, const std::unordered_map<std::string, EpubFile> &files,
+                               std::vector<LibraryEntry> &added, const std::vector<LibraryEntry> &failed)
+{
+  std::string temp_filename = get_temp_filename();
+  FILE *fp = fopen(temp_filename.c_str(), "wb");
+  if (!fp)
+  {
+    ESP_LOGE(TAG, "Failed to create %s", temp_filename.c_str());
+    return false;
+  }
+  uint32_t count = kept_count + added.size();
+  LayoutWriter writer(fp);
+  // leave space for the magic number - it gets filled in once everything else is written
+  writer.write_u32(0);
+  writer.write_u16(LIBRARY_INDEX_VERSION);
+  writer.write_u32(count);
+  writer.write_u32(failed.size());
+  // and the offsets - they get filled in once we know where the entries are
+  for (uint32_t i = 0; i < count; i++)
+  {
+    writer.write_u32(0);
+  }
+  std::vector<uint32_t> offsets;
+  offsets.reserve(count);
+  // the old index and the new books are both sorted by title so they can be merged a page at a time
+  std::sort(added.begin(), added.end(), is_before);
+  size_t next_added = 0;
+  std::vector<LibraryEntry> page;
+  bool success = true;
+  for (uint32_t start = 0; start < previous_count && success; start += UPDATE_PAGE_SIZE)
+  {
+    success = read_entries(start, UPDATE_PAGE_SIZE, page);
+    for (auto &entry : page)
+    {
+      auto file = files.find(entry.path);
+      if (file == files.end() || file->second.state != EPUB_FILE_INDEXED)
+      {
+        continue;
+      }
+      while (next_added < added.size() && is_before(added[next_added], entry))
+      {
+        offsets.push_back(ftell(fp));
+        write_entry(writer, added[next_added++]);
+      }
+      offsets.push_back(ftell(fp));
+      write_entry(writer, entry);
+    }
+  }
+  while (next_added < added.size())
+  {
+    offsets.push_back(ftell(fp));
+    write_entry(writer, added[next_added++]);
+  }
+  for (auto &entry : failed)
+  {
+    write_failed(writer, entry);
+  }
+  // the old index should have had everything we were expecting in it
+  success = success && offsets.size() == count;
+  if (success)
+  {
+    fseek(fp, HEADER_SIZE, SEEK_SET);
+    for (uint32_t offset : offsets)
+    {
+      writer.write_u32(offset);
+    }
+    fseek(fp, 0, SEEK_SET);
+    writer.write_u32(LIBRARY_INDEX_MAGIC);
+  }
+  success = success && writer.ok();
+  if (fclose(fp) != 0)
+  {
+    success = false;
+  }
+  if (!success)
+  {
+    ESP_LOGE(TAG, "Failed to write %s", temp_filename.c_str());
+    remove(temp_filename.c_str());
+    return false;
+  }
+  // the old index is only replaced once the new one is complete - SPIFFS won't rename over a file
+  if (rename(temp_filename.c_str(), m_filename.c_str()) != 0)
+  {
+    remove(m_filename.c_str());
+    if (rename(temp_filename.c_str(), m_filename.c_str()) != 0)
+    {
+      ESP_LOGE(TAG, "Failed to rename %s", temp_filename.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+bool LibraryIndex::update(const char *epub_directory)
+{
+  m_parsed_count = 0;
+  DIR *dir = opendir(epub_directory);
+  if (!dir)
+  {
+    ESP_LOGE(TAG, "Could not open directory %s", epub_directory);
+    return false;
+  }
+  // only the names, sizes and times of the books are held in memory
+  std::unordered_map<std::string, EpubFile> files;
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != NULL)
+  {
+    ESP_LOGD(TAG, "Found file: %s", ent->d_name);
+    // ignore any hidden files starting with "." and any directories
+    if (ent->d_name[0] == '.' || ent->d_type == DT_DIR)
+    {
+      continue;
+    }
+    int name_length = strlen(ent->d_name);
+    if (name_length < 5 || strcmp(ent->d_name + name_length - 5, ".epub") != 0)
+    {
+      continue;
+    }
+    std::string path = std::string(epub_directory) + ent->d_name;
+    struct stat epub_stat;
+    if (stat(path.c_str(), &epub_stat) != 0)
+    {
+      ESP_LOGE(TAG, "Failed to stat %s", path.c_str());
+      continue;
+    }
+    files[path] = {(uint32_t)epub_stat.st_size, (uint32_t)epub_stat.st_mtime, EPUB_FILE_NEW};
+  }
+  closedir(dir);
+
+  // go through the index a page at a time to find the books we've already seen
+  uint32_t previous_count = 0;
+  uint32_t failed_count = 0;
+  FILE *fp = open_index("rb", &previous_count, &failed_count);
+  bool is_valid = fp != nullptr;
+  if (fp)
+  {
+    fclose(fp);
+  }
+  bool changed = false;
+  uint32_t kept_count = 0;
+  std::vector<LibraryEntry> page;
+  for (uint32_t start = 0; start < previous_count && is_valid; start += UPDATE_PAGE_SIZE)
+  {
+    if (!read_entries(start, UPDATE_PAGE_SIZE, page))
+    {
+      is_valid = false;
+      break;
+    }
+    for (auto &entry : page)
+    {
+      auto file = files.find(entry.path);
+      if (file != files.end() && file->second.file_size == entry.file_size && file->second.file_time == entry.file_time)
+      {
+        file->second.state = EPUB_FILE_INDEXED;
+        kept_count++;
+      }
+      else
+      {
+        // it's gone or it has changed
+        changed = true;
+      }
+    }
+  }
+  // books that couldn't be opened aren't tried again until they change
+  std::vector<LibraryEntry> failed;
+  if (is_valid && !read_failed_books(failed))
+  {
+    is_valid = false;
+  }
+  for (auto it = failed.begin(); it != failed.end();)
+  {
+    auto file = files.find(it->path);
+    if (file != files.end() && file->second.file_size == it->file_size && file->second.file_time == it->file_time)
+    {
+      file->second.state = EPUB_FILE_FAILED;
+      ++it;
+    }
+    else
+    {
+      changed = true;
+      it = failed.erase(it);
+    }
+  }
+  // a missing or broken index means starting again from scratch
+  if (!is_valid)
+  {
+    for (auto &file : files)
+    {
+      file.second.state = EPUB_FILE_NEW;
+    }
+    failed.clear();
+    kept_count = 0;
+    previous_count = 0;
+    changed = true;
+  }
+  std::vector<LibraryEntry> added;
+  for (auto &file : files)
+  {
+    if (file.second.state != EPUB_FILE_NEW)
+    {
+      continue;
+    }
+    changed = true;
+    ESP_LOGD(TAG, "Loading epub %s", file.first.c_str());
+    m_parsed_count++;
+    LibraryEntry entry;
+    entry.path = file.first;
+    entry.file_size = file.second.file_size;
+    entry.file_time = file.second.file_time;
+    // only the metadata is needed for the list
+    Epub epub(file.first);
+    if (!epub.load(EPUB_LOAD_METADATA))
+    {
+      ESP_LOGE(TAG, "Failed to load epub %s", file.first.c_str());
+      failed.push_back(entry);
+      continue;
+    }
+    // the epub has already decoded any entities
+    entry.title = epub.get_title();
+    entry.author = epub.get_author();
+    entry.cover_image_item = epub.get_cover_image_item();
+    // the book has changed so the old position won't mean anything now
+    entry.current_section = 0;
+    entry.current_page = 0;
+    entry.pages_in_current_section = 0;
+    added.push_back(entry);
+  }
+  if (!changed)
+  {
+    ESP_LOGI(TAG, "Library index is up to date with %d books", (int)kept_count);
+    return true;
+  }
+  ESP_LOGI(TAG, "Writing library index with %d books, %d opened", (int)(kept_count + added.size()), (int)m_parsed_count);
+  return write_index(previous_count, kept_count, files, added, failed);
+}
+
+int LibraryIndex::get_count()
+{
+  uint32_t count = 0;
+  FILE *fp = open_index("rb", &count);
+  if (!fp)
+  {
+    return 0;
+  }
+  fclose(fp);
+  return count;
+}
+
+bool LibraryIndex::read_entries(int start, int count, std::vector<LibraryEntry> &entries)
+{
+  entries.clear();
+  uint32_t total = 0;
+  FILE *fp = open_index("rb", &total);
+  if (!fp)
+  {
+    return false;
+  }
+  if (start < 0 || start >= (int)total)
+  {
+    fclose(fp);
+    return start == (int)total;
+  }
+  count = std::min(count, (int)total - start);
+  // find the first entry - the rest follow straight after it
+  fseek(fp, HEADER_SIZE + start * 4, SEEK_SET);
+  LayoutReader reader(fp);
+  uint32_t offset = reader.read_u32();
+  fseek(fp, offset, SEEK_SET);
+  entries.resize(count);
+  for (auto &entry : entries)
+  {
+    read_entry(reader, entry);
+  }
+  fclose(fp);
+  if (!reader.ok())
+  {
+    entries.clear();
+    return false;
+  }
+  return true;
+}
+
+bool LibraryIndex::save_position(const std::string &path, uint16_t current_section, uint16_t current_page, uint16_t pages_in_current_section, int index)
+{
+  uint32_t count = 0;
+  FILE *fp = open_index("r+b", &count);
+  if (!fp)
+  {
+    return false;
+  }
+  LayoutReader reader(fp);
+  LibraryEntry entry;
+  long offset = -1;
+  // try where we were told first
+  if (index >= 0 && index < (int)count)
+  {
+    fseek(fp, HEADER_SIZE + index * 4, SEEK_SET);
+    offset = reader.read_u32();
+    fseek(fp, offset, SEEK_SET);
+    read_entry(reader, entry);
+    if (entry.path != path)
+    {
+      offset = -1;
+    }
+  }
+  // otherwise look through all the books for it
+  if (offset < 0)
+  {
+    fseek(fp, HEADER_SIZE + count * 4, SEEK_SET);
+    for (uint32_t i = 0; i < count && reader.ok(); i++)
+    {
+      long entry_offset = ftell(fp);
+      read_entry(reader, entry);
+      if (entry.path == path)
+      {
+        offset = entry_offset;
+        break;
+      }
+    }
+  }
+  bool success = false;
+  if (offset >= 0 && reader.ok())
+  {
+    fseek(fp, offset, SEEK_SET);
+    LayoutWriter writer(fp);
+    writer.write_u16(current_section);
+    writer.write_u16(current_page);
+    writer.write_u16(pages_in_current_section);
+    success = writer.ok();
+  }
+  if (fclose(fp) != 0)
+  {
+    success = false;
+  }
+  return success;
+}
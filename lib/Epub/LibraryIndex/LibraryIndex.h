@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// bump this whenever the format of the index file changes
+#define LIBRARY_INDEX_VERSION 2
+
+// everything the library list needs to know about a book without opening it
+typedef struct
+{
+  std::string path;
+  std::string title;
+  std::string author;
+  std::string cover_image_item;
+  // the size and modification time of the epub file when it was read - if these change the book is read again
+  uint32_t file_size;
+  uint32_t file_time;
+  // where the reader got to
+  uint16_t current_section;
+  uint16_t current_page;
+  uint16_t pages_in_current_section;
+} LibraryEntry;
+
+typedef enum
+{
+  // not in the index yet
+  EPUB_FILE_NEW,
+  // in the index and hasn't changed
+  EPUB_FILE_INDEXED,
+  // couldn't be opened last time and hasn't changed since
+  EPUB_FILE_FAILED,
+} EpubFileState;
+
+// an epub file found in the library directory
+typedef struct
+{
+  uint32_t file_size;
+  uint32_t file_time;
+  EpubFileState state;
+} EpubFile;
+
+// An index of all the books on the file system kept in a single file sorted by title. Only the
+// books that are new or have changed since the last time are opened when the index is brought up
+// to date, and the library list reads it a page at a time so it can hold any number of books.
+//
+// The file is a header, a table with the offset of each entry, the entries themselves and then
+// the books that couldn't be opened. The reading position is at the start of each entry so it can
+// be updated in place. Updates read the old index a page at a time and write a new one alongside
+// it, which only replaces the old one once it is complete.
+class LibraryIndex
+{
+private:
+  std::string m_filename;
+  // how many books had to be opened by the last update
+  size_t m_parsed_count = 0;
+
+  // the new index is written here and then renamed over the old one
+  std::string get_temp_filename() { return m_filename + ".tmp"; }
+  // read the books that couldn't be opened - only their paths, sizes and times are kept
+  bool read_failed_books(std::vector<LibraryEntry> &failed);
+  // write a new index with the books still in the old one merged with the added ones
+  bool write_index(uint32_t previous_count, uint32_t kept_count, const std::unordered_map<std::string, EpubFile> &files,
+                   std::vector<LibraryEntry> &added, const std::vector<LibraryEntry> &failed);
+  // open the index and check the header - returns the number of entries
+  FILE *open_index(const char *mode, uint32_t *count, uint32_t *failed_count = nullptr);
+
+public:
+  LibraryIndex(const std::string &filename = "/fs/library.idx") : m_filename(filename) {}
+  // bring the index up to date with the epub files in the directory - returns false if the directory can't be read
+  bool update(const char *epub_directory);
+  // the number of books in the index
+  int get_count();
+  // read up to count entries starting at start
+  bool read_entries(int start, int count, std::vector<LibraryEntry> &entries);
+  // remember the reading position for a book - index is a hint for where to find it
+  bool save_position(const std::string &path, uint16_t current_section, uint16_t current_page, uint16_t pages_in_current_section, int index = -1);
+
+  size_t get_parsed_count() { return m_parsed_count; }
+};
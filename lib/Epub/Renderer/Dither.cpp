@@ -0,0 +1,54 @@
+#include <stdlib.h>
+#include <algorithm>
+#include "Dither.h"
+
+Dither::Dither(int width, const uint8_t *levels, int level_count)
+{
+  for (int value = 0; value < 256; value++)
+  {
+    int nearest = levels[0];
+    for (int i = 1; i < level_count; i++)
+    {
+      if (abs(levels[i] - value) < abs(nearest - value))
+      {
+        nearest = levels[i];
+      }
+    }
+    m_nearest[value] = nearest;
+  }
+  start(width);
+}
+
+void Dither::start(int width)
+{
+  m_width = width;
+  m_current_error.assign(width + 2, 0);
+  m_next_error.assign(width + 2, 0);
+  m_output.resize(width);
+  m_left_to_right = true;
+}
+
+const uint8_t *Dither::dither_row(const uint8_t *row)
+{
+  int start = m_left_to_right ? 0 : m_width - 1;
+  int step = m_left_to_right ? 1 : -1;
+  // the error arrays are offset by one so we can spill over the edges without checking
+  int16_t *current = &m_current_error[1];
+  int16_t *next = &m_next_error[1];
+  for (int i = 0, x = start; i < m_width; i++, x += step)
+  {
+    // the error is in 16ths - shift rather than divide so negative errors round the same way as positive ones
+    int value = std::max(0, std::min(255, row[x] + ((current[x] + 8) >> 4)));
+    int level = m_nearest[value];
+    int error = value - level;
+    m_output[x] = level;
+    current[x + step] += error * 7;
+    next[x - step] += error * 3;
+    next[x] += error * 5;
+    next[x + step] += error;
+  }
+  std::swap(m_current_error, m_next_error);
+  std::fill(m_next_error.begin(), m_next_error.end(), 0);
+  m_left_to_right = !m_left_to_right;
+  return m_output.data();
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Reduces rows of a gray scale image down to the handful of gray levels the display can
+// actually show using Floyd-Steinberg error diffusion. Without this smooth gradients in
+// images come out as bands of flat gray. Rows go alternately left to right and right to
+// left so the error doesn't pile up on one side.
+class Dither
+{
+private:
+  int m_width;
+  // the nearest level for every gray value
+  uint8_t m_nearest[256];
+  // the error carried into the current row and the next one - with a spare pixel at each end
+  std::vector<int16_t> m_current_error;
+  std::vector<int16_t> m_next_error;
+  std::vector<uint8_t> m_output;
+  bool m_left_to_right = true;
+
+public:
+  // levels are the gray values the display can show - darkest first
+  Dither(int width, const uint8_t *levels, int level_count);
+  // get ready for a new image - the buffers are reused if they are big enough
+  void start(int width);
+  // dithers the next row of the image - the returned row is valid until the next call
+  const uint8_t *dither_row(const uint8_t *row);
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdint.h>
+#include <epd_driver.h>
+
+// hash the metrics of every glyph in the fonts - these are what the layout depends on
+inline uint32_t get_epd_font_signature(const EpdFont *const *fonts, int font_count)
+{
+  uint32_t signature = 2166136261u;
+  for (int font_index = 0; font_index < font_count; font_index++)
+  {
+    const EpdFont *font = fonts[font_index];
+    signature = (signature ^ font->advance_y) * 16777619u;
+    signature = (signature ^ font->interval_count) * 16777619u;
+    for (int i = 0; i < font->interval_count; i++)
+    {
+      const EpdUnicodeInterval *interval = &font->intervals[i];
+      for (uint32_t code_point = interval->first; code_point <= interval->last; code_point++)
+      {
+        const EpdGlyph *glyph = &font->glyph[interval->offset + code_point - interval->first];
+        signature = (signature ^ code_point) * 16777619u;
+        signature = (signature ^ glyph->advance_x) * 16777619u;
+        signature = (signature ^ glyph->width) * 16777619u;
+        signature = (signature ^ (uint16_t)glyph->left) * 16777619u;
+      }
+    }
+  }
+  return signature;
+}
@@ -3,7 +3,13 @@
 #include <epd_driver.h>
 #include <math.h>
 #include "Renderer.h"
-#include "miniz.h"
+#include "GlyphWidthCache.h"
+#include "GlyphBitmapCache.h"
+#include "FrameDiff.h"
+#include "FrameCodec.h"
+#include "EpdFontSignature.h"
+#include "utf8.h"
+#include "../Trace/Trace.h"
 
 #define GAMMA_VALUE (1.0f / 0.8f)
 
@@ -21,6 +27,17 @@ protected:
   EpdFontProperties m_font_props;
   uint8_t gamma_curve[256] = {0};
   bool needs_gray_flush = false;
+  // glyph metrics for measuring text - indexed by the SPAN_STYLE bits
+  GlyphWidthCache *m_width_caches[4] = {nullptr};
+  // the fonts are compressed so keep the glyphs we've drawn recently ready to use
+  GlyphBitmapCache m_glyph_cache;
+  // what is on the screen at the moment so we only need to update the parts that change
+  uint8_t *m_previous_frame = nullptr;
+  FrameDiff m_frame_diff{EPD_WIDTH, EPD_HEIGHT};
+  std::vector<DirtyRegion> m_dirty_regions;
+  // saves the frame buffer while we're in deep sleep
+  FrameCodec m_frame_codec{EPD_WIDTH, EPD_HEIGHT};
+  size_t m_last_flush_bytes = 0;
 
   const EpdFont *get_font(bool is_bold, bool is_italic)
   {
@@ -54,6 +71,28 @@ public:
     m_font_props = epd_font_properties_default();
     // fallback to a question mark for character not available in the font
     m_font_props.fallback_glyph = '?';
+    for (int style = 0; style < 4; style++)
+    {
+      const EpdFont *font = get_font(style & BOLD_SPAN, style & ITALIC_SPAN);
+      uint32_t fallback_glyph = m_font_props.fallback_glyph;
+      m_width_caches[style] = new GlyphWidthCache(
+          [font, fallback_glyph](uint32_t code_point, GlyphMetrics *metrics)
+          {
+            const EpdGlyph *glyph = epd_get_glyph(font, code_point);
+            if (!glyph)
+            {
+              glyph = epd_get_glyph(font, fallback_glyph);
+            }
+            if (!glyph)
+            {
+              return false;
+            }
+            metrics->advance_x = glyph->advance_x;
+            metrics->left = glyph->left;
+            metrics->width = glyph->width;
+            return true;
+          });
+    }
     epd_set_rotation(EPD_ROT_INVERTED_PORTRAIT);
 
     for (int gray_value = 0; gray_value < 256; gray_value++)
@@ -63,6 +102,10 @@ public:
   }
   virtual ~EpdiyFrameBufferRenderer()
   {
+    for (auto cache : m_width_caches)
+    {
+      delete cache;
+    }
   }
   void show_busy()
   {
@@ -109,9 +152,45 @@ public:
 
   int get_text_width(const char *text, bool bold = false, bool italic = false)
   {
-    int x = 0, y = 0, x1 = 0, y1 = 0, x2 = 0, y2 = 0;
-    epd_get_text_bounds(get_font(bold, italic), text, &x, &y, &x1, &y1, &x2, &y2, &m_font_props);
-    return x2 - x1;
+    // gives the same result as epd_get_text_bounds without searching the font for every character
+    return m_width_caches[(bold ? BOLD_SPAN : 0) | (italic ? ITALIC_SPAN : 0)]->get_text_width(text);
+  }
+  void get_text_widths(const char *const *words, const uint8_t *styles, size_t count, uint16_t *widths)
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      widths[i] = m_width_caches[styles[i] & (BOLD_SPAN | ITALIC_SPAN)]->get_text_width(words[i]);
+    }
+  }
+  // draws a glyph with its origin at x and the baseline at y - the same as epd_write_string does
+  void draw_glyph(const EpdFont *font, const EpdGlyph *glyph, uint32_t code_point, int x, int y)
+  {
+    int byte_width = (glyph->width + 1) / 2;
+    const uint8_t *bitmap = &font->bitmap[glyph->data_offset];
+    if (font->compressed)
+    {
+      bitmap = m_glyph_cache.get_bitmap(font, code_point, bitmap, glyph->compressed_size, byte_width * glyph->height);
+      if (!bitmap)
+      {
+        return;
+      }
+    }
+    int start_x = x + glyph->left;
+    int start_y = y - glyph->top;
+    for (int glyph_y = 0; glyph_y < glyph->height; glyph_y++)
+    {
+      const uint8_t *row = bitmap + glyph_y * byte_width;
+      for (int glyph_x = 0; glyph_x < glyph->width; glyph_x++)
+      {
+        // two pixels per byte with the first one in the low nibble
+        uint8_t value = glyph_x & 1 ? row[glyph_x / 2] >> 4 : row[glyph_x / 2] & 0xF;
+        if (value)
+        {
+          // black text on a white background
+          epd_draw_pixel(start_x + glyph_x, start_y + glyph_y, (15 - value) << 4, m_frame_buffer);
+        }
+      }
+    }
   }
   void draw_text(int x, int y, const char *text, bool bold = false, bool italic = false)
   {
@@ -119,8 +198,32 @@ public:
     // needs_gray_flush = true;
     int ypos = y + get_line_height() + margin_top;
     int xpos = x + margin_left;
-    epd_write_string(get_font(bold, italic), text, &xpos, &ypos, m_frame_buffer, &m_font_props);
+    const EpdFont *font = get_font(bold, italic);
+    const uint8_t *p = (const uint8_t *)text;
+    while (*p)
+    {
+      uint32_t code_point = utf8_next_code_point(&p);
+      if (code_point == '\n')
+      {
+        xpos = x + margin_left;
+        ypos += font->advance_y;
+        continue;
+      }
+      const EpdGlyph *glyph = epd_get_glyph(font, code_point);
+      if (!glyph)
+      {
+        code_point = m_font_props.fallback_glyph;
+        glyph = epd_get_glyph(font, code_point);
+      }
+      if (glyph)
+      {
+        draw_glyph(font, glyph, code_point, xpos, ypos);
+        xpos += glyph->advance_x;
+      }
+    }
   }
+  size_t get_glyph_cache_hits() { return m_glyph_cache.get_hits(); }
+  size_t get_glyph_cache_misses() { return m_glyph_cache.get_misses(); }
   void draw_rect(int x, int y, int width, int height, uint8_t color = 0)
   {
     needs_gray(color);
@@ -152,12 +255,89 @@ public:
     needs_gray(corrected_color);
     epd_draw_pixel(x + margin_left, y + margin_top, corrected_color, m_frame_buffer);
   }
+  virtual void draw_gray_span(int x, int y, const uint8_t *gray, int count)
+  {
+    // the screen is rotated so a row of the page is a column in the frame buffer - we still have
+    // to go a pixel at a time but we can skip the virtual calls and the gray check for each one
+    bool has_gray = needs_gray_flush;
+    for (int i = 0; i < count; i++)
+    {
+      uint8_t corrected_color = gamma_curve[gray[i]];
+      has_gray |= corrected_color != 0 && corrected_color != 255;
+      epd_draw_pixel(x + i + margin_left, y + margin_top, corrected_color, m_frame_buffer);
+    }
+    needs_gray_flush = has_gray;
+  }
+  virtual int get_gray_levels(uint8_t *levels)
+  {
+    // the frame buffer is 4 bits per pixel - for each of the 16 levels pick the gray value in the
+    // middle of the range that the gamma curve maps onto it (apart from black and white)
+    int level_count = 0;
+    int start = 0;
+    for (int gray = 1; gray <= 256; gray++)
+    {
+      if (gray == 256 || (gamma_curve[gray] >> 4) != (gamma_curve[start] >> 4))
+      {
+        levels[level_count++] = start == 0 ? 0 : gray == 256 ? 255 : (start + gray - 1) / 2;
+        start = gray;
+      }
+    }
+    return level_count;
+  }
+  virtual uint8_t get_display_gray(uint8_t gray)
+  {
+    return gamma_curve[gray];
+  }
+  virtual void draw_bitmap(int x, int y, int width, int height, const uint8_t *bitmap)
+  {
+    // the bitmap is already gamma corrected so the values go straight into the frame buffer
+    int stride = (width + 1) / 2;
+    bool has_gray = needs_gray_flush;
+    for (int row = 0; row < height; row++)
+    {
+      for (int column = 0; column < width; column++)
+      {
+        uint8_t pixel = bitmap[row * stride + column / 2];
+        uint8_t value = column & 1 ? pixel >> 4 : pixel & 0x0F;
+        has_gray |= value != 0 && value != 15;
+        epd_draw_pixel(x + column + margin_left, y + row + margin_top, value << 4, m_frame_buffer);
+      }
+    }
+    needs_gray_flush = has_gray;
+  }
   virtual void draw_circle(int x, int y, int r, uint8_t color = 0)
   {
     needs_gray(color);
     epd_draw_circle(x, y, r, color, m_frame_buffer);
   }
-  virtual void flush_display() = 0;
+  // called before the first area of a flush is updated
+  virtual void start_update(){};
+  // send part of the frame buffer to the display - in the same rotated coordinates as flush_area
+  virtual void update_area(int x, int y, int width, int height, bool needs_gray) = 0;
+  // only update the parts of the screen that have changed since the last flush
+  virtual void flush_display()
+  {
+    TRACE_STAGE("flush");
+    m_last_flush_bytes = 0;
+    if (m_frame_diff.diff(m_previous_frame, m_frame_buffer, m_dirty_regions))
+    {
+      start_update();
+      for (auto &region : m_dirty_regions)
+      {
+        // the frame buffer is in the display's native orientation and we are rotated
+        update_area(EPD_HEIGHT - region.y - region.height, region.x, region.height, region.width, region.needs_gray);
+        m_frame_diff.copy_region(region, m_frame_buffer, m_previous_frame);
+        m_last_flush_bytes += FrameDiff::get_region_bytes(region);
+      }
+    }
+    needs_gray_flush = false;
+    TRACE_COUNTER("flush bytes", m_last_flush_bytes);
+  }
+  // the number of bytes of the frame buffer sent to the display by the last flush
+  size_t get_last_flush_bytes()
+  {
+    return m_last_flush_bytes;
+  }
   virtual void flush_area(int x, int y, int width, int height) = 0;
 
   virtual void clear_screen()
@@ -183,81 +363,37 @@ public:
   {
     return m_regular_font->advance_y;
   }
+  virtual uint32_t get_font_signature()
+  {
+    const EpdFont *fonts[] = {m_regular_font, m_bold_font, m_italic_font, m_bold_italic_font};
+    return get_epd_font_signature(fonts, 4);
+  }
 
   // dehydate a frame buffer to file
   virtual bool dehydrate()
   {
-    // compress the buffer to save space and increase performance - writing data is slow!
-    size_t compressed_size = 0;
-    void *compressed = tdefl_compress_mem_to_heap(m_frame_buffer, EPD_WIDTH * EPD_HEIGHT / 2, &compressed_size, 0);
-    if (compressed)
+    TRACE_STAGE("frame dehydrate");
+    // the frame is streamed out a chunk at a time as runs - writing data is slow and most of the page is white
+    if (!m_frame_codec.save(m_frame_buffer, "/fs/front_buffer.fc"))
     {
-      ESP_LOGI("EPD", "Buffer compressed size: %d", compressed_size);
-      FILE *fp = fopen("/fs/front_buffer.z", "w");
-      if (fp)
-      {
-        size_t written = fwrite(compressed, 1, compressed_size, fp);
-        fclose(fp);
-        free(compressed);
-        if (written != compressed_size)
-        {
-          ESP_LOGI("EPD", "Failed to write to file");
-          remove("/fs/front_buffer.z");
-          return false;
-        }
-        ESP_LOGI("EPD", "Buffer saved %d", written);
-        return true;
-      }
+      ESP_LOGE("EPD", "Failed to save front buffer");
+      return false;
     }
-    return false;
+    ESP_LOGI("EPD", "Front buffer saved");
+    return true;
   }
 
   // hydrate a frame buffer
   virtual bool hydrate()
   {
-    // load the two buffers - the front and the back buffers
-    FILE *fp = fopen("/fs/front_buffer.z", "r");
-    bool success = false;
-    if (fp)
-    {
-      fseek(fp, 0, SEEK_END);
-      size_t compressed_size = ftell(fp);
-      fseek(fp, 0, SEEK_SET);
-      if (compressed_size > 0)
-      {
-        ESP_LOGI("EPD", "Buffer compressed size: %d", compressed_size);
-        void *compressed = malloc(compressed_size);
-        if (compressed)
-        {
-          fread(compressed, 1, compressed_size, fp);
-          int result = tinfl_decompress_mem_to_mem(m_frame_buffer, EPD_WIDTH * EPD_HEIGHT / 2, compressed, compressed_size, 0);
-          if (result == TINFL_DECOMPRESS_MEM_TO_MEM_FAILED)
-          {
-            ESP_LOGE("EPD", "Failed to decompress front buffer");
-          }
-          else
-          {
-            success = true;
-            ESP_LOGI("EPD", "Success decompressing %d bytes", EPD_WIDTH * EPD_HEIGHT / 2);
-          }
-          free(compressed);
-        }
-        else
-        {
-          ESP_LOGE("EPD", "Failed to allocate memory for front buffer");
-        }
-      }
-      else
-      {
-        ESP_LOGE("EPD", "No data to restore");
-      }
-      fclose(fp);
-    }
-    else
+    // decoded straight into the frame buffer
+    if (!m_frame_codec.load("/fs/front_buffer.fc", m_frame_buffer))
     {
-      ESP_LOGI("EPD", "No front buffer found");
+      ESP_LOGI("EPD", "No front buffer to restore");
+      return false;
     }
-    return success;
+    ESP_LOGI("EPD", "Restored %d bytes", EPD_WIDTH * EPD_HEIGHT / 2);
+    return true;
   }
   virtual void reset() = 0;
 };
\ No newline at end of file
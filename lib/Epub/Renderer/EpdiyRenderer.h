@@ -29,6 +29,8 @@ public:
     // first set full screen to white
     epd_hl_set_all_white(&m_hl);
     m_frame_buffer = epd_hl_get_framebuffer(&m_hl);
+    // the high level api keeps a copy of what is on the screen already
+    m_previous_frame = m_hl.back_fb;
 
 #ifndef CONFIG_EPD_BOARD_REVISION_LILYGO_T5_47
     epd_poweron();
@@ -38,10 +40,9 @@ public:
   {
     epd_deinit();
   }
-  void flush_display()
+  void update_area(int x, int y, int width, int height, bool needs_gray)
   {
-    epd_hl_update_screen(&m_hl, needs_gray_flush ? MODE_GC16 : MODE_DU, temperature);
-    needs_gray_flush = false;
+    epd_hl_update_area(&m_hl, needs_gray ? MODE_GC16 : MODE_DU, temperature, {.x = x, .y = y, .width = width, .height = height});
   }
   void flush_area(int x, int y, int width, int height)
   {
@@ -0,0 +1,336 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "FrameCodec.h"
+
+// "FC01" followed by the width and height of the frame
+static const uint8_t FRAME_CODEC_MAGIC[] = {'F', 'C', '0', '1'};
+static const size_t HEADER_SIZE = 8;
+
+// each run starts with a byte - the type of run in the top two bits and the length in the rest
+static const uint8_t RUN_WHITE = 0;
+static const uint8_t RUN_BYTE = 1;
+static const uint8_t RUN_ABOVE = 2;
+static const uint8_t RUN_LITERAL = 3;
+// lengths that don't fit in the run byte carry on in the bytes after it - 7 bits at a time
+static const size_t MAX_SHORT_LENGTH = 63;
+// anything shorter than this is cheaper as part of a literal
+static const size_t MIN_RUN = 3;
+static const uint8_t WHITE = 0xFF;
+
+// collects the encoded bytes and hands them on a chunk at a time
+class ChunkWriter
+{
+private:
+  uint8_t m_buffer[FrameCodec::CHUNK_SIZE];
+  size_t m_length = 0;
+  std::function<bool(const uint8_t *data, size_t length)> &m_write;
+
+public:
+  bool ok = true;
+
+  ChunkWriter(std::function<bool(const uint8_t *data, size_t length)> &write) : m_write(write) {}
+  void flush()
+  {
+    if (ok && m_length > 0)
+    {
+      ok = m_write(m_buffer, m_length);
+    }
+    m_length = 0;
+  }
+  void put(uint8_t value)
+  {
+    if (m_length == FrameCodec::CHUNK_SIZE)
+    {
+      flush();
+    }
+    m_buffer[m_length++] = value;
+  }
+  void put(const uint8_t *data, size_t length)
+  {
+    while (length > 0)
+    {
+      if (m_length == FrameCodec::CHUNK_SIZE)
+      {
+        flush();
+      }
+      size_t to_copy = std::min(length, FrameCodec::CHUNK_SIZE - m_length);
+      memcpy(m_buffer + m_length, data, to_copy);
+      m_length += to_copy;
+      data += to_copy;
+      length -= to_copy;
+    }
+  }
+  void put_run(uint8_t type, size_t length)
+  {
+    size_t value = length - 1;
+    if (value < MAX_SHORT_LENGTH)
+    {
+      put((type << 6) | value);
+      return;
+    }
+    put((type << 6) | MAX_SHORT_LENGTH);
+    value -= MAX_SHORT_LENGTH;
+    while (value >= 0x80)
+    {
+      put(0x80 | (value & 0x7F));
+      value >>= 7;
+    }
+    put(value);
+  }
+};
+
+// reads the encoded bytes back a chunk at a time
+class ChunkReader
+{
+private:
+  uint8_t m_buffer[FrameCodec::CHUNK_SIZE];
+  size_t m_position = 0;
+  size_t m_length = 0;
+  std::function<size_t(uint8_t *data, size_t length)> &m_read;
+
+public:
+  ChunkReader(std::function<size_t(uint8_t *data, size_t length)> &read) : m_read(read) {}
+  bool get(uint8_t &value)
+  {
+    if (m_position == m_length)
+    {
+      m_length = m_read(m_buffer, FrameCodec::CHUNK_SIZE);
+      m_position = 0;
+      if (m_length == 0)
+      {
+        return false;
+      }
+    }
+    value = m_buffer[m_position++];
+    return true;
+  }
+  bool get(uint8_t *data, size_t length)
+  {
+    while (length > 0)
+    {
+      if (m_position == m_length)
+      {
+        m_length = m_read(m_buffer, FrameCodec::CHUNK_SIZE);
+        m_position = 0;
+        if (m_length == 0)
+        {
+          return false;
+        }
+      }
+      size_t to_copy = std::min(length, m_length - m_position);
+      memcpy(data, m_buffer + m_position, to_copy);
+      m_position += to_copy;
+      data += to_copy;
+      length -= to_copy;
+    }
+    return true;
+  }
+  bool get_run(uint8_t &type, size_t &length)
+  {
+    uint8_t run;
+    if (!get(run))
+    {
+      return false;
+    }
+    type = run >> 6;
+    length = run & MAX_SHORT_LENGTH;
+    if (length == MAX_SHORT_LENGTH)
+    {
+      // no frame is big enough to need more than 4 extra bytes
+      size_t extra = 0;
+      uint8_t value = 0x80;
+      for (int shift = 0; value & 0x80; shift += 7)
+      {
+        if (shift > 21 || !get(value))
+        {
+          return false;
+        }
+        extra |= (size_t)(value & 0x7F) << shift;
+      }
+      length += extra;
+    }
+    length++;
+    return true;
+  }
+};
+
+static size_t count_run(const uint8_t *frame, size_t position, size_t size, uint8_t value)
+{
+  size_t end = position;
+  while (end < size && frame[end] == value)
+  {
+    end++;
+  }
+  return end - position;
+}
+
+static size_t count_above_run(const uint8_t *frame, size_t position, size_t size, size_t row_bytes)
+{
+  if (position < row_bytes)
+  {
+    return 0;
+  }
+  size_t end = position;
+  while (end < size && frame[end] == frame[end - row_bytes])
+  {
+    end++;
+  }
+  return end - position;
+}
+
+bool FrameCodec::encode(const uint8_t *frame, std::function<bool(const uint8_t *data, size_t length)> write)
+{
+  size_t row_bytes = m_width / 2;
+  size_t size = row_bytes * m_height;
+  ChunkWriter writer(write);
+  writer.put(FRAME_CODEC_MAGIC, sizeof(FRAME_CODEC_MAGIC));
+  writer.put(m_width & 0xFF);
+  writer.put(m_width >> 8);
+  writer.put(m_height & 0xFF);
+  writer.put(m_height >> 8);
+  // the literal bytes are written straight from the frame once we know where they end
+  size_t literal_start = 0;
+  size_t position = 0;
+  while (position < size && writer.ok)
+  {
+    // white and copies of the row above don't need the value storing so they win a tie
+    uint8_t type = RUN_WHITE;
+    size_t length = count_run(frame, position, size, WHITE);
+    size_t above_length = count_above_run(frame, position, size, row_bytes);
+    if (above_length > length)
+    {
+      type = RUN_ABOVE;
+      length = above_length;
+    }
+    if (length < MIN_RUN && frame[position] != WHITE)
+    {
+      size_t byte_length = count_run(frame, position, size, frame[position]);
+      if (byte_length > length)
+      {
+        type = RUN_BYTE;
+        length = byte_length;
+      }
+    }
+    if (length < MIN_RUN)
+    {
+      position++;
+      continue;
+    }
+    if (literal_start < position)
+    {
+      writer.put_run(RUN_LITERAL, position - literal_start);
+      writer.put(frame + literal_start, position - literal_start);
+    }
+    writer.put_run(type, length);
+    if (type == RUN_BYTE)
+    {
+      writer.put(frame[position]);
+    }
+    position += length;
+    literal_start = position;
+  }
+  if (literal_start < size)
+  {
+    writer.put_run(RUN_LITERAL, size - literal_start);
+    writer.put(frame + literal_start, size - literal_start);
+  }
+  writer.flush();
+  return writer.ok;
+}
+
+bool FrameCodec::decode(std::function<size_t(uint8_t *data, size_t length)> read, uint8_t *frame)
+{
+  size_t row_bytes = m_width / 2;
+  size_t size = row_bytes * m_height;
+  ChunkReader reader(read);
+  uint8_t header[HEADER_SIZE];
+  if (!reader.get(header, HEADER_SIZE) ||
+      memcmp(header, FRAME_CODEC_MAGIC, sizeof(FRAME_CODEC_MAGIC)) != 0 ||
+      (header[4] | header[5] << 8) != m_width ||
+      (header[6] | header[7] << 8) != m_height)
+  {
+    return false;
+  }
+  size_t position = 0;
+  while (position < size)
+  {
+    uint8_t type;
+    size_t length;
+    if (!reader.get_run(type, length) || length > size - position)
+    {
+      return false;
+    }
+    switch (type)
+    {
+    case RUN_WHITE:
+      memset(frame + position, WHITE, length);
+      break;
+    case RUN_BYTE:
+    {
+      uint8_t value;
+      if (!reader.get(value))
+      {
+        return false;
+      }
+      memset(frame + position, value, length);
+      break;
+    }
+    case RUN_ABOVE:
+      if (position < row_bytes)
+      {
+        return false;
+      }
+      // the run can be longer than a row so it has to go a byte at a time
+      for (size_t i = position; i < position + length; i++)
+      {
+        frame[i] = frame[i - row_bytes];
+      }
+      break;
+    default:
+      if (!reader.get(frame + position, length))
+      {
+        return false;
+      }
+      break;
+    }
+    position += length;
+  }
+  // anything left over means this isn't what we wrote
+  uint8_t extra;
+  return !reader.get(extra);
+}
+
+bool FrameCodec::save(const uint8_t *frame, const char *filename)
+{
+  FILE *fp = fopen(filename, "wb");
+  if (!fp)
+  {
+    return false;
+  }
+  bool success = encode(frame, [fp](const uint8_t *data, size_t length)
+                        { return fwrite(data, 1, length, fp) == length; });
+  if (fclose(fp) != 0)
+  {
+    success = false;
+  }
+  if (!success)
+  {
+    remove(filename);
+  }
+  return success;
+}
+
+bool FrameCodec::load(const char *filename, uint8_t *frame)
+{
+  FILE *fp = fopen(filename, "rb");
+  if (!fp)
+  {
+    return false;
+  }
+  bool success = decode([fp](uint8_t *data, size_t length)
+                        { return fread(data, 1, length, fp); },
+                        frame);
+  fclose(fp);
+  return success;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+// Packs a 4bpp frame buffer so it can be saved while we are in deep sleep. Pages are mostly
+// white with a few runs of text so the frame is stored as runs - white space, repeats of the
+// same byte, bytes that are the same as the row above and literal bytes. The data is streamed
+// through a small fixed size buffer in both directions so there's never a second copy of the frame.
+class FrameCodec
+{
+private:
+  int m_width;
+  int m_height;
+
+public:
+  // the size of the chunks the encoded data is written and read in
+  static const size_t CHUNK_SIZE = 512;
+
+  // width and height are in pixels with two pixels per byte
+  FrameCodec(int width, int height) : m_width(width), m_height(height) {}
+  // encode the frame - write is called with each chunk and can return false to give up
+  bool encode(const uint8_t *frame, std::function<bool(const uint8_t *data, size_t length)> write);
+  // decode into the frame - read fills in up to length bytes and returns how many it read, 0 at the end.
+  // Returns false if the data is corrupt or for a different size of frame.
+  bool decode(std::function<size_t(uint8_t *data, size_t length)> read, uint8_t *frame);
+  // save to and load from a file
+  bool save(const uint8_t *frame, const char *filename);
+  bool load(const char *filename, uint8_t *frame);
+};
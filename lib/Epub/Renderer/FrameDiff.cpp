@@ -0,0 +1,184 @@
+#include <string.h>
+#include <algorithm>
+#include "FrameDiff.h"
+
+static const uint8_t TILE_UNCHANGED = 0;
+static const uint8_t TILE_CHANGED = 1;
+static const uint8_t TILE_GRAY = 2;
+
+// is either pixel in the byte something other than black or white
+static bool has_gray(uint8_t pixels)
+{
+  uint8_t low = pixels & 0x0F;
+  uint8_t high = pixels >> 4;
+  return (low != 0 && low != 0x0F) || (high != 0 && high != 0x0F);
+}
+
+FrameDiff::FrameDiff(int width, int height, int tile_size, size_t max_regions)
+    : m_width(width), m_height(height), m_tile_size(tile_size), m_max_regions(max_regions)
+{
+  m_tiles_across = (width + tile_size - 1) / tile_size;
+  m_tiles_down = (height + tile_size - 1) / tile_size;
+  m_tiles.resize(m_tiles_across * m_tiles_down);
+}
+
+uint8_t FrameDiff::compare_tile(const uint8_t *previous, const uint8_t *current, int tile_x, int tile_y)
+{
+  int row_bytes = m_width / 2;
+  int x_start = tile_x * m_tile_size / 2;
+  int x_bytes = std::min(m_tile_size, m_width - tile_x * m_tile_size) / 2;
+  int y_start = tile_y * m_tile_size;
+  int y_end = std::min(y_start + m_tile_size, m_height);
+  int y = y_start;
+  // find the first row that is different
+  while (y < y_end && memcmp(previous + y * row_bytes + x_start, current + y * row_bytes + x_start, x_bytes) == 0)
+  {
+    y++;
+  }
+  if (y == y_end)
+  {
+    return TILE_UNCHANGED;
+  }
+  // it's changed - now see if there is any gray in the new contents
+  for (y = y_start; y < y_end; y++)
+  {
+    const uint8_t *row = current + y * row_bytes + x_start;
+    for (int x = 0; x < x_bytes; x++)
+    {
+      if (has_gray(row[x]))
+      {
+        return TILE_GRAY;
+      }
+    }
+  }
+  return TILE_CHANGED;
+}
+
+static bool overlaps(const DirtyRegion &a, const DirtyRegion &b)
+{
+  return a.x <= b.x + b.width && b.x <= a.x + a.width && a.y <= b.y + b.height && b.y <= a.y + a.height;
+}
+
+static DirtyRegion combine(const DirtyRegion &a, const DirtyRegion &b)
+{
+  DirtyRegion result;
+  result.x = std::min(a.x, b.x);
+  result.y = std::min(a.y, b.y);
+  result.width = std::max(a.x + a.width, b.x + b.width) - result.x;
+  result.height = std::max(a.y + a.height, b.y + b.height) - result.y;
+  result.needs_gray = a.needs_gray || b.needs_gray;
+  return result;
+}
+
+void FrameDiff::merge_regions(std::vector<DirtyRegion> &regions)
+{
+  bool merged = true;
+  while (merged)
+  {
+    merged = false;
+    // regions that touch might as well be updated together
+    for (size_t i = 0; i < regions.size() && !merged; i++)
+    {
+      for (size_t j = i + 1; j < regions.size() && !merged; j++)
+      {
+        if (overlaps(regions[i], regions[j]))
+        {
+          regions[i] = combine(regions[i], regions[j]);
+          regions.erase(regions.begin() + j);
+          merged = true;
+        }
+      }
+    }
+    // each update has a fixed cost so if there are too many then join up the pair that adds the least area
+    if (!merged && regions.size() > m_max_regions)
+    {
+      size_t best_i = 0, best_j = 1;
+      long best_cost = -1;
+      for (size_t i = 0; i < regions.size(); i++)
+      {
+        for (size_t j = i + 1; j < regions.size(); j++)
+        {
+          DirtyRegion joined = combine(regions[i], regions[j]);
+          long cost = (long)joined.width * joined.height - (long)regions[i].width * regions[i].height - (long)regions[j].width * regions[j].height;
+          if (best_cost < 0 || cost < best_cost)
+          {
+            best_cost = cost;
+            best_i = i;
+            best_j = j;
+          }
+        }
+      }
+      regions[best_i] = combine(regions[best_i], regions[best_j]);
+      regions.erase(regions.begin() + best_j);
+      merged = true;
+    }
+  }
+}
+
+bool FrameDiff::diff(const uint8_t *previous, const uint8_t *current, std::vector<DirtyRegion> &regions)
+{
+  regions.clear();
+  for (int tile_y = 0; tile_y < m_tiles_down; tile_y++)
+  {
+    for (int tile_x = 0; tile_x < m_tiles_across; tile_x++)
+    {
+      m_tiles[tile_y * m_tiles_across + tile_x] = compare_tile(previous, current, tile_x, tile_y);
+    }
+  }
+  // flood fill each group of changed tiles to get its bounding box
+  std::vector<int> stack;
+  for (int start = 0; start < (int)m_tiles.size(); start++)
+  {
+    if (m_tiles[start] == TILE_UNCHANGED)
+    {
+      continue;
+    }
+    int min_x = m_tiles_across, min_y = m_tiles_down, max_x = -1, max_y = -1;
+    bool needs_gray = false;
+    stack.push_back(start);
+    while (!stack.empty())
+    {
+      int index = stack.back();
+      stack.pop_back();
+      if (m_tiles[index] == TILE_UNCHANGED)
+      {
+        continue;
+      }
+      needs_gray |= m_tiles[index] == TILE_GRAY;
+      // mark it as done
+      m_tiles[index] = TILE_UNCHANGED;
+      int tile_x = index % m_tiles_across;
+      int tile_y = index / m_tiles_across;
+      min_x = std::min(min_x, tile_x);
+      max_x = std::max(max_x, tile_x);
+      min_y = std::min(min_y, tile_y);
+      max_y = std::max(max_y, tile_y);
+      if (tile_x > 0)
+        stack.push_back(index - 1);
+      if (tile_x < m_tiles_across - 1)
+        stack.push_back(index + 1);
+      if (tile_y > 0)
+        stack.push_back(index - m_tiles_across);
+      if (tile_y < m_tiles_down - 1)
+        stack.push_back(index + m_tiles_across);
+    }
+    DirtyRegion region;
+    region.x = min_x * m_tile_size;
+    region.y = min_y * m_tile_size;
+    region.width = std::min((max_x + 1) * m_tile_size, m_width) - region.x;
+    region.height = std::min((max_y + 1) * m_tile_size, m_height) - region.y;
+    region.needs_gray = needs_gray;
+    regions.push_back(region);
+  }
+  merge_regions(regions);
+  return !regions.empty();
+}
+
+void FrameDiff::copy_region(const DirtyRegion &region, const uint8_t *from, uint8_t *to)
+{
+  int row_bytes = m_width / 2;
+  for (int y = region.y; y < region.y + region.height; y++)
+  {
+    memcpy(to + y * row_bytes + region.x / 2, from + y * row_bytes + region.x / 2, (region.width + 1) / 2);
+  }
+}
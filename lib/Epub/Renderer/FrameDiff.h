@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// a rectangle of the frame buffer that has changed
+typedef struct
+{
+  int x;
+  int y;
+  int width;
+  int height;
+  // there are shades of gray in the new content so it needs a full gray scale update (GC16),
+  // otherwise it's just black and white and the fast update (DU) will do
+  bool needs_gray;
+} DirtyRegion;
+
+// Works out which parts of a 4bpp frame buffer have changed since the last frame so that only
+// those parts of the screen need to be updated. The frame is split into tiles and the changed
+// tiles are joined together into a small number of rectangles.
+class FrameDiff
+{
+private:
+  int m_width;
+  int m_height;
+  int m_tile_size;
+  int m_tiles_across;
+  int m_tiles_down;
+  size_t m_max_regions;
+  // scratch space for marking the tiles - 0 is unchanged, 1 is changed, 2 is changed and gray
+  std::vector<uint8_t> m_tiles;
+
+  uint8_t compare_tile(const uint8_t *previous, const uint8_t *current, int tile_x, int tile_y);
+  void merge_regions(std::vector<DirtyRegion> &regions);
+
+public:
+  // width and height are in pixels with two pixels per byte - the tile size must be even
+  FrameDiff(int width, int height, int tile_size = 32, size_t max_regions = 8);
+  // fill in the regions that are different between the two frames - returns false if nothing has changed
+  bool diff(const uint8_t *previous, const uint8_t *current, std::vector<DirtyRegion> &regions);
+  // the number of bytes of the frame buffer that cover a region
+  static size_t get_region_bytes(const DirtyRegion &region)
+  {
+    return (size_t)(region.width + 1) / 2 * region.height;
+  }
+  // copy a region from one frame to another - e.g. once it's been sent to the display
+  void copy_region(const DirtyRegion &region, const uint8_t *from, uint8_t *to);
+};
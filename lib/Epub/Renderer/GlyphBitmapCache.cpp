@@ -0,0 +1,111 @@
+#ifndef UNIT_TEST
+#include <esp_heap_caps.h>
+#include <esp_log.h>
+#else
+#define ESP_LOGE(args...)
+#endif
+#include <stdlib.h>
+#include "miniz.h"
+#include "GlyphBitmapCache.h"
+
+static const char *TAG = "GLYPHS";
+
+// put the bitmaps in PSRAM if we have it - they are only read when drawing
+static uint8_t *allocate_bitmap(size_t size)
+{
+#ifndef UNIT_TEST
+  uint8_t *bitmap = (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+  if (bitmap)
+  {
+    return bitmap;
+  }
+#endif
+  return (uint8_t *)malloc(size);
+}
+
+GlyphBitmapCache::GlyphBitmapCache(size_t capacity) : m_capacity(capacity)
+{
+}
+
+GlyphBitmapCache::~GlyphBitmapCache()
+{
+  clear();
+  tinfl_decompressor_free(m_decompressor);
+}
+
+void GlyphBitmapCache::clear()
+{
+  for (auto &cached : m_bitmaps)
+  {
+    free(cached.bitmap);
+  }
+  m_bitmaps.clear();
+  m_index.clear();
+  m_bytes_used = 0;
+}
+
+void GlyphBitmapCache::evict()
+{
+  CachedBitmap &oldest = m_bitmaps.back();
+  m_bytes_used -= oldest.size;
+  m_index.erase(oldest.key);
+  free(oldest.bitmap);
+  m_bitmaps.pop_back();
+  m_evictions++;
+}
+
+bool GlyphBitmapCache::decompress(const uint8_t *compressed, size_t compressed_size, uint8_t *bitmap, size_t bitmap_size)
+{
+  if (!m_decompressor)
+  {
+    m_decompressor = tinfl_decompressor_alloc();
+    if (!m_decompressor)
+    {
+      ESP_LOGE(TAG, "Failed to allocate the decompressor");
+      return false;
+    }
+  }
+  tinfl_init(m_decompressor);
+  size_t in_size = compressed_size;
+  size_t out_size = bitmap_size;
+  tinfl_status status = tinfl_decompress(m_decompressor, compressed, &in_size, bitmap, bitmap, &out_size,
+                                         TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+  return status == TINFL_STATUS_DONE && out_size == bitmap_size;
+}
+
+const uint8_t *GlyphBitmapCache::get_bitmap(const void *font, uint32_t code_point,
+                                            const uint8_t *compressed, size_t compressed_size, size_t bitmap_size)
+{
+  GlyphKey key = {font, code_point};
+  auto found = m_index.find(key);
+  if (found != m_index.end())
+  {
+    m_hits++;
+    // move it to the front so it's the last thing to be thrown away
+    m_bitmaps.splice(m_bitmaps.begin(), m_bitmaps, found->second);
+    return found->second->bitmap;
+  }
+  m_misses++;
+  // glyphs with no pixels still need a valid pointer
+  uint8_t *bitmap = allocate_bitmap(bitmap_size > 0 ? bitmap_size : 1);
+  if (!bitmap)
+  {
+    ESP_LOGE(TAG, "Failed to allocate %d bytes for glyph", bitmap_size);
+    return nullptr;
+  }
+  if (!decompress(compressed, compressed_size, bitmap, bitmap_size))
+  {
+    ESP_LOGE(TAG, "Failed to decompress glyph %d", code_point);
+    free(bitmap);
+    return nullptr;
+  }
+  // make space - the new bitmap always goes in even if it is bigger than the whole cache
+  while (!m_bitmaps.empty() && m_bytes_used + bitmap_size > m_capacity)
+  {
+    evict();
+  }
+  m_bitmaps.push_front({key, bitmap, bitmap_size});
+  m_index[key] = m_bitmaps.begin();
+  m_bytes_used += bitmap_size;
+  return bitmap;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <list>
+#include <unordered_map>
+
+struct tinfl_decompressor_tag;
+
+// Keeps the most recently drawn glyph bitmaps decompressed so that drawing a page doesn't inflate
+// the same few dozen glyphs hundreds of times. The bitmaps live in PSRAM if there is any.
+class GlyphBitmapCache
+{
+private:
+  typedef struct GlyphKey
+  {
+    const void *font;
+    uint32_t code_point;
+    bool operator==(const GlyphKey &other) const
+    {
+      return font == other.font && code_point == other.code_point;
+    }
+  } GlyphKey;
+  struct GlyphKeyHash
+  {
+    size_t operator()(const GlyphKey &key) const
+    {
+      return (uintptr_t)key.font * 31 + key.code_point;
+    }
+  };
+  typedef struct
+  {
+    GlyphKey key;
+    uint8_t *bitmap;
+    size_t size;
+  } CachedBitmap;
+
+  // most recently used at the front
+  std::list<CachedBitmap> m_bitmaps;
+  std::unordered_map<GlyphKey, std::list<CachedBitmap>::iterator, GlyphKeyHash> m_index;
+  size_t m_capacity;
+  size_t m_bytes_used = 0;
+  // kept around so we don't need the decompressor on the stack for every glyph
+  tinfl_decompressor_tag *m_decompressor = nullptr;
+
+  size_t m_hits = 0;
+  size_t m_misses = 0;
+  size_t m_evictions = 0;
+
+  bool decompress(const uint8_t *compressed, size_t compressed_size, uint8_t *bitmap, size_t bitmap_size);
+  void evict();
+
+public:
+  GlyphBitmapCache(size_t capacity = 128 * 1024);
+  ~GlyphBitmapCache();
+  // get the decompressed bitmap for a glyph - the font is just used to tell glyphs apart. The
+  // bitmap is only valid until the next call. Returns nullptr if the glyph could not be decompressed.
+  const uint8_t *get_bitmap(const void *font, uint32_t code_point,
+                            const uint8_t *compressed, size_t compressed_size, size_t bitmap_size);
+  // throw away all the bitmaps
+  void clear();
+
+  size_t get_hits() { return m_hits; }
+  size_t get_misses() { return m_misses; }
+  size_t get_evictions() { return m_evictions; }
+  size_t get_bytes_used() { return m_bytes_used; }
+  size_t get_capacity() { return m_capacity; }
+  void reset_stats()
+  {
+    m_hits = 0;
+    m_misses = 0;
+    m_evictions = 0;
+  }
+};
@@ -0,0 +1,107 @@
+#include "GlyphWidthCache.h"
+#include "utf8.h"
+
+GlyphWidthCache::GlyphWidthCache(GlyphLookup lookup) : m_lookup(lookup)
+{
+  for (int i = 0; i < TABLE_SIZE; i++)
+  {
+    uint32_t code_point = i < LATIN_END - LATIN_START ? LATIN_START + i : PUNCTUATION_START + i - (LATIN_END - LATIN_START);
+    CachedGlyph &cached = m_table[i];
+    GlyphMetrics metrics;
+    if (!m_lookup(code_point, &metrics))
+    {
+      cached.state = GLYPH_MISSING;
+    }
+    else if (metrics.advance_x < 0 || metrics.advance_x > UINT8_MAX ||
+             metrics.left < INT8_MIN || metrics.left > INT8_MAX ||
+             metrics.width < 0 || metrics.width > UINT8_MAX)
+    {
+      cached.state = GLYPH_UNCACHED;
+    }
+    else
+    {
+      cached.state = GLYPH_PRESENT;
+      cached.advance_x = metrics.advance_x;
+      cached.left = metrics.left;
+      cached.width = metrics.width;
+    }
+  }
+}
+
+int GlyphWidthCache::get_table_index(uint32_t code_point)
+{
+  if (code_point >= LATIN_START && code_point < LATIN_END)
+  {
+    return code_point - LATIN_START;
+  }
+  if (code_point >= PUNCTUATION_START && code_point < PUNCTUATION_END)
+  {
+    return (LATIN_END - LATIN_START) + code_point - PUNCTUATION_START;
+  }
+  return -1;
+}
+
+bool GlyphWidthCache::get_metrics(uint32_t code_point, GlyphMetrics *metrics)
+{
+  int index = get_table_index(code_point);
+  if (index < 0 || m_table[index].state == GLYPH_UNCACHED)
+  {
+    return m_lookup(code_point, metrics);
+  }
+  const CachedGlyph &cached = m_table[index];
+  if (cached.state == GLYPH_MISSING)
+  {
+    return false;
+  }
+  metrics->advance_x = cached.advance_x;
+  metrics->left = cached.left;
+  metrics->width = cached.width;
+  return true;
+}
+
+int GlyphWidthCache::get_text_width(const char *text)
+{
+  // this follows the same rules as epd_get_text_bounds - the width runs from the start of the
+  // text (or the leftmost pixel if that is further left) to the rightmost pixel
+  int x = 0;
+  int min_x = 0;
+  int max_x = -1;
+  const uint8_t *p = (const uint8_t *)text;
+  while (*p)
+  {
+    GlyphMetrics metrics;
+    // plain ascii is by far the most common so skip the decoding and the range checks
+    if (*p < 0x80 && *p >= LATIN_START)
+    {
+      const CachedGlyph &cached = m_table[*p++ - LATIN_START];
+      if (cached.state == GLYPH_PRESENT)
+      {
+        int x1 = x + cached.left;
+        int x2 = x1 + cached.width;
+        min_x = x1 < min_x ? x1 : min_x;
+        max_x = x2 > max_x ? x2 : max_x;
+        x += cached.advance_x;
+        continue;
+      }
+      if (cached.state == GLYPH_MISSING || !m_lookup(p[-1], &metrics))
+      {
+        continue;
+      }
+    }
+    else if (!get_metrics(utf8_next_code_point(&p), &metrics))
+    {
+      continue;
+    }
+    int x1 = x + metrics.left;
+    int x2 = x1 + metrics.width;
+    min_x = x1 < min_x ? x1 : min_x;
+    max_x = x2 > max_x ? x2 : max_x;
+    x += metrics.advance_x;
+  }
+  if (!*text)
+  {
+    return 0;
+  }
+  // the renderer takes the left edge away from the width so do the same here
+  return max_x - 2 * min_x;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+
+// the parts of a glyph that affect how wide a piece of text is
+typedef struct
+{
+  int16_t advance_x;
+  int16_t left;
+  int16_t width;
+} GlyphMetrics;
+
+// Measures text using a table of glyph metrics for the commonly used code points so that
+// measuring a word is just a loop over the table instead of searching the font for every
+// character. Anything outside the table is looked up in the font each time.
+class GlyphWidthCache
+{
+public:
+  // get the metrics for a code point - return false if the font has nothing to draw for it
+  typedef std::function<bool(uint32_t code_point, GlyphMetrics *metrics)> GlyphLookup;
+
+private:
+  typedef enum
+  {
+    GLYPH_PRESENT,
+    GLYPH_MISSING,
+    // too big to fit in the table - look it up in the font
+    GLYPH_UNCACHED,
+  } GlyphState;
+  typedef struct
+  {
+    uint8_t advance_x;
+    int8_t left;
+    uint8_t width;
+    uint8_t state;
+  } CachedGlyph;
+
+  GlyphLookup m_lookup;
+  // Basic Latin to Latin Extended-B followed by General Punctuation (quotes, dashes, ellipsis)
+  static const uint32_t LATIN_START = 0x20;
+  static const uint32_t LATIN_END = 0x250;
+  static const uint32_t PUNCTUATION_START = 0x2000;
+  static const uint32_t PUNCTUATION_END = 0x2070;
+  static const int TABLE_SIZE = (LATIN_END - LATIN_START) + (PUNCTUATION_END - PUNCTUATION_START);
+  CachedGlyph m_table[TABLE_SIZE];
+
+  // where a code point lives in the table - -1 if it's not in the table
+  int get_table_index(uint32_t code_point);
+  bool get_metrics(uint32_t code_point, GlyphMetrics *metrics);
+
+public:
+  // the table is filled in straight away so it's safe to use from more than one task
+  GlyphWidthCache(GlyphLookup lookup);
+  // the width of the text in pixels - the text should be UTF-8
+  int get_text_width(const char *text);
+};
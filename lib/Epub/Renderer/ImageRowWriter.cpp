@@ -0,0 +1,51 @@
+#include <string.h>
+#include "ImageRowWriter.h"
+#include "Dither.h"
+#include "Renderer.h"
+
+ImageRowWriter::ImageRowWriter(Renderer *renderer, int x, int y)
+{
+  start(renderer, x, y);
+}
+
+void ImageRowWriter::start(Renderer *renderer, int x, int y)
+{
+  m_renderer = renderer;
+  m_x = x;
+  m_y = y;
+  uint8_t levels[256];
+  int level_count = renderer->get_gray_levels(levels);
+  // a different set of levels needs a new dither
+  if (level_count != m_level_count || memcmp(levels, m_levels, level_count) != 0)
+  {
+    memcpy(m_levels, levels, level_count);
+    m_level_count = level_count;
+    delete m_dither;
+    m_dither = nullptr;
+  }
+  m_dither_started = false;
+}
+
+ImageRowWriter::~ImageRowWriter()
+{
+  delete m_dither;
+}
+
+void ImageRowWriter::write_row(int y, const uint8_t *row, int width)
+{
+  if (m_level_count > 0)
+  {
+    // all the rows are the same width so we can set up the dithering when the first one arrives
+    if (!m_dither_started)
+    {
+      if (!m_dither)
+      {
+        m_dither = new Dither(width, m_levels, m_level_count);
+      }
+      m_dither->start(width);
+      m_dither_started = true;
+    }
+    row = m_dither->dither_row(row);
+  }
+  m_renderer->draw_gray_span(m_x, m_y + y, row, width);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+class Renderer;
+class Dither;
+
+// Draws the rows of a scaled image into the renderer - dithering them first if the
+// display can only show a few gray levels
+class ImageRowWriter
+{
+private:
+  Renderer *m_renderer = nullptr;
+  int m_x = 0;
+  int m_y = 0;
+  uint8_t m_levels[256];
+  int m_level_count = 0;
+  Dither *m_dither = nullptr;
+  bool m_dither_started = false;
+
+public:
+  ImageRowWriter() {}
+  ImageRowWriter(Renderer *renderer, int x, int y);
+  ~ImageRowWriter();
+  // get ready to draw a new image - the dithering buffers are kept from the last image if they fit
+  void start(Renderer *renderer, int x, int y);
+  void write_row(int y, const uint8_t *row, int width);
+};
@@ -0,0 +1,87 @@
+#include <algorithm>
+#include "ImageScaler.h"
+
+// All the coverage calculations are done in units where a source pixel is width (or height)
+// units across and an output pixel is source_width (or source_height) units across. That way
+// the edges of every pixel are at whole numbers.
+
+ImageScaler::ImageScaler(int source_width, int source_height, int width, int height, RowCallback callback)
+    : m_callback(callback)
+{
+  start(source_width, source_height, width, height);
+}
+
+void ImageScaler::start(int source_width, int source_height, int width, int height)
+{
+  m_source_width = source_width;
+  m_source_height = source_height;
+  m_width = std::max(1, std::min(width, source_width));
+  m_height = std::max(1, std::min(height, source_height));
+  m_column.resize(source_width);
+  m_column_weight.resize(source_width);
+  for (int x = 0; x < source_width; x++)
+  {
+    int start = x * m_width;
+    int column = start / source_width;
+    int boundary = (column + 1) * source_width;
+    m_column[x] = column;
+    m_column_weight[x] = std::min(m_width, boundary - start);
+  }
+  m_scaled_row.resize(m_width + 1);
+  m_current_row.assign(m_width, 0);
+  m_next_row.assign(m_width, 0);
+  m_output_row.resize(m_width);
+  m_source_y = 0;
+  m_y = 0;
+}
+
+void ImageScaler::emit_row()
+{
+  // each output pixel has had source_height units of rows added to it
+  uint32_t total = m_source_height * 256;
+  for (int x = 0; x < m_width; x++)
+  {
+    m_output_row[x] = (m_current_row[x] + total / 2) / total;
+  }
+  m_callback(m_y, m_output_row.data(), m_width);
+  m_y++;
+  std::swap(m_current_row, m_next_row);
+  std::fill(m_next_row.begin(), m_next_row.end(), 0);
+}
+
+void ImageScaler::add_row(const uint8_t *row)
+{
+  if (m_source_y >= m_source_height)
+  {
+    return;
+  }
+  // scale the row horizontally
+  std::fill(m_scaled_row.begin(), m_scaled_row.end(), 0);
+  for (int x = 0; x < m_source_width; x++)
+  {
+    int column = m_column[x];
+    uint32_t weight = m_column_weight[x];
+    m_scaled_row[column] += row[x] * weight;
+    // the part of the source pixel that spills into the next column (this is zero at the right hand edge)
+    m_scaled_row[column + 1] += row[x] * (m_width - weight);
+  }
+  // each output pixel has had source_width units of columns added to it - keep 8 bits of fraction
+  for (int x = 0; x < m_width; x++)
+  {
+    m_scaled_row[x] = (m_scaled_row[x] * 256 + m_source_width / 2) / m_source_width;
+  }
+  // now add the row into the output rows it covers
+  int start = m_source_y * m_height;
+  int boundary = (m_y + 1) * m_source_height;
+  uint32_t weight = std::min(m_height, boundary - start);
+  for (int x = 0; x < m_width; x++)
+  {
+    m_current_row[x] += m_scaled_row[x] * weight;
+    m_next_row[x] += m_scaled_row[x] * (m_height - weight);
+  }
+  m_source_y++;
+  if (start + m_height >= boundary)
+  {
+    emit_row();
+  }
+}
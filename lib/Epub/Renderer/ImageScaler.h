@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <functional>
+
+// Shrinks a gray scale image as it is decoded a row at a time. Each output pixel is the average
+// of the area of the source image that it covers (partly covered source pixels count for the part
+// that is covered) so nothing gets skipped and there is no aliasing. It's all integer maths.
+class ImageScaler
+{
+public:
+  // called with each row of the scaled image as soon as it is complete
+  typedef std::function<void(int y, const uint8_t *row, int width)> RowCallback;
+
+private:
+  int m_source_width = 0;
+  int m_source_height = 0;
+  int m_width = 0;
+  int m_height = 0;
+  RowCallback m_callback;
+  // the output column each source column starts in and how much of the source column is in it - the
+  // rest of the source column goes in the next output column
+  std::vector<uint16_t> m_column;
+  std::vector<uint16_t> m_column_weight;
+  // the source row scaled horizontally - in 8.8 fixed point
+  std::vector<uint32_t> m_scaled_row;
+  // the output row we are working on and the one after it
+  std::vector<uint32_t> m_current_row;
+  std::vector<uint32_t> m_next_row;
+  std::vector<uint8_t> m_output_row;
+  int m_source_y = 0;
+  int m_y = 0;
+
+  void emit_row();
+
+public:
+  ImageScaler(RowCallback callback) : m_callback(callback) {}
+  // the image can only be made smaller - the output size is limited to the source size
+  ImageScaler(int source_width, int source_height, int width, int height, RowCallback callback);
+  // get ready to scale a new image - the buffers are reused if they are big enough
+  void start(int source_width, int source_height, int width, int height);
+  // add the next row of the source image - source_width gray pixels
+  void add_row(const uint8_t *row);
+  int get_width() { return m_width; }
+  int get_height() { return m_height; }
+  // the number of rows that have been output so far
+  int get_rows_written() { return m_y; }
+};
@@ -8,49 +8,90 @@
 #define ESP_LOGE(args...)
 #define ESP_LOGI(args...)
 #endif
+#include <algorithm>
 #include "JPEGHelper.h"
 #include "Renderer.h"
+#include "ImageScaler.h"
+#include "ImageRowWriter.h"
 
 static const char *TAG = "JPG";
 
 #define POOL_SIZE 32768
 
+JPEGHelper::~JPEGHelper()
+{
+  free(m_pool);
+}
+
+static inline int read_be16(const uint8_t *data)
+{
+  return (data[0] << 8) | data[1];
+}
+
 bool JPEGHelper::get_size(const uint8_t *data, size_t data_size, int *width, int *height)
 {
-  void *pool = malloc(POOL_SIZE);
-  if (!pool)
+  // the size is in the start of frame segment - we just walk the segments until we find it without
+  // setting up the decoder. This works on just the start of the file.
+  if (data_size < 4 || data[0] != 0xFF || data[1] != 0xD8)
   {
-    ESP_LOGE(TAG, "Failed to allocate memory for pool");
+    ESP_LOGE(TAG, "Not a JPEG file");
     return false;
   }
-  m_data = data;
-  m_data_pos = 0;
-  // decode the jpeg and get its size
-  JDEC dec;
-  JRESULT res = jd_prepare(&dec, read_jpeg_data, pool, POOL_SIZE, this);
-  if (res == JDR_OK)
-  {
-    ESP_LOGI(TAG, "JPEG Decoded - size %d,%d", dec.width, dec.height);
-    *width = dec.width;
-    *height = dec.height;
-  }
-  else
+  size_t pos = 2;
+  while (pos + 4 <= data_size)
   {
-    ESP_LOGE(TAG, "JPEG Decode failed - %d", res);
-    return false;
+    if (data[pos] != 0xFF)
+    {
+      ESP_LOGE(TAG, "Invalid JPEG marker at %d", pos);
+      return false;
+    }
+    uint8_t marker = data[pos + 1];
+    // markers can be padded with any number of 0xFF bytes
+    if (marker == 0xFF)
+    {
+      pos++;
+      continue;
+    }
+    // these markers don't have a length
+    if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8))
+    {
+      pos += 2;
+      continue;
+    }
+    // any start of frame apart from DHT, JPG and DAC which share the range
+    if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+    {
+      if (pos + 9 > data_size)
+      {
+        return false;
+      }
+      *height = read_be16(&data[pos + 5]);
+      *width = read_be16(&data[pos + 7]);
+      ESP_LOGI(TAG, "JPEG size %d,%d", *width, *height);
+      return *width > 0 && *height > 0;
+    }
+    // we've hit the image data or the end without finding the size
+    if (marker == 0xDA || marker == 0xD9)
+    {
+      ESP_LOGE(TAG, "No JPEG start of frame");
+      return false;
+    }
+    pos += 2 + read_be16(&data[pos + 2]);
   }
-  free(pool);
-  m_data = nullptr;
-  m_data_pos = 0;
-  return true;
+  return false;
 }
+
 bool JPEGHelper::render(const uint8_t *data, size_t data_size, Renderer *renderer, int x_pos, int y_pos, int width, int height)
 {
   this->renderer = renderer;
   this->y_pos = y_pos;
   this->x_pos = x_pos;
-  void *pool = malloc(POOL_SIZE);
-  if (!pool)
+  // the decoder's work area is kept for the next image
+  if (!m_pool)
+  {
+    m_pool = malloc(POOL_SIZE);
+  }
+  if (!m_pool)
   {
     ESP_LOGE(TAG, "Failed to allocate memory for pool");
     return false;
@@ -59,37 +100,55 @@ bool JPEGHelper::render(const uint8_t *data, size_t data_size, Renderer *rendere
   m_data_pos = 0;
   // decode the jpeg and get its size
   JDEC dec;
-  JRESULT res = jd_prepare(&dec, read_jpeg_data, pool, POOL_SIZE, this);
+  JRESULT res = jd_prepare(&dec, read_jpeg_data, m_pool, POOL_SIZE, this);
   if (res == JDR_OK)
   {
-    this->x_scale = std::min(1.0f, float(width) / float(dec.width));
-    this->y_scale = std::min(1.0f, float(height) / float(dec.height));
-
+    // let the decoder do as much of the shrinking as it can (it can only do powers of 2) without
+    // going below the size we want - the scaler does the rest properly
     scale_factor = 0;
-    // this doesn't seem to work very well...
-    while (x_scale <= 1.0f && y_scale <= 1.0f && scale_factor <= 3)
+    while (scale_factor < 3 &&
+           (dec.width >> (scale_factor + 1)) >= width &&
+           (dec.height >> (scale_factor + 1)) >= height)
     {
       scale_factor++;
-      x_scale *= 2;
-      y_scale *= 2;
     }
-    scale_factor--;
-    x_scale /= 2;
-    y_scale /= 2;
-
-    ESP_LOGI(TAG, "JPEG Decoded - size %d,%d, scale = %f, %f, %d", dec.width, dec.height, x_scale, y_scale, scale_factor);
-    jd_decomp(&dec, draw_jpeg_function, scale_factor);
+    m_scaled_width = std::max(1, dec.width >> scale_factor);
+    m_scaled_height = std::max(1, dec.height >> scale_factor);
+    m_writer.start(renderer, x_pos, y_pos);
+    m_scaler.start(m_scaled_width, m_scaled_height, width, height);
+    ESP_LOGI(TAG, "JPEG Decoded - size %d,%d, scale = %d, output size %d,%d",
+             dec.width, dec.height, scale_factor, m_scaler.get_width(), m_scaler.get_height());
+    // an MCU is at most 16 rows high
+    m_band.resize(m_scaled_width * 16);
+    m_band_top = 0;
+    m_band_height = 0;
+    res = jd_decomp(&dec, draw_jpeg_function, scale_factor);
+    flush_band();
+    if (res != JDR_OK)
+    {
+      ESP_LOGE(TAG, "JPEG Decode failed - %d", res);
+    }
   }
   else
   {
     ESP_LOGE(TAG, "JPEG Decode failed - %d", res);
   }
-  free(pool);
   m_data = nullptr;
   m_data_pos = 0;
   return res == JDR_OK;
 }
 
+void JPEGHelper::flush_band()
+{
+  for (int y = 0; y < m_band_height; y++)
+  {
+    m_scaler.add_row(&m_band[y * m_scaled_width]);
+  }
+  m_band_height = 0;
+  // feed the watchdog
+  vTaskDelay(1);
+}
+
 size_t read_jpeg_data(
     JDEC *jdec,    /* Pointer to the decompression object */
     uint8_t *buff, /* Pointer to buffer to store the read data */
@@ -110,9 +169,6 @@ size_t read_jpeg_data(
   return ndata;
 }
 
-static int last_y = 0;
-
-// this is not a very efficient way of doing this - could be improved considerably
 int draw_jpeg_function(
     JDEC *jdec,   /* Pointer to the decompression object */
     void *bitmap, /* Bitmap to be output */
@@ -120,24 +176,27 @@ int draw_jpeg_function(
 )
 {
   JPEGHelper *context = (JPEGHelper *)jdec->device;
-  Renderer *renderer = (Renderer *)context->renderer;
-  uint8_t *rgb = (uint8_t *)bitmap;
-  // this is a bit of dirty hack to only delay every line to feed the watchdog
-  if (rect->top != last_y)
+  const uint8_t *rgb = (const uint8_t *)bitmap;
+  // the MCUs come left to right and then top to bottom so a new top means the last band is complete
+  if (rect->top != context->m_band_top)
   {
-    last_y = rect->top;
-    vTaskDelay(1);
+    context->flush_band();
+    context->m_band_top = rect->top;
   }
-
-  for (int y = rect->top; y <= rect->bottom; y++)
+  int band_height = std::min(rect->bottom - rect->top + 1, 16);
+  context->m_band_height = std::max(context->m_band_height, band_height);
+  for (int y = 0; y < band_height; y++)
   {
+    uint8_t *gray = &context->m_band[y * context->m_scaled_width];
     for (int x = rect->left; x <= rect->right; x++)
     {
       uint8_t r = *rgb++;
       uint8_t g = *rgb++;
       uint8_t b = *rgb++;
-      uint32_t gray = (r * 38 + g * 75 + b * 15) >> 7;
-      renderer->draw_pixel(context->x_pos + x * context->x_scale, context->y_pos + y * context->y_scale, gray);
+      if (x < context->m_scaled_width)
+      {
+        gray[x] = (r * 38 + g * 75 + b * 15) >> 7;
+      }
     }
   }
   return 1;
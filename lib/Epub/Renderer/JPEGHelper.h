@@ -2,7 +2,10 @@
 
 #include <tjpgd.h>
 #include <string>
+#include <vector>
 #include "ImageHelper.h"
+#include "ImageScaler.h"
+#include "ImageRowWriter.h"
 
 size_t read_jpeg_data(
     JDEC *jdec,    /* Pointer to the decompression object */
@@ -19,9 +22,9 @@ int draw_jpeg_function(
 class JPEGHelper : public ImageHelper
 {
 private:
-  float x_scale;
-  float y_scale;
   int scale_factor;
+  // the decoder's work area - allocated on first use and kept for the next image
+  void *m_pool = nullptr;
   // temporary vars used for the JPEG callbacks
   const uint8_t *m_data;
   size_t m_data_pos;
@@ -29,6 +32,17 @@ private:
   Renderer *renderer;
   int x_pos;
   int y_pos;
+  // the decoder gives us the image a band of MCUs at a time - we collect the band in gray scale
+  // and then feed it a row at a time into the scaler
+  int m_scaled_width;
+  int m_scaled_height;
+  int m_band_top;
+  int m_band_height;
+  std::vector<uint8_t> m_band;
+  ImageScaler m_scaler;
+  ImageRowWriter m_writer;
+
+  void flush_band();
 
   friend size_t read_jpeg_data(
       JDEC *jdec,    /* Pointer to the decompression object */
@@ -43,6 +57,10 @@ private:
   );
 
 public:
+  JPEGHelper() : m_scaler([this](int y, const uint8_t *row, int width)
+                          { m_writer.write_row(y, row, width); }) {}
+  ~JPEGHelper();
+  // only looks at the headers so data can just be the start of the file
   bool get_size(const uint8_t *data, size_t data_size, int *width, int *height);
   bool render(const uint8_t *data, size_t data_size, Renderer *renderer, int x_pos, int y_pos, int width, int height);
 };
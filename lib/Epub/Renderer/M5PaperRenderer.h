@@ -26,25 +26,56 @@ public:
     driver.SetColorReverse(true);
 
     m_frame_buffer = (uint8_t *)malloc(EPD_WIDTH * EPD_HEIGHT / 2);
+    // without a copy of what's on the screen we just update the whole of it every time
+    m_previous_frame = (uint8_t *)malloc(EPD_WIDTH * EPD_HEIGHT / 2);
+    if (!m_previous_frame)
+    {
+      ESP_LOGE("M5P", "Not enough memory for the previous frame - doing full updates");
+    }
     clear_screen();
+    if (m_previous_frame)
+    {
+      memset(m_previous_frame, 0xFF, EPD_WIDTH * EPD_HEIGHT / 2);
+    }
   }
   ~M5PaperRenderer()
   {
-    // TODO: cleanup and shutdown?
+    free(m_previous_frame);
+    free(m_frame_buffer);
   }
   void flush_display()
   {
+    if (m_previous_frame)
+    {
+      EpdiyFrameBufferRenderer::flush_display();
+      return;
+    }
     driver.WriteFullGram4bpp(m_frame_buffer);
     driver.UpdateFull(needs_gray_flush ? UPDATE_MODE_GC16 : UPDATE_MODE_DU);
     needs_gray_flush = false;
   }
+  void start_update()
+  {
+    // there's probably a way of only sending the data we need to send for the areas
+    driver.WriteFullGram4bpp(m_frame_buffer);
+  }
+  void update_area(int x, int y, int width, int height, bool needs_gray)
+  {
+    // don't forget we're rotated
+    driver.UpdateArea(y, x, height, width, needs_gray ? UPDATE_MODE_GC16 : UPDATE_MODE_DU);
+  }
   void flush_area(int x, int y, int width, int height)
   {
-    // there's probably a way of only sending the data we need to send for the area
     driver.WriteFullGram4bpp(m_frame_buffer);
     // don't forger we're rotated
     driver.UpdateArea(y, x, height, width, needs_gray_flush ? UPDATE_MODE_GC16 : UPDATE_MODE_DU);
     needs_gray_flush = false;
+    // the area is on the screen now
+    DirtyRegion region = {.x = y, .y = EPD_HEIGHT - x - width, .width = height, .height = width, .needs_gray = false};
+    if (m_previous_frame && region.x >= 0 && region.y >= 0 && region.x + region.width <= EPD_WIDTH && region.y + region.height <= EPD_HEIGHT)
+    {
+      m_frame_diff.copy_region(region, m_frame_buffer, m_previous_frame);
+    }
   }
   virtual bool hydrate()
   {
@@ -54,6 +85,10 @@ public:
       ESP_LOGI("M5P", "Hydrated EPD");
       driver.WriteFullGram4bpp(m_frame_buffer);
       driver.UpdateFull(UPDATE_MODE_GC16);
+      if (m_previous_frame)
+      {
+        memcpy(m_previous_frame, m_frame_buffer, EPD_WIDTH * EPD_HEIGHT / 2);
+      }
       return true;
     }
     else
@@ -67,8 +102,13 @@ public:
   {
     ESP_LOGI("M5P", "Full clear");
     clear_screen();
-    // flushing to white
+    // flushing the whole screen to white
     needs_gray_flush = false;
-    flush_display();
+    driver.WriteFullGram4bpp(m_frame_buffer);
+    driver.UpdateFull(UPDATE_MODE_DU);
+    if (m_previous_frame)
+    {
+      memcpy(m_previous_frame, m_frame_buffer, EPD_WIDTH * EPD_HEIGHT / 2);
+    }
   };
 };
\ No newline at end of file
@@ -0,0 +1,463 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include <epd_driver.h>
+#include "Renderer.h"
+#include "GlyphWidthCache.h"
+#include "GlyphBitmapCache.h"
+#include "EpdFontSignature.h"
+#include "utf8.h"
+#include "miniz.h"
+
+// Draws into a 4bpp frame buffer in memory with the real fonts - the same way as the epdiy
+// renderers but without a display or any rotation. The frame is stored a row at a time with two
+// pixels per byte and the first pixel in the low nibble. Used on the host for benchmarking the
+// drawing code and for comparing rendered pages pixel for pixel.
+class MemoryFrameBufferRenderer : public Renderer
+{
+private:
+  const EpdFont *m_fonts[4];
+  int m_width;
+  int m_height;
+  // two pixels per byte, odd widths round up
+  int m_stride;
+  std::vector<uint8_t> m_frame_buffer;
+  uint8_t m_gamma_curve[256];
+  bool m_needs_gray_flush = false;
+  GlyphWidthCache *m_width_caches[4] = {nullptr};
+  GlyphBitmapCache m_glyph_cache;
+  const uint8_t *m_busy_image;
+  int m_busy_image_width;
+  int m_busy_image_height;
+  int m_busy_count = 0;
+
+  const EpdFont *get_font(bool bold, bool italic)
+  {
+    return m_fonts[(bold ? BOLD_SPAN : 0) | (italic ? ITALIC_SPAN : 0)];
+  }
+  // set a pixel without any gamma correction or margins - anything off the frame is ignored
+  void set_pixel(int x, int y, uint8_t color)
+  {
+    if (x < 0 || x >= m_width || y < 0 || y >= m_height)
+    {
+      return;
+    }
+    uint8_t *pixel = &m_frame_buffer[y * m_stride + x / 2];
+    *pixel = x & 1 ? (*pixel & 0x0F) | (color & 0xF0) : (*pixel & 0xF0) | (color >> 4);
+  }
+  void draw_line(int x0, int y0, int x1, int y1, uint8_t color)
+  {
+    int dx = abs(x1 - x0);
+    int dy = -abs(y1 - y0);
+    int step_x = x0 < x1 ? 1 : -1;
+    int step_y = y0 < y1 ? 1 : -1;
+    int error = dx + dy;
+    while (true)
+    {
+      set_pixel(x0, y0, color);
+      if (x0 == x1 && y0 == y1)
+      {
+        break;
+      }
+      int error2 = 2 * error;
+      if (error2 >= dy)
+      {
+        error += dy;
+        x0 += step_x;
+      }
+      if (error2 <= dx)
+      {
+        error += dx;
+        y0 += step_y;
+      }
+    }
+  }
+  void draw_glyph(const EpdFont *font, const EpdGlyph *glyph, uint32_t code_point, int x, int y)
+  {
+    int byte_width = (glyph->width + 1) / 2;
+    const uint8_t *bitmap = &font->bitmap[glyph->data_offset];
+    if (font->compressed)
+    {
+      bitmap = m_glyph_cache.get_bitmap(font, code_point, bitmap, glyph->compressed_size, byte_width * glyph->height);
+      if (!bitmap)
+      {
+        return;
+      }
+    }
+    int start_x = x + glyph->left;
+    int start_y = y - glyph->top;
+    for (int glyph_y = 0; glyph_y < glyph->height; glyph_y++)
+    {
+      const uint8_t *row = bitmap + glyph_y * byte_width;
+      for (int glyph_x = 0; glyph_x < glyph->width; glyph_x++)
+      {
+        uint8_t value = glyph_x & 1 ? row[glyph_x / 2] >> 4 : row[glyph_x / 2] & 0xF;
+        if (value)
+        {
+          // black text on a white background
+          set_pixel(start_x + glyph_x, start_y + glyph_y, (15 - value) << 4);
+        }
+      }
+    }
+  }
+
+public:
+  // the busy image is optional - it's a 4bpp image the same as for the epdiy renderers
+  MemoryFrameBufferRenderer(const EpdFont *regular_font, const EpdFont *bold_font,
+                            const EpdFont *italic_font, const EpdFont *bold_italic_font,
+                            int width = 540, int height = 960,
+                            const uint8_t *busy_image = nullptr, int busy_image_width = 0, int busy_image_height = 0)
+      : m_fonts{regular_font, bold_font, italic_font, bold_italic_font}, m_width(width), m_height(height),
+        m_stride((width + 1) / 2), m_frame_buffer(m_stride * height, 0xFF),
+        m_busy_image(busy_image), m_busy_image_width(busy_image_width), m_busy_image_height(busy_image_height)
+  {
+    for (int style = 0; style < 4; style++)
+    {
+      const EpdFont *font = m_fonts[style];
+      m_width_caches[style] = new GlyphWidthCache(
+          [font](uint32_t code_point, GlyphMetrics *metrics)
+          {
+            const EpdGlyph *glyph = epd_get_glyph(font, code_point);
+            if (!glyph)
+            {
+              glyph = epd_get_glyph(font, '?');
+            }
+            if (!glyph)
+            {
+              return false;
+            }
+            metrics->advance_x = glyph->advance_x;
+            metrics->left = glyph->left;
+            metrics->width = glyph->width;
+            return true;
+          });
+    }
+    // the same gamma correction as the display
+    for (int gray_value = 0; gray_value < 256; gray_value++)
+    {
+      m_gamma_curve[gray_value] = round(255 * pow(gray_value / 255.0, 1.0 / 0.8));
+    }
+  }
+  virtual ~MemoryFrameBufferRenderer()
+  {
+    for (auto cache : m_width_caches)
+    {
+      delete cache;
+    }
+  }
+
+  const std::vector<uint8_t> &get_frame_buffer() { return m_frame_buffer; }
+  // the 4 bit value of a pixel - 0 is black and 15 is white
+  uint8_t get_pixel(int x, int y)
+  {
+    uint8_t pixel = m_frame_buffer[y * m_stride + x / 2];
+    return x & 1 ? pixel >> 4 : pixel & 0x0F;
+  }
+  int get_width() { return m_width; }
+  int get_height() { return m_height; }
+  int get_busy_count() { return m_busy_count; }
+  size_t get_glyph_cache_hits() { return m_glyph_cache.get_hits(); }
+  size_t get_glyph_cache_misses() { return m_glyph_cache.get_misses(); }
+
+  // write the frame out as an 8 bit grayscale PGM - returns false if the file can't be written
+  bool dump_pgm(const char *filename)
+  {
+    FILE *fp = fopen(filename, "wb");
+    if (!fp)
+    {
+      return false;
+    }
+    fprintf(fp, "P5\n%d %d\n255\n", m_width, m_height);
+    std::vector<uint8_t> row(m_width);
+    bool success = true;
+    for (int y = 0; y < m_height && success; y++)
+    {
+      for (int x = 0; x < m_width; x++)
+      {
+        row[x] = get_pixel(x, y) * 17;
+      }
+      success = fwrite(row.data(), 1, m_width, fp) == m_width;
+    }
+    return fclose(fp) == 0 && success;
+  }
+  // write the frame out as an 8 bit grayscale PNG
+  bool dump_png(const char *filename)
+  {
+    std::vector<uint8_t> gray(m_width * m_height);
+    for (int y = 0; y < m_height; y++)
+    {
+      for (int x = 0; x < m_width; x++)
+      {
+        gray[y * m_width + x] = get_pixel(x, y) * 17;
+      }
+    }
+    size_t png_size = 0;
+    void *png = tdefl_write_image_to_png_file_in_memory(gray.data(), m_width, m_height, 1, &png_size);
+    if (!png)
+    {
+      return false;
+    }
+    FILE *fp = fopen(filename, "wb");
+    bool success = fp && fwrite(png, 1, png_size, fp) == png_size;
+    if (fp && fclose(fp) != 0)
+    {
+      success = false;
+    }
+    mz_free(png);
+    return success;
+  }
+
+  void show_busy()
+  {
+    m_busy_count++;
+    if (m_busy_image)
+    {
+      show_img((m_width - m_busy_image_width) / 2, (m_height - m_busy_image_height) / 2,
+               m_busy_image_width, m_busy_image_height, m_busy_image);
+      m_needs_gray_flush = true;
+    }
+  }
+  void show_img(int x, int y, int width, int height, const uint8_t *img_buffer)
+  {
+    // 0xE is transparent - the same as the epdiy renderers use
+    int stride = (width + 1) / 2;
+    for (int row = 0; row < height; row++)
+    {
+      for (int column = 0; column < width; column++)
+      {
+        uint8_t pixel = img_buffer[row * stride + column / 2];
+        uint8_t value = column & 1 ? pixel >> 4 : pixel & 0x0F;
+        if (value != 0xE)
+        {
+          set_pixel(x + column, y + row, value << 4);
+        }
+      }
+    }
+  }
+  void needs_gray(uint8_t color)
+  {
+    if (color != 0 && color != 255)
+    {
+      m_needs_gray_flush = true;
+    }
+  }
+  bool has_gray()
+  {
+    return m_needs_gray_flush;
+  }
+  void flush_display()
+  {
+    m_needs_gray_flush = false;
+  }
+  int get_text_width(const char *text, bool bold = false, bool italic = false)
+  {
+    return m_width_caches[(bold ? BOLD_SPAN : 0) | (italic ? ITALIC_SPAN : 0)]->get_text_width(text);
+  }
+  void get_text_widths(const char *const *words, const uint8_t *styles, size_t count, uint16_t *widths)
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      widths[i] = m_width_caches[styles[i] & (BOLD_SPAN | ITALIC_SPAN)]->get_text_width(words[i]);
+    }
+  }
+  void draw_text(int x, int y, const char *text, bool bold = false, bool italic = false)
+  {
+    int ypos = y + get_line_height() + margin_top;
+    int xpos = x + margin_left;
+    const EpdFont *font = get_font(bold, italic);
+    const uint8_t *p = (const uint8_t *)text;
+    while (*p)
+    {
+      uint32_t code_point = utf8_next_code_point(&p);
+      if (code_point == '\n')
+      {
+        xpos = x + margin_left;
+        ypos += font->advance_y;
+        continue;
+      }
+      const EpdGlyph *glyph = epd_get_glyph(font, code_point);
+      if (!glyph)
+      {
+        code_point = '?';
+        glyph = epd_get_glyph(font, code_point);
+      }
+      if (glyph)
+      {
+        draw_glyph(font, glyph, code_point, xpos, ypos);
+        xpos += glyph->advance_x;
+      }
+    }
+  }
+  void draw_rect(int x, int y, int width, int height, uint8_t color = 0)
+  {
+    needs_gray(color);
+    x += margin_left;
+    y += margin_top;
+    draw_line(x, y, x + width - 1, y, color);
+    draw_line(x, y + height - 1, x + width - 1, y + height - 1, color);
+    draw_line(x, y, x, y + height - 1, color);
+    draw_line(x + width - 1, y, x + width - 1, y + height - 1, color);
+  }
+  void fill_rect(int x, int y, int width, int height, uint8_t color = 0)
+  {
+    needs_gray(color);
+    for (int row = y + margin_top; row < y + margin_top + height; row++)
+    {
+      for (int column = x + margin_left; column < x + margin_left + width; column++)
+      {
+        set_pixel(column, row, color);
+      }
+    }
+  }
+  // the circles and triangles ignore the margins - the same as the epdiy renderers
+  void draw_circle(int x, int y, int r, uint8_t color = 0)
+  {
+    needs_gray(color);
+    int dx = r;
+    int dy = 0;
+    int error = 1 - r;
+    while (dx >= dy)
+    {
+      set_pixel(x + dx, y + dy, color);
+      set_pixel(x - dx, y + dy, color);
+      set_pixel(x + dx, y - dy, color);
+      set_pixel(x - dx, y - dy, color);
+      set_pixel(x + dy, y + dx, color);
+      set_pixel(x - dy, y + dx, color);
+      set_pixel(x + dy, y - dx, color);
+      set_pixel(x - dy, y - dx, color);
+      dy++;
+      if (error < 0)
+      {
+        error += 2 * dy + 1;
+      }
+      else
+      {
+        dx--;
+        error += 2 * (dy - dx) + 1;
+      }
+    }
+  }
+  void fill_circle(int x, int y, int r, uint8_t color = 0)
+  {
+    needs_gray(color);
+    for (int dy = -r; dy <= r; dy++)
+    {
+      for (int dx = -r; dx <= r; dx++)
+      {
+        if (dx * dx + dy * dy <= r * r)
+        {
+          set_pixel(x + dx, y + dy, color);
+        }
+      }
+    }
+  }
+  void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint8_t color)
+  {
+    needs_gray(color);
+    draw_line(x0, y0, x1, y1, color);
+    draw_line(x1, y1, x2, y2, color);
+    draw_line(x2, y2, x0, y0, color);
+  }
+  void fill_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint8_t color)
+  {
+    needs_gray(color);
+    // every pixel in the bounding box that is on the inside of all three edges
+    int min_x = std::min(x0, std::min(x1, x2));
+    int max_x = std::max(x0, std::max(x1, x2));
+    int min_y = std::min(y0, std::min(y1, y2));
+    int max_y = std::max(y0, std::max(y1, y2));
+    int area = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+    for (int y = min_y; y <= max_y; y++)
+    {
+      for (int x = min_x; x <= max_x; x++)
+      {
+        int w0 = (x1 - x) * (y2 - y) - (x2 - x) * (y1 - y);
+        int w1 = (x2 - x) * (y0 - y) - (x0 - x) * (y2 - y);
+        int w2 = (x0 - x) * (y1 - y) - (x1 - x) * (y0 - y);
+        if (area >= 0 ? (w0 >= 0 && w1 >= 0 && w2 >= 0) : (w0 <= 0 && w1 <= 0 && w2 <= 0))
+        {
+          set_pixel(x, y, color);
+        }
+      }
+    }
+    draw_triangle(x0, y0, x1, y1, x2, y2, color);
+  }
+  void draw_pixel(int x, int y, uint8_t color)
+  {
+    uint8_t corrected_color = m_gamma_curve[color];
+    needs_gray(corrected_color);
+    set_pixel(x + margin_left, y + margin_top, corrected_color);
+  }
+  void draw_gray_span(int x, int y, const uint8_t *gray, int count)
+  {
+    for (int i = 0; i < count; i++)
+    {
+      uint8_t corrected_color = m_gamma_curve[gray[i]];
+      m_needs_gray_flush |= corrected_color != 0 && corrected_color != 255;
+      set_pixel(x + i + margin_left, y + margin_top, corrected_color);
+    }
+  }
+  int get_gray_levels(uint8_t *levels)
+  {
+    // the middle of the range of grays that the gamma curve maps onto each of the 16 levels
+    int level_count = 0;
+    int start = 0;
+    for (int gray = 1; gray <= 256; gray++)
+    {
+      if (gray == 256 || (m_gamma_curve[gray] >> 4) != (m_gamma_curve[start] >> 4))
+      {
+        levels[level_count++] = start == 0 ? 0 : gray == 256 ? 255 : (start + gray - 1) / 2;
+        start = gray;
+      }
+    }
+    return level_count;
+  }
+  uint8_t get_display_gray(uint8_t gray)
+  {
+    return m_gamma_curve[gray];
+  }
+  void draw_bitmap(int x, int y, int width, int height, const uint8_t *bitmap)
+  {
+    int stride = (width + 1) / 2;
+    for (int row = 0; row < height; row++)
+    {
+      for (int column = 0; column < width; column++)
+      {
+        uint8_t pixel = bitmap[row * stride + column / 2];
+        uint8_t value = column & 1 ? pixel >> 4 : pixel & 0x0F;
+        m_needs_gray_flush |= value != 0 && value != 15;
+        set_pixel(x + column + margin_left, y + row + margin_top, value << 4);
+      }
+    }
+  }
+  void clear_screen()
+  {
+    memset(m_frame_buffer.data(), 0xFF, m_frame_buffer.size());
+  }
+  int get_page_width()
+  {
+    return m_width - (margin_left + margin_right);
+  }
+  int get_page_height()
+  {
+    return m_height - (margin_top + margin_bottom);
+  }
+  int get_space_width()
+  {
+    return epd_get_glyph(m_fonts[0], ' ')->advance_x;
+  }
+  int get_line_height()
+  {
+    return m_fonts[0]->advance_y;
+  }
+  uint32_t get_font_signature()
+  {
+    return get_epd_font_signature(m_fonts, 4);
+  }
+};
@@ -7,81 +7,80 @@
 #define ESP_LOGE(args...)
 #define ESP_LOGI(args...)
 #endif
+#include <string.h>
 #include <PNGdec.h>
 #include "PNGHelper.h"
 #include "Renderer.h"
+#include "PNGLine.h"
 
 static const char *TAG = "PNG";
 
-void convert_rgb_565_to_rgb(uint16_t rgb565, uint8_t *r, uint8_t *g, uint8_t *b)
-{
-  *r = ((rgb565 >> 11) & 0x1F) << 3;
-  *g = ((rgb565 >> 5) & 0x3F) << 2;
-  *b = (rgb565 & 0x1F) << 3;
-}
-
 bool PNGHelper::get_size(const uint8_t *data, size_t data_size, int *width, int *height)
 {
-  int rc = png.openRAM(const_cast<uint8_t *>(data), data_size, NULL);
-  if (rc == PNG_SUCCESS)
-  {
-    ESP_LOGI(TAG, "image specs: (%d x %d), %d bpp, pixel type: %d", png.getWidth(), png.getHeight(), png.getBpp(), png.getPixelType());
-    *width = png.getWidth();
-    *height = png.getHeight();
-    return true;
-    png.close();
-  }
-  else
+  // the size is in the IHDR chunk which always comes straight after the signature - so we can read
+  // it from just the start of the file without setting up the decoder
+  static const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+  if (data_size < 24 || memcmp(data, signature, 8) != 0 || memcmp(data + 12, "IHDR", 4) != 0)
   {
-    ESP_LOGE(TAG, "failed to open png %d", rc);
+    ESP_LOGE(TAG, "failed to find png header");
     return false;
   }
+  *width = (data[16] << 24) | (data[17] << 16) | (data[18] << 8) | data[19];
+  *height = (data[20] << 24) | (data[21] << 16) | (data[22] << 8) | data[23];
+  ESP_LOGI(TAG, "image specs: (%d x %d)", *width, *height);
+  return *width > 0 && *height > 0;
 }
+
 bool PNGHelper::render(const uint8_t *data, size_t data_size, Renderer *renderer, int x_pos, int y_pos, int width, int height)
 {
-  this->renderer = renderer;
-  this->y_pos = y_pos;
-  this->x_pos = x_pos;
   int rc = png.openRAM(const_cast<uint8_t *>(data), data_size, png_draw_callback);
-  if (rc == PNG_SUCCESS)
+  if (rc != PNG_SUCCESS)
   {
-    this->x_scale = std::min(1.0f, float(width) / float(png.getWidth()));
-    this->y_scale = std::min(1.0f, float(height) / float(png.getHeight()));
-    this->last_y = -1;
-    this->tmp_rgb565_buffer = (uint16_t *)malloc(png.getWidth() * 2);
-
-    png.decode(this, PNG_FAST_PALETTE);
-    png.close();
-    free(this->tmp_rgb565_buffer);
-    return true;
+    ESP_LOGE(TAG, "failed to parse png %d", rc);
+    return false;
   }
-  else
+  m_writer.start(renderer, x_pos, y_pos);
+  m_scaler.start(png.getWidth(), png.getHeight(), width, height);
+  ESP_LOGI(TAG, "PNG - size %d,%d, pixel type %d, %d bpp, output size %d,%d",
+           png.getWidth(), png.getHeight(), png.getPixelType(), png.getBpp(), m_scaler.get_width(), m_scaler.get_height());
+  m_gray_line.resize(png.getWidth());
+  m_has_palette_gray = false;
+  m_failed = false;
+  rc = png.decode(this, 0);
+  png.close();
+  if (rc != PNG_SUCCESS || m_failed)
   {
-    ESP_LOGE(TAG, "failed to parse png %d", rc);
+    ESP_LOGE(TAG, "failed to decode png %d", rc);
     return false;
   }
+  return true;
 }
+
 void PNGHelper::draw_callback(PNGDRAW *draw)
 {
-  // work out where we should be drawing this line
-  int y = y_pos + draw->y * y_scale;
-  // only bother to draw if we haven't already drawn to this destination line
-  if (y != last_y)
+  if (m_failed)
+  {
+    return;
+  }
+  // the palette doesn't change so we only need to convert it once
+  if (draw->iPixelType == PNG_PIXEL_INDEXED && !m_has_palette_gray)
+  {
+    png_palette_to_gray(draw->pPalette, draw->iHasAlpha, m_palette_gray);
+    m_has_palette_gray = true;
+  }
+  if (!png_line_to_gray(draw->pPixels, draw->iWidth, draw->iPixelType, draw->iBpp, m_palette_gray, m_gray_line.data()))
+  {
+    ESP_LOGE(TAG, "unsupported pixel type %d, %d bpp", draw->iPixelType, draw->iBpp);
+    m_failed = true;
+    return;
+  }
+  m_scaler.add_row(m_gray_line.data());
+  // feed the watchdog
+  if (draw->y % 16 == 0)
   {
-    // feed the watchdog
     vTaskDelay(1);
-    // get the rgb 565 pixel values                 BKG is in form of 00BBGGRR
-    png.getLineAsRGB565(draw, tmp_rgb565_buffer, 0, 0x00FFFFFF);
-    for (int x = 0; x < png.getWidth() * x_scale; x++)
-    {
-      uint8_t r, g, b;
-      convert_rgb_565_to_rgb(tmp_rgb565_buffer[int(x / x_scale)], &r, &g, &b);
-      uint32_t gray = (r * 38 + g * 75 + b * 15) >> 7;
-      renderer->draw_pixel(x_pos + x, y, gray);
-    }
-    last_y = y;
   }
-};
+}
 
 void png_draw_callback(PNGDRAW *draw)
 {
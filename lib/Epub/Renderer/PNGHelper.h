@@ -1,8 +1,11 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <PNGdec.h>
 #include "ImageHelper.h"
+#include "ImageScaler.h"
+#include "ImageRowWriter.h"
 
 class Renderer;
 
@@ -11,20 +14,23 @@ void png_draw_callback(PNGDRAW *draw);
 class PNGHelper : public ImageHelper
 {
 private:
-  // temporary vars used for the PNG callbacks
-  Renderer *renderer;
-  int x_pos;
-  int y_pos;
-  int last_y;
-  float x_scale;
-  float y_scale;
-  uint16_t *tmp_rgb565_buffer;
+  // temporary vars used for the PNG callbacks - each line is converted to gray and fed into the scaler.
+  // These are kept from one image to the next so we aren't allocating them for every image.
+  ImageScaler m_scaler;
+  ImageRowWriter m_writer;
+  std::vector<uint8_t> m_gray_line;
+  uint8_t m_palette_gray[256];
+  bool m_has_palette_gray;
+  bool m_failed;
 
   PNG png;
 
   friend void png_draw_callback(PNGDRAW *draw);
 
 public:
+  PNGHelper() : m_scaler([this](int y, const uint8_t *row, int width)
+                         { m_writer.write_row(y, row, width); }) {}
+  // only looks at the headers so data can just be the start of the file
   bool get_size(const uint8_t *data, size_t data_size, int *width, int *height);
   bool render(const uint8_t *data, size_t data_size, Renderer *renderer, int x_pos, int y_pos, int width, int height);
   void draw_callback(PNGDRAW *draw);
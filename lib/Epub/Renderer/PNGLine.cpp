@@ -0,0 +1,104 @@
+#include "PNGLine.h"
+
+static inline uint8_t rgb_to_gray(int r, int g, int b)
+{
+  return (r * 38 + g * 75 + b * 15) >> 7;
+}
+
+// blend onto a white background
+static inline uint8_t blend_white(int gray, int alpha)
+{
+  return (gray * alpha + 255 * (255 - alpha) + 127) / 255;
+}
+
+// pull out a sample that is less than 8 bits - they are packed with the first pixel in the top bits
+static inline int get_packed_sample(const uint8_t *pixels, int x, int bits)
+{
+  int per_byte = 8 / bits;
+  int shift = 8 - bits * (x % per_byte + 1);
+  return (pixels[x / per_byte] >> shift) & ((1 << bits) - 1);
+}
+
+void png_palette_to_gray(const uint8_t *palette, bool has_alpha, uint8_t *palette_gray)
+{
+  for (int i = 0; i < 256; i++)
+  {
+    const uint8_t *rgb = &palette[i * 3];
+    palette_gray[i] = rgb_to_gray(rgb[0], rgb[1], rgb[2]);
+    if (has_alpha)
+    {
+      palette_gray[i] = blend_white(palette_gray[i], palette[768 + i]);
+    }
+  }
+}
+
+bool png_line_to_gray(const uint8_t *pixels, int width, int pixel_type, int bits_per_sample,
+                      const uint8_t *palette_gray, uint8_t *gray)
+{
+  // 16 bit samples are big endian so we just use the top byte
+  int bytes_per_sample = bits_per_sample == 16 ? 2 : 1;
+  switch (pixel_type)
+  {
+  case PNG_LINE_GRAYSCALE:
+    if (bits_per_sample < 8)
+    {
+      // scale the sample up to the full 0-255 range
+      int scale = 255 / ((1 << bits_per_sample) - 1);
+      for (int x = 0; x < width; x++)
+      {
+        gray[x] = get_packed_sample(pixels, x, bits_per_sample) * scale;
+      }
+    }
+    else
+    {
+      for (int x = 0; x < width; x++)
+      {
+        gray[x] = pixels[x * bytes_per_sample];
+      }
+    }
+    return true;
+  case PNG_LINE_GRAY_ALPHA:
+    for (int x = 0; x < width; x++)
+    {
+      const uint8_t *pixel = &pixels[x * 2 * bytes_per_sample];
+      gray[x] = blend_white(pixel[0], pixel[bytes_per_sample]);
+    }
+    return true;
+  case PNG_LINE_TRUECOLOR:
+    for (int x = 0; x < width; x++)
+    {
+      const uint8_t *pixel = &pixels[x * 3 * bytes_per_sample];
+      gray[x] = rgb_to_gray(pixel[0], pixel[bytes_per_sample], pixel[2 * bytes_per_sample]);
+    }
+    return true;
+  case PNG_LINE_TRUECOLOR_ALPHA:
+    for (int x = 0; x < width; x++)
+    {
+      const uint8_t *pixel = &pixels[x * 4 * bytes_per_sample];
+      gray[x] = blend_white(rgb_to_gray(pixel[0], pixel[bytes_per_sample], pixel[2 * bytes_per_sample]), pixel[3 * bytes_per_sample]);
+    }
+    return true;
+  case PNG_LINE_INDEXED:
+    if (!palette_gray || bits_per_sample > 8)
+    {
+      return false;
+    }
+    if (bits_per_sample < 8)
+    {
+      for (int x = 0; x < width; x++)
+      {
+        gray[x] = palette_gray[get_packed_sample(pixels, x, bits_per_sample)];
+      }
+    }
+    else
+    {
+      for (int x = 0; x < width; x++)
+      {
+        gray[x] = palette_gray[pixels[x]];
+      }
+    }
+    return true;
+  default:
+    return false;
+  }
+}
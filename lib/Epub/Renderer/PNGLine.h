@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+// the PNG colour types - these match the PNG_PIXEL_ values in PNGdec
+typedef enum
+{
+  PNG_LINE_GRAYSCALE = 0,
+  PNG_LINE_TRUECOLOR = 2,
+  PNG_LINE_INDEXED = 3,
+  PNG_LINE_GRAY_ALPHA = 4,
+  PNG_LINE_TRUECOLOR_ALPHA = 6,
+} PNG_LINE_TYPE;
+
+// Works out the gray value of each palette entry. The palette is 256 RGB triplets followed by 256
+// alpha values (the same layout as PNGdec uses). Transparent colours are blended onto white.
+void png_palette_to_gray(const uint8_t *palette, bool has_alpha, uint8_t *palette_gray);
+
+// Converts a decoded line of a PNG straight to 8 bit gray scale working on the pixels in whatever
+// format the PNG stores them in. Transparent pixels are blended onto white. palette_gray comes from
+// png_palette_to_gray and is only needed for indexed images. Returns false if the format is not supported.
+bool png_line_to_gray(const uint8_t *pixels, int width, int pixel_type, int bits_per_sample,
+                      const uint8_t *palette_gray, uint8_t *gray);
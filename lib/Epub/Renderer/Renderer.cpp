@@ -1,6 +1,7 @@
 #include "Renderer.h"
 #include "JPEGHelper.h"
 #include "PNGHelper.h"
+#include "../Trace/Trace.h"
 #ifndef UNIT_TEST
 #include <esp_log.h>
 #else
@@ -40,6 +41,8 @@ ImageHelper *Renderer::get_image_helper(const std::string &filename, const uint8
 
 void Renderer::draw_image(const std::string &filename, const uint8_t *data, size_t data_size, int x, int y, int width, int height)
 {
+  TRACE_STAGE("image decode");
+  std::lock_guard<std::mutex> lock(image_helper_mutex);
   ImageHelper *helper = get_image_helper(filename, data, data_size);
   if (!helper ||
       !helper->render(data, data_size, this, x, y, width, height))
@@ -51,6 +54,9 @@ void Renderer::draw_image(const std::string &filename, const uint8_t *data, size
 
 bool Renderer::get_image_size(const std::string &filename, const uint8_t *data, size_t data_size, int *width, int *height)
 {
+  TRACE_SCOPE("image size");
+  // sections can be layed out in the background while we are drawing
+  std::lock_guard<std::mutex> lock(image_helper_mutex);
   ImageHelper *helper = get_image_helper(filename, data, data_size);
   if (helper && helper->get_size(data, data_size, width, height))
   {
@@ -63,6 +69,36 @@ bool Renderer::get_image_size(const std::string &filename, const uint8_t *data,
   return false;
 }
 
+void Renderer::draw_gray_span(int x, int y, const uint8_t *gray, int count)
+{
+  for (int i = 0; i < count; i++)
+  {
+    draw_pixel(x + i, y, gray[i]);
+  }
+}
+
+void Renderer::draw_bitmap(int x, int y, int width, int height, const uint8_t *bitmap)
+{
+  int stride = (width + 1) / 2;
+  for (int row = 0; row < height; row++)
+  {
+    for (int column = 0; column < width; column++)
+    {
+      uint8_t pixel = bitmap[row * stride + column / 2];
+      uint8_t value = column & 1 ? pixel >> 4 : pixel & 0x0F;
+      draw_pixel(x + column, y + row, value * 17);
+    }
+  }
+}
+
+void Renderer::get_text_widths(const char *const *words, const uint8_t *styles, size_t count, uint16_t *widths)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    widths[i] = get_text_width(words[i], styles[i] & BOLD_SPAN, styles[i] & ITALIC_SPAN);
+  }
+}
+
 void Renderer::draw_text_box(const std::string &text, int x, int y, int width, int height, bool bold, bool italic)
 {
   int length = text.length();
@@ -86,3 +122,15 @@ void Renderer::draw_text_box(const std::string &text, int x, int y, int width, i
     end = start + 1;
   }
 }
+
+uint32_t Renderer::get_font_signature()
+{
+  // we don't know anything about the fonts so just measure some text in each style
+  const char *sample = "The quick brown fox jumps over the lazy dog";
+  uint32_t signature = get_space_width() * 31 + get_line_height();
+  for (int style = 0; style < 4; style++)
+  {
+    signature = signature * 31 + get_text_width(sample, style & 1, style & 2);
+  }
+  return signature;
+}
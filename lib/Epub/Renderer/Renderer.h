@@ -1,16 +1,26 @@
 #pragma once
 
+#include <stdint.h>
 #include <string>
+#include <mutex>
 
 class ImageHelper;
 
 #define MAX_WORD_LENGTH 100
 
+typedef enum
+{
+  BOLD_SPAN = 1,
+  ITALIC_SPAN = 2,
+} SPAN_STYLE;
+
 class Renderer
 {
 private:
   ImageHelper *png_helper = nullptr;
   ImageHelper *jpeg_helper = nullptr;
+  // the image helpers hold state while they decode so only one thread can use them at a time
+  std::mutex image_helper_mutex;
 
   ImageHelper *get_image_helper(const std::string &filename, const uint8_t *data, size_t data_size);
 
@@ -25,7 +35,19 @@ public:
   virtual void draw_image(const std::string &filename, const uint8_t *data, size_t data_size, int x, int y, int width, int height);
   virtual bool get_image_size(const std::string &filename, const uint8_t *data, size_t data_size, int *width, int *height);
   virtual void draw_pixel(int x, int y, uint8_t color) = 0;
+  // draw a horizontal run of gray pixels - used for images which are decoded a row at a time
+  virtual void draw_gray_span(int x, int y, const uint8_t *gray, int count);
+  // fills in the gray values the display can actually show (darkest first) so images can be dithered
+  // to them - returns the number of levels or 0 if any gray value can be shown
+  virtual int get_gray_levels(uint8_t *levels) { return 0; }
+  // the value that actually ends up on the display when an image pixel of this gray is drawn
+  virtual uint8_t get_display_gray(uint8_t gray) { return gray; }
+  // copy a 4 bits per pixel bitmap that is ready for the display (two pixels per byte with the first in the
+  // low nibble - the same as epdiy images) - unlike draw_image the values are not adjusted in any way
+  virtual void draw_bitmap(int x, int y, int width, int height, const uint8_t *bitmap);
   virtual int get_text_width(const char *text, bool bold = false, bool italic = false) = 0;
+  // measure a batch of words in one go - the styles are combinations of SPAN_STYLE
+  virtual void get_text_widths(const char *const *words, const uint8_t *styles, size_t count, uint16_t *widths);
   virtual void draw_text(int x, int y, const char *text, bool bold = false, bool italic = false) = 0;
   virtual void draw_text_box(const std::string &text, int x, int y, int width, int height, bool bold = false, bool italic = false);
   virtual void draw_rect(int x, int y, int width, int height, uint8_t color = 0) = 0;
@@ -52,6 +74,12 @@ public:
   void set_margin_bottom(int margin_bottom) { this->margin_bottom = margin_bottom; }
   void set_margin_left(int margin_left) { this->margin_left = margin_left; }
   void set_margin_right(int margin_right) { this->margin_right = margin_right; }
+  int get_margin_top() { return margin_top; }
+  int get_margin_bottom() { return margin_bottom; }
+  int get_margin_left() { return margin_left; }
+  int get_margin_right() { return margin_right; }
+  // identifies the fonts in use - anything layed out with different fonts needs to be layed out again
+  virtual uint32_t get_font_signature();
   // deep sleep helper - persist any state to disk that may be needed on wake
   virtual bool dehydrate() { return false; };
   // deep sleep helper - retrieve any state from disk after wake
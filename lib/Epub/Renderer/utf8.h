@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+// decode the next code point from a UTF-8 string and move past it - invalid sequences become U+FFFD
+static inline uint32_t utf8_next_code_point(const uint8_t **text)
+{
+  const uint8_t *p = *text;
+  uint32_t code_point = *p++;
+  int continuation_bytes = 0;
+  if ((code_point & 0xE0) == 0xC0)
+  {
+    code_point &= 0x1F;
+    continuation_bytes = 1;
+  }
+  else if ((code_point & 0xF0) == 0xE0)
+  {
+    code_point &= 0x0F;
+    continuation_bytes = 2;
+  }
+  else if ((code_point & 0xF8) == 0xF0)
+  {
+    code_point &= 0x07;
+    continuation_bytes = 3;
+  }
+  else if (code_point >= 0x80)
+  {
+    code_point = 0xFFFD;
+  }
+  for (int i = 0; i < continuation_bytes; i++)
+  {
+    if ((*p & 0xC0) != 0x80)
+    {
+      // this also stops us running past the null terminator
+      code_point = 0xFFFD;
+      break;
+    }
+    code_point = (code_point << 6) | (*p++ & 0x3F);
+  }
+  *text = p;
+  return code_point;
+}
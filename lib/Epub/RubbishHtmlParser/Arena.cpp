@@ -0,0 +1,177 @@
+#include <stdlib.h>
+#include <string.h>
+#include "Arena.h"
+
+// round up to a multiple of alignment - alignment must be a power of 2
+static size_t align_up(size_t value, size_t alignment)
+{
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// the smallest n such that 2^n >= value
+static int ceil_log2(size_t value)
+{
+  int n = 0;
+  while (((size_t)1 << n) < value)
+  {
+    n++;
+  }
+  return n;
+}
+
+// the largest n such that 2^n <= value
+static int floor_log2(size_t value)
+{
+  int n = 0;
+  while (((size_t)2 << n) <= value)
+  {
+    n++;
+  }
+  return n;
+}
+
+Arena::~Arena()
+{
+  while (m_chunks)
+  {
+    Chunk *next = m_chunks->next;
+    free(m_chunks);
+    m_chunks = next;
+  }
+}
+
+void *Arena::allocate_chunk(size_t size)
+{
+  size_t header_size = align_up(sizeof(Chunk), alignof(max_align_t));
+  Chunk *chunk = (Chunk *)malloc(header_size + size);
+  if (!chunk)
+  {
+    return nullptr;
+  }
+  chunk->next = m_chunks;
+  chunk->size = size;
+  m_chunks = chunk;
+  m_chunk_count++;
+  m_bytes_reserved += size;
+  return (uint8_t *)chunk + header_size;
+}
+
+void *Arena::allocate(size_t size, size_t alignment)
+{
+  m_allocation_count++;
+  m_bytes_allocated += size;
+  // see if there's something we can reuse
+  if (size <= m_chunk_size / 4)
+  {
+    int list = ceil_log2(size < sizeof(void *) ? sizeof(void *) : size);
+    void *data = list < NUM_FREE_LISTS ? m_free_lists[list] : nullptr;
+    if (data && ((uintptr_t)data & (alignment - 1)) == 0)
+    {
+      m_free_lists[list] = *(void **)data;
+      return data;
+    }
+  }
+  // the current pointer is always max aligned at the start of a chunk
+  // so aligning the address is the same as aligning the offset
+  uint8_t *start = (uint8_t *)align_up((uintptr_t)m_current, alignment);
+  if (m_current && start + size <= m_end)
+  {
+    m_current = start + size;
+    return start;
+  }
+  // big allocations get a chunk of their own so we don't waste the rest of the current chunk
+  if (size > m_chunk_size / 4)
+  {
+    return allocate_chunk(size);
+  }
+  uint8_t *data = (uint8_t *)allocate_chunk(m_chunk_size);
+  if (!data)
+  {
+    return nullptr;
+  }
+  m_current = data + size;
+  m_end = data + m_chunk_size;
+  return data;
+}
+
+void Arena::release(void *data, size_t size)
+{
+  if (!data || size < sizeof(void *))
+  {
+    return;
+  }
+  if (size <= m_chunk_size / 4)
+  {
+    // keep hold of it for later
+    int list = floor_log2(size);
+    if (list < NUM_FREE_LISTS)
+    {
+      *(void **)data = m_free_lists[list];
+      m_free_lists[list] = data;
+    }
+    return;
+  }
+  size_t header_size = align_up(sizeof(Chunk), alignof(max_align_t));
+  Chunk *chunk = (Chunk *)((uint8_t *)data - header_size);
+  // make sure it really is one of our chunks before we free it
+  for (Chunk **link = &m_chunks; *link; link = &(*link)->next)
+  {
+    if (*link == chunk)
+    {
+      *link = chunk->next;
+      m_chunk_count--;
+      m_bytes_reserved -= chunk->size;
+      free(chunk);
+      return;
+    }
+  }
+}
+
+char *Arena::copy_string(const char *text, size_t length)
+{
+  char *copy = (char *)allocate(length + 1, 1);
+  if (copy)
+  {
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+  }
+  return copy;
+}
+
+// every object has a header in front of it that tells us where it came from
+static const size_t OBJECT_HEADER_SIZE = alignof(max_align_t) > sizeof(Arena *) ? alignof(max_align_t) : sizeof(Arena *);
+
+void *ArenaObject::operator new(size_t size, Arena *arena)
+{
+  void *data = arena ? arena->allocate(OBJECT_HEADER_SIZE + size) : malloc(OBJECT_HEADER_SIZE + size);
+  if (!data)
+  {
+    throw std::bad_alloc();
+  }
+  *(Arena **)data = arena;
+  return (uint8_t *)data + OBJECT_HEADER_SIZE;
+}
+
+void *ArenaObject::operator new(size_t size)
+{
+  return operator new(size, nullptr);
+}
+
+void ArenaObject::operator delete(void *data)
+{
+  if (!data)
+  {
+    return;
+  }
+  void *header = (uint8_t *)data - OBJECT_HEADER_SIZE;
+  // objects in an arena are freed along with the arena
+  if (*(Arena **)header == nullptr)
+  {
+    free(header);
+  }
+}
+
+void ArenaObject::operator delete(void *data, Arena *arena)
+{
+  operator delete(data);
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <vector>
+
+// A simple bump allocator - memory is handed out from large chunks and is only
+// given back when the arena is destroyed. This saves us from making thousands of
+// tiny allocations for each section which fragments the heap.
+class Arena
+{
+private:
+  // each chunk is a single allocation - the data follows on from the header
+  typedef struct Chunk
+  {
+    struct Chunk *next;
+    size_t size;
+  } Chunk;
+  Chunk *m_chunks = nullptr;
+  // where we are in the current chunk
+  uint8_t *m_current = nullptr;
+  uint8_t *m_end = nullptr;
+  size_t m_chunk_size;
+  // memory given back by containers as they grow - list n holds blocks of at least 2^n bytes
+  static const int NUM_FREE_LISTS = 16;
+  void *m_free_lists[NUM_FREE_LISTS] = {nullptr};
+  // some stats so we can see how well we are doing
+  size_t m_allocation_count = 0;
+  size_t m_chunk_count = 0;
+  size_t m_bytes_allocated = 0;
+  size_t m_bytes_reserved = 0;
+
+  void *allocate_chunk(size_t size);
+
+public:
+  Arena(size_t chunk_size = 16384) : m_chunk_size(chunk_size) {}
+  ~Arena();
+  // get some memory - returns nullptr if we're out of memory
+  void *allocate(size_t size, size_t alignment = alignof(max_align_t));
+  // give back memory that is no longer needed (e.g. when a vector grows) - big allocations
+  // have their own chunk which is freed straight away, smaller ones are reused by later allocations
+  void release(void *data, size_t size);
+  // copy a string into the arena
+  char *copy_string(const char *text, size_t length);
+  size_t get_allocation_count() { return m_allocation_count; }
+  size_t get_chunk_count() { return m_chunk_count; }
+  size_t get_bytes_allocated() { return m_bytes_allocated; }
+  size_t get_bytes_reserved() { return m_bytes_reserved; }
+};
+
+// lets the standard containers store their data in an arena - with no arena it uses the heap
+template <class T>
+class ArenaAllocator
+{
+public:
+  typedef T value_type;
+  Arena *arena;
+
+  ArenaAllocator(Arena *arena = nullptr) : arena(arena) {}
+  template <class U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+  T *allocate(size_t n)
+  {
+    if (arena)
+    {
+      void *data = arena->allocate(n * sizeof(T), alignof(T));
+      if (!data)
+      {
+        throw std::bad_alloc();
+      }
+      return static_cast<T *>(data);
+    }
+    return static_cast<T *>(::operator new(n * sizeof(T)));
+  }
+  void deallocate(T *data, size_t n)
+  {
+    if (arena)
+    {
+      arena->release(data, n * sizeof(T));
+    }
+    else
+    {
+      ::operator delete(data);
+    }
+  }
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena == b.arena; }
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena != b.arena; }
+
+// a vector that keeps its data in an arena
+template <class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+// Base class for objects that can be created in an arena with new (arena) T(...).
+// They can always be deleted as normal - if they came from an arena then the
+// destructor is run but the memory stays with the arena. Passing a null arena
+// puts the object on the heap.
+class ArenaObject
+{
+public:
+  static void *operator new(size_t size, Arena *arena);
+  static void *operator new(size_t size);
+  static void operator delete(void *data);
+  // only used if the constructor throws
+  static void operator delete(void *data, Arena *arena);
+};
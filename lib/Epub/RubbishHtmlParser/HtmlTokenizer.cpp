@@ -0,0 +1,305 @@
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "HtmlTokenizer.h"
+
+static bool is_space(char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// can this character follow a '<' at the start of a tag?
+static bool is_tag_start(char c)
+{
+  return isalpha((unsigned char)c) || c == '/' || c == '!' || c == '?';
+}
+
+// find a string in a block of data that is not null terminated
+static const char *find(const char *data, size_t length, const char *needle)
+{
+  size_t needle_length = strlen(needle);
+  for (size_t i = 0; i + needle_length <= length; i++)
+  {
+    if (memcmp(data + i, needle, needle_length) == 0)
+    {
+      return data + i;
+    }
+  }
+  return nullptr;
+}
+
+bool HtmlTag::get_attribute(const char *attribute_name, std::string &value) const
+{
+  size_t attribute_name_length = strlen(attribute_name);
+  size_t pos = 0;
+  while (pos < attributes_length)
+  {
+    // skip to the start of the attribute name
+    while (pos < attributes_length && is_space(attributes[pos]))
+    {
+      pos++;
+    }
+    size_t name_start = pos;
+    while (pos < attributes_length && attributes[pos] != '=' && !is_space(attributes[pos]))
+    {
+      pos++;
+    }
+    size_t name_length = pos - name_start;
+    while (pos < attributes_length && is_space(attributes[pos]))
+    {
+      pos++;
+    }
+    // attributes without a value are allowed in html
+    size_t value_start = pos;
+    size_t value_length = 0;
+    if (pos < attributes_length && attributes[pos] == '=')
+    {
+      pos++;
+      while (pos < attributes_length && is_space(attributes[pos]))
+      {
+        pos++;
+      }
+      if (pos < attributes_length && (attributes[pos] == '"' || attributes[pos] == '\''))
+      {
+        char quote = attributes[pos++];
+        value_start = pos;
+        while (pos < attributes_length && attributes[pos] != quote)
+        {
+          pos++;
+        }
+        value_length = pos - value_start;
+        // skip the closing quote
+        pos++;
+      }
+      else
+      {
+        value_start = pos;
+        while (pos < attributes_length && !is_space(attributes[pos]))
+        {
+          pos++;
+        }
+        value_length = pos - value_start;
+      }
+    }
+    if (name_length == 0)
+    {
+      // stray characters - move on so we don't get stuck
+      pos++;
+    }
+    else if (name_length == attribute_name_length && strncasecmp(attributes + name_start, attribute_name, name_length) == 0)
+    {
+      value.assign(attributes + value_start, value_length);
+      return true;
+    }
+  }
+  return false;
+}
+
+void HtmlTokenizer::parse(const char *html, size_t length)
+{
+  tokenize(html, length, true);
+}
+
+void HtmlTokenizer::feed(const char *data, size_t length)
+{
+  if (m_pending.empty())
+  {
+    // nothing left over from the last chunk so we can work straight from the new data
+    size_t consumed = tokenize(data, length, false);
+    m_pending.assign(data + consumed, data + length);
+    return;
+  }
+  m_pending.insert(m_pending.end(), data, data + length);
+  size_t consumed = tokenize(m_pending.data(), m_pending.size(), false);
+  m_pending.erase(m_pending.begin(), m_pending.begin() + consumed);
+}
+
+void HtmlTokenizer::finish()
+{
+  if (!m_pending.empty())
+  {
+    tokenize(m_pending.data(), m_pending.size(), true);
+    m_pending.clear();
+  }
+}
+
+size_t HtmlTokenizer::tokenize(const char *data, size_t length, bool is_final)
+{
+  size_t pos = 0;
+  while (pos < length)
+  {
+    if (data[pos] == '<')
+    {
+      // we need to see the next character to know if this is really a tag
+      if (pos + 1 == length && !is_final)
+      {
+        break;
+      }
+      if (pos + 1 < length && is_tag_start(data[pos + 1]))
+      {
+        size_t consumed = process_tag(data + pos, length - pos, is_final);
+        if (consumed == 0)
+        {
+          // wait for the rest of the tag
+          break;
+        }
+        pos += consumed;
+        continue;
+      }
+    }
+    // this is text - it runs up to the start of the next tag
+    size_t end = pos + 1;
+    while (end < length && !(data[end] == '<' && (end + 1 == length || is_tag_start(data[end + 1]))))
+    {
+      end++;
+    }
+    // if we stopped at a '<' right at the end of the data we don't know yet if it starts a tag
+    if (end + 1 >= length && !is_final)
+    {
+      // the text may continue in the next chunk - hold onto it unless it's getting too big
+      if (length - pos <= m_max_pending_text)
+      {
+        break;
+      }
+      // split at the last whitespace so we don't break a word in half
+      size_t split = end;
+      while (split > pos && !is_space(data[split - 1]))
+      {
+        split--;
+      }
+      if (split > pos)
+      {
+        end = split;
+      }
+    }
+    // don't bother sending through text that is just whitespace
+    for (size_t i = pos; i < end; i++)
+    {
+      if (!is_space(data[i]))
+      {
+        m_handler->on_text(data + pos, end - pos);
+        break;
+      }
+    }
+    pos = end;
+  }
+  return pos;
+}
+
+// process the tag at the start of data - returns 0 if the tag is not complete yet
+size_t HtmlTokenizer::process_tag(const char *data, size_t length, bool is_final)
+{
+  if (data[1] == '!' || data[1] == '?')
+  {
+    // we need enough data to tell comments and CDATA apart from other declarations
+    if (length < 9 && !is_final)
+    {
+      return 0;
+    }
+    if (length >= 4 && strncmp(data, "<!--", 4) == 0)
+    {
+      const char *end = find(data + 4, length - 4, "-->");
+      if (!end)
+      {
+        return is_final ? length : 0;
+      }
+      return end + 3 - data;
+    }
+    if (length >= 9 && strncmp(data, "<![CDATA[", 9) == 0)
+    {
+      const char *end = find(data + 9, length - 9, "]]>");
+      if (!end)
+      {
+        if (!is_final)
+        {
+          return 0;
+        }
+        end = data + length;
+      }
+      if (end > data + 9)
+      {
+        m_handler->on_text(data + 9, end - (data + 9));
+      }
+      return end < data + length ? end + 3 - data : length;
+    }
+    // doctype or processing instruction - we don't care about these
+    const char *end = (const char *)memchr(data, '>', length);
+    if (!end)
+    {
+      return is_final ? length : 0;
+    }
+    return end + 1 - data;
+  }
+  // find the end of the tag - quotes only count when they start an attribute value
+  char quote = 0;
+  char last = 0;
+  size_t end = 1;
+  for (; end < length; end++)
+  {
+    char c = data[end];
+    if (quote)
+    {
+      if (c == quote)
+      {
+        quote = 0;
+      }
+    }
+    else if ((c == '"' || c == '\'') && last == '=')
+    {
+      quote = c;
+    }
+    else if (c == '>')
+    {
+      break;
+    }
+    if (!is_space(c))
+    {
+      last = c;
+    }
+  }
+  if (end == length)
+  {
+    // an unterminated tag at the end of the document is just dropped
+    return is_final ? length : 0;
+  }
+  bool is_end_tag = data[1] == '/';
+  size_t name_start = is_end_tag ? 2 : 1;
+  size_t name_end = name_start;
+  while (name_end < end && !is_space(data[name_end]) && data[name_end] != '/')
+  {
+    name_end++;
+  }
+  // self closing tags end with "/>"
+  size_t attributes_end = end;
+  while (attributes_end > name_end && is_space(data[attributes_end - 1]))
+  {
+    attributes_end--;
+  }
+  bool is_self_closing = !is_end_tag && attributes_end > name_start && data[attributes_end - 1] == '/';
+  if (is_self_closing)
+  {
+    attributes_end--;
+  }
+  if (name_end > name_start)
+  {
+    HtmlTag tag;
+    tag.name = data + name_start;
+    tag.name_length = name_end - name_start;
+    // the attributes start after the character that ended the name
+    tag.attributes = data + name_end + 1;
+    tag.attributes_length = attributes_end > name_end + 1 ? attributes_end - name_end - 1 : 0;
+    if (is_end_tag)
+    {
+      m_handler->on_end_tag(tag.name, tag.name_length);
+    }
+    else
+    {
+      m_handler->on_start_tag(tag);
+      if (is_self_closing)
+      {
+        m_handler->on_end_tag(tag.name, tag.name_length);
+      }
+    }
+  }
+  return end + 1;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+
+// an opening tag from the html - the name and attributes point straight into the html
+// and are only valid for the duration of the callback
+class HtmlTag
+{
+public:
+  // the tag name - not null terminated
+  const char *name;
+  size_t name_length;
+  // the raw text of the attributes - not null terminated
+  const char *attributes;
+  size_t attributes_length;
+  // find an attribute by name and copy out its value
+  bool get_attribute(const char *attribute_name, std::string &value) const;
+};
+
+// receives the events from the tokenizer as it works through the html
+class HtmlTokenHandler
+{
+public:
+  virtual ~HtmlTokenHandler() {}
+  // an opening tag
+  virtual void on_start_tag(const HtmlTag &tag) = 0;
+  // a closing tag - self closing tags get this straight after on_start_tag
+  virtual void on_end_tag(const char *tag_name, size_t tag_name_length) = 0;
+  // a run of text between tags - not null terminated and entities are not decoded
+  virtual void on_text(const char *text, size_t length) = 0;
+};
+
+// A very simple non-validating html tokenizer. It never modifies or copies the html -
+// the events point straight into the data it is given. It can also be fed the html in
+// chunks, in which case only the part of a token that straddles two chunks is held on to,
+// so memory use is bounded by the chunk size and not by the size of the document.
+class HtmlTokenizer
+{
+private:
+  HtmlTokenHandler *m_handler;
+  // any data we've been given that doesn't make up a complete token yet
+  std::vector<char> m_pending;
+  // text runs longer than this are split at whitespace rather than held on to
+  size_t m_max_pending_text;
+
+  // process as many complete tokens as we can - returns the number of bytes consumed
+  size_t tokenize(const char *data, size_t length, bool is_final);
+  size_t process_tag(const char *data, size_t length, bool is_final);
+
+public:
+  HtmlTokenizer(HtmlTokenHandler *handler, size_t max_pending_text = 8192)
+      : m_handler(handler), m_max_pending_text(max_pending_text)
+  {
+  }
+  // tokenize a complete document in one go
+  void parse(const char *html, size_t length);
+  // feed in the next chunk of html
+  void feed(const char *data, size_t length);
+  // no more data - flush anything that is pending
+  void finish();
+};
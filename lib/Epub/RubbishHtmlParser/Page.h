@@ -2,15 +2,26 @@
 
 #include "blocks/TextBlock.h"
 #include "blocks/ImageBlock.h"
+#include "../LayoutCache/LayoutFile.h"
+#include "../Trace/Trace.h"
+
+// the types of element that are written to the layout cache
+typedef enum
+{
+  PAGE_LINE_ELEMENT = 0,
+  PAGE_IMAGE_ELEMENT = 1,
+} PageElementType;
 
 // represents something that has been added to a page
-class PageElement
+class PageElement : public ArenaObject
 {
 public:
   int y_pos;
   PageElement(int y_pos) : y_pos(y_pos) {}
   virtual ~PageElement() {}
   virtual void render(Renderer *renderer, Epub *epub) = 0;
+  // write out everything needed to render this element again
+  virtual void serialize(LayoutWriter &writer) = 0;
 };
 
 // a line from a block element
@@ -30,6 +41,57 @@ public:
   {
     block->render(renderer, line_break_index, 0, y_pos);
   }
+  void serialize(LayoutWriter &writer)
+  {
+    writer.write_u8(PAGE_LINE_ELEMENT);
+    writer.write_u16(y_pos);
+    block->serialize_line(writer, line_break_index);
+  }
+};
+
+// a line read back from the layout cache - it has its own copy of the words
+class CachedPageLine : public PageElement
+{
+public:
+  // the words on the line separated by null terminators
+  std::string text;
+  std::vector<uint16_t> word_offsets;
+  std::vector<uint16_t> word_xpos;
+  std::vector<uint8_t> word_styles;
+
+  CachedPageLine(LayoutReader &reader, int y_pos) : PageElement(y_pos)
+  {
+    int word_count = reader.read_u16();
+    for (int i = 0; i < word_count && reader.ok(); i++)
+    {
+      word_xpos.push_back(reader.read_u16());
+      word_styles.push_back(reader.read_u8());
+      word_offsets.push_back(text.size());
+      text += reader.read_string();
+      text.push_back('\0');
+    }
+  }
+  void render(Renderer *renderer, Epub *epub)
+  {
+    TRACE_SCOPE("glyph draw");
+    for (int i = 0; i < word_offsets.size(); i++)
+    {
+      renderer->draw_text(word_xpos[i], y_pos, text.c_str() + word_offsets[i], word_styles[i] & BOLD_SPAN, word_styles[i] & ITALIC_SPAN);
+    }
+  }
+  void serialize(LayoutWriter &writer)
+  {
+    writer.write_u8(PAGE_LINE_ELEMENT);
+    writer.write_u16(y_pos);
+    writer.write_u16(word_offsets.size());
+    for (int i = 0; i < word_offsets.size(); i++)
+    {
+      writer.write_u16(word_xpos[i]);
+      writer.write_u8(word_styles[i]);
+      const char *word = text.c_str() + word_offsets[i];
+      writer.write_string(word, strlen(word));
+    }
+  }
 };
 
 // an image
@@ -46,14 +108,44 @@ public:
   {
     block->render(renderer, epub, y_pos);
   }
+  void serialize(LayoutWriter &writer)
+  {
+    writer.write_u8(PAGE_IMAGE_ELEMENT);
+    writer.write_u16(y_pos);
+    writer.write_u16(block->x_pos);
+    writer.write_u16(block->width);
+    writer.write_u16(block->height);
+    writer.write_string(block->m_src.c_str(), block->m_src.size());
+  }
+};
+
+// an image read back from the layout cache - the image block belongs to us
+class CachedPageImage : public PageImage
+{
+public:
+  CachedPageImage(LayoutReader &reader, int y_pos) : PageImage(nullptr, y_pos)
+  {
+    int x_pos = reader.read_u16();
+    int width = reader.read_u16();
+    int height = reader.read_u16();
+    block = new ImageBlock(reader.read_string());
+    block->x_pos = x_pos;
+    block->width = width;
+    block->height = height;
+  }
+  ~CachedPageImage()
+  {
+    delete block;
+  }
 };
 
 // a layed out page ready to be rendered
-class Page
+class Page : public ArenaObject
 {
 public:
   // the list of block index and line numbers on this page
-  std::vector<PageElement *> elements;
+  ArenaVector<PageElement *> elements;
+  Page(Arena *arena = nullptr) : elements(arena) {}
   void render(Renderer *renderer, Epub *epub)
   {
     for (auto element : elements)
@@ -61,6 +153,43 @@ public:
       element->render(renderer, epub);
     }
   }
+  void serialize(LayoutWriter &writer)
+  {
+    writer.write_u16(elements.size());
+    for (auto element : elements)
+    {
+      element->serialize(writer);
+    }
+  }
+  // read a page back from the layout cache - returns nullptr if the data is bad
+  static Page *deserialize(LayoutReader &reader)
+  {
+    Page *page = new Page();
+    int element_count = reader.read_u16();
+    for (int i = 0; i < element_count && reader.ok(); i++)
+    {
+      uint8_t type = reader.read_u8();
+      int y_pos = reader.read_u16();
+      if (type == PAGE_LINE_ELEMENT)
+      {
+        page->elements.push_back(new CachedPageLine(reader, y_pos));
+      }
+      else if (type == PAGE_IMAGE_ELEMENT)
+      {
+        page->elements.push_back(new CachedPageImage(reader, y_pos));
+      }
+      else
+      {
+        break;
+      }
+    }
+    if (!reader.ok() || (int)page->elements.size() != element_count)
+    {
+      delete page;
+      return nullptr;
+    }
+    return page;
+  }
   ~Page()
   {
     for (auto element : elements)
@@ -9,12 +9,15 @@
 #endif
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <string>
 #include <list>
 #include <vector>
 #include <exception>
+#include <atomic>
 #include "../ZipFile/ZipFile.h"
 #include "../Renderer/Renderer.h"
+#include "../Trace/Trace.h"
 #include "htmlEntities.h"
 #include "blocks/TextBlock.h"
 #include "blocks/ImageBlock.h"
@@ -24,6 +27,9 @@
 
 static const char *TAG = "HTML";
 
+// the prefetcher parses on its own thread
+static std::atomic<uint32_t> parse_count(0);
+
 const char *HEADER_TAGS[] = {"h1", "h2", "h3", "h4", "h5", "h6"};
 const int NUM_HEADER_TAGS = sizeof(HEADER_TAGS) / sizeof(HEADER_TAGS[0]);
 
@@ -42,12 +48,18 @@ const int NUM_IMAGE_TAGS = sizeof(IMAGE_TAGS) / sizeof(IMAGE_TAGS[0]);
 const char *SKIP_TAGS[] = {"head", "table"};
 const int NUM_SKIP_TAGS = sizeof(SKIP_TAGS) / sizeof(SKIP_TAGS[0]);
 
+// check to see if a tag name from the html is the same as the tag we are looking for
+static bool is_tag(const char *tag_name, size_t tag_name_length, const char *tag)
+{
+  return strlen(tag) == tag_name_length && strncasecmp(tag_name, tag, tag_name_length) == 0;
+}
+
 // given the start and end of a tag, check to see if it matches a known tag
-bool matches(const char *tag_name, const char *possible_tags[], int possible_tag_count)
+bool matches(const char *tag_name, size_t tag_name_length, const char *possible_tags[], int possible_tag_count)
 {
   for (int i = 0; i < possible_tag_count; i++)
   {
-    if (strcmp(tag_name, possible_tags[i]) == 0)
+    if (is_tag(tag_name, tag_name_length, possible_tags[i]))
     {
       return true;
     }
@@ -56,6 +68,7 @@ bool matches(const char *tag_name, const char *possible_tags[], int possible_tag
 }
 
 RubbishHtmlParser::RubbishHtmlParser(const char *html, int length, const std::string &base_path)
+    : blocks(&m_arena), pages(&m_arena)
 {
   m_base_path = base_path;
   parse(html, length);
@@ -63,20 +76,33 @@ RubbishHtmlParser::RubbishHtmlParser(const char *html, int length, const std::st
 
 RubbishHtmlParser::~RubbishHtmlParser()
 {
+  // the memory all belongs to the arena but we still need to run the destructors
+  for (auto page : pages)
+  {
+    delete page;
+  }
   for (auto block : blocks)
   {
     delete block;
   }
 }
 
-bool RubbishHtmlParser::VisitEnter(const tinyxml2::XMLElement &element, const tinyxml2::XMLAttribute *firstAttribute)
+RubbishHtmlParser::RubbishHtmlParser(Epub *epub, const std::string &item_href, const std::string &base_path)
+    : blocks(&m_arena), pages(&m_arena)
+{
+  m_base_path = base_path;
+  parse(epub, item_href);
+}
+
+bool RubbishHtmlParser::enterElement(const HtmlTag &tag)
 {
-  const char *tag_name = element.Name();
+  const char *tag_name = tag.name;
+  size_t tag_name_length = tag.name_length;
+  std::string src;
   // we only handle image tags
-  if (matches(tag_name, IMAGE_TAGS, NUM_IMAGE_TAGS))
+  if (matches(tag_name, tag_name_length, IMAGE_TAGS, NUM_IMAGE_TAGS))
   {
-    const char *src = element.Attribute("src");
-    if (src)
+    if (tag.get_attribute("src", src))
     {
       // don't leave an empty text block in the list
       BLOCK_STYLE style = currentTextBlock->get_style();
@@ -86,7 +112,7 @@ bool RubbishHtmlParser::VisitEnter(const tinyxml2::XMLElement &element, const ti
         delete currentTextBlock;
         currentTextBlock = nullptr;
       }
-      blocks.push_back(new ImageBlock(m_base_path + src));
+      blocks.push_back(new (&m_arena) ImageBlock(m_base_path + src));
       // start a new text block - with the same style as before
       startNewTextBlock(style);
     }
@@ -95,18 +121,18 @@ bool RubbishHtmlParser::VisitEnter(const tinyxml2::XMLElement &element, const ti
       ESP_LOGE(TAG, "Could not find src attribute");
     }
   }
-  else if (matches(tag_name, SKIP_TAGS, NUM_SKIP_TAGS))
+  else if (matches(tag_name, tag_name_length, SKIP_TAGS, NUM_SKIP_TAGS))
   {
     return false;
   }
-  else if (matches(tag_name, HEADER_TAGS, NUM_HEADER_TAGS))
+  else if (matches(tag_name, tag_name_length, HEADER_TAGS, NUM_HEADER_TAGS))
   {
     is_bold = true;
     startNewTextBlock(CENTER_ALIGN);
   }
-  else if (matches(tag_name, BLOCK_TAGS, NUM_BLOCK_TAGS))
+  else if (matches(tag_name, tag_name_length, BLOCK_TAGS, NUM_BLOCK_TAGS))
   {
-    if (strcmp(tag_name, "br") == 0)
+    if (is_tag(tag_name, tag_name_length, "br"))
     {
       startNewTextBlock(currentTextBlock->get_style());
     }
@@ -115,42 +141,93 @@ bool RubbishHtmlParser::VisitEnter(const tinyxml2::XMLElement &element, const ti
       startNewTextBlock(JUSTIFIED);
     }
   }
-  else if (matches(tag_name, BOLD_TAGS, NUM_BOLD_TAGS))
+  else if (matches(tag_name, tag_name_length, BOLD_TAGS, NUM_BOLD_TAGS))
   {
     is_bold = true;
   }
-  else if (matches(tag_name, ITALIC_TAGS, NUM_ITALIC_TAGS))
+  else if (matches(tag_name, tag_name_length, ITALIC_TAGS, NUM_ITALIC_TAGS))
   {
     is_italic = true;
   }
   return true;
 }
-/// Visit a text node.
-bool RubbishHtmlParser::Visit(const tinyxml2::XMLText &text)
-{
-  addText(text.Value(), is_bold, is_italic);
-  return true;
-}
-bool RubbishHtmlParser::VisitExit(const tinyxml2::XMLElement &element)
+
+void RubbishHtmlParser::exitElement(const char *tag_name, size_t tag_name_length)
 {
-  const char *tag_name = element.Name();
-  if (matches(tag_name, HEADER_TAGS, NUM_HEADER_TAGS))
+  if (matches(tag_name, tag_name_length, HEADER_TAGS, NUM_HEADER_TAGS))
   {
     is_bold = false;
   }
-  else if (matches(tag_name, BLOCK_TAGS, NUM_BLOCK_TAGS))
+  else if (matches(tag_name, tag_name_length, BLOCK_TAGS, NUM_BLOCK_TAGS))
   {
     // nothing to do
   }
-  else if (matches(tag_name, BOLD_TAGS, NUM_BOLD_TAGS))
+  else if (matches(tag_name, tag_name_length, BOLD_TAGS, NUM_BOLD_TAGS))
   {
     is_bold = false;
   }
-  else if (matches(tag_name, ITALIC_TAGS, NUM_ITALIC_TAGS))
+  else if (matches(tag_name, tag_name_length, ITALIC_TAGS, NUM_ITALIC_TAGS))
   {
     is_italic = false;
   }
-  return true;
+}
+
+void RubbishHtmlParser::addAnchor(const HtmlTag &tag)
+{
+  std::string id;
+  if (tag.get_attribute("id", id) && !id.empty())
+  {
+    SectionAnchor anchor;
+    anchor.id = m_anchor_ids.intern(id);
+    // the element starts after everything that's been added so far - if the text block is empty
+    // then this is the start of whatever block ends up in its place
+    anchor.block_index = blocks.size() - 1;
+    anchor.word_index = currentTextBlock ? currentTextBlock->get_word_count() : 0;
+    anchor.page = 0;
+    m_anchors.push_back(anchor);
+  }
+}
+
+void RubbishHtmlParser::on_start_tag(const HtmlTag &tag)
+{
+  // elements we don't display can still be linked to - they go where their contents would have been
+  addAnchor(tag);
+  // skipping over the contents of an element - just keep track of any nesting
+  if (m_skip_depth > 0)
+  {
+    if (is_tag(tag.name, tag.name_length, m_skip_tag.c_str()))
+    {
+      m_skip_depth++;
+    }
+    return;
+  }
+  if (!enterElement(tag))
+  {
+    m_skip_tag.assign(tag.name, tag.name_length);
+    m_skip_depth = 1;
+  }
+}
+void RubbishHtmlParser::on_end_tag(const char *tag_name, size_t tag_name_length)
+{
+  if (m_skip_depth > 0)
+  {
+    if (is_tag(tag_name, tag_name_length, m_skip_tag.c_str()))
+    {
+      m_skip_depth--;
+    }
+    if (m_skip_depth > 0)
+    {
+      return;
+    }
+  }
+  exitElement(tag_name, tag_name_length);
+}
+void RubbishHtmlParser::on_text(const char *text, size_t length)
+{
+  if (m_skip_depth == 0)
+  {
+    addText(std::string(text, length).c_str(), is_bold, is_italic);
+  }
 }
 
 // start a new text block if needed
@@ -169,16 +246,40 @@ void RubbishHtmlParser::startNewTextBlock(BLOCK_STYLE style)
       currentTextBlock->finish();
     }
   }
-  currentTextBlock = new TextBlock(style);
+  currentTextBlock = new (&m_arena) TextBlock(style, &m_arena);
   blocks.push_back(currentTextBlock);
 }
 
+uint32_t RubbishHtmlParser::get_parse_count()
+{
+  return parse_count;
+}
+
 void RubbishHtmlParser::parse(const char *html, int length)
 {
+  TRACE_STAGE("parse");
+  parse_count++;
   startNewTextBlock(JUSTIFIED);
-  tinyxml2::XMLDocument doc(false, tinyxml2::COLLAPSE_WHITESPACE);
-  doc.Parse(html, length);
-  doc.Accept(this);
+  HtmlTokenizer tokenizer(this);
+  tokenizer.parse(html, length);
+}
+
+bool RubbishHtmlParser::parse(Epub *epub, const std::string &item_href)
+{
+  TRACE_STAGE("parse");
+  parse_count++;
+  startNewTextBlock(JUSTIFIED);
+  // feed the html through the tokenizer as it is decompressed
+  HtmlTokenizer tokenizer(this);
+  bool success = epub->stream_item_contents(
+      item_href,
+      [&tokenizer](const uint8_t *data, size_t length)
+      {
+        tokenizer.feed(reinterpret_cast<const char *>(data), length);
+        return true;
+      });
+  tokenizer.finish();
+  return success;
 }
 
 void RubbishHtmlParser::addText(const char *text, bool is_bold, bool is_italic)
@@ -190,58 +291,156 @@ void RubbishHtmlParser::addText(const char *text, bool is_bold, bool is_italic)
 
 void RubbishHtmlParser::layout(Renderer *renderer, Epub *epub)
 {
-  const int line_height = renderer->get_line_height();
-  const int page_height = renderer->get_page_height();
-  // first ask the blocks to work out where they should have
-  // line breaks based on the page width
-  for (auto block : blocks)
+  start_layout(renderer, epub);
+  finish_layout();
+}
+
+void RubbishHtmlParser::start_layout(Renderer *renderer, Epub *epub)
+{
+  m_layout_renderer = renderer;
+  m_layout_epub = epub;
+  m_layout_block = blocks.begin();
+  m_layout_block_index = 0;
+  m_layout_y = 0;
+  m_layout_anchor_index = 0;
+  m_layout_complete = false;
+  // anything from an earlier layout goes - the memory stays in the arena until the parser is deleted
+  for (auto page : pages)
   {
-    block->layout(renderer, epub);
-    // feed the watchdog
-    vTaskDelay(1);
+    delete page;
   }
-  // now we need to allocate the lines to pages
-  // we'll run through each block and the lines within each block and allocate
-  // them to pages. When we run out of space on a page we'll start a new page
-  // and continue
-  int y = 0;
-  pages.push_back(new Page());
-  for (auto block : blocks)
+  pages.clear();
+  pages.push_back(new (&m_arena) Page(&m_arena));
+}
+
+void RubbishHtmlParser::layout_to_page(int page_index)
+{
+  // a page is finished once the one after it has been started
+  if (m_layout_complete || (int)pages.size() >= page_index + 3)
+  {
+    return;
+  }
+  TRACE_STAGE("layout");
+  while (!m_layout_complete && (int)pages.size() < page_index + 3)
+  {
+    layout_next_block();
+  }
+}
+
+void RubbishHtmlParser::finish_layout()
+{
+  if (m_layout_complete)
+  {
+    return;
+  }
+  TRACE_STAGE("layout");
+  while (!m_layout_complete)
+  {
+    layout_next_block();
+  }
+}
+
+bool RubbishHtmlParser::layout_next_block()
+{
+  if (m_layout_complete || !m_layout_renderer)
+  {
+    return false;
+  }
+  if (m_layout_block == blocks.end())
+  {
+    // anything after the last line is on the last page
+    while (m_layout_anchor_index < m_anchors.size())
+    {
+      m_anchors[m_layout_anchor_index++].page = pages.size() - 1;
+    }
+    m_layout_complete = true;
+    return false;
+  }
+  const int line_height = m_layout_renderer->get_line_height();
+  const int page_height = m_layout_renderer->get_page_height();
+  Block *block = *m_layout_block;
+  // first ask the block to work out where it should have line breaks based on the page width
+  block->layout(m_layout_renderer, m_layout_epub);
+  // feed the watchdog
+  vTaskDelay(1);
+  // now allocate the lines to pages - when we run out of space on a page we start a new one and continue
+  if (block->getType() == BlockType::TEXT_BLOCK)
   {
-    // feed the watchdog
-    vTaskDelay(1);
-    if (block->getType() == BlockType::TEXT_BLOCK)
+    TextBlock *textBlock = (TextBlock *)block;
+    for (int line_break_index = 0; line_break_index < textBlock->line_breaks.size(); line_break_index++)
     {
-      TextBlock *textBlock = (TextBlock *)block;
-      for (int line_break_index = 0; line_break_index < textBlock->line_breaks.size(); line_break_index++)
+      if (m_layout_y + line_height > page_height)
+      {
+        pages.push_back(new (&m_arena) Page(&m_arena));
+        m_layout_y = 0;
+      }
+      // the anchors are in document order - any before the end of this line start on this page
+      while (m_layout_anchor_index < m_anchors.size() &&
+             (m_anchors[m_layout_anchor_index].block_index < m_layout_block_index ||
+              (m_anchors[m_layout_anchor_index].block_index == m_layout_block_index &&
+               m_anchors[m_layout_anchor_index].word_index < textBlock->line_breaks[line_break_index])))
       {
-        if (y + line_height > page_height)
-        {
-          pages.push_back(new Page());
-          y = 0;
-        }
-        pages.back()->elements.push_back(new PageLine(textBlock, line_break_index, y));
-        y += line_height;
+        m_anchors[m_layout_anchor_index++].page = pages.size() - 1;
       }
-      // add some extra line between blocks
-      y += line_height * 0.5;
+      pages.back()->elements.push_back(new (&m_arena) PageLine(textBlock, line_break_index, m_layout_y));
+      m_layout_y += line_height;
+    }
+    // add some extra line between blocks
+    m_layout_y += line_height * 0.5;
+  }
+  if (block->getType() == BlockType::IMAGE_BLOCK)
+  {
+    ImageBlock *imageBlock = (ImageBlock *)block;
+    if (m_layout_y + imageBlock->height > page_height)
+    {
+      pages.push_back(new (&m_arena) Page(&m_arena));
+      m_layout_y = 0;
     }
-    if (block->getType() == BlockType::IMAGE_BLOCK)
+    while (m_layout_anchor_index < m_anchors.size() && m_anchors[m_layout_anchor_index].block_index <= m_layout_block_index)
+    {
+      m_anchors[m_layout_anchor_index++].page = pages.size() - 1;
+    }
+    pages.back()->elements.push_back(new (&m_arena) PageImage(imageBlock, m_layout_y));
+    m_layout_y += imageBlock->height;
+  }
+  m_layout_block++;
+  m_layout_block_index++;
+  return true;
+}
+
+int RubbishHtmlParser::get_anchor_page(const std::string &anchor)
+{
+  uint32_t id;
+  if (!m_anchor_ids.find(anchor, &id))
+  {
+    return -1;
+  }
+  // if an id is used more than once then the first one wins
+  for (size_t i = 0; i < m_anchors.size(); i++)
+  {
+    if (m_anchors[i].id == id)
     {
-      ImageBlock *imageBlock = (ImageBlock *)block;
-      if (y + imageBlock->height > page_height)
+      // the page isn't known until the layout has got past the element
+      bool more = true;
+      while (more && i >= m_layout_anchor_index)
       {
-        pages.push_back(new Page());
-        y = 0;
+        more = layout_next_block();
       }
-      pages.back()->elements.push_back(new PageImage(imageBlock, y));
-      y += imageBlock->height;
+      return m_anchors[i].page;
     }
   }
+  return -1;
 }
 
 void RubbishHtmlParser::render_page(int page_index, Renderer *renderer, Epub *epub)
 {
+  layout_to_page(page_index);
+  render_page(page_index >= 0 && page_index < pages.size() ? pages[page_index] : nullptr, renderer, epub);
+}
+
+void RubbishHtmlParser::render_page(Page *page, Renderer *renderer, Epub *epub)
+{
+  TRACE_STAGE("render page");
   renderer->clear_screen();
   // This is presumably needed only for epdiy based devices. @chris let's not do it for others like M5
   if (renderer->has_gray()) {
@@ -250,15 +449,17 @@ void RubbishHtmlParser::render_page(int page_index, Renderer *renderer, Epub *ep
     renderer->flush_display();
   }
 
-  try
-    {
-      pages.at(page_index)->render(renderer, epub);
-    } catch (const std::out_of_range &oor) {
-      ESP_LOGI(TAG, "render_page out of range");
-      // This could be nicer. Notice that last word "button" is cut          v
-      uint16_t y = renderer->get_page_height()/2-20;
-      renderer->draw_rect(1, y, renderer->get_page_width(), 105, 125);
-      renderer->draw_text_box("Reached the limit of the book\nUse the SELECT button",
-                              10, y, renderer->get_page_width(), 80, false, false);
-    }
+  if (page)
+  {
+    page->render(renderer, epub);
+  }
+  else
+  {
+    ESP_LOGI(TAG, "render_page out of range");
+    // This could be nicer. Notice that last word "button" is cut          v
+    uint16_t y = renderer->get_page_height()/2-20;
+    renderer->draw_rect(1, y, renderer->get_page_width(), 105, 125);
+    renderer->draw_text_box("Reached the limit of the book\nUse the SELECT button",
+                            10, y, renderer->get_page_width(), 80, false, false);
+  }
 }
@@ -3,8 +3,10 @@
 #include <string>
 #include <list>
 #include <vector>
-#include <tinyxml2.h>
 #include "blocks/TextBlock.h"
+#include "HtmlTokenizer.h"
+#include "Arena.h"
+#include "../EpubList/StringPool.h"
 
 using namespace std;
 
@@ -12,44 +14,123 @@ class Page;
 class Renderer;
 class Epub;
 
+// an element id in the section and where it ended up - links and the table of contents point at these
+typedef struct
+{
+  // offset of the id in the parser's string pool
+  uint32_t id;
+  // the text before the element - the block it is in and how many words of that block come first
+  uint32_t block_index;
+  uint32_t word_index;
+  // the page the element starts on - filled in by the layout
+  uint16_t page;
+} SectionAnchor;
+
 // a very stupid xhtml parser - it will probably work for very simple cases
 // but will probably fail for complex ones
-class RubbishHtmlParser : public tinyxml2::XMLVisitor
+class RubbishHtmlParser : public HtmlTokenHandler
 {
 private:
   bool is_bold = false;
   bool is_italic = false;
 
-  std::list<Block *> blocks;
+  // all the blocks, words, lines and pages for the section live in here
+  Arena m_arena;
+  std::list<Block *, ArenaAllocator<Block *>> blocks;
   TextBlock *currentTextBlock = nullptr;
-  std::vector<Page *> pages;
+  ArenaVector<Page *> pages;
 
   std::string m_base_path;
 
+  // the ids of elements in the order they appear
+  StringPool m_anchor_ids;
+  std::vector<SectionAnchor> m_anchors;
+
+  // the element we are skipping the contents of and how deeply it is nested
+  std::string m_skip_tag;
+  int m_skip_depth = 0;
+
+  // how far the layout has got - pages are only layed out as they are needed
+  Renderer *m_layout_renderer = nullptr;
+  Epub *m_layout_epub = nullptr;
+  std::list<Block *, ArenaAllocator<Block *>>::iterator m_layout_block;
+  uint32_t m_layout_block_index = 0;
+  int m_layout_y = 0;
+  size_t m_layout_anchor_index = 0;
+  bool m_layout_complete = false;
+
   // start a new text block if needed
   void startNewTextBlock(BLOCK_STYLE style);
+  // returns false if the contents of the element should be skipped
+  bool enterElement(const HtmlTag &tag);
+  void exitElement(const char *tag_name, size_t tag_name_length);
+  // remember where an element with an id starts
+  void addAnchor(const HtmlTag &tag);
+  // break the next block into lines and add them to the pages - returns false once there are no blocks left
+  bool layout_next_block();
 
 public:
+  // parses html that is already in memory - the html is not copied or modified
   RubbishHtmlParser(const char *html, int length, const std::string &base_path);
+  // streams the html for the item straight out of the epub file without loading it all into memory
+  RubbishHtmlParser(Epub *epub, const std::string &item_href, const std::string &base_path);
   ~RubbishHtmlParser();
 
-  // xml parser callbacks
-  bool VisitEnter(const tinyxml2::XMLElement &element, const tinyxml2::XMLAttribute *firstAttribute);
-  bool Visit(const tinyxml2::XMLText &text);
-  bool VisitExit(const tinyxml2::XMLElement &element);
-  // xml parser callbacks
+  // html tokenizer callbacks
+  void on_start_tag(const HtmlTag &tag);
+  void on_end_tag(const char *tag_name, size_t tag_name_length);
+  void on_text(const char *text, size_t length);
+  // html tokenizer callbacks
 
   void parse(const char *html, int length);
+  bool parse(Epub *epub, const std::string &item_href);
   void addText(const char *text, bool is_bold, bool is_italic);
+  // lay out the whole section
   void layout(Renderer *renderer, Epub *epub);
+  // get ready to lay out the section a page at a time - nothing is layed out until it is asked for
+  void start_layout(Renderer *renderer, Epub *epub);
+  // lay out enough of the section for the page and the one after it
+  void layout_to_page(int page_index);
+  // lay out whatever is left of the section
+  void finish_layout();
+  bool is_layout_complete()
+  {
+    return m_layout_complete;
+  }
+  // how many sections have been parsed since startup - by any thread
+  static uint32_t get_parse_count();
 
+  // until the layout is complete the section has at least this many pages
   int get_page_count()
   {
-    return pages.size();
+    // the last page isn't finished until the next one is started
+    return m_layout_complete || pages.empty() ? pages.size() : pages.size() - 1;
   }
-  const std::list<Block *> &get_blocks()
+  const std::list<Block *, ArenaAllocator<Block *>> &get_blocks()
   {
     return blocks;
   }
+  const ArenaVector<Page *> &get_pages()
+  {
+    return pages;
+  }
+  // the page an element id is on - the section is layed out as far as the element if it hasn't been already
+  // returns -1 if there's no such id
+  int get_anchor_page(const std::string &anchor);
+  int get_anchor_count()
+  {
+    return m_anchors.size();
+  }
+  const char *get_anchor(int index, int *page)
+  {
+    *page = m_anchors[index].page;
+    return m_anchor_ids.get(m_anchors[index].id);
+  }
   void render_page(int page_index, Renderer *renderer, Epub *epub);
+  Arena &get_arena()
+  {
+    return m_arena;
+  }
+  // render a page that has already been layed out - a null page means we've gone past the end of the book
+  static void render_page(Page *page, Renderer *renderer, Epub *epub);
 };
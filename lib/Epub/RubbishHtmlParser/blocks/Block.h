@@ -1,5 +1,7 @@
 #pragma once
 
+#include "../Arena.h"
+
 class Renderer;
 class Epub;
 
@@ -10,7 +12,7 @@ typedef enum
 } BlockType;
 
 // a block of content in the html - either a paragraph or an image
-class Block
+class Block : public ArenaObject
 {
 public:
   virtual ~Block() {}
@@ -1,4 +1,5 @@
 #pragma once
+#include <vector>
 #include "../../Renderer/Renderer.h"
 #include "Block.h"
 #include "../../EpubList/Epub.h"
@@ -30,9 +31,34 @@ public:
   }
   void layout(Renderer *renderer, Epub *epub, int max_width = -1)
   {
-    size_t image_data_size = 0;
-    uint8_t *image_data = epub->get_item_contents(m_src, &image_data_size);
-    renderer->get_image_size(m_src, image_data, image_data_size, &width, &height);
+    // the size is in the image headers so we only need to decompress the start of the image
+    std::vector<uint8_t> header;
+    bool found_size = false;
+    epub->stream_item_contents(
+        m_src,
+        [&](const uint8_t *data, size_t length)
+        {
+          // usually the headers are all in the first chunk so we don't need to copy anything
+          if (header.empty())
+          {
+            found_size = renderer->get_image_size(m_src, data, length, &width, &height);
+            if (!found_size)
+            {
+              header.assign(data, data + length);
+            }
+          }
+          else
+          {
+            header.insert(header.end(), data, data + length);
+            found_size = renderer->get_image_size(m_src, header.data(), header.size(), &width, &height);
+          }
+          return !found_size;
+        });
+    if (!found_size)
+    {
+      // just provide a dummy height and width so we can do a placeholder
+      renderer->get_image_size(m_src, nullptr, 0, &width, &height);
+    }
     if (width > renderer->get_page_width() || height > renderer->get_page_height())
     {
       float scale = std::min(
@@ -43,7 +69,6 @@ public:
     }
     // horizontal center
     x_pos = (renderer->get_page_width() - width) / 2;
-    free(image_data);
   }
   void render(Renderer *renderer, Epub *epub, int y_pos)
   {
@@ -1,7 +1,10 @@
 #include <string.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <stdint.h>
 #include "TextBlock.h"
+#include "../../LayoutCache/LayoutFile.h"
+#include "../../Trace/Trace.h"
 #ifndef UNIT_TEST
 #include <esp_log.h>
 #else
@@ -14,7 +17,7 @@
 // TODO - is there any more whitespace we should consider?
 static bool is_whitespace(char c)
 {
-  return (c == ' ' || c == '\r' || c == '\n');
+  return (c == ' ' || c == '\r' || c == '\n' || c == '\t');
 }
 
 // move past anything that should be considered part of a work
@@ -42,9 +45,22 @@ void TextBlock::add_span(const char *span, bool is_bold, bool is_italic)
   // adding a span to text block
   // make a copy of the text as we'll modify it
   int length = strlen(span);
-  char *text = new char[length + 1];
-  strcpy(text, span);
-  spans.push_back(text);
+  char *text = nullptr;
+  if (arena)
+  {
+    text = arena->copy_string(span, length);
+    if (!text)
+    {
+      ESP_LOGE("TextBlock", "Out of memory for span");
+      return;
+    }
+  }
+  else
+  {
+    text = new char[length + 1];
+    strcpy(text, span);
+    spans.push_back(text);
+  }
   // work out where each word is in the span
   int index = 0;
   while (index < length)
@@ -69,13 +85,9 @@ void TextBlock::add_span(const char *span, bool is_bold, bool is_italic)
 // given a renderer works out where to break the words into lines
 void TextBlock::layout(Renderer *renderer, Epub *epub, int max_width)
 {
-  // measure each word
-  for (int i = 0; i < words.size(); i++)
-  {
-    // measure the word
-    int width = renderer->get_text_width(words[i], word_styles[i] & BOLD_SPAN, word_styles[i] & ITALIC_SPAN);
-    word_widths.push_back(width);
-  }
+  // measure all the words in one go
+  word_widths.resize(words.size());
+  renderer->get_text_widths(words.data(), word_styles.data(), words.size(), word_widths.data());
 
   int page_width = max_width != -1 ? max_width : renderer->get_page_width();
   int space_width = renderer->get_space_width();
@@ -83,27 +95,23 @@ void TextBlock::layout(Renderer *renderer, Epub *epub, int max_width)
   // now apply the dynamic programming algorithm to find the best line breaks
   int n = word_widths.size();
 
-  // DP table in which dp[i] represents cost of line starting with word words[i]
-  int dp[n];
-
-  // Array in which ans[i] store index of last word in line starting with word word[i]
-  size_t ans[n];
+  // cost[i] is the minimum cost of the lines starting with word i and next_break[i] is the index
+  // of the last word on the line starting with word i. These go on the heap (or in the arena) as a
+  // long paragraph would overflow the stack.
+  ArenaVector<int64_t> cost(n + 1, 0, ArenaAllocator<int64_t>(arena));
+  ArenaVector<uint32_t> next_break(n, 0, ArenaAllocator<uint32_t>(arena));
 
-  // If only one word is present then only one line is required. Cost of last line is zero. Hence cost
-  // of this line is zero. Ending point is also n-1 as single word is present
-  dp[n - 1] = 0;
-  ans[n - 1] = n - 1;
-
-  // Make each word first word of line by iterating over each index in arr.
-  for (int i = n - 2; i >= 0; i--)
+  // Make each word first word of line by working backwards from the last word. The last line
+  // doesn't cost anything so cost[n] is zero.
+  for (int i = n - 1; i >= 0; i--)
   {
     int currlen = -1;
-    dp[i] = INT_MAX;
-
-    // Variable to store possible minimum cost of line.
-    int cost;
+    cost[i] = INT64_MAX;
+    // a word that is too wide for the page gets a line to itself
+    next_break[i] = i;
 
-    // Keep on adding words in current line by iterating from starting word upto last word in arr.
+    // Keep on adding words to the line until it is full - the number of words that can fit on a
+    // line is limited by the page width so this is linear in the number of words
     for (int j = i; j < n; j++)
     {
       // Update the width of the words in current line + the space between two words.
@@ -114,48 +122,39 @@ void TextBlock::layout(Renderer *renderer, Epub *epub, int max_width)
         break;
 
       // if we've run out of words then this is last line and the cost should be 0
-      // Otherwise the cost is the sqaure of the left over space + the costs of all the previous lines
-      if (j == n - 1)
-        cost = 0;
-      else
-        cost = (page_width - currlen) * (page_width - currlen) + dp[j + 1];
+      // Otherwise the cost is the sqaure of the left over space + the costs of all the following lines
+      int64_t line_cost = 0;
+      if (j != n - 1)
+        line_cost = int64_t(page_width - currlen) * (page_width - currlen) + cost[j + 1];
 
       // Check if this arrangement gives minimum cost for line starting with word words[i].
-      if (cost < dp[i])
+      // Ties go to the shorter line.
+      if (line_cost < cost[i])
       {
-        dp[i] = cost;
-        ans[i] = j;
+        cost[i] = line_cost;
+        next_break[i] = j;
       }
     }
+    if (cost[i] == INT64_MAX)
+    {
+      cost[i] = cost[i + 1];
+    }
   }
   // We can now iterate through the answer to find the line break positions
-  size_t i = 0;
+  line_breaks.clear();
+  int i = 0;
   while (i < n)
   {
-    i = ans[i] + 1;
-    if (i > n)
+    // each line ends on or after the word it starts with - if it doesn't the table is bad so
+    // put everything that's left on one line rather than going round forever
+    if (next_break[i] < i || next_break[i] >= n)
     {
-      ESP_LOGI("TextBlock", "fallen off the end of the words");
-      dump();
-
-      for (int x = 0; x < n; x++)
-      {
-        ESP_LOGI("TextBlock", "line break %d=>%d", x, ans[x]);
-      }
+      ESP_LOGE("TextBlock", "Bad line break %u for word %d of %d", (unsigned)next_break[i], i, n);
+      line_breaks.push_back(n);
       break;
     }
+    i = next_break[i] + 1;
     line_breaks.push_back(i);
-    if (line_breaks.size() > 1000)
-    {
-      ESP_LOGE("TextBlock", "too many line breaks");
-      dump();
-
-      for (int x = 0; x < n; x++)
-      {
-        ESP_LOGI("TextBlock", "line break %d=>%d", x, ans[x]);
-      }
-      break;
-    }
   }
   // With the page breaks calculated we can now position the words along the line
   int start_word = 0;
@@ -194,16 +193,22 @@ void TextBlock::layout(Renderer *renderer, Epub *epub, int max_width)
     }
     start_word = line_breaks[i];
   }
-  spans.shrink_to_fit();
-  words.shrink_to_fit();
-  word_widths.shrink_to_fit();
-  word_xpos.shrink_to_fit();
-  word_styles.shrink_to_fit();
+  // shrinking the vectors in an arena would just use up more of the arena
+  if (!arena)
+  {
+    spans.shrink_to_fit();
+    words.shrink_to_fit();
+    word_widths.shrink_to_fit();
+    word_xpos.shrink_to_fit();
+    word_styles.shrink_to_fit();
+  }
 }
 void TextBlock::render(Renderer *renderer, int line_break_index, int x_pos, int y_pos)
 {
   int start = line_break_index == 0 ? 0 : line_breaks[line_break_index - 1];
   int end = line_breaks[line_break_index];
+  // a line at a time - tracing every word would cost more than drawing it
+  TRACE_SCOPE("glyph draw");
   for (int i = start; i < end; i++)
   {
     // get the style
@@ -212,6 +217,18 @@ void TextBlock::render(Renderer *renderer, int line_break_index, int x_pos, int
     renderer->draw_text(x_pos + word_xpos[i], y_pos, words[i], style & BOLD_SPAN, style & ITALIC_SPAN);
   }
 }
+void TextBlock::serialize_line(LayoutWriter &writer, int line_break_index)
+{
+  int start = line_break_index == 0 ? 0 : line_breaks[line_break_index - 1];
+  int end = line_breaks[line_break_index];
+  writer.write_u16(end - start);
+  for (int i = start; i < end; i++)
+  {
+    writer.write_u16(word_xpos[i]);
+    writer.write_u8(word_styles[i]);
+    writer.write_string(words[i], strlen(words[i]));
+  }
+}
 // debug helper - dumps out the contents of the block with line breaks
 void TextBlock::dump()
 {
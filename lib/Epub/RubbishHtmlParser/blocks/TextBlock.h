@@ -4,11 +4,7 @@
 #include <vector>
 #include "Block.h"
 
-typedef enum
-{
-  BOLD_SPAN = 1,
-  ITALIC_SPAN = 2,
-} SPAN_STYLE;
+class LayoutWriter;
 
 typedef enum
 {
@@ -22,26 +18,30 @@ typedef enum
 class TextBlock : public Block
 {
 private:
-  // the spans of text in this block
+  // where the words and their positions are stored - null if we are using the heap
+  Arena *arena;
+  // the spans of text in this block - only needed if we are using the heap
   std::vector<const char *> spans;
   // pointer to each word
-  std::vector<const char *> words;
+  ArenaVector<const char *> words;
   // width of each word
-  std::vector<uint16_t> word_widths;
+  ArenaVector<uint16_t> word_widths;
   // x position of each word
-  std::vector<uint16_t> word_xpos;
+  ArenaVector<uint16_t> word_xpos;
   // the styles of each word
-  std::vector<uint8_t> word_styles;
+  ArenaVector<uint8_t> word_styles;
 
   // the style of the block - left, center, right aligned
   BLOCK_STYLE style;
 
 public:
-  // where do we want to break the words into lines
-  std::vector<uint16_t> line_breaks;
+  // where do we want to break the words into lines - the index of the word after each line
+  // a paragraph can easily have more words than fit in 16 bits
+  ArenaVector<uint32_t> line_breaks;
 
   void add_span(const char *span, bool is_bold, bool is_italic);
-  TextBlock(BLOCK_STYLE style) : style(style)
+  TextBlock(BLOCK_STYLE style, Arena *arena = nullptr)
+      : arena(arena), words(arena), word_widths(arena), word_xpos(arena), word_styles(arena), style(style), line_breaks(arena)
   {
   }
   ~TextBlock()
@@ -59,19 +59,26 @@ public:
   {
     return style;
   }
+  // spans are only kept when the block isn't in an arena so go by the words
   bool isEmpty()
   {
-    return spans.empty();
+    return is_empty();
   }
   // given a renderer works out where to break the words into lines
   void layout(Renderer *renderer, Epub *epub, int max_width = -1);
   void render(Renderer *renderer, int line_break_index, int x_pos, int y_pos);
+  // write out the words on a line with their positions and styles
+  void serialize_line(LayoutWriter &writer, int line_break_index);
   // debug helper - dumps out the contents of the block with line breaks
   void dump();
   bool is_empty()
   {
     return words.empty();
   }
+  int get_word_count()
+  {
+    return words.size();
+  }
   virtual BlockType getType()
   {
     return TEXT_BLOCK;
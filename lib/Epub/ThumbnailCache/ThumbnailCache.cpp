@@ -0,0 +1,439 @@
+#ifndef UNIT_TEST
+#include <esp_log.h>
+#include <esp_system.h>
+#include <esp_pthread.h>
+#else
+#define ESP_LOGI(args...)
+#define ESP_LOGE(args...)
+#define ESP_LOGD(args...)
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include "ThumbnailCache.h"
+#include "../LayoutCache/LayoutFile.h"
+#include "../EpubList/Epub.h"
+#include "../Renderer/Renderer.h"
+
+static const char *TAG = "THUMB";
+
+// "THMB" - written last so a partially written file is never treated as valid
+static const uint32_t THUMBNAIL_CACHE_MAGIC = 0x424d4854;
+
+static size_t get_free_heap()
+{
+#ifndef UNIT_TEST
+  return esp_get_free_heap_size();
+#else
+  return SIZE_MAX;
+#endif
+}
+
+// FNV-1a
+static uint32_t hash_bytes(uint32_t hash, const uint8_t *data, size_t length)
+{
+  for (size_t i = 0; i < length; i++)
+  {
+    hash = (hash ^ data[i]) * 16777619u;
+  }
+  return hash;
+}
+
+// Draws images into a 4 bits per pixel bitmap the same way the real renderer would draw them
+// onto the display. Everything apart from images is ignored.
+class ThumbnailRenderer : public Renderer
+{
+private:
+  const uint8_t *m_levels;
+  int m_level_count;
+  const uint8_t *m_display_gray;
+  int m_width = 0;
+  int m_height = 0;
+
+public:
+  std::vector<uint8_t> pixels;
+  // draw_image only draws a rectangle if it can't decode the image
+  bool failed = false;
+
+  ThumbnailRenderer(const uint8_t *levels, int level_count, const uint8_t *display_gray)
+      : m_levels(levels), m_level_count(level_count), m_display_gray(display_gray)
+  {
+  }
+  void start(int width, int height)
+  {
+    m_width = width;
+    m_height = height;
+    // start off white
+    pixels.assign(((width + 1) / 2) * height, 0xFF);
+    failed = false;
+  }
+  int get_gray_levels(uint8_t *levels)
+  {
+    memcpy(levels, m_levels, m_level_count);
+    return m_level_count;
+  }
+  void draw_gray_span(int x, int y, const uint8_t *gray, int count)
+  {
+    if (y < 0 || y >= m_height)
+    {
+      return;
+    }
+    uint8_t *row = &pixels[y * ((m_width + 1) / 2)];
+    for (int i = std::max(0, -x); i < count && x + i < m_width; i++)
+    {
+      int column = x + i;
+      uint8_t value = m_display_gray[gray[i]] >> 4;
+      uint8_t *pixel = &row[column / 2];
+      *pixel = column & 1 ? (*pixel & 0x0F) | (value << 4) : (*pixel & 0xF0) | value;
+    }
+  }
+  void draw_pixel(int x, int y, uint8_t color)
+  {
+    draw_gray_span(x, y, &color, 1);
+  }
+  void draw_rect(int x, int y, int width, int height, uint8_t color = 0)
+  {
+    failed = true;
+  }
+  int get_text_width(const char *text, bool bold = false, bool italic = false) { return 0; }
+  void draw_text(int x, int y, const char *text, bool bold = false, bool italic = false) {}
+  void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint8_t color) {}
+  void draw_circle(int x, int y, int r, uint8_t color = 0) {}
+  void fill_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint8_t color) {}
+  void fill_rect(int x, int y, int width, int height, uint8_t color = 0) {}
+  void fill_circle(int x, int y, int r, uint8_t color = 0) {}
+  void needs_gray(uint8_t color) {}
+  bool has_gray() { return true; }
+  void show_busy() {}
+  void show_img(int x, int y, int width, int height, const uint8_t *img_buffer) {}
+  void clear_screen() {}
+  int get_page_width() { return m_width; }
+  int get_page_height() { return m_height; }
+  int get_space_width() { return 0; }
+  int get_line_height() { return 0; }
+};
+
+ThumbnailCache::ThumbnailCache(Renderer *renderer, const std::string &cache_path, size_t min_free_heap)
+    : m_renderer(renderer), m_cache_path(cache_path), m_min_free_heap(min_free_heap)
+{
+  // take a copy of how the renderer draws images so the worker doesn't need to touch it
+  m_level_count = renderer->get_gray_levels(m_levels);
+  for (int gray = 0; gray < 256; gray++)
+  {
+    m_display_gray[gray] = renderer->get_display_gray(gray);
+  }
+  m_display_signature = hash_bytes(2166136261u, m_levels, m_level_count);
+  m_display_signature = hash_bytes(m_display_signature, m_display_gray, 256);
+  m_foreground_renderer = new ThumbnailRenderer(m_levels, m_level_count, m_display_gray);
+  m_worker_renderer = new ThumbnailRenderer(m_levels, m_level_count, m_display_gray);
+}
+
+ThumbnailCache::~ThumbnailCache()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+    m_wanted.clear();
+  }
+  m_changed.notify_all();
+  if (m_worker.joinable())
+  {
+    m_worker.join();
+  }
+  delete m_foreground_renderer;
+  delete m_worker_renderer;
+}
+
+void ThumbnailCache::start_worker()
+{
+  if (m_worker.joinable())
+  {
+    return;
+  }
+#ifndef UNIT_TEST
+  // the main task is on core 1 so do the work on core 0 - at the lowest priority so the idle task still gets to run
+  esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
+  cfg.stack_size = 16384;
+  cfg.prio = 0;
+  cfg.pin_to_core = 0;
+  cfg.thread_name = "thumbnails";
+  esp_pthread_set_cfg(&cfg);
+#endif
+  m_worker = std::thread(&ThumbnailCache::worker_loop, this);
+#ifndef UNIT_TEST
+  // don't affect any other threads we start
+  cfg = esp_pthread_get_default_config();
+  esp_pthread_set_cfg(&cfg);
+#endif
+}
+
+std::string ThumbnailCache::get_filename(const std::string &epub_path)
+{
+  // keep the names short - SPIFFS only allows 32 characters
+  char filename[32];
+  snprintf(filename, sizeof(filename), "%08x.thm", hash_bytes(2166136261u, (const uint8_t *)epub_path.c_str(), epub_path.size()));
+  return m_cache_path + filename;
+}
+
+bool ThumbnailCache::open_thumbnail(const std::string &epub_path, int width, int height, FILE **fp, Thumbnail *thumbnail)
+{
+  // if the epub file changes then the thumbnail is no longer valid
+  struct stat epub_stat;
+  if (stat(epub_path.c_str(), &epub_stat) != 0)
+  {
+    ESP_LOGE(TAG, "Failed to stat %s", epub_path.c_str());
+    return false;
+  }
+  std::string filename = get_filename(epub_path);
+  *fp = fopen(filename.c_str(), "rb");
+  if (!*fp)
+  {
+    // not in the cache
+    return false;
+  }
+  LayoutReader reader(*fp);
+  bool is_valid = reader.read_u32() == THUMBNAIL_CACHE_MAGIC &&
+                  reader.read_u16() == THUMBNAIL_CACHE_VERSION &&
+                  reader.read_string() == epub_path &&
+                  reader.read_u32() == (uint32_t)epub_stat.st_size &&
+                  reader.read_u32() == (uint32_t)epub_stat.st_mtime &&
+                  reader.read_u32() == m_display_signature &&
+                  reader.read_u16() == width &&
+                  reader.read_u16() == height;
+  thumbnail->width = reader.read_u16();
+  thumbnail->height = reader.read_u16();
+  if (!is_valid || !reader.ok() || thumbnail->width > width || thumbnail->height > height)
+  {
+    fclose(*fp);
+    *fp = nullptr;
+    return false;
+  }
+  return true;
+}
+
+bool ThumbnailCache::is_cached(const std::string &epub_path, int width, int height)
+{
+  FILE *fp = nullptr;
+  Thumbnail thumbnail;
+  if (!open_thumbnail(epub_path, width, height, &fp, &thumbnail))
+  {
+    return false;
+  }
+  fclose(fp);
+  return true;
+}
+
+bool ThumbnailCache::load(const std::string &epub_path, int width, int height, Thumbnail *thumbnail)
+{
+  FILE *fp = nullptr;
+  if (!open_thumbnail(epub_path, width, height, &fp, thumbnail))
+  {
+    return false;
+  }
+  thumbnail->pixels.resize(((thumbnail->width + 1) / 2) * thumbnail->height);
+  LayoutReader reader(fp);
+  reader.read(thumbnail->pixels.data(), thumbnail->pixels.size());
+  fclose(fp);
+  return reader.ok();
+}
+
+bool ThumbnailCache::save(const std::string &epub_path, int width, int height, const Thumbnail &thumbnail)
+{
+  struct stat epub_stat;
+  if (stat(epub_path.c_str(), &epub_stat) != 0)
+  {
+    ESP_LOGE(TAG, "Failed to stat %s", epub_path.c_str());
+    return false;
+  }
+  std::string filename = get_filename(epub_path);
+  FILE *fp = fopen(filename.c_str(), "wb");
+  if (!fp)
+  {
+    ESP_LOGE(TAG, "Failed to create %s", filename.c_str());
+    return false;
+  }
+  LayoutWriter writer(fp);
+  // leave space for the magic number - it gets filled in once everything else is written
+  writer.write_u32(0);
+  writer.write_u16(THUMBNAIL_CACHE_VERSION);
+  writer.write_string(epub_path.c_str(), epub_path.size());
+  writer.write_u32(epub_stat.st_size);
+  writer.write_u32(epub_stat.st_mtime);
+  writer.write_u32(m_display_signature);
+  writer.write_u16(width);
+  writer.write_u16(height);
+  writer.write_u16(thumbnail.width);
+  writer.write_u16(thumbnail.height);
+  writer.write(thumbnail.pixels.data(), thumbnail.pixels.size());
+  fseek(fp, 0, SEEK_SET);
+  writer.write_u32(THUMBNAIL_CACHE_MAGIC);
+  bool success = writer.ok();
+  if (fclose(fp) != 0)
+  {
+    success = false;
+  }
+  if (!success)
+  {
+    ESP_LOGE(TAG, "Failed to write %s", filename.c_str());
+    ::remove(filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool ThumbnailCache::generate(ThumbnailRenderer *renderer, const std::string &epub_path, int width, int height, Thumbnail *thumbnail)
+{
+  Epub epub(epub_path);
+  if (!epub.load(EPUB_LOAD_METADATA))
+  {
+    ESP_LOGE(TAG, "Failed to load %s", epub_path.c_str());
+    return false;
+  }
+  thumbnail->width = 0;
+  thumbnail->height = 0;
+  thumbnail->pixels.clear();
+  const std::string &cover = epub.get_cover_image_item();
+  size_t image_data_size = 0;
+  uint8_t *image_data = cover.empty() ? nullptr : epub.get_item_contents(cover, &image_data_size);
+  if (image_data)
+  {
+    // covers are never made bigger than they are so the thumbnail can be smaller than the area
+    int image_width = width, image_height = height;
+    if (renderer->get_image_size(cover, image_data, image_data_size, &image_width, &image_height))
+    {
+      thumbnail->width = std::min(width, image_width);
+      thumbnail->height = std::min(height, image_height);
+      renderer->start(thumbnail->width, thumbnail->height);
+      renderer->draw_image(cover, image_data, image_data_size, 0, 0, width, height);
+      if (renderer->failed)
+      {
+        thumbnail->width = 0;
+        thumbnail->height = 0;
+      }
+      else
+      {
+        thumbnail->pixels.swap(renderer->pixels);
+      }
+    }
+    free(image_data);
+  }
+  // books without a cover we can draw are remembered as well so we don't keep trying
+  save(epub_path, width, height, *thumbnail);
+  return true;
+}
+
+void ThumbnailCache::draw(const std::string &epub_path, int x, int y, int width, int height)
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    // the worker doesn't need to do this one now
+    m_wanted.erase(std::remove(m_wanted.begin(), m_wanted.end(), epub_path), m_wanted.end());
+    // it will be done soon so it's quicker to wait than to start again - this also stops us
+    // writing the same file as the worker
+    m_changed.wait(lock, [this, &epub_path]()
+                   { return m_in_progress != epub_path; });
+  }
+  Thumbnail thumbnail;
+  if (!load(epub_path, width, height, &thumbnail) &&
+      !generate(m_foreground_renderer, epub_path, width, height, &thumbnail))
+  {
+    thumbnail.width = 0;
+  }
+  if (thumbnail.width > 0)
+  {
+    m_renderer->draw_bitmap(x, y, thumbnail.width, thumbnail.height, thumbnail.pixels.data());
+  }
+  else
+  {
+    // the same placeholder as draw_image uses
+    m_renderer->draw_rect(x + 20, y + 20, width - 40, height - 40);
+  }
+}
+
+void ThumbnailCache::prefetch(const std::vector<std::string> &epub_paths, int width, int height)
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_wanted.clear();
+    for (auto &epub_path : epub_paths)
+    {
+      if (epub_path != m_in_progress)
+      {
+        m_wanted.push_back(epub_path);
+      }
+    }
+    m_wanted_width = width;
+    m_wanted_height = height;
+    start_worker();
+  }
+  m_changed.notify_all();
+}
+
+void ThumbnailCache::cancel()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_wanted.clear();
+  }
+  m_changed.notify_all();
+}
+
+void ThumbnailCache::wait_until_idle()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_changed.wait(lock, [this]()
+                 { return m_stopping || (m_wanted.empty() && m_in_progress.empty()); });
+}
+
+void ThumbnailCache::remove(const std::string &epub_path)
+{
+  ::remove(get_filename(epub_path).c_str());
+}
+
+size_t ThumbnailCache::get_generated_count()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_generated_count;
+}
+
+void ThumbnailCache::worker_loop()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true)
+  {
+    m_changed.wait(lock, [this]()
+                   { return m_stopping || !m_wanted.empty(); });
+    if (m_stopping)
+    {
+      break;
+    }
+    m_in_progress = m_wanted.front();
+    m_wanted.erase(m_wanted.begin());
+    int width = m_wanted_width;
+    int height = m_wanted_height;
+    lock.unlock();
+    // one book at a time so the list stays responsive - anything already done is skipped
+    bool generated = false;
+    if (!is_cached(m_in_progress, width, height))
+    {
+      if (get_free_heap() < m_min_free_heap)
+      {
+        ESP_LOGI(TAG, "Not enough memory to make a thumbnail for %s", m_in_progress.c_str());
+      }
+      else
+      {
+        ESP_LOGI(TAG, "Making thumbnail for %s", m_in_progress.c_str());
+        Thumbnail thumbnail;
+        generated = generate(m_worker_renderer, m_in_progress, width, height, &thumbnail);
+      }
+    }
+    lock.lock();
+    if (generated)
+    {
+      m_generated_count++;
+    }
+    m_in_progress.clear();
+    m_changed.notify_all();
+  }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class Renderer;
+class ThumbnailRenderer;
+
+// bump this whenever the format of the thumbnail files changes
+#define THUMBNAIL_CACHE_VERSION 1
+
+// a book's cover shrunk down and ready to copy straight onto the display - an empty
+// thumbnail means the book doesn't have a cover we can draw
+typedef struct
+{
+  uint16_t width;
+  uint16_t height;
+  // 4 bits per pixel - see Renderer::draw_bitmap
+  std::vector<uint8_t> pixels;
+} Thumbnail;
+
+// Keeps the covers for the library list on the file system already scaled and dithered to the
+// size they are drawn at. Drawing a page of the list is then just a matter of copying bitmaps
+// instead of opening every book and decoding its cover. Thumbnails that aren't ready yet can be
+// made on a worker thread while the user is looking at the list.
+class ThumbnailCache
+{
+private:
+  Renderer *m_renderer;
+  std::string m_cache_path;
+  // how images look on the display - thumbnails have to be made again if this changes
+  uint8_t m_levels[256];
+  int m_level_count;
+  uint8_t m_display_gray[256];
+  uint32_t m_display_signature;
+  // one for drawing thumbnails we need right now and one for the worker
+  ThumbnailRenderer *m_foreground_renderer = nullptr;
+  ThumbnailRenderer *m_worker_renderer = nullptr;
+  // don't start on a thumbnail in the background if there's less than this free
+  size_t m_min_free_heap;
+
+  std::thread m_worker;
+  std::mutex m_mutex;
+  std::condition_variable m_changed;
+  bool m_stopping = false;
+  // the books to make thumbnails for - in the order we want them
+  std::vector<std::string> m_wanted;
+  int m_wanted_width = 0;
+  int m_wanted_height = 0;
+  // the book the worker is busy with - empty if it's not doing anything
+  std::string m_in_progress;
+  size_t m_generated_count = 0;
+
+  void start_worker();
+  void worker_loop();
+  // read back the header of a thumbnail file and check it's for this version of the book
+  bool open_thumbnail(const std::string &epub_path, int width, int height, FILE **fp, Thumbnail *thumbnail);
+  bool generate(ThumbnailRenderer *renderer, const std::string &epub_path, int width, int height, Thumbnail *thumbnail);
+  bool save(const std::string &epub_path, int width, int height, const Thumbnail &thumbnail);
+
+public:
+  // the thumbnail files are written to cache_path which should end in a "/"
+  ThumbnailCache(Renderer *renderer, const std::string &cache_path = "/fs/", size_t min_free_heap = 128 * 1024);
+  ~ThumbnailCache();
+  // the file the thumbnail for a book is stored in
+  std::string get_filename(const std::string &epub_path);
+  // is there an up to date thumbnail of this size for the book?
+  bool is_cached(const std::string &epub_path, int width, int height);
+  // read a thumbnail from the cache - returns false if it's not there or is out of date
+  bool load(const std::string &epub_path, int width, int height, Thumbnail *thumbnail);
+  // draw the cover of a book fitted into the area - the thumbnail is made and saved first if it's not in the cache
+  void draw(const std::string &epub_path, int x, int y, int width, int height);
+  // make thumbnails for these books on the worker thread - replaces anything that was already waiting
+  void prefetch(const std::vector<std::string> &epub_paths, int width, int height);
+  // forget about any thumbnails that haven't been started yet
+  void cancel();
+  // wait for the worker to finish everything it has been asked to do
+  void wait_until_idle();
+  // get rid of the thumbnail for the book
+  void remove(const std::string &epub_path);
+
+  size_t get_generated_count();
+};
@@ -0,0 +1,314 @@
+#ifdef TRACE_ENABLED
+#ifndef UNIT_TEST
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#else
+#include <chrono>
+#endif
+#include <string.h>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include "Trace.h"
+
+typedef enum
+{
+  TRACE_EVENT_SCOPE = 0,
+  TRACE_EVENT_COUNTER = 1,
+} TraceEventType;
+
+typedef struct
+{
+  const char *name;
+  int64_t start_us;
+  // the duration of a scope or the value of a counter
+  int32_t value;
+  uint32_t free;
+  uint32_t largest_free_block;
+  uint8_t type;
+  uint8_t thread;
+  bool has_heap;
+} TraceEvent;
+
+#ifndef UNIT_TEST
+static void sample_free_heap(TraceHeapSample *sample)
+{
+  sample->free = esp_get_free_heap_size();
+  sample->largest_free_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+}
+static TraceHeapSampler heap_sampler = sample_free_heap;
+#else
+static TraceHeapSampler heap_sampler = nullptr;
+#endif
+
+// sections are parsed and layed out on the prefetcher's thread as well as the main one
+static std::mutex trace_mutex;
+static TraceEvent events[TRACE_BUFFER_SIZE];
+static size_t next_event = 0;
+static size_t event_count = 0;
+static size_t dropped_count = 0;
+static TraceStage stages[TRACE_MAX_STAGES];
+static size_t stage_count = 0;
+
+// small ids are easier to read in the trace viewer than the real thread ids
+static std::atomic<uint8_t> last_thread_id(0);
+static thread_local uint8_t thread_id = 0;
+
+static int64_t get_time_us()
+{
+#ifndef UNIT_TEST
+  return esp_timer_get_time();
+#else
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+static uint8_t get_thread_id()
+{
+  if (thread_id == 0)
+  {
+    thread_id = ++last_thread_id;
+  }
+  return thread_id;
+}
+
+static bool sample_heap(TraceHeapSample *sample)
+{
+  if (!heap_sampler)
+  {
+    return false;
+  }
+  heap_sampler(sample);
+  return true;
+}
+
+static uint8_t get_fragmentation(const TraceHeapSample &sample)
+{
+  if (sample.free == 0)
+  {
+    return 0;
+  }
+  return 100 - (uint64_t)sample.largest_free_block * 100 / sample.free;
+}
+
+// the name is nearly always the same string literal so compare the pointers first - must hold the lock
+static TraceStage *find_stage(const char *name, bool create)
+{
+  for (size_t i = 0; i < stage_count; i++)
+  {
+    if (stages[i].name == name || strcmp(stages[i].name, name) == 0)
+    {
+      return &stages[i];
+    }
+  }
+  if (!create || stage_count == TRACE_MAX_STAGES)
+  {
+    return nullptr;
+  }
+  TraceStage *stage = &stages[stage_count++];
+  memset(stage, 0, sizeof(TraceStage));
+  stage->name = name;
+  stage->lowest_free = UINT32_MAX;
+  stage->lowest_largest_free_block = UINT32_MAX;
+  return stage;
+}
+
+static void add_heap_sample(TraceStage *stage, const TraceHeapSample &sample)
+{
+  stage->heap_samples++;
+  stage->lowest_free = std::min(stage->lowest_free, sample.free);
+  stage->lowest_largest_free_block = std::min(stage->lowest_largest_free_block, sample.largest_free_block);
+  stage->worst_fragmentation = std::max(stage->worst_fragmentation, get_fragmentation(sample));
+}
+
+// must hold the lock
+static TraceEvent *add_event()
+{
+  TraceEvent *event = &events[next_event];
+  next_event = (next_event + 1) % TRACE_BUFFER_SIZE;
+  if (event_count == TRACE_BUFFER_SIZE)
+  {
+    dropped_count++;
+  }
+  else
+  {
+    event_count++;
+  }
+  return event;
+}
+
+TraceScope::TraceScope(const char *name, bool sample_heap) : m_name(name), m_sample_heap(sample_heap)
+{
+  if (m_sample_heap)
+  {
+    TraceHeapSample sample;
+    if (::sample_heap(&sample))
+    {
+      std::lock_guard<std::mutex> lock(trace_mutex);
+      TraceStage *stage = find_stage(m_name, true);
+      if (stage)
+      {
+        add_heap_sample(stage, sample);
+      }
+    }
+  }
+  m_start_us = get_time_us();
+}
+
+TraceScope::~TraceScope()
+{
+  int64_t duration = get_time_us() - m_start_us;
+  TraceHeapSample sample = {0, 0};
+  bool has_heap = m_sample_heap && sample_heap(&sample);
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  TraceEvent *event = add_event();
+  event->name = m_name;
+  event->start_us = m_start_us;
+  event->value = duration;
+  event->free = sample.free;
+  event->largest_free_block = sample.largest_free_block;
+  event->type = TRACE_EVENT_SCOPE;
+  event->thread = get_thread_id();
+  event->has_heap = has_heap;
+  TraceStage *stage = find_stage(m_name, true);
+  if (stage)
+  {
+    stage->calls++;
+    stage->total_us += duration;
+    stage->max_us = std::max(stage->max_us, (uint32_t)duration);
+    if (has_heap)
+    {
+      add_heap_sample(stage, sample);
+    }
+  }
+}
+
+void trace_counter(const char *name, int32_t value)
+{
+  int64_t now = get_time_us();
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  TraceEvent *event = add_event();
+  event->name = name;
+  event->start_us = now;
+  event->value = value;
+  event->type = TRACE_EVENT_COUNTER;
+  event->thread = get_thread_id();
+  event->has_heap = false;
+}
+
+void trace_reset()
+{
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  next_event = 0;
+  event_count = 0;
+  dropped_count = 0;
+  stage_count = 0;
+}
+
+void trace_set_heap_sampler(TraceHeapSampler sampler)
+{
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  heap_sampler = sampler;
+}
+
+size_t trace_get_event_count()
+{
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  return event_count;
+}
+
+size_t trace_get_dropped_count()
+{
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  return dropped_count;
+}
+
+bool trace_get_stage(const char *name, TraceStage *stage)
+{
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  TraceStage *found = find_stage(name, false);
+  if (!found)
+  {
+    return false;
+  }
+  *stage = *found;
+  return true;
+}
+
+// the events in the ring buffer oldest first - must hold the lock
+static const TraceEvent &get_event(size_t index)
+{
+  return events[(next_event + TRACE_BUFFER_SIZE - event_count + index) % TRACE_BUFFER_SIZE];
+}
+
+void trace_dump(FILE *fp)
+{
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  fprintf(fp, "TRACE: %zu events, %zu dropped\n", event_count, dropped_count);
+  fprintf(fp, "TRACE: %-20s %8s %12s %10s %10s %10s %5s\n", "stage", "calls", "total ms", "max ms", "low free", "low block", "frag");
+  for (size_t i = 0; i < stage_count; i++)
+  {
+    const TraceStage &stage = stages[i];
+    if (stage.heap_samples > 0)
+    {
+      fprintf(fp, "TRACE: %-20s %8u %12.3f %10.3f %10u %10u %4u%%\n", stage.name, (unsigned)stage.calls, stage.total_us / 1000.0, stage.max_us / 1000.0,
+              (unsigned)stage.lowest_free, (unsigned)stage.lowest_largest_free_block, stage.worst_fragmentation);
+    }
+    else
+    {
+      fprintf(fp, "TRACE: %-20s %8u %12.3f %10.3f\n", stage.name, (unsigned)stage.calls, stage.total_us / 1000.0, stage.max_us / 1000.0);
+    }
+  }
+  for (size_t i = 0; i < event_count; i++)
+  {
+    const TraceEvent &event = get_event(i);
+    if (event.type == TRACE_EVENT_COUNTER)
+    {
+      fprintf(fp, "TRACE: %lld us [%u] %s = %d\n", (long long)event.start_us, event.thread, event.name, (int)event.value);
+    }
+    else if (event.has_heap)
+    {
+      fprintf(fp, "TRACE: %lld us [%u] %s %.3f ms, free %u, largest block %u\n", (long long)event.start_us, event.thread, event.name,
+              event.value / 1000.0, (unsigned)event.free, (unsigned)event.largest_free_block);
+    }
+    else
+    {
+      fprintf(fp, "TRACE: %lld us [%u] %s %.3f ms\n", (long long)event.start_us, event.thread, event.name, event.value / 1000.0);
+    }
+  }
+}
+
+bool trace_write_chrome_json(const char *filename)
+{
+  FILE *fp = fopen(filename, "w");
+  if (!fp)
+  {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(trace_mutex);
+  fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+  for (size_t i = 0; i < event_count; i++)
+  {
+    const TraceEvent &event = get_event(i);
+    const char *separator = i == 0 ? "\n" : ",\n";
+    if (event.type == TRACE_EVENT_COUNTER)
+    {
+      fprintf(fp, "%s{\"name\": \"%s\", \"ph\": \"C\", \"ts\": %lld, \"pid\": 1, \"tid\": %u, \"args\": {\"value\": %d}}",
+              separator, event.name, (long long)event.start_us, event.thread, (int)event.value);
+      continue;
+    }
+    fprintf(fp, "%s{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %lld, \"dur\": %d, \"pid\": 1, \"tid\": %u}",
+            separator, event.name, (long long)event.start_us, (int)event.value, event.thread);
+    // the heap shows up as a graph above the threads
+    if (event.has_heap)
+    {
+      fprintf(fp, ",\n{\"name\": \"heap\", \"ph\": \"C\", \"ts\": %lld, \"pid\": 1, \"args\": {\"free\": %u, \"largest_free_block\": %u}}",
+              (long long)(event.start_us + event.value), (unsigned)event.free, (unsigned)event.largest_free_block);
+    }
+  }
+  fprintf(fp, "\n]}\n");
+  return fclose(fp) == 0;
+}
+
+#endif
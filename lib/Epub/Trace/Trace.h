@@ -0,0 +1,93 @@
+#pragma once
+
+// Lightweight tracing of the hot paths. Build with -DTRACE_ENABLED to turn it on - without it
+// the macros below are empty and nothing here is compiled in.
+//
+//  TRACE_SCOPE("glyph draw")     - time the rest of the enclosing block
+//  TRACE_STAGE("layout")         - the same but also sample the heap at the start and the end
+//  TRACE_COUNTER("pages", count) - record a value
+//  TRACE_DUMP()                  - print the stages and recent events (to the serial port on the device)
+//
+// Events go into a fixed size ring buffer so the most recent ones are kept, and every stage keeps
+// running totals along with the lowest free heap and worst fragmentation seen while it ran.
+// trace_write_chrome_json writes the ring buffer out for chrome://tracing or https://ui.perfetto.dev
+#ifdef TRACE_ENABLED
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+
+// number of events kept in the ring buffer
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE 256
+#endif
+// number of differently named stages that get running totals
+#ifndef TRACE_MAX_STAGES
+#define TRACE_MAX_STAGES 32
+#endif
+
+typedef struct
+{
+  uint32_t free;
+  uint32_t largest_free_block;
+} TraceHeapSample;
+
+// fills in the sample - on the device this is the 8 bit capable heap, on the host there is nothing
+// to sample until a test provides a sampler
+typedef void (*TraceHeapSampler)(TraceHeapSample *sample);
+
+typedef struct
+{
+  const char *name;
+  uint32_t calls;
+  uint64_t total_us;
+  uint32_t max_us;
+  // only the TRACE_STAGE calls sample the heap
+  uint32_t heap_samples;
+  uint32_t lowest_free;
+  uint32_t lowest_largest_free_block;
+  // percentage of the free heap that wasn't in the largest block
+  uint8_t worst_fragmentation;
+} TraceStage;
+
+class TraceScope
+{
+private:
+  const char *m_name;
+  bool m_sample_heap;
+  int64_t m_start_us;
+
+public:
+  TraceScope(const char *name, bool sample_heap);
+  ~TraceScope();
+};
+
+void trace_counter(const char *name, int32_t value);
+// clear the ring buffer and all the stages
+void trace_reset();
+void trace_set_heap_sampler(TraceHeapSampler sampler);
+// events currently in the ring buffer and how many were overwritten since the last reset
+size_t trace_get_event_count();
+size_t trace_get_dropped_count();
+// copies the running totals for the stage - returns false if it hasn't been seen
+bool trace_get_stage(const char *name, TraceStage *stage);
+// the stages followed by the events in the ring buffer oldest first
+void trace_dump(FILE *fp);
+// the events in the ring buffer in the chrome trace event format
+bool trace_write_chrome_json(const char *filename);
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name, false)
+#define TRACE_STAGE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name, true)
+#define TRACE_COUNTER(name, value) trace_counter(name, value)
+#define TRACE_DUMP() trace_dump(stdout)
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_STAGE(name)
+#define TRACE_COUNTER(name, value)
+#define TRACE_DUMP()
+
+#endif
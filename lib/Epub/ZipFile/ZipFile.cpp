@@ -5,39 +5,97 @@
 #define ESP_LOGI(args...)
 #endif
 #include "ZipFile.h"
-
-#include "miniz.h"
+#include "../Trace/Trace.h"
 
 #define TAG "ZIP"
 
-// read a file from the zip file allocating the required memory for the data
-uint8_t *ZipFile::read_file_to_memory(const char *filename, size_t *size)
+ZipFile::ZipFile(const char *filename) : m_filename(filename)
+{
+  memset(&m_zip_archive, 0, sizeof(m_zip_archive));
+}
+
+ZipFile::~ZipFile()
+{
+  close();
+}
+
+bool ZipFile::open()
 {
-  // open up the epub file using miniz
-  mz_zip_archive zip_archive;
-  memset(&zip_archive, 0, sizeof(zip_archive));
-  bool status = mz_zip_reader_init_file(&zip_archive, m_filename.c_str(), 0);
-  if (!status)
+  if (m_is_open)
+  {
+    return true;
+  }
+  // open up the epub file using miniz - this reads in the central directory
+  memset(&m_zip_archive, 0, sizeof(m_zip_archive));
+  if (!mz_zip_reader_init_file(&m_zip_archive, m_filename.c_str(), 0))
   {
     ESP_LOGE(TAG, "mz_zip_reader_init_file() failed!\n");
-    ESP_LOGE(TAG, "Error %s\n", mz_zip_get_error_string(zip_archive.m_last_error));
-    return nullptr;
+    ESP_LOGE(TAG, "Error %s\n", mz_zip_get_error_string(m_zip_archive.m_last_error));
+    return false;
+  }
+  m_is_open = true;
+  return true;
+}
+
+void ZipFile::close()
+{
+  if (m_is_open)
+  {
+    // Close the archive, freeing any resources it was using
+    mz_zip_reader_end(&m_zip_archive);
+    m_is_open = false;
+  }
+}
+
+bool ZipFile::locate_file(const char *filename, mz_uint32 *file_index)
+{
+  if (!open())
+  {
+    return false;
+  }
+  // the central directory is sorted when the archive is opened so this is a binary search
+  if (!mz_zip_reader_locate_file_v2(&m_zip_archive, filename, nullptr, 0, file_index))
+  {
+    ESP_LOGE(TAG, "Could not find file %s", filename);
+    return false;
+  }
+  return true;
+}
+
+bool ZipFile::get_file_size(const char *filename, size_t *size)
+{
+  mz_uint32 file_index = 0;
+  if (!locate_file(filename, &file_index))
+  {
+    return false;
   }
+  mz_zip_archive_file_stat file_stat;
+  if (!mz_zip_reader_file_stat(&m_zip_archive, file_index, &file_stat))
+  {
+    ESP_LOGE(TAG, "mz_zip_reader_file_stat() failed!\n");
+    ESP_LOGE(TAG, "Error %s\n", mz_zip_get_error_string(m_zip_archive.m_last_error));
+    return false;
+  }
+  *size = file_stat.m_uncomp_size;
+  return true;
+}
+
+// read a file from the zip file allocating the required memory for the data
+uint8_t *ZipFile::read_file_to_memory(const char *filename, size_t *size)
+{
+  TRACE_STAGE("zip extract");
   // find the file
   mz_uint32 file_index = 0;
-  if (!mz_zip_reader_locate_file_v2(&zip_archive, filename, nullptr, 0, &file_index))
+  if (!locate_file(filename, &file_index))
   {
-    ESP_LOGE(TAG, "Could not find file %s", filename);
-    mz_zip_reader_end(&zip_archive);
     return nullptr;
   }
   // get the file size - we do this all manually so we can add a null terminator to any strings
   mz_zip_archive_file_stat file_stat;
-  if (!mz_zip_reader_file_stat(&zip_archive, file_index, &file_stat))
+  if (!mz_zip_reader_file_stat(&m_zip_archive, file_index, &file_stat))
   {
     ESP_LOGE(TAG, "mz_zip_reader_file_stat() failed!\n");
-    ESP_LOGE(TAG, "Error %s\n", mz_zip_get_error_string(zip_archive.m_last_error));
-    mz_zip_reader_end(&zip_archive);
+    ESP_LOGE(TAG, "Error %s\n", mz_zip_get_error_string(m_zip_archive.m_last_error));
     return nullptr;
   }
   // allocate memory for the file
@@ -46,21 +104,17 @@ uint8_t *ZipFile::read_file_to_memory(const char *filename, size_t *size)
   if (!file_data)
   {
     ESP_LOGE(TAG, "Failed to allocate memory for %s\n", file_stat.m_filename);
-    mz_zip_reader_end(&zip_archive);
     return nullptr;
   }
   // read the file
-  status = mz_zip_reader_extract_to_mem(&zip_archive, file_index, file_data, file_size, 0);
-  if (!status)
+  if (!mz_zip_reader_extract_to_mem(&m_zip_archive, file_index, file_data, file_size, 0))
   {
     ESP_LOGE(TAG, "mz_zip_reader_extract_to_mem() failed!\n");
-    ESP_LOGE(TAG, "Error %s\n", mz_zip_get_error_string(zip_archive.m_last_error));
+    ESP_LOGE(TAG, "Error %s\n", mz_zip_get_error_string(m_zip_archive.m_last_error));
     free(file_data);
-    mz_zip_reader_end(&zip_archive);
     return nullptr;
   }
-  // Close the archive, freeing any resources it was using
-  mz_zip_reader_end(&zip_archive);
+  m_bytes_extracted += file_size;
   // return the size if required
   if (size)
   {
@@ -68,37 +122,70 @@ uint8_t *ZipFile::read_file_to_memory(const char *filename, size_t *size)
   }
   return file_data;
 }
+
 bool ZipFile::read_file_to_file(const char *filename, const char *dest)
 {
-  mz_zip_archive zip_archive;
-  memset(&zip_archive, 0, sizeof(zip_archive));
-  bool status = mz_zip_reader_init_file(&zip_archive, m_filename.c_str(), 0);
-  if (!status)
+  mz_uint32 file_index = 0;
+  if (!locate_file(filename, &file_index))
   {
-    ESP_LOGE(TAG, "mz_zip_reader_init_file() failed!\n");
-    ESP_LOGE(TAG, "Error %s\n", mz_zip_get_error_string(zip_archive.m_last_error));
     return false;
   }
-  // Run through the archive and find the requiested file
-  for (int i = 0; i < (int)mz_zip_reader_get_num_files(&zip_archive); i++)
+  ESP_LOGI(TAG, "Extracting %s\n", filename);
+  if (!mz_zip_reader_extract_to_file(&m_zip_archive, file_index, dest, 0))
+  {
+    ESP_LOGE(TAG, "mz_zip_reader_extract_to_file() failed!\n");
+    ESP_LOGE(TAG, "Error %s\n", mz_zip_get_error_string(m_zip_archive.m_last_error));
+    return false;
+  }
+  return true;
+}
+
+bool ZipFile::read_file_to_callback(const char *filename, ChunkCallback callback, size_t chunk_size)
+{
+  mz_uint32 file_index = 0;
+  if (!locate_file(filename, &file_index))
   {
-    mz_zip_archive_file_stat file_stat;
-    if (!mz_zip_reader_file_stat(&zip_archive, i, &file_stat))
+    return false;
+  }
+  // the iterator only holds onto the compressed read buffer and the decompression window
+  mz_zip_reader_extract_iter_state *iter = mz_zip_reader_extract_iter_new(&m_zip_archive, file_index, 0);
+  if (!iter)
+  {
+    ESP_LOGE(TAG, "mz_zip_reader_extract_iter_new() failed!\n");
+    ESP_LOGE(TAG, "Error %s\n", mz_zip_get_error_string(m_zip_archive.m_last_error));
+    return false;
+  }
+  uint8_t *chunk = (uint8_t *)malloc(chunk_size);
+  if (!chunk)
+  {
+    ESP_LOGE(TAG, "Failed to allocate memory for chunk\n");
+    mz_zip_reader_extract_iter_free(iter);
+    return false;
+  }
+  bool keep_reading = true;
+  while (keep_reading)
+  {
+    size_t length = 0;
     {
-      ESP_LOGE(TAG, "mz_zip_reader_file_stat() failed!\n");
-      ESP_LOGE(TAG, "Error %s\n", mz_zip_get_error_string(zip_archive.m_last_error));
-      mz_zip_reader_end(&zip_archive);
-      return false;
+      // only the decompression - the callback is traced by whoever is using the data
+      TRACE_SCOPE("zip extract");
+      length = mz_zip_reader_extract_iter_read(iter, chunk, chunk_size);
     }
-    // is this the file we're looking for?
-    if (strcmp(filename, file_stat.m_filename) == 0)
+    if (length == 0)
     {
-      ESP_LOGI(TAG, "Extracting %s\n", file_stat.m_filename);
-      mz_zip_reader_extract_file_to_file(&zip_archive, file_stat.m_filename, dest, 0);
-      mz_zip_reader_end(&zip_archive);
-      return true;
+      break;
     }
+    m_bytes_extracted += length;
+    keep_reading = callback(chunk, length);
+  }
+  free(chunk);
+  // this also checks the crc if we read all the data
+  bool status = mz_zip_reader_extract_iter_free(iter);
+  if (keep_reading && !status)
+  {
+    ESP_LOGE(TAG, "Failed to extract %s\n", filename);
+    ESP_LOGE(TAG, "Error %s\n", mz_zip_get_error_string(m_zip_archive.m_last_error));
+    return false;
   }
-  mz_zip_reader_end(&zip_archive);
-  return false;
+  return true;
 }
@@ -1,19 +1,39 @@
 #pragma once
 
 #include <string>
+#include <functional>
+#include "miniz.h"
 
+// A zip archive that is opened once and kept open - the central directory
+// is read and parsed on the first access and then reused for every subsequent
+// read so we don't have to keep re-reading it for every file we extract
 class ZipFile
 {
 private:
   std::string m_filename;
+  mz_zip_archive m_zip_archive;
+  bool m_is_open = false;
+  // how much data we've decompressed - useful for spotting things being read more than they need to be
+  size_t m_bytes_extracted = 0;
+
+  // open the archive and read in the central directory if we haven't already
+  bool open();
+  // find the index of a file in the central directory
+  bool locate_file(const char *filename, mz_uint32 *file_index);
 
 public:
-  ZipFile(const char *filename)
-  {
-    m_filename = filename;
-  }
-  ~ZipFile() {}
+  ZipFile(const char *filename);
+  ~ZipFile();
   // read a file from the zip file allocating the required memory for the data
   uint8_t *read_file_to_memory(const char *filename, size_t *size = nullptr);
   bool read_file_to_file(const char *filename, const char *dest);
-};
\ No newline at end of file
+  // the uncompressed size of a file in the zip file
+  bool get_file_size(const char *filename, size_t *size);
+  // receives each chunk of a file as it is decompressed - return false to stop reading
+  typedef std::function<bool(const uint8_t *data, size_t length)> ChunkCallback;
+  // stream a file from the zip file in fixed size chunks without holding the whole file in memory
+  bool read_file_to_callback(const char *filename, ChunkCallback callback, size_t chunk_size = 4096);
+  // release the archive - it will be reopened automatically if needed
+  void close();
+  size_t get_bytes_extracted() { return m_bytes_extracted; }
+};
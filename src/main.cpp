@@ -8,6 +8,7 @@
 #include "EpubList/EpubReader.h"
 #include "EpubList/EpubToc.h"
 #include <RubbishHtmlParser/RubbishHtmlParser.h>
+#include <Trace/Trace.h>
 #include "boards/Board.h"
 
 #ifdef LOG_ENABLED
@@ -50,8 +51,12 @@ void handleEpub(Renderer *renderer, UIAction action)
 {
   if (!reader)
   {
-    reader = new EpubReader(epub_list_state.epub_list[epub_list_state.selected_item], renderer);
-    reader->load();
+    reader = new EpubReader(epub_list_state.selected_epub, renderer);
+    // after a deep sleep we can usually carry on from the snapshot without loading the book
+    if (!reader->hydrate())
+    {
+      reader->load();
+    }
   }
   switch (action)
   {
@@ -73,6 +78,8 @@ void handleEpub(Renderer *renderer, UIAction action)
     {
       epub_list = new EpubList(renderer, epub_list_state);
     }
+    // keep our place in the book for next time
+    epub_list->save_position();
     handleEpubList(renderer, NONE, true);
     return;
   case NONE:
@@ -86,7 +93,7 @@ void handleEpubTableContents(Renderer *renderer, UIAction action, bool needs_red
 {
   if (!contents)
   {
-    contents = new EpubToc(epub_list_state.epub_list[epub_list_state.selected_item], epub_index_state, renderer);
+    contents = new EpubToc(epub_list_state.selected_epub, epub_index_state, renderer);
     contents->set_needs_redraw();
     contents->load();
   }
@@ -102,8 +109,8 @@ void handleEpubTableContents(Renderer *renderer, UIAction action, bool needs_red
     // setup the reader state
     ui_state = READING_EPUB;
     // create the reader and load the book
-    reader = new EpubReader(epub_list_state.epub_list[epub_list_state.selected_item], renderer);
-    reader->set_state_section(contents->get_selected_toc());
+    reader = new EpubReader(epub_list_state.selected_epub, renderer);
+    reader->set_state_section(contents->get_selected_toc(), contents->get_selected_anchor());
     reader->load();
     //switch to reading the epub
     delete contents;
@@ -145,8 +152,11 @@ void handleEpubList(Renderer *renderer, UIAction action, bool needs_redraw)
     // switch to reading the epub
     // setup the reader state
     ui_state = SELECTING_TABLE_CONTENTS;
+    // the book needs the cpu more than the thumbnails
+    epub_list->stop_prefetching();
+    epub_list->select_current();
     // create the reader and load the book
-    contents = new EpubToc(epub_list_state.epub_list[epub_list_state.selected_item], epub_index_state, renderer);
+    contents = new EpubToc(epub_list_state.selected_epub, epub_index_state, renderer);
     contents->load();
     contents->set_needs_redraw();
     handleEpubTableContents(renderer, NONE, true);
@@ -261,6 +271,11 @@ void main_task(void *param)
   while (esp_timer_get_time() - last_user_interaction < 120 * 1000 * 1000)
   {
     UIAction ui_action = NONE;
+    // carry on laying out the rest of the section a page at a time while nothing else is happening
+    if (ui_state == READING_EPUB && reader && uxQueueMessagesWaiting(ui_queue) == 0 && reader->layout_more())
+    {
+      continue;
+    }
     // wait for something to happen for 60 seconds
     if (xQueueReceive(ui_queue, &ui_action, pdMS_TO_TICKS(60000)) == pdTRUE)
     {
@@ -286,8 +301,24 @@ void main_task(void *param)
     renderer->flush_display();
   }
   ESP_LOGI("main", "Saving state");
+  // the position in the book is in RTC memory but that's lost if the power goes
+  if (ui_state == READING_EPUB)
+  {
+    if (!epub_list)
+    {
+      epub_list = new EpubList(renderer, epub_list_state);
+    }
+    epub_list->save_position();
+    // and the layout of the page we're on so the next page turn doesn't have to parse anything
+    if (reader)
+    {
+      reader->dehydrate();
+    }
+  }
   // save the state of the renderer
   renderer->dehydrate();
+  // everything we've traced since waking up goes out over the serial port
+  TRACE_DUMP();
   // turn off the filesystem
   board->stop_filesystem();
   // get ready to go to sleep
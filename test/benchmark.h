@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdio.h>
+#include <chrono>
+
+// simple wall clock timer for the host side benchmarks
+class BenchmarkTimer
+{
+private:
+  std::chrono::steady_clock::time_point m_start;
+
+public:
+  BenchmarkTimer() : m_start(std::chrono::steady_clock::now()) {}
+  void reset()
+  {
+    m_start = std::chrono::steady_clock::now();
+  }
+  double elapsed_ms()
+  {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count();
+  }
+};
+
+// benchmark results are just printed out along with the test results
+#define BENCHMARK_REPORT(...)   \
+  printf("[BENCHMARK] ");       \
+  printf(__VA_ARGS__);          \
+  printf("\n");
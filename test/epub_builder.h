@@ -0,0 +1,182 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "miniz.h"
+
+// builds small but valid epub files for the tests that need lots of books or unusual content
+class EpubBuilder
+{
+private:
+  std::string m_title;
+  std::string m_author;
+  // the title of each chapter and the html that goes in its body
+  std::vector<std::pair<std::string, std::string>> m_chapters;
+  // how deeply each chapter is nested in the table of contents
+  std::vector<int> m_levels;
+  // write an EPUB3 nav document instead of an ncx file
+  bool m_use_nav = false;
+
+  static bool add_file(mz_zip_archive *zip, const char *name, const std::string &contents, bool compress = true)
+  {
+    return mz_zip_writer_add_mem(zip, name, contents.data(), contents.size(), compress ? MZ_DEFAULT_COMPRESSION : MZ_NO_COMPRESSION);
+  }
+  // the table of contents as nested ncx navPoints
+  std::string build_nav_points()
+  {
+    std::string nav_points;
+    for (size_t i = 0; i < m_chapters.size(); i++)
+    {
+      // close the previous entry unless this one is its child - and any parents we've come out of
+      for (int level = i > 0 ? m_levels[i - 1] : -1; level >= m_levels[i]; level--)
+      {
+        nav_points += "</navPoint>";
+      }
+      nav_points += "<navPoint id=\"nav" + std::to_string(i) + "\" playOrder=\"" + std::to_string(i + 1) + "\"><navLabel><text>" +
+                    m_chapters[i].first + "</text></navLabel><content src=\"chapter" + std::to_string(i) + ".xhtml\"/>";
+    }
+    for (int level = m_chapters.empty() ? -1 : m_levels.back(); level >= 0; level--)
+    {
+      nav_points += "</navPoint>";
+    }
+    return nav_points;
+  }
+  // the table of contents as nested lists in an EPUB3 nav document - links are relative to the document
+  std::string build_nav_document(const std::string &link_prefix)
+  {
+    std::string nav = "<?xml version=\"1.0\"?><html xmlns=\"http://www.w3.org/1999/xhtml\" xmlns:epub=\"http://www.idpf.org/2007/ops\">"
+                      "<head><title>Contents</title></head><body><nav epub:type=\"toc\" id=\"toc\"><h1>Contents</h1><ol>";
+    for (size_t i = 0; i < m_chapters.size(); i++)
+    {
+      if (i > 0 && m_levels[i] > m_levels[i - 1])
+      {
+        nav += "<ol>";
+      }
+      else if (i > 0)
+      {
+        nav += "</li>";
+        for (int level = m_levels[i - 1]; level > m_levels[i]; level--)
+        {
+          nav += "</ol></li>";
+        }
+      }
+      nav += "<li><a href=\"" + link_prefix + "chapter" + std::to_string(i) + ".xhtml\">" + m_chapters[i].first + "</a>";
+    }
+    if (!m_chapters.empty())
+    {
+      nav += "</li>";
+      for (int level = m_levels.back(); level > 0; level--)
+      {
+        nav += "</ol></li>";
+      }
+    }
+    // the landmarks aren't part of the table of contents
+    return nav + "</ol></nav><nav epub:type=\"landmarks\"><ol><li><a href=\"" + link_prefix + "chapter0.xhtml\">Start</a></li></ol></nav></body></html>";
+  }
+
+public:
+  EpubBuilder(const std::string &title, const std::string &author) : m_title(title), m_author(author) {}
+  // the level is how deeply the chapter is nested in the table of contents - it can be at most one
+  // more than the level of the chapter before it
+  void add_chapter(const std::string &title, const std::string &body, int level = 0)
+  {
+    m_chapters.push_back(std::make_pair(title, body));
+    m_levels.push_back(level);
+  }
+  // fill the book with made up chapters of about words_per_chapter words each - paragraphs with some
+  // bold and italic text and a heading every so often. The same seed always gives the same book.
+  void add_generated_chapters(int count, int words_per_chapter, uint32_t seed = 1)
+  {
+    static const char *words[] = {"the", "a", "lamp", "street", "door", "quiet", "lawyer", "was", "of", "and",
+                                  "night", "remarkable", "in", "his", "friend", "story", "window", "cold", "to", "had",
+                                  "gentleman", "walked", "with", "strange", "fog", "late", "it", "house", "London", "case"};
+    const int word_count = sizeof(words) / sizeof(words[0]);
+    uint32_t state = seed;
+    auto next_random = [&state](int range)
+    {
+      state = state * 1664525u + 1013904223u;
+      return (int)((state >> 8) % range);
+    };
+    int first = m_chapters.size();
+    for (int chapter = 0; chapter < count; chapter++)
+    {
+      std::string title = "Chapter " + std::to_string(first + chapter + 1);
+      std::string body = "<h1 id=\"start\">" + title + "</h1><p>";
+      for (int word = 0; word < words_per_chapter; word++)
+      {
+        int style = next_random(20);
+        const char *text = words[next_random(word_count)];
+        body += style == 0 ? "<b>" + std::string(text) + "</b>" : style == 1 ? "<i>" + std::string(text) + "</i>" : std::string(text);
+        if (next_random(60) == 0)
+        {
+          body += ".</p><h2 id=\"part" + std::to_string(word) + "\">Part " + std::to_string(word) + "</h2><p>";
+        }
+        else if (next_random(12) == 0)
+        {
+          body += ".</p><p>";
+        }
+        else
+        {
+          body += next_random(8) == 0 ? ", " : " ";
+        }
+      }
+      add_chapter(title, body + "</p>");
+    }
+  }
+  void use_nav(bool use_nav) { m_use_nav = use_nav; }
+  bool write(const std::string &path)
+  {
+    mz_zip_archive zip;
+    memset(&zip, 0, sizeof(zip));
+    if (!mz_zip_writer_init_file(&zip, path.c_str(), 0))
+    {
+      return false;
+    }
+    std::string manifest, spine;
+    for (size_t i = 0; i < m_chapters.size(); i++)
+    {
+      std::string id = "chapter" + std::to_string(i);
+      manifest += "<item id=\"" + id + "\" href=\"" + id + ".xhtml\" media-type=\"application/xhtml+xml\"/>";
+      spine += "<itemref idref=\"" + id + "\"/>";
+    }
+    // the mimetype has to come first and can't be compressed
+    bool success = add_file(&zip, "mimetype", "application/epub+zip", false);
+    success = success && add_file(&zip, "META-INF/container.xml",
+                                  "<?xml version=\"1.0\"?><container version=\"1.0\" xmlns=\"urn:oasis:names:tc:opendocument:xmlns:container\">"
+                                  "<rootfiles><rootfile full-path=\"OEBPS/content.opf\" media-type=\"application/oebps-package+xml\"/></rootfiles></container>");
+    std::string package = "<?xml version=\"1.0\"?><package xmlns=\"http://www.idpf.org/2007/opf\" version=\"" + std::string(m_use_nav ? "3.0" : "2.0") + "\">"
+                          "<metadata xmlns:dc=\"http://purl.org/dc/elements/1.1/\"><dc:title>" + m_title + "</dc:title><dc:creator>" + m_author + "</dc:creator></metadata>";
+    if (m_use_nav)
+    {
+      // the nav document goes in its own folder so the links in it are relative to that
+      package += "<manifest><item id=\"nav\" href=\"nav/nav.xhtml\" media-type=\"application/xhtml+xml\" properties=\"nav\"/>" + manifest + "</manifest><spine>" + spine + "</spine></package>";
+    }
+    else
+    {
+      package += "<manifest><item id=\"ncx\" href=\"toc.ncx\" media-type=\"application/x-dtbncx+xml\"/>" + manifest + "</manifest><spine toc=\"ncx\">" + spine + "</spine></package>";
+    }
+    success = success && add_file(&zip, "OEBPS/content.opf", package);
+    if (m_use_nav)
+    {
+      success = success && add_file(&zip, "OEBPS/nav/nav.xhtml", build_nav_document("../"));
+    }
+    else
+    {
+      success = success && add_file(&zip, "OEBPS/toc.ncx",
+                                    "<?xml version=\"1.0\"?><ncx xmlns=\"http://www.daisy.org/z3986/2005/ncx/\" version=\"2005-1\"><navMap>" +
+                                        build_nav_points() + "</navMap></ncx>");
+    }
+    for (size_t i = 0; i < m_chapters.size() && success; i++)
+    {
+      std::string name = "OEBPS/chapter" + std::to_string(i) + ".xhtml";
+      success = add_file(&zip, name.c_str(),
+                         "<?xml version=\"1.0\"?><html xmlns=\"http://www.w3.org/1999/xhtml\"><head><title>" + m_chapters[i].first +
+                             "</title></head><body>" + m_chapters[i].second + "</body></html>");
+    }
+    success = success && mz_zip_writer_finalize_archive(&zip);
+    return mz_zip_writer_end(&zip) && success;
+  }
+};
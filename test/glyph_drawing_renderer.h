@@ -0,0 +1,168 @@
+#pragma once
+
+#include <unity.h>
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+#include <Renderer/GlyphBitmapCache.h>
+#include <Renderer/GlyphWidthCache.h>
+#include <Renderer/utf8.h>
+#include <regular_font.h>
+#include <bold_font.h>
+#include <italic_font.h>
+#include <bold_italic_font.h>
+#include "miniz.h"
+#include "recording_renderer.h"
+
+// draws text with the real fonts into a 4bpp buffer the same way as the epdiy renderer
+class GlyphDrawingRenderer : public RecordingRenderer
+{
+private:
+  const EpdFont *m_fonts[4] = {&regular_font, &bold_font, &italic_font, &bold_italic_font};
+  GlyphWidthCache *m_width_caches[4];
+
+  void draw_pixel_4bpp(int x, int y, uint8_t color)
+  {
+    if (x < 0 || x >= page_width || y < 0 || y >= page_height)
+    {
+      return;
+    }
+    uint8_t *pixel = &frame_buffer[y * page_width / 2 + x / 2];
+    *pixel = x & 1 ? (*pixel & 0x0F) | (color & 0xF0) : (*pixel & 0xF0) | (color >> 4);
+  }
+
+public:
+  // null draws the glyphs by inflating them every time as epd_write_string does
+  GlyphBitmapCache *glyph_cache = nullptr;
+  std::vector<uint8_t> frame_buffer;
+  size_t glyphs_drawn = 0;
+
+  GlyphDrawingRenderer() : RecordingRenderer(540, 960), frame_buffer(540 * 960 / 2, 0xFF)
+  {
+    for (int style = 0; style < 4; style++)
+    {
+      const EpdFont *font = m_fonts[style];
+      m_width_caches[style] = new GlyphWidthCache(
+          [font](uint32_t code_point, GlyphMetrics *metrics)
+          {
+            const EpdGlyph *glyph = epd_get_glyph(font, code_point);
+            if (!glyph)
+            {
+              glyph = epd_get_glyph(font, '?');
+            }
+            if (!glyph)
+            {
+              return false;
+            }
+            metrics->advance_x = glyph->advance_x;
+            metrics->left = glyph->left;
+            metrics->width = glyph->width;
+            return true;
+          });
+    }
+  }
+  ~GlyphDrawingRenderer()
+  {
+    for (auto cache : m_width_caches)
+    {
+      delete cache;
+    }
+  }
+  int get_text_width(const char *text, bool bold = false, bool italic = false)
+  {
+    return m_width_caches[(bold ? BOLD_SPAN : 0) | (italic ? ITALIC_SPAN : 0)]->get_text_width(text);
+  }
+  int get_space_width()
+  {
+    return epd_get_glyph(&regular_font, ' ')->advance_x;
+  }
+  int get_line_height()
+  {
+    return regular_font.advance_y;
+  }
+  void clear_screen()
+  {
+    memset(frame_buffer.data(), 0xFF, frame_buffer.size());
+  }
+  void draw_pixel(int x, int y, uint8_t color)
+  {
+    draw_pixel_4bpp(x, y, color);
+  }
+  int get_gray_levels(uint8_t *levels)
+  {
+    for (int i = 0; i < 16; i++)
+    {
+      levels[i] = i * 17;
+    }
+    return 16;
+  }
+  void draw_bitmap(int x, int y, int width, int height, const uint8_t *bitmap)
+  {
+    for (int row = 0; row < height; row++)
+    {
+      for (int column = 0; column < width; column++)
+      {
+        uint8_t pixel = bitmap[row * ((width + 1) / 2) + column / 2];
+        draw_pixel_4bpp(x + column, y + row, (column & 1 ? pixel >> 4 : pixel & 0x0F) * 17);
+      }
+    }
+  }
+  void draw_gray_span(int x, int y, const uint8_t *gray, int count)
+  {
+    for (int i = 0; i < count; i++)
+    {
+      draw_pixel_4bpp(x + i, y, gray[i]);
+    }
+  }
+  void draw_text(int x, int y, const char *text, bool bold = false, bool italic = false)
+  {
+    const EpdFont *font = m_fonts[(bold ? BOLD_SPAN : 0) | (italic ? ITALIC_SPAN : 0)];
+    int ypos = y + get_line_height();
+    const uint8_t *p = (const uint8_t *)text;
+    while (*p)
+    {
+      uint32_t code_point = utf8_next_code_point(&p);
+      const EpdGlyph *glyph = epd_get_glyph(font, code_point);
+      if (!glyph)
+      {
+        code_point = '?';
+        glyph = epd_get_glyph(font, code_point);
+      }
+      if (!glyph)
+      {
+        continue;
+      }
+      int byte_width = (glyph->width + 1) / 2;
+      size_t bitmap_size = byte_width * glyph->height;
+      const uint8_t *compressed = &font->bitmap[glyph->data_offset];
+      uint8_t *inflated = nullptr;
+      const uint8_t *bitmap = nullptr;
+      if (glyph_cache)
+      {
+        bitmap = glyph_cache->get_bitmap(font, code_point, compressed, glyph->compressed_size, bitmap_size);
+      }
+      else
+      {
+        inflated = (uint8_t *)malloc(bitmap_size + 1);
+        tinfl_decompress_mem_to_mem(inflated, bitmap_size, compressed, glyph->compressed_size, TINFL_FLAG_PARSE_ZLIB_HEADER);
+        bitmap = inflated;
+      }
+      TEST_ASSERT_NOT_NULL(bitmap);
+      for (int glyph_y = 0; glyph_y < glyph->height; glyph_y++)
+      {
+        const uint8_t *row = bitmap + glyph_y * byte_width;
+        for (int glyph_x = 0; glyph_x < glyph->width; glyph_x++)
+        {
+          uint8_t value = glyph_x & 1 ? row[glyph_x / 2] >> 4 : row[glyph_x / 2] & 0xF;
+          if (value)
+          {
+            draw_pixel_4bpp(x + glyph->left + glyph_x, ypos - glyph->top + glyph_y, (15 - value) << 4);
+          }
+        }
+      }
+      free(inflated);
+      x += glyph->advance_x;
+      glyphs_drawn++;
+    }
+  }
+};
@@ -0,0 +1,151 @@
+#include "heap_tracker.h"
+#include <atomic>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#include <errno.h>
+
+extern "C"
+{
+  void *__libc_malloc(size_t size);
+  void *__libc_calloc(size_t count, size_t size);
+  void *__libc_realloc(void *ptr, size_t size);
+  void *__libc_memalign(size_t alignment, size_t size);
+  void __libc_free(void *ptr);
+}
+
+static std::atomic<size_t> current_bytes(0);
+static std::atomic<size_t> peak_bytes(0);
+static std::atomic<size_t> allocation_count(0);
+static std::atomic<size_t> live_count(0);
+
+static void track_allocation(void *ptr)
+{
+  if (ptr)
+  {
+    size_t current = current_bytes += malloc_usable_size(ptr);
+    size_t peak = peak_bytes.load();
+    while (current > peak && !peak_bytes.compare_exchange_weak(peak, current))
+    {
+    }
+    allocation_count++;
+    live_count++;
+  }
+}
+
+static void track_free(void *ptr)
+{
+  if (ptr)
+  {
+    current_bytes -= malloc_usable_size(ptr);
+    live_count--;
+  }
+}
+
+extern "C"
+{
+  void *malloc(size_t size)
+  {
+    void *ptr = __libc_malloc(size);
+    track_allocation(ptr);
+    return ptr;
+  }
+  void *calloc(size_t count, size_t size)
+  {
+    void *ptr = __libc_calloc(count, size);
+    track_allocation(ptr);
+    return ptr;
+  }
+  void *realloc(void *ptr, size_t size)
+  {
+    track_free(ptr);
+    void *new_ptr = __libc_realloc(ptr, size);
+    // a failed realloc leaves the original allocation in place
+    track_allocation(new_ptr ? new_ptr : (size ? ptr : nullptr));
+    return new_ptr;
+  }
+  void *memalign(size_t alignment, size_t size)
+  {
+    void *ptr = __libc_memalign(alignment, size);
+    track_allocation(ptr);
+    return ptr;
+  }
+  void *aligned_alloc(size_t alignment, size_t size)
+  {
+    return memalign(alignment, size);
+  }
+  int posix_memalign(void **ptr, size_t alignment, size_t size)
+  {
+    *ptr = memalign(alignment, size);
+    return *ptr ? 0 : ENOMEM;
+  }
+  void free(void *ptr)
+  {
+    track_free(ptr);
+    __libc_free(ptr);
+  }
+}
+
+bool heap_tracker_supported()
+{
+  return true;
+}
+
+void heap_tracker_reset()
+{
+  peak_bytes = current_bytes.load();
+  allocation_count = 0;
+}
+
+size_t heap_tracker_current()
+{
+  return current_bytes;
+}
+
+size_t heap_tracker_peak()
+{
+  return peak_bytes;
+}
+
+size_t heap_tracker_allocations()
+{
+  return allocation_count;
+}
+
+size_t heap_tracker_live_allocations()
+{
+  return live_count;
+}
+
+#else
+
+bool heap_tracker_supported()
+{
+  return false;
+}
+
+void heap_tracker_reset()
+{
+}
+
+size_t heap_tracker_current()
+{
+  return 0;
+}
+
+size_t heap_tracker_peak()
+{
+  return 0;
+}
+
+size_t heap_tracker_allocations()
+{
+  return 0;
+}
+
+size_t heap_tracker_live_allocations()
+{
+  return 0;
+}
+
+#endif
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stddef.h>
+
+// Tracks the heap allocations made by the host test binary so that the tests can
+// report allocation counts and peak heap use. This works by wrapping malloc and
+// friends so it is only available on glibc - heap_tracker_supported() will return
+// false on other platforms and all the counts will be zero.
+bool heap_tracker_supported();
+// reset the allocation count and set the peak to the current heap use
+void heap_tracker_reset();
+// bytes currently allocated
+size_t heap_tracker_current();
+// highest number of bytes allocated since the last reset
+size_t heap_tracker_peak();
+// number of allocations since the last reset
+size_t heap_tracker_allocations();
+// number of allocations that are still live
+size_t heap_tracker_live_allocations();
@@ -0,0 +1,172 @@
+#pragma once
+// Just enough of the epdiy font api to use the real fonts in lib/Fonts from the host tests.
+// The glyph lookup and text measurement follow epdiy's font.c.
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct
+{
+  uint8_t width;
+  uint8_t height;
+  uint8_t advance_x;
+  int16_t left;
+  int16_t top;
+  uint16_t compressed_size;
+  uint32_t data_offset;
+} EpdGlyph;
+
+typedef struct
+{
+  uint32_t first;
+  uint32_t last;
+  uint32_t offset;
+} EpdUnicodeInterval;
+
+typedef struct
+{
+  const uint8_t *bitmap;
+  const EpdGlyph *glyph;
+  const EpdUnicodeInterval *intervals;
+  uint32_t interval_count;
+  bool compressed;
+  uint16_t advance_y;
+  int ascender;
+  int descender;
+} EpdFont;
+
+enum EpdFontFlags
+{
+  EPD_DRAW_BACKGROUND = 0x1,
+  EPD_DRAW_ALIGN_LEFT = 0x2,
+  EPD_DRAW_ALIGN_RIGHT = 0x4,
+  EPD_DRAW_ALIGN_CENTER = 0x8,
+};
+
+typedef struct
+{
+  uint8_t fg_color : 4;
+  uint8_t bg_color : 4;
+  uint32_t fallback_glyph;
+  enum EpdFontFlags flags;
+} EpdFontProperties;
+
+static inline EpdFontProperties epd_font_properties_default()
+{
+  EpdFontProperties props;
+  props.fg_color = 0;
+  props.bg_color = 15;
+  props.fallback_glyph = 0;
+  props.flags = EPD_DRAW_ALIGN_LEFT;
+  return props;
+}
+
+static inline const EpdGlyph *epd_get_glyph(const EpdFont *font, uint32_t code_point)
+{
+  // the intervals are sorted so we can binary search them
+  int low = 0;
+  int high = (int)font->interval_count - 1;
+  while (low <= high)
+  {
+    int mid = low + (high - low) / 2;
+    const EpdUnicodeInterval *interval = &font->intervals[mid];
+    if (code_point < interval->first)
+    {
+      high = mid - 1;
+    }
+    else if (code_point > interval->last)
+    {
+      low = mid + 1;
+    }
+    else
+    {
+      return &font->glyph[interval->offset + (code_point - interval->first)];
+    }
+  }
+  return nullptr;
+}
+
+static inline uint32_t epd_next_code_point(const uint8_t **string)
+{
+  const uint8_t *p = *string;
+  uint32_t code_point = *p++;
+  int continuation_bytes = 0;
+  if ((code_point & 0xE0) == 0xC0)
+  {
+    code_point &= 0x1F;
+    continuation_bytes = 1;
+  }
+  else if ((code_point & 0xF0) == 0xE0)
+  {
+    code_point &= 0x0F;
+    continuation_bytes = 2;
+  }
+  else if ((code_point & 0xF8) == 0xF0)
+  {
+    code_point &= 0x07;
+    continuation_bytes = 3;
+  }
+  else if (code_point >= 0x80)
+  {
+    code_point = 0xFFFD;
+  }
+  for (int i = 0; i < continuation_bytes; i++)
+  {
+    if ((*p & 0xC0) != 0x80)
+    {
+      code_point = 0xFFFD;
+      break;
+    }
+    code_point = (code_point << 6) | (*p++ & 0x3F);
+  }
+  *string = p;
+  return code_point;
+}
+
+static inline void epd_get_text_bounds(const EpdFont *font, const char *string, const int *x, const int *y,
+                                       int *x1, int *y1, int *w, int *h, const EpdFontProperties *props)
+{
+  if (*string == '\0')
+  {
+    *w = 0;
+    *h = 0;
+    *x1 = *x;
+    *y1 = *y;
+    return;
+  }
+  int min_x = 100000, min_y = 100000, max_x = -1, max_y = -1;
+  int temp_x = *x;
+  int temp_y = *y + font->ascender;
+  const uint8_t *p = (const uint8_t *)string;
+  while (*p)
+  {
+    uint32_t code_point = epd_next_code_point(&p);
+    const EpdGlyph *glyph = epd_get_glyph(font, code_point);
+    if (!glyph)
+    {
+      glyph = epd_get_glyph(font, props->fallback_glyph);
+    }
+    if (!glyph)
+    {
+      continue;
+    }
+    int gx1 = temp_x + glyph->left;
+    int gy1 = temp_y + (glyph->top - glyph->height);
+    int gx2 = gx1 + glyph->width;
+    int gy2 = gy1 + glyph->height;
+    if (props->flags & EPD_DRAW_BACKGROUND)
+    {
+      gx1 = gx1 < temp_x ? gx1 : temp_x;
+      gx2 = gx2 > temp_x + glyph->advance_x ? gx2 : temp_x + glyph->advance_x;
+    }
+    min_x = gx1 < min_x ? gx1 : min_x;
+    min_y = gy1 < min_y ? gy1 : min_y;
+    max_x = gx2 > max_x ? gx2 : max_x;
+    max_y = gy2 > max_y ? gy2 : max_y;
+    temp_x += glyph->advance_x;
+  }
+  *x1 = *x < min_x ? *x : min_x;
+  *w = max_x - *x1;
+  *y1 = min_y;
+  *h = max_y - min_y;
+}
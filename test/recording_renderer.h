@@ -0,0 +1,67 @@
+#pragma once
+
+#include <string>
+#include <string.h>
+#include <stdio.h>
+#include <Renderer/Renderer.h>
+
+// a renderer that just records what it is asked to draw so that tests can
+// compare the output of different code paths
+class RecordingRenderer : public Renderer
+{
+public:
+  std::string output;
+  int page_width;
+  int page_height;
+  int busy_count = 0;
+
+  RecordingRenderer(int page_width = 100, int page_height = 100) : page_width(page_width), page_height(page_height) {}
+  void record(const char *format, int a, int b, int c = 0, int d = 0, const char *text = "")
+  {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), format, a, b, c, d);
+    output += buffer;
+    output += text;
+    output += "\n";
+  }
+  virtual void draw_image(const std::string &filename, const uint8_t *data, size_t data_size, int x, int y, int width, int height)
+  {
+    record("image %d,%d %dx%d ", x, y, width, height, filename.c_str());
+  }
+  virtual bool get_image_size(const std::string &filename, const uint8_t *data, size_t data_size, int *width, int *height)
+  {
+    *width = 10;
+    *height = 10;
+    return true;
+  }
+  virtual void draw_pixel(int x, int y, uint8_t color) {}
+  virtual int get_text_width(const char *text, bool bold = false, bool italic = false)
+  {
+    return strlen(text);
+  }
+  virtual void draw_text(int x, int y, const char *text, bool bold = false, bool italic = false)
+  {
+    record("text %d,%d %d%d ", x, y, bold, italic, text);
+  }
+  virtual void draw_rect(int x, int y, int width, int height, uint8_t color = 0) {}
+  virtual void draw_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint8_t color) {}
+  virtual void draw_circle(int x, int y, int r, uint8_t color = 0) {}
+  virtual void fill_rect(int x, int y, int width, int height, uint8_t color = 0) {}
+  virtual void fill_triangle(int x0, int y0, int x1, int y1, int x2, int y2, uint8_t color) {}
+  virtual void fill_circle(int x, int y, int r, uint8_t color = 0) {}
+  virtual void show_busy()
+  {
+    busy_count++;
+  }
+  virtual void clear_screen()
+  {
+    output += "clear\n";
+  }
+  virtual int get_page_width() { return page_width; }
+  virtual int get_page_height() { return page_height; }
+  virtual int get_space_width() { return 1; }
+  virtual int get_line_height() { return 1; }
+  virtual void needs_gray(uint8_t color) {}
+  virtual bool has_gray() { return false; }
+  virtual void show_img(int x, int y, int width, int height, const uint8_t *img_buffer) {}
+};
@@ -74,3 +74,24 @@ void test_parser(void)
     TEST_ASSERT_EQUAL_STRING("HTML/test.png", reinterpret_cast<ImageBlock *>(img_block)->m_src.c_str());
   }
 }
+
+void test_parser_malformed_html(void)
+{
+  // not valid xml but we should still get something sensible out of it
+  const char *html =
+      "<HTML><HEAD><TITLE>Test</TITLE></HEAD>"
+      "<BODY>"
+      "<H1>This is a title"
+      "<P>Unclosed paragraph & stray ampersand"
+      "<p>Unquoted <img src=test.png> image"
+      "<table><tr><td>skipped"
+      "</table>"
+      "<p>Bananas!";
+  RubbishHtmlParser parser(html, strlen(html), "");
+  TEST_ASSERT_EQUAL(6, parser.get_blocks().size());
+  auto iterator = parser.get_blocks().begin();
+  std::advance(iterator, 3);
+  Block *img_block = *iterator;
+  TEST_ASSERT_EQUAL(BlockType::IMAGE_BLOCK, img_block->getType());
+  TEST_ASSERT_EQUAL_STRING("test.png", reinterpret_cast<ImageBlock *>(img_block)->m_src.c_str());
+}
@@ -0,0 +1,132 @@
+#include <unity.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <EpubList/Epub.h>
+#include <RubbishHtmlParser/Arena.h>
+#include <RubbishHtmlParser/RubbishHtmlParser.h>
+#include "recording_renderer.h"
+#include "heap_tracker.h"
+#include "benchmark.h"
+
+class TestArenaObject : public ArenaObject
+{
+public:
+  std::string value;
+  TestArenaObject(const char *value) : value(value) {}
+};
+
+void test_arena_allocations(void)
+{
+  Arena arena(1024);
+  // small allocations all come from the same chunk and are aligned
+  uint8_t *byte = (uint8_t *)arena.allocate(1, 1);
+  uint32_t *word = (uint32_t *)arena.allocate(sizeof(uint32_t), alignof(uint32_t));
+  TEST_ASSERT_NOT_NULL(byte);
+  TEST_ASSERT_EQUAL(0, (uintptr_t)word % alignof(uint32_t));
+  TEST_ASSERT_EQUAL(1, arena.get_chunk_count());
+  for (int i = 0; i < 100; i++)
+  {
+    arena.allocate(100);
+  }
+  TEST_ASSERT_TRUE(arena.get_chunk_count() > 1);
+  TEST_ASSERT_EQUAL(102, arena.get_allocation_count());
+  // big allocations get their own chunk which is freed when it is released
+  size_t chunks = arena.get_chunk_count();
+  void *big = arena.allocate(4096);
+  TEST_ASSERT_EQUAL(chunks + 1, arena.get_chunk_count());
+  arena.release(big, 4096);
+  TEST_ASSERT_EQUAL(chunks, arena.get_chunk_count());
+  // small released allocations get reused
+  void *small = arena.allocate(64);
+  arena.release(small, 64);
+  TEST_ASSERT_EQUAL_PTR(small, arena.allocate(40));
+  // containers can use the arena
+  ArenaVector<int> numbers{ArenaAllocator<int>(&arena)};
+  for (int i = 0; i < 1000; i++)
+  {
+    numbers.push_back(i);
+  }
+  TEST_ASSERT_EQUAL(999, numbers.back());
+  TEST_ASSERT_EQUAL_STRING("hello", arena.copy_string("hello world", 5));
+}
+
+void test_arena_objects(void)
+{
+  if (!heap_tracker_supported())
+  {
+    TEST_IGNORE_MESSAGE("Heap tracking is not supported on this platform");
+  }
+  heap_tracker_reset();
+  size_t live = heap_tracker_live_allocations();
+  {
+    Arena arena;
+    // objects in the arena just use the arena's chunk
+    TestArenaObject *in_arena = new (&arena) TestArenaObject("in the arena");
+    TEST_ASSERT_EQUAL(live + 1, heap_tracker_live_allocations());
+    delete in_arena;
+    TEST_ASSERT_EQUAL(live + 1, heap_tracker_live_allocations());
+    // objects without an arena are on the heap and get freed as normal
+    TestArenaObject *on_heap = new TestArenaObject("on the heap");
+    TEST_ASSERT_EQUAL(live + 2, heap_tracker_live_allocations());
+    TEST_ASSERT_EQUAL_STRING("on the heap", on_heap->value.c_str());
+    delete on_heap;
+    TEST_ASSERT_EQUAL(live + 1, heap_tracker_live_allocations());
+  }
+  // the arena's chunk goes with the arena
+  TEST_ASSERT_EQUAL(live, heap_tracker_live_allocations());
+}
+
+void benchmark_arena_section_allocations(void)
+{
+  if (!heap_tracker_supported())
+  {
+    TEST_IGNORE_MESSAGE("Heap tracking is not supported on this platform");
+  }
+  const char *fixtures[] = {
+      "fixtures/no_oebps.epub",
+      "fixtures/oebps.epub",
+      "fixtures/relative_paths.epub",
+  };
+  for (auto fixture : fixtures)
+  {
+    Epub epub(fixture);
+    TEST_ASSERT_TRUE(epub.load());
+    // find the biggest chapter in the book and pull it into memory
+    size_t largest_size = 0;
+    char *html = nullptr;
+    for (int i = 0; i < epub.get_spine_items_count(); i++)
+    {
+      size_t size = 0;
+      char *data = (char *)epub.get_item_contents(epub.get_spine_item(i), &size);
+      if (size > largest_size)
+      {
+        free(html);
+        html = data;
+        largest_size = size;
+      }
+      else
+      {
+        free(data);
+      }
+    }
+    RecordingRenderer renderer;
+    heap_tracker_reset();
+    size_t live = heap_tracker_live_allocations();
+    RubbishHtmlParser *parser = new RubbishHtmlParser(html, largest_size, "");
+    parser->layout(&renderer, &epub);
+    // every arena allocation would have been a separate heap allocation without the arena
+    size_t arena_allocations = parser->get_arena().get_allocation_count();
+    size_t heap_allocations = heap_tracker_allocations();
+    // the number of separate blocks the section holds on the heap is what fragments it
+    size_t live_blocks = heap_tracker_live_allocations() - live;
+    size_t arena_bytes = parser->get_arena().get_bytes_reserved();
+    size_t arena_chunks = parser->get_arena().get_chunk_count();
+    delete parser;
+    TEST_ASSERT_EQUAL(live, heap_tracker_live_allocations());
+    free(html);
+    BENCHMARK_REPORT("%s: largest chapter %zu bytes, %zu allocations without the arena, %zu heap allocations with it, %zu live heap blocks, %zu bytes in %zu arena chunks",
+                     fixture, largest_size, arena_allocations, heap_allocations, live_blocks, arena_bytes, arena_chunks);
+    TEST_ASSERT_LESS_THAN(arena_allocations / 10, live_blocks);
+  }
+}
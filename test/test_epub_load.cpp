@@ -1,5 +1,14 @@
 #include <unity.h>
 #include <EpubList/Epub.h>
+#include <ZipFile/ZipFile.h>
+#include "heap_tracker.h"
+#include "benchmark.h"
+
+static const char *fixtures[] = {
+    "fixtures/no_oebps.epub",
+    "fixtures/oebps.epub",
+    "fixtures/relative_paths.epub",
+};
 
 void test_epub_no_oebps_load(void)
 {
@@ -40,3 +49,126 @@ void test_epub_load(void)
   TEST_ASSERT_EQUAL_STRING("OEBPS/@public@vhost@g@gutenberg@html@files@43@43-h@images@cover.jpg", epub->get_cover_image_item().c_str());
   TEST_ASSERT_NOT_NULL(epub->get_item_contents(epub->get_cover_image_item()));
 }
+
+void test_epub_load_levels(void)
+{
+  for (auto fixture : fixtures)
+  {
+    Epub full(fixture);
+    TEST_ASSERT_TRUE(full.load());
+    // the metadata is the same however it's read but nothing else is there
+    Epub epub(fixture);
+    TEST_ASSERT_TRUE(epub.load(EPUB_LOAD_METADATA));
+    TEST_ASSERT_EQUAL_STRING(full.get_title().c_str(), epub.get_title().c_str());
+    TEST_ASSERT_EQUAL_STRING(full.get_author().c_str(), epub.get_author().c_str());
+    TEST_ASSERT_EQUAL_STRING(full.get_cover_image_item().c_str(), epub.get_cover_image_item().c_str());
+    TEST_ASSERT_EQUAL(0, epub.get_spine_items_count());
+    TEST_ASSERT_EQUAL(0, epub.get_toc_items_count());
+    // then the spine can be added
+    TEST_ASSERT_TRUE(epub.load(EPUB_LOAD_SPINE));
+    TEST_ASSERT_EQUAL(full.get_spine_items_count(), epub.get_spine_items_count());
+    TEST_ASSERT_EQUAL_STRING(full.get_spine_item(0), epub.get_spine_item(0));
+    TEST_ASSERT_EQUAL(0, epub.get_toc_items_count());
+    // and the table of contents
+    TEST_ASSERT_TRUE(epub.load(EPUB_LOAD_TOC));
+    TEST_ASSERT_EQUAL(full.get_spine_items_count(), epub.get_spine_items_count());
+    TEST_ASSERT_EQUAL(full.get_toc_items_count(), epub.get_toc_items_count());
+    // asking for less than we've got doesn't do anything
+    size_t extracted = epub.get_bytes_extracted();
+    TEST_ASSERT_TRUE(epub.load(EPUB_LOAD_METADATA));
+    TEST_ASSERT_EQUAL(extracted, epub.get_bytes_extracted());
+    TEST_ASSERT_EQUAL(full.get_spine_items_count(), epub.get_spine_items_count());
+  }
+  // the metadata comes from the start of the content.opf so we don't need to decompress all of it
+  Epub epub("fixtures/relative_paths.epub");
+  TEST_ASSERT_TRUE(epub.load(EPUB_LOAD_METADATA));
+  TEST_ASSERT_EQUAL_STRING("Alejandra Pizarnik", epub.get_author().c_str());
+  TEST_ASSERT_LESS_THAN(60049, epub.get_bytes_extracted());
+}
+
+void benchmark_epub_load_levels(void)
+{
+  if (!heap_tracker_supported())
+  {
+    TEST_IGNORE_MESSAGE("Heap tracking is not supported on this platform");
+  }
+  const char *level_names[] = {"metadata", "spine", "toc"};
+  for (auto fixture : fixtures)
+  {
+    for (int level = EPUB_LOAD_METADATA; level <= EPUB_LOAD_TOC; level++)
+    {
+      const int runs = 10;
+      size_t allocations = 0, peak = 0, extracted = 0;
+      BenchmarkTimer timer;
+      for (int i = 0; i < runs; i++)
+      {
+        heap_tracker_reset();
+        size_t start_heap = heap_tracker_current();
+        Epub epub(fixture);
+        TEST_ASSERT_TRUE(epub.load((EpubLoadLevel)level));
+        allocations = heap_tracker_allocations();
+        peak = heap_tracker_peak() - start_heap;
+        extracted = epub.get_bytes_extracted();
+      }
+      BENCHMARK_REPORT("%s load %s: %.2f ms, %zu allocations, %zu bytes peak heap, %zu bytes decompressed",
+                       fixture, level_names[level], timer.elapsed_ms() / runs, allocations, peak, extracted);
+    }
+  }
+}
+
+void benchmark_epub_lookups(void)
+{
+  if (!heap_tracker_supported())
+  {
+    TEST_IGNORE_MESSAGE("Heap tracking is not supported on this platform");
+  }
+  // the zip file's central directory is a fixed cost that has nothing to do with how we parse the book
+  heap_tracker_reset();
+  size_t start_heap = heap_tracker_current();
+  ZipFile *zip = new ZipFile("fixtures/relative_paths.epub");
+  size_t mimetype_size = 0;
+  TEST_ASSERT_TRUE(zip->get_file_size("mimetype", &mimetype_size));
+  size_t zip_retained = heap_tracker_current() - start_heap;
+  size_t zip_allocations = heap_tracker_live_allocations();
+  delete zip;
+  heap_tracker_reset();
+  start_heap = heap_tracker_current();
+  BenchmarkTimer timer;
+  Epub *epub = new Epub("fixtures/relative_paths.epub");
+  TEST_ASSERT_TRUE(epub->load());
+  double load_ms = timer.elapsed_ms();
+  size_t allocations = heap_tracker_allocations();
+  size_t peak = heap_tracker_peak() - start_heap;
+  // what's left once the parsing is done
+  size_t retained = heap_tracker_current() - start_heap - zip_retained;
+  size_t live_allocations = heap_tracker_live_allocations() - zip_allocations;
+  BENCHMARK_REPORT("relative_paths.epub load: %.2f ms, %zu allocations, %zu bytes peak heap, %zu bytes in %zu allocations kept for %d spine items and %d toc entries",
+                   load_ms, allocations, peak, retained, live_allocations, epub->get_spine_items_count(), epub->get_toc_items_count());
+  // every toc entry resolved to its section
+  const int runs = 100;
+  int total = 0;
+  timer.reset();
+  for (int run = 0; run < runs; run++)
+  {
+    for (int i = 0; i < epub->get_toc_items_count(); i++)
+    {
+      total += epub->get_spine_index_for_toc_index(i);
+    }
+  }
+  double toc_us = timer.elapsed_ms() * 1000 / (runs * epub->get_toc_items_count());
+  TEST_ASSERT_GREATER_THAN(0, total);
+  // and every section fetched in order
+  timer.reset();
+  size_t length = 0;
+  for (int run = 0; run < runs; run++)
+  {
+    for (int i = 0; i < epub->get_spine_items_count(); i++)
+    {
+      length += strlen(epub->get_spine_item(i));
+    }
+  }
+  double spine_us = timer.elapsed_ms() * 1000 / (runs * epub->get_spine_items_count());
+  TEST_ASSERT_GREATER_THAN(0, length);
+  BENCHMARK_REPORT("relative_paths.epub lookups: toc entry to section %.3f us, section href %.3f us", toc_us, spine_us);
+  delete epub;
+}
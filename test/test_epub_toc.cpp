@@ -0,0 +1,221 @@
+#include <unity.h>
+#include <string.h>
+#include <string>
+#include <EpubList/Epub.h>
+#include <EpubList/TocParser.h>
+#include <EpubList/EpubToc.h>
+#include <EpubList/State.h>
+#include "recording_renderer.h"
+#include "epub_builder.h"
+#include "heap_tracker.h"
+#include "benchmark.h"
+
+static int expected_level(int i)
+{
+  return i % 7 == 0 ? 0 : (i % 7 == 1 || i % 7 == 4 ? 1 : 2);
+}
+
+// parts with chapters in them and sections in those - three levels of nesting
+static void add_nested_chapters(EpubBuilder &builder, int count)
+{
+  for (int i = 0; i < count; i++)
+  {
+    builder.add_chapter("Entry-" + std::to_string(i), "<p>Entry " + std::to_string(i) + "</p>", expected_level(i));
+  }
+}
+
+// every entry comes after its parent and is one level further in
+static void check_toc_structure(Epub &epub)
+{
+  for (int i = 0; i < epub.get_toc_items_count(); i++)
+  {
+    int parent = epub.get_toc_item_parent(i);
+    TEST_ASSERT_LESS_THAN(i, parent);
+    TEST_ASSERT_EQUAL(parent == -1 ? 0 : epub.get_toc_item_level(parent) + 1, epub.get_toc_item_level(i));
+    // and the entries in between are all inside the parent as well
+    for (int j = parent + 1; parent >= 0 && j < i; j++)
+    {
+      TEST_ASSERT_GREATER_THAN(epub.get_toc_item_level(parent), epub.get_toc_item_level(j));
+    }
+  }
+}
+
+void test_epub_toc_nested_ncx(void)
+{
+  // a real book with three levels in its ncx
+  Epub epub("fixtures/relative_paths.epub");
+  TEST_ASSERT_TRUE(epub.load());
+  TEST_ASSERT_EQUAL(365, epub.get_toc_items_count());
+  int level_counts[3] = {0, 0, 0};
+  for (int i = 0; i < epub.get_toc_items_count(); i++)
+  {
+    TEST_ASSERT_LESS_THAN(3, epub.get_toc_item_level(i));
+    level_counts[epub.get_toc_item_level(i)]++;
+    // every entry points at a section of the book
+    TEST_ASSERT_GREATER_OR_EQUAL(0, epub.get_spine_index(epub.get_toc_item_href(i)));
+  }
+  TEST_ASSERT_EQUAL(13, level_counts[0]);
+  TEST_ASSERT_EQUAL(117, level_counts[1]);
+  TEST_ASSERT_EQUAL(235, level_counts[2]);
+  check_toc_structure(epub);
+  TEST_ASSERT_EQUAL_STRING("Cubierta", epub.get_toc_item_title(0));
+  TEST_ASSERT_EQUAL_STRING("OEBPS/Text/cubierta.xhtml", epub.get_toc_item_href(0));
+  TEST_ASSERT_EQUAL_STRING("La tierra m\xC3\xA1s lejana (1955)", epub.get_toc_item_title(2));
+  TEST_ASSERT_EQUAL_STRING("D\xC3\xAD" "as contra el ensue\xC3\xB1o", epub.get_toc_item_title(3));
+  TEST_ASSERT_EQUAL(2, epub.get_toc_item_parent(3));
+  TEST_ASSERT_EQUAL(1, epub.get_toc_item_level(3));
+  TEST_ASSERT_EQUAL_STRING("Humo", epub.get_toc_item_title(4));
+  TEST_ASSERT_EQUAL(2, epub.get_toc_item_parent(4));
+}
+
+void test_epub_toc_relative_manifest(void)
+{
+  // the manifest hrefs start with "./" and "../" but the toc links are relative to the nav document
+  Epub epub("fixtures/relative_manifest.epub");
+  TEST_ASSERT_TRUE(epub.load());
+  TEST_ASSERT_EQUAL(2, epub.get_spine_items_count());
+  TEST_ASSERT_EQUAL_STRING("OEBPS/Text/one.xhtml", epub.get_spine_item(0));
+  TEST_ASSERT_EQUAL_STRING("OEBPS/Text/two.xhtml", epub.get_spine_item(1));
+  TEST_ASSERT_EQUAL_STRING("OEBPS/Images/cover.svg", epub.get_cover_image_item().c_str());
+  TEST_ASSERT_EQUAL(2, epub.get_toc_items_count());
+  TEST_ASSERT_EQUAL_STRING("Two", epub.get_toc_item_title(1));
+  TEST_ASSERT_EQUAL_STRING("end", epub.get_toc_item_anchor(1));
+  // so they still go to the right sections
+  TEST_ASSERT_EQUAL(0, epub.get_spine_index_for_toc_index(0));
+  TEST_ASSERT_EQUAL(1, epub.get_spine_index_for_toc_index(1));
+  // and just the metadata gets the same cover
+  Epub metadata("fixtures/relative_manifest.epub");
+  TEST_ASSERT_TRUE(metadata.load(EPUB_LOAD_METADATA));
+  TEST_ASSERT_EQUAL_STRING("OEBPS/Images/cover.svg", metadata.get_cover_image_item().c_str());
+}
+
+void test_epub_toc_nested_builder(void)
+{
+  // the same nested contents as an ncx and as an EPUB3 navigation document in a different folder
+  for (int use_nav = 0; use_nav < 2; use_nav++)
+  {
+    EpubBuilder builder("Nested", "Author");
+    builder.use_nav(use_nav);
+    add_nested_chapters(builder, 30);
+    TEST_ASSERT_TRUE(builder.write("/tmp/nested_toc.epub"));
+    Epub epub("/tmp/nested_toc.epub");
+    TEST_ASSERT_TRUE(epub.load());
+    // the landmarks in the navigation document aren't part of the contents
+    TEST_ASSERT_EQUAL(30, epub.get_toc_items_count());
+    for (int i = 0; i < epub.get_toc_items_count(); i++)
+    {
+      TEST_ASSERT_EQUAL_STRING(("Entry-" + std::to_string(i)).c_str(), epub.get_toc_item_title(i));
+      TEST_ASSERT_EQUAL_STRING(("OEBPS/chapter" + std::to_string(i) + ".xhtml").c_str(), epub.get_toc_item_href(i));
+      TEST_ASSERT_EQUAL_STRING("", epub.get_toc_item_anchor(i));
+      TEST_ASSERT_EQUAL(expected_level(i), epub.get_toc_item_level(i));
+      TEST_ASSERT_EQUAL(i, epub.get_spine_index_for_toc_index(i));
+    }
+    check_toc_structure(epub);
+    remove("/tmp/nested_toc.epub");
+  }
+}
+
+void test_epub_toc_handlers(void)
+{
+  // headings without links go to their first child and entries without labels or links don't break anything - and
+  // the toc can have other types as well
+  const char *nav = "<html><body><nav epub:type=\"landmarks\"><ol><li><a href=\"cover.xhtml\">Cover</a></li></ol></nav>"
+                    "<nav epub:type=\" toc\n  bodymatter\"><h2>Contents</h2><ol>"
+                    "<li><span>Part\n   One</span><ol><li><a href=\"../Text/one.xhtml#start\">Chapter <b>1</b> &amp; more</a></li>"
+                    "<li><a href=\"./two.xhtml\">Two</a><ol><li><a href=\"#local\">Local</a></li></ol></li></ol></li>"
+                    "<li><a>No link</a></li><li></li></ol></nav></body></html>";
+  StringPool strings;
+  std::vector<EpubTocEntry> toc;
+  NavTocHandler nav_handler(strings, toc, "OEBPS/Nav/nav.xhtml");
+  HtmlTokenizer nav_tokenizer(&nav_handler);
+  nav_tokenizer.parse(nav, strlen(nav));
+  nav_handler.finish();
+  TEST_ASSERT_EQUAL(6, toc.size());
+  const char *titles[] = {"Part One", "Chapter 1 & more", "Two", "Local", "No link", ""};
+  const char *hrefs[] = {"OEBPS/Text/one.xhtml", "OEBPS/Text/one.xhtml", "OEBPS/Nav/two.xhtml", "OEBPS/Nav/nav.xhtml", "", ""};
+  const char *anchors[] = {"start", "start", "", "local", "", ""};
+  int parents[] = {-1, 0, 0, 2, -1, -1};
+  for (int i = 0; i < 6; i++)
+  {
+    TEST_ASSERT_EQUAL_STRING(titles[i], strings.get(toc[i].title));
+    TEST_ASSERT_EQUAL_STRING(hrefs[i], strings.get(toc[i].href));
+    TEST_ASSERT_EQUAL_STRING(anchors[i], strings.get(toc[i].anchor));
+    TEST_ASSERT_EQUAL(parents[i], toc[i].parent);
+  }
+
+  const char *ncx = "<ncx><docTitle><text>Book</text></docTitle><navMap>"
+                    "<navPoint><navLabel><text>First</text></navLabel><content src=\"a.xhtml#x\"/>"
+                    "<navPoint><content src=\"b.xhtml\"/></navPoint>"
+                    "<navPoint><navLabel></navLabel></navPoint></navPoint>"
+                    "<navPoint><navLabel><text>Last</text></navLabel><content src=\"c.xhtml\"/>"
+                    "</navMap><pageList><pageTarget><navLabel><text>1</text></navLabel><content src=\"a.xhtml\"/></pageTarget></pageList></ncx>";
+  toc.clear();
+  NcxTocHandler ncx_handler(strings, toc, "toc.ncx");
+  HtmlTokenizer ncx_tokenizer(&ncx_handler);
+  ncx_tokenizer.parse(ncx, strlen(ncx));
+  ncx_handler.finish();
+  TEST_ASSERT_EQUAL(4, toc.size());
+  TEST_ASSERT_EQUAL_STRING("First", strings.get(toc[0].title));
+  TEST_ASSERT_EQUAL_STRING("a.xhtml", strings.get(toc[0].href));
+  TEST_ASSERT_EQUAL_STRING("x", strings.get(toc[0].anchor));
+  TEST_ASSERT_EQUAL_STRING("", strings.get(toc[1].title));
+  TEST_ASSERT_EQUAL_STRING("b.xhtml", strings.get(toc[1].href));
+  TEST_ASSERT_EQUAL(0, toc[1].parent);
+  TEST_ASSERT_EQUAL(0, toc[2].parent);
+  // the last one is never closed
+  TEST_ASSERT_EQUAL_STRING("Last", strings.get(toc[3].title));
+  TEST_ASSERT_EQUAL(-1, toc[3].parent);
+}
+
+void test_epub_toc_render(void)
+{
+  EpubListItem selected_epub;
+  memset(&selected_epub, 0, sizeof(selected_epub));
+  strcpy(selected_epub.path, "fixtures/relative_paths.epub");
+  EpubTocState state = {-1, -1, 0};
+  RecordingRenderer renderer(200, 600);
+  EpubToc toc(selected_epub, state, &renderer);
+  toc.load();
+  toc.render();
+  // only the first page of entries is drawn and the nested ones are indented
+  TEST_ASSERT_TRUE(renderer.output.find("text 10,") != std::string::npos);
+  TEST_ASSERT_TRUE(renderer.output.find(" Cubierta\n") != std::string::npos);
+  TEST_ASSERT_TRUE(renderer.output.find("text 30,") != std::string::npos);
+  TEST_ASSERT_TRUE(renderer.output.find(" Humo\n") != std::string::npos);
+  TEST_ASSERT_TRUE(renderer.output.find(" Agua\n") == std::string::npos);
+  // moving up from the top goes round to the last entry
+  renderer.output.clear();
+  toc.prev();
+  toc.render();
+  TEST_ASSERT_EQUAL(364, state.selected_item);
+  TEST_ASSERT_TRUE(renderer.output.find(" Cubierta\n") == std::string::npos);
+}
+
+void benchmark_epub_toc_load(void)
+{
+  if (!heap_tracker_supported())
+  {
+    TEST_IGNORE_MESSAGE("Heap tracking is not supported on this platform");
+  }
+  EpubBuilder builder("Nested", "Author");
+  add_nested_chapters(builder, 1000);
+  TEST_ASSERT_TRUE(builder.write("/tmp/nested_toc.epub"));
+  const char *books[] = {"fixtures/oebps.epub", "fixtures/relative_paths.epub", "/tmp/nested_toc.epub"};
+  for (auto book : books)
+  {
+    Epub *epub = new Epub(book);
+    TEST_ASSERT_TRUE(epub->load(EPUB_LOAD_SPINE));
+    // just the cost of the table of contents on top of the spine
+    heap_tracker_reset();
+    size_t start_heap = heap_tracker_current();
+    size_t start_allocations = heap_tracker_live_allocations();
+    BenchmarkTimer timer;
+    TEST_ASSERT_TRUE(epub->load(EPUB_LOAD_TOC));
+    double load_ms = timer.elapsed_ms();
+    BENCHMARK_REPORT("%s toc: %d entries in %.2f ms, %zu allocations, %zu bytes peak heap, %zu bytes in %zu allocations kept",
+                     book, epub->get_toc_items_count(), load_ms, heap_tracker_allocations(), heap_tracker_peak() - start_heap,
+                     heap_tracker_current() - start_heap, heap_tracker_live_allocations() - start_allocations);
+    delete epub;
+  }
+  remove("/tmp/nested_toc.epub");
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+
+// the directory inside the epub that a spine item's links are relative to
+static inline std::string get_base_path(const std::string &item)
+{
+  return item.substr(0, item.find_last_of('/') + 1);
+}
+
+// copy a fixture into a directory the test owns
+static inline bool copy_file(const char *from, const std::string &to)
+{
+  FILE *in = fopen(from, "rb");
+  FILE *out = fopen(to.c_str(), "wb");
+  bool success = in && out;
+  char buffer[4096];
+  size_t length;
+  while (success && (length = fread(buffer, 1, sizeof(buffer), in)) > 0)
+  {
+    success = fwrite(buffer, 1, length, out) == length;
+  }
+  if (in)
+  {
+    fclose(in);
+  }
+  if (out)
+  {
+    fclose(out);
+  }
+  return success;
+}
@@ -0,0 +1,165 @@
+#include <unity.h>
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <EpubList/Epub.h>
+#include <RubbishHtmlParser/RubbishHtmlParser.h>
+#include <Renderer/FrameCodec.h>
+#include "glyph_drawing_renderer.h"
+#include "heap_tracker.h"
+#include "benchmark.h"
+
+static const int WIDTH = 200;
+static const int HEIGHT = 100;
+
+static std::vector<uint8_t> encode(FrameCodec &codec, const std::vector<uint8_t> &frame, size_t *largest_chunk = nullptr)
+{
+  std::vector<uint8_t> encoded;
+  TEST_ASSERT_TRUE(codec.encode(frame.data(), [&](const uint8_t *data, size_t length)
+                                {
+                                  if (largest_chunk)
+                                  {
+                                    *largest_chunk = std::max(*largest_chunk, length);
+                                  }
+                                  encoded.insert(encoded.end(), data, data + length);
+                                  return true; }));
+  return encoded;
+}
+
+// feed the encoded data back a few bytes at a time so the runs get split across reads
+static bool decode(FrameCodec &codec, const std::vector<uint8_t> &encoded, std::vector<uint8_t> &frame, size_t read_size)
+{
+  size_t position = 0;
+  return codec.decode([&](uint8_t *data, size_t length)
+                      {
+                        size_t to_read = std::min(std::min(length, read_size), encoded.size() - position);
+                        memcpy(data, encoded.data() + position, to_read);
+                        position += to_read;
+                        return to_read; },
+                      frame.data());
+}
+
+void test_frame_codec_round_trip(void)
+{
+  FrameCodec codec(WIDTH, HEIGHT);
+  size_t size = WIDTH * HEIGHT / 2;
+  std::vector<std::vector<uint8_t>> frames;
+  // all white
+  frames.push_back(std::vector<uint8_t>(size, 0xFF));
+  // text-like rows - runs of white with a few dark bytes and some rows repeated
+  std::vector<uint8_t> text(size, 0xFF);
+  for (int y = 10; y < 90; y++)
+  {
+    for (int x = 5; x < 95; x += 7)
+    {
+      text[y * WIDTH / 2 + x] = (y % 3 == 0) ? 0x00 : 0x3F;
+      text[y * WIDTH / 2 + x + 1] = 0x80 + y;
+    }
+  }
+  frames.push_back(text);
+  // a gray image with long runs of the same byte and a stripe in the first row
+  std::vector<uint8_t> image(size, 0x77);
+  memset(image.data(), 0x12, 30);
+  frames.push_back(image);
+  // noise - nothing to compress at all
+  std::vector<uint8_t> noise(size);
+  srand(1234);
+  for (auto &pixel : noise)
+  {
+    pixel = rand() & 0xFF;
+  }
+  frames.push_back(noise);
+  for (auto &frame : frames)
+  {
+    size_t largest_chunk = 0;
+    std::vector<uint8_t> encoded = encode(codec, frame, &largest_chunk);
+    TEST_ASSERT_LESS_OR_EQUAL(FrameCodec::CHUNK_SIZE, largest_chunk);
+    for (size_t read_size : {(size_t)1, (size_t)7, FrameCodec::CHUNK_SIZE})
+    {
+      std::vector<uint8_t> decoded(size, 0);
+      TEST_ASSERT_TRUE(decode(codec, encoded, decoded, read_size));
+      TEST_ASSERT_TRUE(decoded == frame);
+    }
+  }
+  // mostly white pages come out tiny and noise doesn't grow by much
+  TEST_ASSERT_LESS_THAN(16, encode(codec, frames[0]).size());
+  TEST_ASSERT_LESS_THAN(size / 2, encode(codec, frames[1]).size());
+  TEST_ASSERT_LESS_THAN(size + size / 32, encode(codec, frames[3]).size());
+
+  // anything cut short, with extra on the end or for a different size of frame is rejected
+  std::vector<uint8_t> encoded = encode(codec, frames[1]);
+  std::vector<uint8_t> decoded(size);
+  std::vector<uint8_t> truncated(encoded.begin(), encoded.end() - 1);
+  TEST_ASSERT_FALSE(decode(codec, truncated, decoded, FrameCodec::CHUNK_SIZE));
+  std::vector<uint8_t> extended = encoded;
+  extended.push_back(0);
+  TEST_ASSERT_FALSE(decode(codec, extended, decoded, FrameCodec::CHUNK_SIZE));
+  FrameCodec other_codec(WIDTH, HEIGHT + 2);
+  std::vector<uint8_t> other_decoded(WIDTH * (HEIGHT + 2) / 2);
+  TEST_ASSERT_FALSE(decode(other_codec, encoded, other_decoded, FrameCodec::CHUNK_SIZE));
+  TEST_ASSERT_FALSE(decode(codec, std::vector<uint8_t>(), decoded, FrameCodec::CHUNK_SIZE));
+
+  // and through a file
+  TEST_ASSERT_TRUE(codec.save(frames[1].data(), "/tmp/front_buffer.fc"));
+  std::fill(decoded.begin(), decoded.end(), 0);
+  TEST_ASSERT_TRUE(codec.load("/tmp/front_buffer.fc", decoded.data()));
+  TEST_ASSERT_TRUE(decoded == frames[1]);
+  remove("/tmp/front_buffer.fc");
+  TEST_ASSERT_FALSE(codec.load("/tmp/front_buffer.fc", decoded.data()));
+}
+
+void benchmark_frame_codec(void)
+{
+  Epub epub("fixtures/oebps.epub");
+  TEST_ASSERT_TRUE(epub.load());
+  std::string item = epub.get_spine_item(1);
+  GlyphDrawingRenderer renderer;
+  RubbishHtmlParser parser(&epub, item, item.substr(0, item.find_last_of('/') + 1));
+  parser.layout(&renderer, &epub);
+  FrameCodec codec(renderer.page_width, renderer.page_height);
+  size_t frame_size = renderer.frame_buffer.size();
+  std::vector<uint8_t> decoded(frame_size);
+  size_t codec_bytes = 0, deflate_bytes = 0, codec_peak = 0, deflate_peak = 0;
+  double codec_encode_ms = 0, codec_decode_ms = 0, deflate_encode_ms = 0, deflate_decode_ms = 0;
+  int pages = parser.get_page_count();
+  for (int i = 0; i < pages; i++)
+  {
+    std::fill(renderer.frame_buffer.begin(), renderer.frame_buffer.end(), 0xFF);
+    parser.render_page(i, &renderer, &epub);
+    // the run length codec - the chunks are just counted the same as they would be written to a file
+    heap_tracker_reset();
+    size_t start_heap = heap_tracker_current();
+    BenchmarkTimer timer;
+    TEST_ASSERT_TRUE(codec.encode(renderer.frame_buffer.data(), [&](const uint8_t *data, size_t length)
+                                  {
+                                    codec_bytes += length;
+                                    return true; }));
+    codec_encode_ms += timer.elapsed_ms();
+    codec_peak = std::max(codec_peak, heap_tracker_peak() - start_heap);
+    std::vector<uint8_t> encoded = encode(codec, renderer.frame_buffer);
+    timer.reset();
+    TEST_ASSERT_TRUE(decode(codec, encoded, decoded, FrameCodec::CHUNK_SIZE));
+    codec_decode_ms += timer.elapsed_ms();
+    TEST_ASSERT_TRUE(decoded == renderer.frame_buffer);
+    // deflate the whole frame the way it used to be done
+    heap_tracker_reset();
+    start_heap = heap_tracker_current();
+    timer.reset();
+    size_t compressed_size = 0;
+    void *compressed = tdefl_compress_mem_to_heap(renderer.frame_buffer.data(), frame_size, &compressed_size, 0);
+    deflate_encode_ms += timer.elapsed_ms();
+    deflate_peak = std::max(deflate_peak, heap_tracker_peak() - start_heap);
+    TEST_ASSERT_NOT_NULL(compressed);
+    deflate_bytes += compressed_size;
+    timer.reset();
+    TEST_ASSERT_NOT_EQUAL(TINFL_DECOMPRESS_MEM_TO_MEM_FAILED, tinfl_decompress_mem_to_mem(decoded.data(), frame_size, compressed, compressed_size, 0));
+    deflate_decode_ms += timer.elapsed_ms();
+    free(compressed);
+    TEST_ASSERT_TRUE(decoded == renderer.frame_buffer);
+  }
+  BENCHMARK_REPORT("%d pages of %zu bytes - runs: %zu bytes, encode %.3f ms, decode %.3f ms, %zu bytes peak heap",
+                   pages, frame_size, codec_bytes / pages, codec_encode_ms / pages, codec_decode_ms / pages, codec_peak);
+  BENCHMARK_REPORT("%d pages of %zu bytes - deflate: %zu bytes, encode %.3f ms, decode %.3f ms, %zu bytes peak heap",
+                   pages, frame_size, deflate_bytes / pages, deflate_encode_ms / pages, deflate_decode_ms / pages, deflate_peak);
+}
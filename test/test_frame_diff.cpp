@@ -0,0 +1,126 @@
+#include <unity.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <EpubList/Epub.h>
+#include <RubbishHtmlParser/RubbishHtmlParser.h>
+#include <Renderer/FrameDiff.h>
+#include "glyph_drawing_renderer.h"
+#include "benchmark.h"
+
+static const int WIDTH = 200;
+static const int HEIGHT = 100;
+
+static void set_pixel(std::vector<uint8_t> &frame, int x, int y, uint8_t value)
+{
+  uint8_t &pixel = frame[y * WIDTH / 2 + x / 2];
+  pixel = x & 1 ? (pixel & 0x0F) | (value << 4) : (pixel & 0xF0) | value;
+}
+
+void test_frame_diff_regions(void)
+{
+  FrameDiff frame_diff(WIDTH, HEIGHT, 32, 2);
+  std::vector<uint8_t> previous(WIDTH * HEIGHT / 2, 0xFF);
+  std::vector<uint8_t> current = previous;
+  std::vector<DirtyRegion> regions;
+  // nothing has changed
+  TEST_ASSERT_FALSE(frame_diff.diff(previous.data(), current.data(), regions));
+  TEST_ASSERT_EQUAL(0, regions.size());
+  // a black pixel just needs its tile updating with a fast update
+  set_pixel(current, 40, 10, 0);
+  TEST_ASSERT_TRUE(frame_diff.diff(previous.data(), current.data(), regions));
+  TEST_ASSERT_EQUAL(1, regions.size());
+  TEST_ASSERT_EQUAL(32, regions[0].x);
+  TEST_ASSERT_EQUAL(0, regions[0].y);
+  TEST_ASSERT_EQUAL(32, regions[0].width);
+  TEST_ASSERT_EQUAL(32, regions[0].height);
+  TEST_ASSERT_FALSE(regions[0].needs_gray);
+  TEST_ASSERT_EQUAL(16 * 32, FrameDiff::get_region_bytes(regions[0]));
+  // once it's been copied over there's nothing left to do
+  frame_diff.copy_region(regions[0], current.data(), previous.data());
+  TEST_ASSERT_FALSE(frame_diff.diff(previous.data(), current.data(), regions));
+  // a gray pixel in the bottom right corner - the tiles at the edges are smaller
+  set_pixel(current, 199, 99, 7);
+  TEST_ASSERT_TRUE(frame_diff.diff(previous.data(), current.data(), regions));
+  TEST_ASSERT_EQUAL(1, regions.size());
+  TEST_ASSERT_EQUAL(192, regions[0].x);
+  TEST_ASSERT_EQUAL(96, regions[0].y);
+  TEST_ASSERT_EQUAL(8, regions[0].width);
+  TEST_ASSERT_EQUAL(4, regions[0].height);
+  TEST_ASSERT_TRUE(regions[0].needs_gray);
+  // two changes far apart get their own regions and only the gray one needs a gray update
+  set_pixel(current, 0, 90, 0);
+  TEST_ASSERT_TRUE(frame_diff.diff(previous.data(), current.data(), regions));
+  TEST_ASSERT_EQUAL(2, regions.size());
+  TEST_ASSERT_TRUE(regions[0].needs_gray != regions[1].needs_gray);
+  // too many regions get merged together
+  set_pixel(current, 100, 0, 0);
+  TEST_ASSERT_TRUE(frame_diff.diff(previous.data(), current.data(), regions));
+  TEST_ASSERT_EQUAL(2, regions.size());
+  // changes in neighbouring tiles end up in one region
+  previous = current;
+  for (int x = 10; x < 150; x++)
+  {
+    set_pixel(current, x, 50, 0);
+  }
+  TEST_ASSERT_TRUE(frame_diff.diff(previous.data(), current.data(), regions));
+  TEST_ASSERT_EQUAL(1, regions.size());
+  TEST_ASSERT_EQUAL(0, regions[0].x);
+  TEST_ASSERT_EQUAL(32, regions[0].y);
+  TEST_ASSERT_EQUAL(160, regions[0].width);
+  TEST_ASSERT_EQUAL(32, regions[0].height);
+  // every changed pixel is inside a region
+  for (auto &region : regions)
+  {
+    frame_diff.copy_region(region, current.data(), previous.data());
+  }
+  TEST_ASSERT_TRUE(previous == current);
+}
+
+void benchmark_frame_diff_page_turns(void)
+{
+  Epub epub("fixtures/oebps.epub");
+  TEST_ASSERT_TRUE(epub.load());
+  std::string item = epub.get_spine_item(1);
+  GlyphDrawingRenderer renderer;
+  RubbishHtmlParser parser(&epub, item, item.substr(0, item.find_last_of('/') + 1));
+  parser.layout(&renderer, &epub);
+  TEST_ASSERT_TRUE(parser.get_page_count() > 1);
+  FrameDiff frame_diff(renderer.page_width, renderer.page_height);
+  std::vector<DirtyRegion> regions;
+  std::vector<uint8_t> previous(renderer.frame_buffer.size(), 0xFF);
+  size_t full_bytes = previous.size();
+  size_t pushed_bytes = 0;
+  size_t region_count = 0;
+  double diff_ms = 0;
+  int page_turns = 0;
+  for (int i = 0; i < parser.get_page_count(); i++)
+  {
+    parser.render_page(i, &renderer, &epub);
+    BenchmarkTimer timer;
+    frame_diff.diff(previous.data(), renderer.frame_buffer.data(), regions);
+    diff_ms += timer.elapsed_ms();
+    for (auto &region : regions)
+    {
+      pushed_bytes += FrameDiff::get_region_bytes(region);
+      frame_diff.copy_region(region, renderer.frame_buffer.data(), previous.data());
+    }
+    TEST_ASSERT_TRUE(previous == renderer.frame_buffer);
+    region_count += regions.size();
+    page_turns++;
+  }
+  // something small like the busy indicator
+  for (int y = 400; y < 500; y++)
+  {
+    memset(&renderer.frame_buffer[y * renderer.page_width / 2 + 100], 0x00, 50);
+  }
+  frame_diff.diff(previous.data(), renderer.frame_buffer.data(), regions);
+  size_t busy_bytes = 0;
+  for (auto &region : regions)
+  {
+    busy_bytes += FrameDiff::get_region_bytes(region);
+  }
+  BENCHMARK_REPORT("%d page turns: %zu bytes pushed per turn on average (%.0f%% of a full update) in %.1f regions, diff %.3f ms per turn, busy indicator %zu bytes",
+                   page_turns, pushed_bytes / page_turns, 100.0 * pushed_bytes / page_turns / full_bytes,
+                   (double)region_count / page_turns, diff_ms / page_turns, busy_bytes);
+}
@@ -0,0 +1,112 @@
+#include <unity.h>
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <EpubList/Epub.h>
+#include <RubbishHtmlParser/RubbishHtmlParser.h>
+#include <Renderer/GlyphBitmapCache.h>
+#include "miniz.h"
+#include "glyph_drawing_renderer.h"
+#include "benchmark.h"
+
+static void add_bitmap(GlyphBitmapCache &cache, const void *font, uint32_t code_point, size_t size)
+{
+  // every byte of the bitmap is the code point so we can tell them apart
+  std::vector<uint8_t> bitmap(size, code_point);
+  std::vector<uint8_t> compressed(size + 64);
+  mz_ulong compressed_size = compressed.size();
+  TEST_ASSERT_EQUAL(MZ_OK, mz_compress(compressed.data(), &compressed_size, bitmap.data(), size));
+  const uint8_t *result = cache.get_bitmap(font, code_point, compressed.data(), compressed_size, size);
+  TEST_ASSERT_NOT_NULL(result);
+  TEST_ASSERT_EQUAL(0, memcmp(bitmap.data(), result, size));
+}
+
+void test_glyph_bitmap_cache_lru(void)
+{
+  GlyphBitmapCache cache(300);
+  int font_a = 0, font_b = 0;
+  add_bitmap(cache, &font_a, 'a', 100);
+  add_bitmap(cache, &font_a, 'b', 100);
+  // the same code point in a different font is a different glyph
+  add_bitmap(cache, &font_b, 'a', 100);
+  TEST_ASSERT_EQUAL(3, cache.get_misses());
+  TEST_ASSERT_EQUAL(0, cache.get_hits());
+  // using 'a' makes 'b' the least recently used
+  add_bitmap(cache, &font_a, 'a', 100);
+  TEST_ASSERT_EQUAL(1, cache.get_hits());
+  add_bitmap(cache, &font_a, 'c', 100);
+  TEST_ASSERT_EQUAL(1, cache.get_evictions());
+  TEST_ASSERT_EQUAL(300, cache.get_bytes_used());
+  add_bitmap(cache, &font_a, 'a', 100);
+  TEST_ASSERT_EQUAL(2, cache.get_hits());
+  add_bitmap(cache, &font_a, 'b', 100);
+  TEST_ASSERT_EQUAL(5, cache.get_misses());
+  // a bitmap bigger than the cache still gets returned
+  add_bitmap(cache, &font_a, 'd', 500);
+  TEST_ASSERT_EQUAL(500, cache.get_bytes_used());
+  // bad data doesn't get cached
+  uint8_t garbage[] = {1, 2, 3, 4};
+  TEST_ASSERT_NULL(cache.get_bitmap(&font_a, 'e', garbage, sizeof(garbage), 100));
+  TEST_ASSERT_EQUAL(500, cache.get_bytes_used());
+  cache.clear();
+  TEST_ASSERT_EQUAL(0, cache.get_bytes_used());
+}
+
+// lay out the biggest chapter of a fixture and render the first few pages
+static void render_pages(GlyphDrawingRenderer &renderer, Epub &epub, RubbishHtmlParser &parser, int page_count, std::vector<uint8_t> *first_page)
+{
+  for (int i = 0; i < page_count && i < parser.get_page_count(); i++)
+  {
+    parser.render_page(i, &renderer, &epub);
+    if (i == 0 && first_page)
+    {
+      *first_page = renderer.frame_buffer;
+    }
+  }
+}
+
+void benchmark_glyph_bitmap_cache(void)
+{
+  Epub epub("fixtures/oebps.epub");
+  TEST_ASSERT_TRUE(epub.load());
+  // find the biggest chapter in the book
+  int largest_section = 0;
+  size_t largest_size = 0;
+  for (int i = 0; i < epub.get_spine_items_count(); i++)
+  {
+    size_t size = 0;
+    uint8_t *data = epub.get_item_contents(epub.get_spine_item(i), &size);
+    free(data);
+    if (size > largest_size)
+    {
+      largest_size = size;
+      largest_section = i;
+    }
+  }
+  std::string item = epub.get_spine_item(largest_section);
+  GlyphDrawingRenderer renderer;
+  RubbishHtmlParser parser(&epub, item, item.substr(0, item.find_last_of('/') + 1));
+  parser.layout(&renderer, &epub);
+  const int page_count = 5;
+
+  std::vector<uint8_t> uncached_page;
+  BenchmarkTimer timer;
+  render_pages(renderer, epub, parser, page_count, &uncached_page);
+  double uncached_ms = timer.elapsed_ms();
+  size_t glyphs_drawn = renderer.glyphs_drawn;
+
+  GlyphBitmapCache cache;
+  renderer.glyph_cache = &cache;
+  std::vector<uint8_t> cached_page;
+  timer.reset();
+  render_pages(renderer, epub, parser, page_count, &cached_page);
+  double cached_ms = timer.elapsed_ms();
+
+  // the cache must not change what ends up on the screen
+  TEST_ASSERT_TRUE(uncached_page == cached_page);
+  TEST_ASSERT_EQUAL(glyphs_drawn, cache.get_hits() + cache.get_misses());
+  TEST_ASSERT_TRUE(cache.get_hits() > cache.get_misses());
+  BENCHMARK_REPORT("%d pages, %zu glyphs: inflating every glyph %.2f ms, glyph bitmap cache %.2f ms (%zu hits, %zu misses, %zu bytes cached)",
+                   page_count, glyphs_drawn, uncached_ms, cached_ms, cache.get_hits(), cache.get_misses(), cache.get_bytes_used());
+}
@@ -0,0 +1,140 @@
+#include <unity.h>
+#include <string>
+#include <vector>
+#include <EpubList/Epub.h>
+#include <RubbishHtmlParser/RubbishHtmlParser.h>
+#include <Renderer/GlyphWidthCache.h>
+#include <regular_font.h>
+#include <bold_font.h>
+#include "recording_renderer.h"
+#include "benchmark.h"
+
+static const char FALLBACK_GLYPH = '?';
+
+static GlyphWidthCache::GlyphLookup get_lookup(const EpdFont *font)
+{
+  return [font](uint32_t code_point, GlyphMetrics *metrics)
+  {
+    const EpdGlyph *glyph = epd_get_glyph(font, code_point);
+    if (!glyph)
+    {
+      glyph = epd_get_glyph(font, FALLBACK_GLYPH);
+    }
+    if (!glyph)
+    {
+      return false;
+    }
+    metrics->advance_x = glyph->advance_x;
+    metrics->left = glyph->left;
+    metrics->width = glyph->width;
+    return true;
+  };
+}
+
+// this is how the renderer measured text before the cache
+static int get_reference_width(const EpdFont *font, const char *text)
+{
+  EpdFontProperties props = epd_font_properties_default();
+  props.fallback_glyph = FALLBACK_GLYPH;
+  int x = 0, y = 0, x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+  epd_get_text_bounds(font, text, &x, &y, &x1, &y1, &x2, &y2, &props);
+  return x2 - x1;
+}
+
+// records every word that the layout asks to be measured
+class WordCollectingRenderer : public RecordingRenderer
+{
+public:
+  std::vector<std::string> words;
+  virtual void get_text_widths(const char *const *words, const uint8_t *styles, size_t count, uint16_t *widths)
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      this->words.push_back(words[i]);
+    }
+    RecordingRenderer::get_text_widths(words, styles, count, widths);
+  }
+};
+
+static std::vector<std::string> get_fixture_words()
+{
+  const char *fixtures[] = {
+      "fixtures/no_oebps.epub",
+      "fixtures/oebps.epub",
+      "fixtures/relative_paths.epub",
+  };
+  WordCollectingRenderer renderer;
+  for (auto fixture : fixtures)
+  {
+    Epub epub(fixture);
+    TEST_ASSERT_TRUE(epub.load());
+    for (int i = 0; i < epub.get_spine_items_count(); i++)
+    {
+      std::string item = epub.get_spine_item(i);
+      RubbishHtmlParser parser(&epub, item, item.substr(0, item.find_last_of('/') + 1));
+      parser.layout(&renderer, &epub);
+    }
+  }
+  return renderer.words;
+}
+
+void test_glyph_width_cache_matches_text_bounds(void)
+{
+  std::vector<std::string> words = get_fixture_words();
+  TEST_ASSERT_TRUE(words.size() > 1000);
+  // things that aren't in the table or aren't in the font at all
+  words.push_back("");
+  words.push_back("\xe2\x80\x9cquoted\xe2\x80\x9d");
+  words.push_back("caf\xc3\xa9");
+  words.push_back("\xe4\xb8\xad\xe6\x96\x87");
+  words.push_back("\xf0\x9f\x98\x80");
+  words.push_back("tab\there");
+  words.push_back("broken\xc3");
+  const EpdFont *fonts[] = {&regular_font, &bold_font};
+  for (auto font : fonts)
+  {
+    GlyphWidthCache cache(get_lookup(font));
+    for (auto &word : words)
+    {
+      TEST_ASSERT_EQUAL_MESSAGE(get_reference_width(font, word.c_str()), cache.get_text_width(word.c_str()), word.c_str());
+    }
+  }
+}
+
+void benchmark_glyph_width_cache(void)
+{
+  std::vector<std::string> words = get_fixture_words();
+  std::vector<const char *> word_ptrs;
+  for (auto &word : words)
+  {
+    word_ptrs.push_back(word.c_str());
+  }
+  const int iterations = 20;
+  // searching the font intervals for every character of every word
+  BenchmarkTimer timer;
+  int reference_total = 0;
+  for (int iteration = 0; iteration < iterations; iteration++)
+  {
+    for (auto word : word_ptrs)
+    {
+      reference_total += get_reference_width(&regular_font, word);
+    }
+  }
+  double reference_ms = timer.elapsed_ms();
+  // the cached table
+  GlyphWidthCache cache(get_lookup(&regular_font));
+  timer.reset();
+  int cached_total = 0;
+  for (int iteration = 0; iteration < iterations; iteration++)
+  {
+    for (auto word : word_ptrs)
+    {
+      cached_total += cache.get_text_width(word);
+    }
+  }
+  double cached_ms = timer.elapsed_ms();
+  TEST_ASSERT_EQUAL(reference_total, cached_total);
+  double word_count = (double)word_ptrs.size() * iterations;
+  BENCHMARK_REPORT("measured %zu words %d times: epd_get_text_bounds %.0f words/ms, glyph width cache %.0f words/ms",
+                   word_ptrs.size(), iterations, word_count / reference_ms, word_count / cached_ms);
+}
@@ -0,0 +1,250 @@
+#include <unity.h>
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <tinyxml2.h>
+#include <EpubList/Epub.h>
+#include <RubbishHtmlParser/HtmlTokenizer.h>
+#include <RubbishHtmlParser/RubbishHtmlParser.h>
+#include "benchmark.h"
+
+// turns the tokenizer events back into a string we can easily check
+class RecordingTokenHandler : public HtmlTokenHandler
+{
+public:
+  std::string events;
+  void on_start_tag(const HtmlTag &tag)
+  {
+    events += "<";
+    events.append(tag.name, tag.name_length);
+    std::string src;
+    if (tag.get_attribute("src", src))
+    {
+      events += " src=" + src;
+    }
+    events += ">";
+  }
+  void on_end_tag(const char *tag_name, size_t tag_name_length)
+  {
+    events += "</";
+    events.append(tag_name, tag_name_length);
+    events += ">";
+  }
+  void on_text(const char *text, size_t length)
+  {
+    events += "[" + std::string(text, length) + "]";
+  }
+};
+
+static std::string tokenize(const char *html, size_t chunk_size)
+{
+  RecordingTokenHandler handler;
+  HtmlTokenizer tokenizer(&handler);
+  size_t length = strlen(html);
+  for (size_t pos = 0; pos < length; pos += chunk_size)
+  {
+    tokenizer.feed(html + pos, std::min(chunk_size, length - pos));
+  }
+  tokenizer.finish();
+  return handler.events;
+}
+
+void test_html_tokenizer_events(void)
+{
+  const char *html =
+      "<?xml version=\"1.0\"?>"
+      "<!DOCTYPE html>"
+      "<html><body>"
+      "<!-- a comment with <p>tags</p> in it -->"
+      "<p class='x'>Some <b>bold</b> text</p>"
+      "<br/><br />"
+      "<img alt=\"a > b\" src = \"image.png\" />"
+      "<img src=unquoted.jpg>"
+      "<p>1 < 2</p>"
+      "<![CDATA[raw <text>]]>"
+      "</body></html>";
+  const char *expected =
+      "<html><body>"
+      "<p>[Some ]<b>[bold]</b>[ text]</p>"
+      "<br></br><br></br>"
+      "<img src=image.png></img>"
+      "<img src=unquoted.jpg>"
+      "<p>[1 < 2]</p>"
+      "[raw <text>]"
+      "</body></html>";
+  TEST_ASSERT_EQUAL_STRING(expected, tokenize(html, strlen(html)).c_str());
+  // we should get exactly the same events no matter how the data is split up
+  for (size_t chunk_size = 1; chunk_size < 20; chunk_size++)
+  {
+    TEST_ASSERT_EQUAL_STRING(expected, tokenize(html, chunk_size).c_str());
+  }
+}
+
+void test_html_tokenizer_long_text(void)
+{
+  // long runs of text are split on whitespace so words are never broken
+  std::string html = "<p>";
+  for (int i = 0; i < 5000; i++)
+  {
+    html += "word ";
+  }
+  html += "</p>";
+  RecordingTokenHandler handler;
+  HtmlTokenizer tokenizer(&handler, 100);
+  for (size_t pos = 0; pos < html.size(); pos += 64)
+  {
+    tokenizer.feed(html.c_str() + pos, std::min((size_t)64, html.size() - pos));
+  }
+  tokenizer.finish();
+  TEST_ASSERT_EQUAL(0, handler.events.find("<p>["));
+  TEST_ASSERT_TRUE(handler.events.find("wor]") == std::string::npos);
+  TEST_ASSERT_TRUE(handler.events.find("[ord") == std::string::npos);
+  TEST_ASSERT_TRUE(handler.events.find("</p>") == handler.events.size() - 4);
+}
+
+// checks that every event points straight into the source html
+class InPlaceTokenHandler : public HtmlTokenHandler
+{
+public:
+  const char *start;
+  const char *end;
+  int events = 0;
+  int copies = 0;
+  void check(const char *data, size_t length)
+  {
+    events++;
+    if (data < start || data + length > end)
+    {
+      copies++;
+    }
+  }
+  void on_start_tag(const HtmlTag &tag)
+  {
+    check(tag.name, tag.name_length);
+    check(tag.attributes, tag.attributes_length);
+  }
+  void on_end_tag(const char *tag_name, size_t tag_name_length)
+  {
+    check(tag_name, tag_name_length);
+  }
+  void on_text(const char *text, size_t length)
+  {
+    check(text, length);
+  }
+};
+
+void test_html_tokenizer_in_place(void)
+{
+  const char *html = "<html><body><p class=\"x\">Some <i>text</i></p><img src='a.png'/></body></html>";
+  std::string copy = html;
+  InPlaceTokenHandler handler;
+  handler.start = html;
+  handler.end = html + strlen(html);
+  HtmlTokenizer tokenizer(&handler);
+  tokenizer.parse(html, strlen(html));
+  TEST_ASSERT_EQUAL(17, handler.events);
+  TEST_ASSERT_EQUAL(0, handler.copies);
+  // and the html is left untouched
+  TEST_ASSERT_EQUAL_STRING(copy.c_str(), html);
+}
+
+void test_html_tokenizer_malformed(void)
+{
+  // the sort of thing real epubs contain - none of this is valid xml
+  const char *html =
+      "<P>Unclosed paragraph"
+      "<p>Bare & ampersand and <b>unclosed bold"
+      "<br><img src=pic.jpg alt=\"it's\">"
+      "</i></div>"
+      "<p attr=\"unterminated>text</p>"
+      "<p>after</p>"
+      "<p>truncated <b";
+  const char *expected =
+      "<P>[Unclosed paragraph]"
+      "<p>[Bare & ampersand and ]<b>[unclosed bold]"
+      "<br><img src=pic.jpg>"
+      "</i></div>";
+  std::string events = tokenize(html, strlen(html));
+  TEST_ASSERT_EQUAL(0, events.find(expected));
+  // whatever happens to the unterminated attribute we must not lose all of the rest of the document
+  for (size_t chunk_size = 1; chunk_size < 20; chunk_size++)
+  {
+    TEST_ASSERT_EQUAL_STRING(events.c_str(), tokenize(html, chunk_size).c_str());
+  }
+}
+
+// counts the events so the compiler can't optimise the tokenizer away
+class CountingTokenHandler : public HtmlTokenHandler
+{
+public:
+  size_t count = 0;
+  void on_start_tag(const HtmlTag &tag) { count++; }
+  void on_end_tag(const char *tag_name, size_t tag_name_length) { count++; }
+  void on_text(const char *text, size_t length) { count += length; }
+};
+
+void benchmark_html_parser_throughput(void)
+{
+  const char *fixtures[] = {
+      "fixtures/no_oebps.epub",
+      "fixtures/oebps.epub",
+      "fixtures/relative_paths.epub",
+  };
+  for (auto fixture : fixtures)
+  {
+    Epub epub(fixture);
+    TEST_ASSERT_TRUE(epub.load());
+    // extract everything up front so we only measure the parsing
+    std::vector<std::string> chapters;
+    size_t total_size = 0;
+    for (int i = 0; i < epub.get_spine_items_count(); i++)
+    {
+      size_t size = 0;
+      char *html = (char *)epub.get_item_contents(epub.get_spine_item(i), &size);
+      TEST_ASSERT_NOT_NULL(html);
+      chapters.push_back(std::string(html, size));
+      total_size += size;
+      free(html);
+    }
+    const int iterations = 5;
+    double megabytes = double(total_size) * iterations / (1024.0 * 1024.0);
+    // just the tokenizer
+    CountingTokenHandler handler;
+    BenchmarkTimer timer;
+    for (int i = 0; i < iterations; i++)
+    {
+      for (auto &chapter : chapters)
+      {
+        HtmlTokenizer tokenizer(&handler);
+        tokenizer.parse(chapter.c_str(), chapter.size());
+      }
+    }
+    double tokenizer_ms = timer.elapsed_ms();
+    // the full parser building the text blocks
+    timer.reset();
+    for (int i = 0; i < iterations; i++)
+    {
+      for (auto &chapter : chapters)
+      {
+        RubbishHtmlParser parser(chapter.c_str(), chapter.size(), "");
+      }
+    }
+    double parser_ms = timer.elapsed_ms();
+    // what it used to cost to build the tinyxml2 document
+    timer.reset();
+    for (int i = 0; i < iterations; i++)
+    {
+      for (auto &chapter : chapters)
+      {
+        tinyxml2::XMLDocument doc(false, tinyxml2::COLLAPSE_WHITESPACE);
+        doc.Parse(chapter.c_str(), chapter.size());
+      }
+    }
+    double tinyxml_ms = timer.elapsed_ms();
+    TEST_ASSERT_TRUE(handler.count > 0);
+    BENCHMARK_REPORT("%s: %zu bytes html, tokenizer %.1f MB/s, parser %.1f MB/s, tinyxml2 document %.1f MB/s",
+                     fixture, total_size, megabytes * 1000.0 / tokenizer_ms, megabytes * 1000.0 / parser_ms,
+                     megabytes * 1000.0 / tinyxml_ms);
+  }
+}
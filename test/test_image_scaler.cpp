@@ -0,0 +1,271 @@
+#include <unity.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <tjpgd.h>
+#include <EpubList/Epub.h>
+#include <Renderer/ImageScaler.h>
+#include "glyph_drawing_renderer.h"
+#include "benchmark.h"
+
+// keeps the gray values from the image exactly as they are drawn - the recording renderer just records
+// the image so these tests call Renderer::draw_image to actually decode it
+class GrayCaptureRenderer : public RecordingRenderer
+{
+public:
+  std::vector<uint8_t> pixels;
+  int width;
+  int height;
+
+  GrayCaptureRenderer(int width, int height) : RecordingRenderer(width, height), pixels(width * height, 255), width(width), height(height)
+  {
+  }
+  void draw_gray_span(int x, int y, const uint8_t *gray, int count)
+  {
+    for (int i = 0; i < count; i++)
+    {
+      if (x + i >= 0 && x + i < width && y >= 0 && y < height)
+      {
+        pixels[y * width + x + i] = gray[i];
+      }
+    }
+  }
+};
+
+static std::vector<uint8_t> scale_image(const std::vector<uint8_t> &source, int source_width, int source_height, int width, int height)
+{
+  std::vector<uint8_t> output;
+  ImageScaler scaler(source_width, source_height, width, height,
+                     [&](int y, const uint8_t *row, int row_width)
+                     {
+                       TEST_ASSERT_EQUAL(output.size() / row_width, y);
+                       output.insert(output.end(), row, row + row_width);
+                     });
+  for (int y = 0; y < source_height; y++)
+  {
+    scaler.add_row(&source[y * source_width]);
+  }
+  TEST_ASSERT_EQUAL(scaler.get_height(), scaler.get_rows_written());
+  return output;
+}
+
+void test_image_scaler_area_average(void)
+{
+  // halving averages each 2x2 block
+  std::vector<uint8_t> source = {
+      0, 100, 200, 200,
+      100, 200, 0, 0,
+      10, 10, 255, 255,
+      30, 30, 255, 255};
+  std::vector<uint8_t> expected = {100, 100, 20, 255};
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data(), scale_image(source, 4, 4, 2, 2).data(), 4);
+  // 3 to 2 splits the middle pixel between the two output pixels
+  source = {0, 90, 180};
+  expected = {30, 150};
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data(), scale_image(source, 3, 1, 2, 1).data(), 2);
+  source = {0, 90, 180};
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected.data(), scale_image(source, 1, 3, 1, 2).data(), 2);
+  // a single line of black is never lost however much we shrink
+  source.assign(100 * 100, 255);
+  for (int x = 0; x < 100; x++)
+  {
+    source[37 * 100 + x] = 0;
+  }
+  std::vector<uint8_t> scaled = scale_image(source, 100, 100, 7, 7);
+  TEST_ASSERT_EQUAL(49, scaled.size());
+  TEST_ASSERT_TRUE(scaled[2 * 7] < 255);
+  // flat images stay flat and images are never made bigger
+  source.assign(33 * 17, 77);
+  scaled = scale_image(source, 33, 17, 100, 5);
+  TEST_ASSERT_EQUAL(33 * 5, scaled.size());
+  for (auto value : scaled)
+  {
+    TEST_ASSERT_EQUAL(77, value);
+  }
+}
+
+// decode a jpeg at full size into gray scale
+struct FullDecode
+{
+  const uint8_t *data;
+  size_t pos;
+  int width;
+  std::vector<uint8_t> gray;
+};
+
+static size_t full_decode_read(JDEC *jdec, uint8_t *buff, size_t ndata)
+{
+  FullDecode *decode = (FullDecode *)jdec->device;
+  if (buff)
+  {
+    memcpy(buff, decode->data + decode->pos, ndata);
+  }
+  decode->pos += ndata;
+  return ndata;
+}
+
+static int full_decode_write(JDEC *jdec, void *bitmap, JRECT *rect)
+{
+  FullDecode *decode = (FullDecode *)jdec->device;
+  const uint8_t *rgb = (const uint8_t *)bitmap;
+  for (int y = rect->top; y <= rect->bottom; y++)
+  {
+    for (int x = rect->left; x <= rect->right; x++)
+    {
+      decode->gray[y * decode->width + x] = (rgb[0] * 38 + rgb[1] * 75 + rgb[2] * 15) >> 7;
+      rgb += 3;
+    }
+  }
+  return 1;
+}
+
+static bool decode_jpeg(const uint8_t *data, FullDecode *decode, int *width, int *height)
+{
+  std::vector<uint8_t> pool(32768);
+  JDEC dec;
+  decode->data = data;
+  decode->pos = 0;
+  if (jd_prepare(&dec, full_decode_read, pool.data(), pool.size(), decode) != JDR_OK)
+  {
+    return false;
+  }
+  decode->width = *width = dec.width;
+  *height = dec.height;
+  decode->gray.assign(dec.width * dec.height, 0);
+  return jd_decomp(&dec, full_decode_write, 0) == JDR_OK;
+}
+
+// the exact area average worked out in floating point
+static std::vector<double> reference_scale(const std::vector<uint8_t> &source, int source_width, int source_height, int width, int height)
+{
+  std::vector<double> output(width * height, 0);
+  double x_ratio = double(source_width) / width;
+  double y_ratio = double(source_height) / height;
+  for (int y = 0; y < height; y++)
+  {
+    double top = y * y_ratio, bottom = (y + 1) * y_ratio;
+    for (int x = 0; x < width; x++)
+    {
+      double left = x * x_ratio, right = (x + 1) * x_ratio;
+      double sum = 0;
+      for (int sy = int(top); sy < source_height && sy < bottom; sy++)
+      {
+        double y_cover = std::min(bottom, sy + 1.0) - std::max(top, double(sy));
+        for (int sx = int(left); sx < source_width && sx < right; sx++)
+        {
+          double x_cover = std::min(right, sx + 1.0) - std::max(left, double(sx));
+          sum += source[sy * source_width + sx] * x_cover * y_cover;
+        }
+      }
+      output[y * width + x] = sum / (x_ratio * y_ratio);
+    }
+  }
+  return output;
+}
+
+static double psnr(const std::vector<double> &reference, const std::vector<uint8_t> &image)
+{
+  double error = 0;
+  for (size_t i = 0; i < reference.size(); i++)
+  {
+    error += (reference[i] - image[i]) * (reference[i] - image[i]);
+  }
+  error /= reference.size();
+  return 10 * log10(255.0 * 255.0 / std::max(error, 1e-9));
+}
+
+// what the old renderer did - pick the nearest pixel
+static std::vector<uint8_t> point_sample(const std::vector<uint8_t> &source, int source_width, int source_height, int width, int height)
+{
+  std::vector<uint8_t> output(width * height);
+  for (int y = 0; y < height; y++)
+  {
+    for (int x = 0; x < width; x++)
+    {
+      output[y * width + x] = source[(y * source_height / height) * source_width + x * source_width / width];
+    }
+  }
+  return output;
+}
+
+struct TestImage
+{
+  const char *epub;
+  const char *item;
+};
+
+static const TestImage test_images[] = {
+    {"fixtures/oebps.epub", nullptr},
+    {"fixtures/relative_paths.epub", "OEBPS/Images/cover.jpg"},
+    {"fixtures/relative_paths.epub", "OEBPS/Images/autor.jpg"},
+};
+
+static uint8_t *load_test_image(const TestImage &image, size_t *size)
+{
+  Epub epub(image.epub);
+  TEST_ASSERT_TRUE(epub.load());
+  std::string item = image.item ? image.item : epub.get_cover_image_item();
+  uint8_t *data = epub.get_item_contents(item, size);
+  TEST_ASSERT_NOT_NULL(data);
+  return data;
+}
+
+void test_image_scaler_jpeg_quality(void)
+{
+  size_t size = 0;
+  uint8_t *data = load_test_image(test_images[0], &size);
+  FullDecode decode;
+  int source_width = 0, source_height = 0;
+  TEST_ASSERT_TRUE(decode_jpeg(data, &decode, &source_width, &source_height));
+  // the sizes the cover gets drawn at in the library list and on a page
+  int sizes[][2] = {{126, 193}, {source_width / 3, source_height / 3}, {540, 700}};
+  for (auto &target : sizes)
+  {
+    int width = std::min(target[0], source_width);
+    int height = std::min(target[1], source_height);
+    std::vector<double> reference = reference_scale(decode.gray, source_width, source_height, width, height);
+    GrayCaptureRenderer renderer(width, height);
+    renderer.Renderer::draw_image("cover.jpg", data, size, 0, 0, width, height);
+    double quality = psnr(reference, renderer.pixels);
+    TEST_ASSERT_GREATER_THAN(30, (int)quality);
+  }
+  free(data);
+}
+
+void benchmark_image_scaler_jpeg(void)
+{
+  for (auto &image : test_images)
+  {
+    size_t size = 0;
+    uint8_t *data = load_test_image(image, &size);
+    FullDecode decode;
+    int source_width = 0, source_height = 0;
+    TEST_ASSERT_TRUE(decode_jpeg(data, &decode, &source_width, &source_height));
+    // a library thumbnail and a full page
+    int sizes[][2] = {{126, 193}, {540, 960}};
+    for (auto &target : sizes)
+    {
+      int width = std::min(target[0], source_width);
+      int height = std::min(target[1], source_height);
+      std::vector<double> reference = reference_scale(decode.gray, source_width, source_height, width, height);
+      GrayCaptureRenderer capture(width, height);
+      capture.Renderer::draw_image("image.jpg", data, size, 0, 0, width, height);
+      double area_psnr = psnr(reference, capture.pixels);
+      double point_psnr = psnr(reference, point_sample(decode.gray, source_width, source_height, width, height));
+      // and how long it takes to draw into the 4bpp frame buffer
+      GlyphDrawingRenderer renderer;
+      const int runs = 5;
+      BenchmarkTimer timer;
+      for (int i = 0; i < runs; i++)
+      {
+        renderer.Renderer::draw_image("image.jpg", data, size, 0, 0, width, height);
+      }
+      double ms = timer.elapsed_ms() / runs;
+      BENCHMARK_REPORT("%s %s: %dx%d -> %dx%d in %.2f ms, PSNR against exact area average %.1f dB (point sampling %.1f dB)",
+                       image.epub, image.item ? image.item : "cover", source_width, source_height, width, height, ms, area_psnr, point_psnr);
+    }
+    free(data);
+  }
+}
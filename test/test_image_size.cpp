@@ -0,0 +1,96 @@
+#include <unity.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <EpubList/Epub.h>
+#include <RubbishHtmlParser/blocks/ImageBlock.h>
+#include "glyph_drawing_renderer.h"
+#include "heap_tracker.h"
+#include "benchmark.h"
+
+// actually decodes the images rather than just recording them
+class ImageDecodingRenderer : public GlyphDrawingRenderer
+{
+public:
+  void draw_image(const std::string &filename, const uint8_t *data, size_t data_size, int x, int y, int width, int height)
+  {
+    Renderer::draw_image(filename, data, data_size, x, y, width, height);
+  }
+  bool get_image_size(const std::string &filename, const uint8_t *data, size_t data_size, int *width, int *height)
+  {
+    return Renderer::get_image_size(filename, data, data_size, width, height);
+  }
+};
+
+static const char *image_items[] = {
+    "OEBPS/Images/cover.jpg",
+    "OEBPS/Images/autor.jpg",
+    "OEBPS/Images/EPL_logo.png",
+    "OEBPS/Images/ex_libris.png",
+};
+
+void test_image_size_from_headers(void)
+{
+  Epub epub("fixtures/relative_paths.epub");
+  TEST_ASSERT_TRUE(epub.load());
+  ImageDecodingRenderer renderer;
+  int expected_sizes[][2] = {{600, 900}, {304, 380}, {258, 175}, {150, 150}};
+  for (int i = 0; i < 4; i++)
+  {
+    size_t size = 0;
+    uint8_t *data = epub.get_item_contents(image_items[i], &size);
+    TEST_ASSERT_NOT_NULL(data);
+    // the first part of the file is enough
+    int width = 0, height = 0;
+    TEST_ASSERT_TRUE(renderer.get_image_size(image_items[i], data, std::min(size, (size_t)16384), &width, &height));
+    TEST_ASSERT_EQUAL(expected_sizes[i][0], width);
+    TEST_ASSERT_EQUAL(expected_sizes[i][1], height);
+    // but not if the size hasn't been reached yet
+    TEST_ASSERT_FALSE(renderer.get_image_size(image_items[i], data, 12, &width, &height));
+    // and rubbish is rejected
+    data[1] = 0;
+    TEST_ASSERT_FALSE(renderer.get_image_size(image_items[i], data, size, &width, &height));
+    free(data);
+  }
+  // image blocks only need to decompress the start of the image to lay themselves out
+  ImageBlock block(image_items[0]);
+  size_t extracted = epub.get_bytes_extracted();
+  block.layout(&renderer, &epub);
+  TEST_ASSERT_EQUAL(540, block.width);
+  TEST_ASSERT_EQUAL(810, block.height);
+  TEST_ASSERT_LESS_THAN(16384, epub.get_bytes_extracted() - extracted);
+}
+
+void benchmark_image_page(void)
+{
+  if (!heap_tracker_supported())
+  {
+    TEST_IGNORE_MESSAGE("Heap tracking is not supported on this platform");
+  }
+  Epub epub("fixtures/relative_paths.epub");
+  TEST_ASSERT_TRUE(epub.load());
+  ImageDecodingRenderer renderer;
+  // lay out and draw each image as a page would - twice so we can see what happens once everything is warmed up
+  for (int pass = 0; pass < 2; pass++)
+  {
+    for (auto item : image_items)
+    {
+      size_t item_size = 0;
+      free(epub.get_item_contents(item, &item_size));
+      ImageBlock block(item);
+      size_t extracted = epub.get_bytes_extracted();
+      heap_tracker_reset();
+      size_t start_heap = heap_tracker_current();
+      BenchmarkTimer timer;
+      block.layout(&renderer, &epub);
+      size_t layout_allocations = heap_tracker_allocations();
+      size_t layout_extracted = epub.get_bytes_extracted() - extracted;
+      block.render(&renderer, &epub, 0);
+      double ms = timer.elapsed_ms();
+      BENCHMARK_REPORT("%s %s (%zu bytes, %dx%d): layout %zu allocations %zu bytes decompressed, layout + render %zu allocations, %zu bytes peak heap, %zu bytes decompressed, %.2f ms",
+                       pass == 0 ? "first" : "again", item, item_size, block.width, block.height, layout_allocations, layout_extracted,
+                       heap_tracker_allocations(), heap_tracker_peak() - start_heap, epub.get_bytes_extracted() - extracted, ms);
+    }
+  }
+}
@@ -0,0 +1,215 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <EpubList/Epub.h>
+#include <EpubList/EpubReader.h>
+#include <EpubList/State.h>
+#include <RubbishHtmlParser/RubbishHtmlParser.h>
+#include <LayoutCache/LayoutCache.h>
+#include <Renderer/MemoryFrameBufferRenderer.h>
+#include <regular_font.h>
+#include <bold_font.h>
+#include <italic_font.h>
+#include <bold_italic_font.h>
+#include "recording_renderer.h"
+#include "epub_builder.h"
+#include "benchmark.h"
+#include "test_files.h"
+
+static const char *INCREMENTAL_BOOK = "/tmp/incremental_layout.epub";
+static const char *INCREMENTAL_CACHE_PATH = "/tmp/incremental_cache/";
+
+static std::string render_page(RubbishHtmlParser *parser, int page, RecordingRenderer &renderer, Epub *epub)
+{
+  renderer.output.clear();
+  parser->render_page(page, &renderer, epub);
+  return renderer.output;
+}
+
+// laying out a page at a time gives the same pages and anchors as laying out everything in one go
+static void check_incremental_layout(Epub &epub, int section)
+{
+  RecordingRenderer renderer(100, 20);
+  std::string item = epub.get_spine_item(section);
+  RubbishHtmlParser full(&epub, item, get_base_path(item));
+  full.layout(&renderer, &epub);
+  TEST_ASSERT_TRUE(full.is_layout_complete());
+  int page_count = full.get_page_count();
+  RubbishHtmlParser incremental(&epub, item, get_base_path(item));
+  incremental.start_layout(&renderer, &epub);
+  TEST_ASSERT_EQUAL(0, incremental.get_page_count());
+  for (int page = 0; page < page_count; page++)
+  {
+    incremental.layout_to_page(page);
+    // the page and the one after it are ready but nothing much further
+    TEST_ASSERT_GREATER_OR_EQUAL(std::min(page + 2, page_count), incremental.get_page_count());
+    if (!incremental.is_layout_complete())
+    {
+      TEST_ASSERT_LESS_THAN(page_count, incremental.get_page_count());
+    }
+    std::string expected = render_page(&full, page, renderer, &epub);
+    TEST_ASSERT_EQUAL_STRING(expected.c_str(), render_page(&incremental, page, renderer, &epub).c_str());
+  }
+  incremental.finish_layout();
+  TEST_ASSERT_TRUE(incremental.is_layout_complete());
+  TEST_ASSERT_EQUAL(page_count, incremental.get_page_count());
+  // looking up an anchor only lays out as far as it needs to
+  RubbishHtmlParser anchors(&epub, item, get_base_path(item));
+  anchors.start_layout(&renderer, &epub);
+  for (int i = 0; i < full.get_anchor_count(); i++)
+  {
+    int page = 0;
+    const char *id = full.get_anchor(i, &page);
+    TEST_ASSERT_EQUAL(full.get_anchor_page(id), anchors.get_anchor_page(id));
+  }
+}
+
+static void write_incremental_book(int chapters, int words)
+{
+  EpubBuilder builder("Incremental", "Layout");
+  builder.add_generated_chapters(chapters, words);
+  TEST_ASSERT_TRUE(builder.write(INCREMENTAL_BOOK));
+}
+
+void test_incremental_layout_matches_full_layout(void)
+{
+  for (const char *fixture : {"fixtures/no_oebps.epub", "fixtures/oebps.epub", "fixtures/relative_paths.epub"})
+  {
+    Epub epub(fixture);
+    TEST_ASSERT_TRUE(epub.load());
+    for (int section = 0; section < epub.get_spine_items_count(); section++)
+    {
+      check_incremental_layout(epub, section);
+    }
+  }
+  write_incremental_book(1, 2000);
+  Epub epub(INCREMENTAL_BOOK);
+  TEST_ASSERT_TRUE(epub.load());
+  check_incremental_layout(epub, 0);
+  // the first page of a long section only needs a small part of it layed out
+  RecordingRenderer renderer(100, 20);
+  std::string item = epub.get_spine_item(0);
+  RubbishHtmlParser parser(&epub, item, get_base_path(item));
+  parser.start_layout(&renderer, &epub);
+  parser.layout_to_page(0);
+  TEST_ASSERT_FALSE(parser.is_layout_complete());
+  TEST_ASSERT_EQUAL(2, parser.get_page_count());
+  // pages that haven't been reached yet are layed out when they are drawn
+  TEST_ASSERT_NOT_EQUAL(std::string::npos, render_page(&parser, 5, renderer, &epub).find("text"));
+  TEST_ASSERT_EQUAL(7, parser.get_page_count());
+  remove(INCREMENTAL_BOOK);
+}
+
+void test_incremental_layout_epub_reader(void)
+{
+  write_incremental_book(2, 2000);
+  mkdir(INCREMENTAL_CACHE_PATH, 0755);
+  RecordingRenderer renderer(100, 20);
+  Epub epub(INCREMENTAL_BOOK);
+  TEST_ASSERT_TRUE(epub.load());
+  std::string item = epub.get_spine_item(0);
+  RubbishHtmlParser full(&epub, item, get_base_path(item));
+  full.layout(&renderer, &epub);
+  int page_count = full.get_page_count();
+
+  EpubListItem state;
+  memset(&state, 0, sizeof(state));
+  strcpy(state.path, INCREMENTAL_BOOK);
+  EpubReader *reader = new EpubReader(state, &renderer, INCREMENTAL_CACHE_PATH);
+  reader->load();
+  reader->render();
+  // we only know about the first couple of pages to start with
+  TEST_ASSERT_EQUAL(2, state.pages_in_current_section);
+  TEST_ASSERT_NULL(LayoutCache(INCREMENTAL_CACHE_PATH).load(&epub, &renderer, 0));
+  // turning the pages lays out more of the section and we move on at the real end of it
+  int pages_seen = 1;
+  while (state.current_section == 0)
+  {
+    reader->next();
+    reader->render();
+    pages_seen += state.current_section == 0 ? 1 : 0;
+    TEST_ASSERT_LESS_OR_EQUAL(page_count, state.pages_in_current_section);
+  }
+  TEST_ASSERT_EQUAL(page_count, pages_seen);
+  // once it was all layed out it went into the cache
+  CachedSection *cached = LayoutCache(INCREMENTAL_CACHE_PATH).load(&epub, &renderer, 0);
+  TEST_ASSERT_NOT_NULL(cached);
+  TEST_ASSERT_EQUAL(page_count, cached->get_page_count());
+  delete cached;
+  // going back to the last page of the previous section needs to know where it ends
+  reader->prev();
+  TEST_ASSERT_EQUAL(0, state.current_section);
+  TEST_ASSERT_EQUAL(page_count - 1, state.current_page);
+  delete reader;
+
+  // the rest of the section gets layed out while we're waiting for the user
+  LayoutCache(INCREMENTAL_CACHE_PATH).remove(&epub, 0);
+  state.current_section = 0;
+  state.current_page = 0;
+  reader = new EpubReader(state, &renderer, INCREMENTAL_CACHE_PATH);
+  reader->load();
+  reader->render();
+  TEST_ASSERT_EQUAL(2, state.pages_in_current_section);
+  int steps = 0;
+  while (reader->layout_more())
+  {
+    steps++;
+  }
+  TEST_ASSERT_GREATER_THAN(1, steps);
+  TEST_ASSERT_EQUAL(page_count, state.pages_in_current_section);
+  TEST_ASSERT_FALSE(reader->layout_more());
+  cached = LayoutCache(INCREMENTAL_CACHE_PATH).load(&epub, &renderer, 0);
+  TEST_ASSERT_NOT_NULL(cached);
+  delete cached;
+  delete reader;
+  for (int section = 0; section < epub.get_spine_items_count(); section++)
+  {
+    LayoutCache(INCREMENTAL_CACHE_PATH).remove(&epub, section);
+  }
+  rmdir(INCREMENTAL_CACHE_PATH);
+  remove(INCREMENTAL_BOOK);
+}
+
+void benchmark_time_to_first_page(void)
+{
+  MemoryFrameBufferRenderer renderer(&regular_font, &bold_font, &italic_font, &bold_italic_font);
+  renderer.set_margin_top(35);
+  renderer.set_margin_left(10);
+  renderer.set_margin_right(10);
+  for (int words : {2000, 10000, 40000})
+  {
+    write_incremental_book(1, words);
+    Epub epub(INCREMENTAL_BOOK);
+    TEST_ASSERT_TRUE(epub.load());
+    std::string item = epub.get_spine_item(0);
+    // everything layed out before the first page is drawn
+    BenchmarkTimer timer;
+    RubbishHtmlParser *parser = new RubbishHtmlParser(&epub, item, get_base_path(item));
+    double parse_ms = timer.elapsed_ms();
+    parser->layout(&renderer, &epub);
+    parser->render_page(0, &renderer, &epub);
+    double full_ms = timer.elapsed_ms();
+    int page_count = parser->get_page_count();
+    delete parser;
+    // just the first page and the one after it
+    timer.reset();
+    parser = new RubbishHtmlParser(&epub, item, get_base_path(item));
+    parser->start_layout(&renderer, &epub);
+    parser->layout_to_page(0);
+    parser->render_page(0, &renderer, &epub);
+    double first_page_ms = timer.elapsed_ms();
+    // and what's left to do in the background
+    timer.reset();
+    parser->finish_layout();
+    double remaining_ms = timer.elapsed_ms();
+    TEST_ASSERT_EQUAL(page_count, parser->get_page_count());
+    delete parser;
+    BENCHMARK_REPORT("%d word section, %d pages: first page %.3f ms incremental, %.3f ms full layout (parse %.3f ms), %.3f ms left to lay out",
+                     words, page_count, first_page_ms, full_ms, parse_ms, remaining_ms);
+  }
+  remove(INCREMENTAL_BOOK);
+}
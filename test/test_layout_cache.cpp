@@ -0,0 +1,288 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <string>
+#include <fstream>
+#include <vector>
+#include <EpubList/Epub.h>
+#include <EpubList/EpubReader.h>
+#include <EpubList/State.h>
+#include <RubbishHtmlParser/RubbishHtmlParser.h>
+#include <RubbishHtmlParser/Page.h>
+#include <LayoutCache/LayoutCache.h>
+#include "recording_renderer.h"
+#include "benchmark.h"
+#include "test_files.h"
+
+static const char *CACHE_PATH = "/tmp/";
+
+static const char *fixtures[] = {
+    "fixtures/no_oebps.epub",
+    "fixtures/oebps.epub",
+    "fixtures/relative_paths.epub",
+};
+
+static std::string render_cached_pages(CachedSection *section, Renderer *renderer, Epub *epub)
+{
+  RecordingRenderer *recorder = (RecordingRenderer *)renderer;
+  recorder->output.clear();
+  for (int i = 0; i < section->get_page_count(); i++)
+  {
+    Page *page = section->load_page(i);
+    TEST_ASSERT_NOT_NULL(page);
+    RubbishHtmlParser::render_page(page, renderer, epub);
+    delete page;
+  }
+  return recorder->output;
+}
+
+void test_layout_cache_matches_fresh_layout(void)
+{
+  LayoutCache cache(CACHE_PATH);
+  for (auto fixture : fixtures)
+  {
+    Epub epub(fixture);
+    TEST_ASSERT_TRUE(epub.load());
+    for (int section = 0; section < epub.get_spine_items_count(); section++)
+    {
+      std::string item = epub.get_spine_item(section);
+      RecordingRenderer renderer;
+      RubbishHtmlParser parser(&epub, item, get_base_path(item));
+      parser.layout(&renderer, &epub);
+      for (int i = 0; i < parser.get_page_count(); i++)
+      {
+        parser.render_page(i, &renderer, &epub);
+      }
+      std::string fresh = renderer.output;
+      TEST_ASSERT_TRUE(cache.save(&epub, &renderer, section, &parser));
+
+      CachedSection *cached = cache.load(&epub, &renderer, section);
+      TEST_ASSERT_NOT_NULL(cached);
+      TEST_ASSERT_EQUAL(parser.get_page_count(), cached->get_page_count());
+      TEST_ASSERT_EQUAL_STRING(fresh.c_str(), render_cached_pages(cached, &renderer, &epub).c_str());
+      TEST_ASSERT_NULL(cached->load_page(cached->get_page_count()));
+      delete cached;
+      cache.remove(&epub, section);
+    }
+  }
+}
+
+void test_layout_cache_invalidation(void)
+{
+  LayoutCache cache(CACHE_PATH);
+  Epub epub("fixtures/oebps.epub");
+  TEST_ASSERT_TRUE(epub.load());
+  std::string item = epub.get_spine_item(1);
+  RecordingRenderer renderer;
+  RubbishHtmlParser parser(&epub, item, get_base_path(item));
+  parser.layout(&renderer, &epub);
+  TEST_ASSERT_TRUE(cache.save(&epub, &renderer, 1, &parser));
+  // a different section is not in the cache
+  TEST_ASSERT_NULL(cache.load(&epub, &renderer, 2));
+  // changing the page geometry invalidates the layout
+  RecordingRenderer narrow_renderer(80, 100);
+  TEST_ASSERT_NULL(cache.load(&epub, &narrow_renderer, 1));
+  // and the out of date file should have been removed
+  TEST_ASSERT_NULL(cache.load(&epub, &renderer, 1));
+
+  TEST_ASSERT_TRUE(cache.save(&epub, &renderer, 1, &parser));
+  renderer.set_margin_left(10);
+  TEST_ASSERT_NULL(cache.load(&epub, &renderer, 1));
+  renderer.set_margin_left(0);
+
+  // a partially written file should not be used
+  TEST_ASSERT_TRUE(cache.save(&epub, &renderer, 1, &parser));
+  std::string filename = cache.get_filename(epub.get_path(), 1);
+  TEST_ASSERT_EQUAL(0, truncate(filename.c_str(), 100));
+  TEST_ASSERT_NULL(cache.load(&epub, &renderer, 1));
+
+  // and neither should a file that didn't get its magic number written
+  TEST_ASSERT_TRUE(cache.save(&epub, &renderer, 1, &parser));
+  FILE *fp = fopen(filename.c_str(), "r+b");
+  TEST_ASSERT_NOT_NULL(fp);
+  fwrite("\0\0\0\0", 1, 4, fp);
+  fclose(fp);
+  TEST_ASSERT_NULL(cache.load(&epub, &renderer, 1));
+  cache.remove(&epub, 1);
+}
+
+static const char *BUDGET_CACHE_PATH = "/tmp/layout_budget/";
+
+static void save_section(LayoutCache &cache, Epub &epub, int section)
+{
+  std::string item = epub.get_spine_item(section);
+  RecordingRenderer renderer;
+  RubbishHtmlParser parser(&epub, item, get_base_path(item));
+  parser.layout(&renderer, &epub);
+  cache.save(&epub, &renderer, section, &parser);
+}
+
+static bool is_cached(LayoutCache &cache, Epub &epub, int section)
+{
+  return access(cache.get_filename(epub.get_path(), section).c_str(), F_OK) == 0;
+}
+
+static void set_age(LayoutCache &cache, Epub &epub, int section, time_t mtime)
+{
+  struct utimbuf times = {mtime, mtime};
+  TEST_ASSERT_EQUAL(0, utime(cache.get_filename(epub.get_path(), section).c_str(), &times));
+}
+
+void test_layout_cache_budget(void)
+{
+  mkdir(BUDGET_CACHE_PATH, 0755);
+  std::string other_file = std::string(BUDGET_CACHE_PATH) + "library.idx";
+  FILE *fp = fopen(other_file.c_str(), "wb");
+  TEST_ASSERT_NOT_NULL(fp);
+  fputs("not a layout", fp);
+  fclose(fp);
+  // fill the cache with a couple of books - the first one was read longest ago
+  LayoutCache unlimited(BUDGET_CACHE_PATH, SIZE_MAX);
+  Epub oldest("fixtures/no_oebps.epub");
+  Epub older("fixtures/relative_paths.epub");
+  Epub current("fixtures/oebps.epub");
+  TEST_ASSERT_TRUE(oldest.load());
+  TEST_ASSERT_TRUE(older.load());
+  TEST_ASSERT_TRUE(current.load());
+  for (int section = 0; section < oldest.get_spine_items_count(); section++)
+  {
+    save_section(unlimited, oldest, section);
+    set_age(unlimited, oldest, section, 1000 + section);
+  }
+  for (int section = 0; section < older.get_spine_items_count(); section++)
+  {
+    save_section(unlimited, older, section);
+    set_age(unlimited, older, section, 2000 + section);
+  }
+  size_t budget = unlimited.get_total_size();
+  TEST_ASSERT_GREATER_THAN(0, budget);
+
+  // going over the budget throws away the oldest layouts first
+  LayoutCache cache(BUDGET_CACHE_PATH, budget);
+  save_section(cache, current, 1);
+  TEST_ASSERT_TRUE(is_cached(cache, current, 1));
+  TEST_ASSERT_LESS_OR_EQUAL(budget, cache.get_total_size());
+  TEST_ASSERT_FALSE(is_cached(cache, oldest, 0));
+  bool kept = false;
+  for (int section = 0; section < oldest.get_spine_items_count(); section++)
+  {
+    // once one section survives so do all the newer ones
+    kept |= is_cached(cache, oldest, section);
+    TEST_ASSERT_EQUAL(kept, is_cached(cache, oldest, section));
+  }
+  for (int section = 0; section < older.get_spine_items_count(); section++)
+  {
+    TEST_ASSERT_TRUE(is_cached(cache, older, section));
+  }
+
+  // the book being read keeps its layouts even if it doesn't fit on its own
+  LayoutCache tiny(BUDGET_CACHE_PATH, 1);
+  save_section(tiny, current, 2);
+  TEST_ASSERT_TRUE(is_cached(tiny, current, 1));
+  TEST_ASSERT_TRUE(is_cached(tiny, current, 2));
+  TEST_ASSERT_FALSE(is_cached(tiny, older, 0));
+
+  // books that have been deleted lose their layouts
+  std::string deleted_path = std::string(BUDGET_CACHE_PATH) + "deleted.epub";
+  {
+    std::ifstream in("fixtures/oebps.epub", std::ios::binary);
+    std::ofstream out(deleted_path, std::ios::binary);
+    out << in.rdbuf();
+  }
+  Epub deleted(deleted_path);
+  TEST_ASSERT_TRUE(deleted.load());
+  save_section(unlimited, deleted, 0);
+  save_section(unlimited, older, 0);
+  TEST_ASSERT_TRUE(is_cached(unlimited, deleted, 0));
+  remove(deleted_path.c_str());
+  unlimited.remove_orphans();
+  TEST_ASSERT_FALSE(is_cached(unlimited, deleted, 0));
+  TEST_ASSERT_TRUE(is_cached(unlimited, older, 0));
+  TEST_ASSERT_TRUE(is_cached(unlimited, current, 1));
+  unlimited.remove_book(older.get_path());
+  unlimited.remove_book(current.get_path());
+  TEST_ASSERT_EQUAL(0, unlimited.get_total_size());
+  // and anything else in the directory is left alone
+  TEST_ASSERT_EQUAL(0, access(other_file.c_str(), F_OK));
+  remove(other_file.c_str());
+  rmdir(BUDGET_CACHE_PATH);
+}
+
+void test_layout_cache_epub_reader(void)
+{
+  EpubListItem state;
+  memset(&state, 0, sizeof(state));
+  strcpy(state.path, "fixtures/oebps.epub");
+  state.current_section = 1;
+  // the first time through the section is parsed and layed out
+  RecordingRenderer renderer;
+  EpubReader *reader = new EpubReader(state, &renderer, CACHE_PATH);
+  reader->load();
+  reader->render();
+  TEST_ASSERT_EQUAL(2, renderer.busy_count);
+  std::string fresh = renderer.output;
+  int page_count = state.pages_in_current_section;
+  delete reader;
+  // the second time it comes straight from the cache
+  renderer.output.clear();
+  renderer.busy_count = 0;
+  reader = new EpubReader(state, &renderer, CACHE_PATH);
+  reader->load();
+  reader->render();
+  TEST_ASSERT_EQUAL(1, renderer.busy_count);
+  TEST_ASSERT_EQUAL(page_count, state.pages_in_current_section);
+  TEST_ASSERT_EQUAL_STRING(fresh.c_str(), renderer.output.c_str());
+  delete reader;
+  Epub epub(state.path);
+  LayoutCache(CACHE_PATH).remove(&epub, 1);
+}
+
+void benchmark_layout_cache(void)
+{
+  LayoutCache cache(CACHE_PATH);
+  for (auto fixture : fixtures)
+  {
+    Epub epub(fixture);
+    TEST_ASSERT_TRUE(epub.load());
+    // find the biggest chapter in the book
+    int largest_section = 0;
+    size_t largest_size = 0;
+    for (int i = 0; i < epub.get_spine_items_count(); i++)
+    {
+      size_t size = 0;
+      uint8_t *data = epub.get_item_contents(epub.get_spine_item(i), &size);
+      free(data);
+      if (size > largest_size)
+      {
+        largest_size = size;
+        largest_section = i;
+      }
+    }
+    std::string item = epub.get_spine_item(largest_section);
+    RecordingRenderer renderer;
+    // parse, layout and render the first page as we would on a chapter change
+    BenchmarkTimer timer;
+    RubbishHtmlParser *parser = new RubbishHtmlParser(&epub, item, get_base_path(item));
+    parser->layout(&renderer, &epub);
+    parser->render_page(0, &renderer, &epub);
+    double fresh_ms = timer.elapsed_ms();
+    cache.save(&epub, &renderer, largest_section, parser);
+    delete parser;
+    // and the same again from the cache
+    timer.reset();
+    CachedSection *cached = cache.load(&epub, &renderer, largest_section);
+    TEST_ASSERT_NOT_NULL(cached);
+    Page *page = cached->load_page(0);
+    RubbishHtmlParser::render_page(page, &renderer, &epub);
+    double cached_ms = timer.elapsed_ms();
+    delete page;
+    delete cached;
+    cache.remove(&epub, largest_section);
+    BENCHMARK_REPORT("%s: first page of largest chapter (%zu bytes) fresh layout %.2f ms, cached layout %.2f ms",
+                     fixture, largest_size, fresh_ms, cached_ms);
+  }
+}
@@ -0,0 +1,381 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <string>
+#include <vector>
+extern "C"
+{
+#include <dirent.h>
+}
+#include <EpubList/Epub.h>
+#include <EpubList/EpubList.h>
+#include <EpubList/State.h>
+#include <LibraryIndex/LibraryIndex.h>
+#include "recording_renderer.h"
+#include "epub_builder.h"
+#include "heap_tracker.h"
+#include "benchmark.h"
+#include "test_files.h"
+
+static const char *LIBRARY_PATH = "/tmp/library_index/";
+static const char *LARGE_LIBRARY_PATH = "/tmp/library_index_large/";
+
+// start off with an empty directory
+static void empty_directory(const char *path)
+{
+  mkdir(path, 0755);
+  DIR *dir = opendir(path);
+  TEST_ASSERT_NOT_NULL(dir);
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != NULL)
+  {
+    if (ent->d_name[0] != '.')
+    {
+      remove((std::string(path) + ent->d_name).c_str());
+    }
+  }
+  closedir(dir);
+}
+
+static std::string index_filename(const char *path)
+{
+  return std::string(path) + "library.idx";
+}
+
+void test_library_index_update(void)
+{
+  empty_directory(LIBRARY_PATH);
+  std::string jekyll = std::string(LIBRARY_PATH) + "jekyll.epub";
+  std::string aleph = std::string(LIBRARY_PATH) + "aleph.epub";
+  TEST_ASSERT_TRUE(copy_file("fixtures/oebps.epub", jekyll));
+  TEST_ASSERT_TRUE(copy_file("fixtures/no_oebps.epub", aleph));
+  TEST_ASSERT_TRUE(copy_file("fixtures/relative_paths.epub", std::string(LIBRARY_PATH) + "poesia.epub"));
+  // this isn't a book
+  TEST_ASSERT_TRUE(copy_file("fixtures/test.html", std::string(LIBRARY_PATH) + "notes.html"));
+  LibraryIndex index(index_filename(LIBRARY_PATH));
+  TEST_ASSERT_EQUAL(0, index.get_count());
+  // the first time every book has to be opened
+  TEST_ASSERT_TRUE(index.update(LIBRARY_PATH));
+  TEST_ASSERT_EQUAL(3, index.get_parsed_count());
+  TEST_ASSERT_EQUAL(3, index.get_count());
+  // and they come back sorted by title
+  std::vector<LibraryEntry> entries;
+  TEST_ASSERT_TRUE(index.read_entries(0, 10, entries));
+  TEST_ASSERT_EQUAL(3, entries.size());
+  TEST_ASSERT_EQUAL_STRING("El Aleph", entries[0].title.c_str());
+  TEST_ASSERT_EQUAL_STRING("Jorge Luis Borges", entries[0].author.c_str());
+  TEST_ASSERT_EQUAL_STRING(aleph.c_str(), entries[0].path.c_str());
+  TEST_ASSERT_EQUAL_STRING("Poesía completa", entries[1].title.c_str());
+  TEST_ASSERT_EQUAL_STRING("OEBPS/Images/cover.jpg", entries[1].cover_image_item.c_str());
+  TEST_ASSERT_EQUAL_STRING("The Strange Case of Dr. Jekyll and Mr. Hyde", entries[2].title.c_str());
+  TEST_ASSERT_EQUAL_STRING("Robert Louis Stevenson", entries[2].author.c_str());
+  // pages can start anywhere
+  TEST_ASSERT_TRUE(index.read_entries(1, 1, entries));
+  TEST_ASSERT_EQUAL(1, entries.size());
+  TEST_ASSERT_EQUAL_STRING("Poesía completa", entries[0].title.c_str());
+  TEST_ASSERT_TRUE(index.read_entries(3, 5, entries));
+  TEST_ASSERT_EQUAL(0, entries.size());
+  TEST_ASSERT_FALSE(index.read_entries(4, 5, entries));
+
+  // reading positions are kept - and found even if the hint is wrong
+  TEST_ASSERT_TRUE(index.save_position(jekyll, 3, 7, 12, 2));
+  TEST_ASSERT_TRUE(index.save_position(aleph, 1, 2, 3, 2));
+  TEST_ASSERT_FALSE(index.save_position("/tmp/missing.epub", 1, 2, 3));
+  // nothing has changed so nothing is opened
+  TEST_ASSERT_TRUE(index.update(LIBRARY_PATH));
+  TEST_ASSERT_EQUAL(0, index.get_parsed_count());
+  TEST_ASSERT_TRUE(index.read_entries(0, 3, entries));
+  TEST_ASSERT_EQUAL(1, entries[0].current_section);
+  TEST_ASSERT_EQUAL(2, entries[0].current_page);
+  TEST_ASSERT_EQUAL(3, entries[0].pages_in_current_section);
+  TEST_ASSERT_EQUAL(3, entries[2].current_section);
+  TEST_ASSERT_EQUAL(7, entries[2].current_page);
+  TEST_ASSERT_EQUAL(12, entries[2].pages_in_current_section);
+
+  // only a changed book is opened again - and starts from the beginning
+  struct timeval times[2] = {{1000, 0}, {1000, 0}};
+  TEST_ASSERT_EQUAL(0, utimes(jekyll.c_str(), times));
+  TEST_ASSERT_TRUE(index.update(LIBRARY_PATH));
+  TEST_ASSERT_EQUAL(1, index.get_parsed_count());
+  TEST_ASSERT_TRUE(index.read_entries(0, 3, entries));
+  TEST_ASSERT_EQUAL(1, entries[0].current_section);
+  TEST_ASSERT_EQUAL(0, entries[2].current_section);
+  // as is a new one
+  TEST_ASSERT_TRUE(copy_file("fixtures/oebps.epub", std::string(LIBRARY_PATH) + "another.epub"));
+  TEST_ASSERT_TRUE(index.update(LIBRARY_PATH));
+  TEST_ASSERT_EQUAL(1, index.get_parsed_count());
+  TEST_ASSERT_EQUAL(4, index.get_count());
+  // and books that have gone disappear from the index
+  remove(aleph.c_str());
+  TEST_ASSERT_TRUE(index.update(LIBRARY_PATH));
+  TEST_ASSERT_EQUAL(0, index.get_parsed_count());
+  TEST_ASSERT_EQUAL(3, index.get_count());
+  TEST_ASSERT_TRUE(index.read_entries(0, 1, entries));
+  TEST_ASSERT_EQUAL_STRING("Poesía completa", entries[0].title.c_str());
+  // a broken index is just built again
+  FILE *fp = fopen(index_filename(LIBRARY_PATH).c_str(), "r+b");
+  TEST_ASSERT_NOT_NULL(fp);
+  fwrite("\0\0\0\0", 1, 4, fp);
+  fclose(fp);
+  TEST_ASSERT_EQUAL(0, index.get_count());
+  TEST_ASSERT_TRUE(index.update(LIBRARY_PATH));
+  TEST_ASSERT_EQUAL(3, index.get_parsed_count());
+  TEST_ASSERT_EQUAL(3, index.get_count());
+  // and a missing directory is an error
+  TEST_ASSERT_FALSE(index.update("/tmp/no_such_library/"));
+  empty_directory(LIBRARY_PATH);
+}
+
+void test_library_index_failed_books(void)
+{
+  empty_directory(LIBRARY_PATH);
+  TEST_ASSERT_TRUE(copy_file("fixtures/oebps.epub", std::string(LIBRARY_PATH) + "jekyll.epub"));
+  std::string broken = std::string(LIBRARY_PATH) + "broken.epub";
+  TEST_ASSERT_TRUE(copy_file("fixtures/test.html", broken));
+  LibraryIndex index(index_filename(LIBRARY_PATH));
+  TEST_ASSERT_TRUE(index.update(LIBRARY_PATH));
+  TEST_ASSERT_EQUAL(2, index.get_parsed_count());
+  TEST_ASSERT_EQUAL(1, index.get_count());
+  // a book that can't be opened isn't tried again
+  TEST_ASSERT_TRUE(index.update(LIBRARY_PATH));
+  TEST_ASSERT_EQUAL(0, index.get_parsed_count());
+  TEST_ASSERT_EQUAL(1, index.get_count());
+  // until it changes
+  TEST_ASSERT_TRUE(copy_file("fixtures/no_oebps.epub", broken));
+  TEST_ASSERT_TRUE(index.update(LIBRARY_PATH));
+  TEST_ASSERT_EQUAL(1, index.get_parsed_count());
+  TEST_ASSERT_EQUAL(2, index.get_count());
+  empty_directory(LIBRARY_PATH);
+}
+
+void test_library_index_entities(void)
+{
+  empty_directory(LIBRARY_PATH);
+  // an escaped entity in the title should only be decoded once
+  EpubBuilder builder("Fish &amp;amp; Chips &amp;lt;3", "A &amp; B");
+  builder.add_chapter("Chapter 1", "<p>Some text</p>");
+  TEST_ASSERT_TRUE(builder.write(std::string(LIBRARY_PATH) + "fish.epub"));
+  LibraryIndex index(index_filename(LIBRARY_PATH));
+  TEST_ASSERT_TRUE(index.update(LIBRARY_PATH));
+  std::vector<LibraryEntry> entries;
+  TEST_ASSERT_TRUE(index.read_entries(0, 1, entries));
+  TEST_ASSERT_EQUAL_STRING("Fish &amp; Chips &lt;3", entries[0].title.c_str());
+  TEST_ASSERT_EQUAL_STRING("A & B", entries[0].author.c_str());
+  empty_directory(LIBRARY_PATH);
+}
+
+void test_library_index_interrupted_write(void)
+{
+  empty_directory(LIBRARY_PATH);
+  std::string jekyll = std::string(LIBRARY_PATH) + "jekyll.epub";
+  TEST_ASSERT_TRUE(copy_file("fixtures/oebps.epub", jekyll));
+  LibraryIndex index(index_filename(LIBRARY_PATH));
+  TEST_ASSERT_TRUE(index.update(LIBRARY_PATH));
+  TEST_ASSERT_TRUE(index.save_position(jekyll, 3, 7, 12));
+  // a new index that didn't get finished leaves the old one alone
+  std::string temp_filename = index_filename(LIBRARY_PATH) + ".tmp";
+  FILE *fp = fopen(temp_filename.c_str(), "wb");
+  TEST_ASSERT_NOT_NULL(fp);
+  fputs("half written", fp);
+  fclose(fp);
+  std::vector<LibraryEntry> entries;
+  TEST_ASSERT_TRUE(index.read_entries(0, 1, entries));
+  TEST_ASSERT_EQUAL(3, entries[0].current_section);
+  // the new book is added and the old positions are still there
+  TEST_ASSERT_TRUE(copy_file("fixtures/no_oebps.epub", std::string(LIBRARY_PATH) + "aleph.epub"));
+  TEST_ASSERT_TRUE(index.update(LIBRARY_PATH));
+  TEST_ASSERT_EQUAL(1, index.get_parsed_count());
+  TEST_ASSERT_EQUAL(-1, access(temp_filename.c_str(), F_OK));
+  // losing the power after the old index was removed but before the new one was renamed
+  TEST_ASSERT_EQUAL(0, rename(index_filename(LIBRARY_PATH).c_str(), temp_filename.c_str()));
+  TEST_ASSERT_EQUAL(2, index.get_count());
+  TEST_ASSERT_TRUE(index.read_entries(0, 2, entries));
+  TEST_ASSERT_EQUAL_STRING(jekyll.c_str(), entries[1].path.c_str());
+  TEST_ASSERT_EQUAL(3, entries[1].current_section);
+  TEST_ASSERT_EQUAL(7, entries[1].current_page);
+  empty_directory(LIBRARY_PATH);
+}
+
+void test_library_index_update_in_pages(void)
+{
+  // more books than are read from the index at a time
+  empty_directory(LIBRARY_PATH);
+  const int book_count = 75;
+  for (int i = 0; i < book_count; i++)
+  {
+    char title[20];
+    snprintf(title, sizeof(title), "Book-%02d", (i * 7) % book_count);
+    EpubBuilder builder(title, "An Author");
+    builder.add_chapter("Chapter 1", "<p>Some text</p>");
+    TEST_ASSERT_TRUE(builder.write(std::string(LIBRARY_PATH) + "book" + std::to_string(i) + ".epub"));
+  }
+  LibraryIndex index(index_filename(LIBRARY_PATH));
+  TEST_ASSERT_TRUE(index.update(LIBRARY_PATH));
+  TEST_ASSERT_EQUAL(book_count, index.get_count());
+  std::string kept = std::string(LIBRARY_PATH) + "book70.epub";
+  TEST_ASSERT_TRUE(index.save_position(kept, 2, 4, 6));
+  // take one away and add some that sort into different pages
+  remove((std::string(LIBRARY_PATH) + "book3.epub").c_str());
+  for (const char *title : {"Book-00a", "Book-40a", "Book-99"})
+  {
+    EpubBuilder builder(title, "Another Author");
+    builder.add_chapter("Chapter 1", "<p>Some text</p>");
+    TEST_ASSERT_TRUE(builder.write(std::string(LIBRARY_PATH) + title + ".epub"));
+  }
+  TEST_ASSERT_TRUE(index.update(LIBRARY_PATH));
+  TEST_ASSERT_EQUAL(3, index.get_parsed_count());
+  TEST_ASSERT_EQUAL(book_count + 2, index.get_count());
+  std::vector<LibraryEntry> entries;
+  TEST_ASSERT_TRUE(index.read_entries(0, book_count + 2, entries));
+  TEST_ASSERT_EQUAL(book_count + 2, entries.size());
+  for (int i = 1; i < (int)entries.size(); i++)
+  {
+    TEST_ASSERT_TRUE(entries[i - 1].title < entries[i].title);
+    TEST_ASSERT_NOT_EQUAL(0, entries[i].title.compare("Book-21"));
+    if (entries[i].path == kept)
+    {
+      TEST_ASSERT_EQUAL(2, entries[i].current_section);
+      TEST_ASSERT_EQUAL(4, entries[i].current_page);
+    }
+  }
+  TEST_ASSERT_EQUAL_STRING("Book-00a", entries[1].title.c_str());
+  TEST_ASSERT_EQUAL_STRING("Book-99", entries.back().title.c_str());
+  empty_directory(LIBRARY_PATH);
+}
+
+void test_library_index_epub_list(void)
+{
+  // more books than used to fit in the list
+  empty_directory(LIBRARY_PATH);
+  const int book_count = 23;
+  for (int i = 0; i < book_count; i++)
+  {
+    char title[20];
+    snprintf(title, sizeof(title), "Book-%02d", i);
+    EpubBuilder builder(title, "An Author");
+    builder.add_chapter("Chapter 1", "<p>Some text</p>");
+    TEST_ASSERT_TRUE(builder.write(std::string(LIBRARY_PATH) + "book" + std::to_string(i) + ".epub"));
+  }
+  EpubListState state;
+  memset(&state, 0, sizeof(state));
+  RecordingRenderer renderer(540, 960);
+  EpubList list(&renderer, state, LIBRARY_PATH);
+  TEST_ASSERT_TRUE(list.load(LIBRARY_PATH));
+  TEST_ASSERT_EQUAL(book_count, state.num_epubs);
+  // move to the last page and pick the last book
+  for (int i = 0; i < book_count - 1; i++)
+  {
+    list.next();
+  }
+  list.render();
+  TEST_ASSERT_TRUE(renderer.output.find("Book-22") != std::string::npos);
+  TEST_ASSERT_TRUE(renderer.output.find("Book-19") == std::string::npos);
+  list.select_current();
+  TEST_ASSERT_EQUAL_STRING("Book-22", state.selected_epub.title);
+  TEST_ASSERT_EQUAL_STRING((std::string(LIBRARY_PATH) + "book22.epub").c_str(), state.selected_epub.path);
+  // read a bit and come back - the position ends up in the index
+  state.selected_epub.current_section = 1;
+  state.selected_epub.current_page = 5;
+  list.save_position();
+  list.next();
+  list.select_current();
+  TEST_ASSERT_EQUAL_STRING("Book-00", state.selected_epub.title);
+  TEST_ASSERT_EQUAL(0, state.selected_epub.current_page);
+  // and it's still there after the list is loaded again from scratch
+  memset(&state, 0, sizeof(state));
+  EpubList reloaded(&renderer, state, LIBRARY_PATH);
+  TEST_ASSERT_TRUE(reloaded.load(LIBRARY_PATH));
+  for (int i = 0; i < book_count - 1; i++)
+  {
+    reloaded.next();
+  }
+  reloaded.select_current();
+  TEST_ASSERT_EQUAL(1, state.selected_epub.current_section);
+  TEST_ASSERT_EQUAL(5, state.selected_epub.current_page);
+  empty_directory(LIBRARY_PATH);
+}
+
+// the old way of building the list - open every book every time
+static int load_every_book(const char *path)
+{
+  int count = 0;
+  DIR *dir = opendir(path);
+  struct dirent *ent;
+  while ((ent = readdir(dir)) != NULL)
+  {
+    int name_length = strlen(ent->d_name);
+    if (name_length < 5 || strcmp(ent->d_name + name_length - 5, ".epub") != 0)
+    {
+      continue;
+    }
+    Epub epub(std::string(path) + ent->d_name);
+    if (epub.load())
+    {
+      count++;
+    }
+  }
+  closedir(dir);
+  return count;
+}
+
+void benchmark_library_index(void)
+{
+  if (!heap_tracker_supported())
+  {
+    TEST_IGNORE_MESSAGE("Heap tracking is not supported on this platform");
+  }
+  const int book_count = 1000;
+  empty_directory(LARGE_LIBRARY_PATH);
+  for (int i = 0; i < book_count; i++)
+  {
+    EpubBuilder builder("Synthetic Book " + std::to_string((i * 7919) % book_count), "Author " + std::to_string(i % 37));
+    for (int chapter = 0; chapter < 5; chapter++)
+    {
+      builder.add_chapter("Chapter " + std::to_string(chapter), "<p>A short paragraph of text for the chapter.</p>");
+    }
+    TEST_ASSERT_TRUE(builder.write(std::string(LARGE_LIBRARY_PATH) + "book" + std::to_string(i) + ".epub"));
+  }
+  heap_tracker_reset();
+  size_t start_heap = heap_tracker_current();
+  BenchmarkTimer timer;
+  TEST_ASSERT_EQUAL(book_count, load_every_book(LARGE_LIBRARY_PATH));
+  BENCHMARK_REPORT("opening all %d books: %.2f ms, %zu allocations, %zu bytes peak heap",
+                   book_count, timer.elapsed_ms(), heap_tracker_allocations(), heap_tracker_peak() - start_heap);
+
+  LibraryIndex index(index_filename(LARGE_LIBRARY_PATH));
+  const char *passes[] = {"cold index", "warm index", "one new book"};
+  for (auto pass : passes)
+  {
+    if (strcmp(pass, "one new book") == 0)
+    {
+      EpubBuilder builder("A New Book", "New Author");
+      builder.add_chapter("Chapter 1", "<p>Text</p>");
+      TEST_ASSERT_TRUE(builder.write(std::string(LARGE_LIBRARY_PATH) + "new.epub"));
+    }
+    heap_tracker_reset();
+    start_heap = heap_tracker_current();
+    timer.reset();
+    TEST_ASSERT_TRUE(index.update(LARGE_LIBRARY_PATH));
+    BENCHMARK_REPORT("library index update (%s): %.2f ms, %zu books opened, %zu allocations, %zu bytes peak heap",
+                     pass, timer.elapsed_ms(), index.get_parsed_count(), heap_tracker_allocations(), heap_tracker_peak() - start_heap);
+  }
+  TEST_ASSERT_EQUAL(book_count + 1, index.get_count());
+  // reading a page of the list from anywhere in the index
+  std::vector<LibraryEntry> entries;
+  heap_tracker_reset();
+  start_heap = heap_tracker_current();
+  timer.reset();
+  const int pages = 100;
+  for (int page = 0; page < pages; page++)
+  {
+    TEST_ASSERT_TRUE(index.read_entries((page * 37 % (book_count / 5)) * 5, 5, entries));
+    TEST_ASSERT_EQUAL(5, entries.size());
+  }
+  BENCHMARK_REPORT("reading a page of 5 books from the index: %.3f ms, %zu allocations, %zu bytes peak heap",
+                   timer.elapsed_ms() / pages, heap_tracker_allocations() / pages, heap_tracker_peak() - start_heap);
+  empty_directory(LARGE_LIBRARY_PATH);
+}
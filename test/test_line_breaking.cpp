@@ -0,0 +1,148 @@
+#include <unity.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <EpubList/Epub.h>
+#include <RubbishHtmlParser/RubbishHtmlParser.h>
+#include <RubbishHtmlParser/blocks/TextBlock.h>
+#include "recording_renderer.h"
+#include "benchmark.h"
+
+// hash all the line breaks in a section so we can compare them against known good values
+static uint32_t hash_line_breaks(RubbishHtmlParser &parser, uint32_t hash)
+{
+  for (auto block : parser.get_blocks())
+  {
+    if (block->getType() == TEXT_BLOCK)
+    {
+      for (auto line_break : ((TextBlock *)block)->line_breaks)
+      {
+        hash = (hash ^ line_break) * 16777619u;
+      }
+    }
+    // mark the end of each block
+    hash = (hash ^ 0xffff) * 16777619u;
+  }
+  return hash;
+}
+
+static uint32_t hash_fixture(const char *fixture, int page_width)
+{
+  Epub epub(fixture);
+  TEST_ASSERT_TRUE(epub.load());
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < epub.get_spine_items_count(); i++)
+  {
+    std::string item = epub.get_spine_item(i);
+    RubbishHtmlParser parser(&epub, item, item.substr(0, item.find_last_of('/') + 1));
+    RecordingRenderer renderer(page_width, 100);
+    parser.layout(&renderer, &epub);
+    hash = hash_line_breaks(parser, hash);
+  }
+  return hash;
+}
+
+void test_line_breaking_golden(void)
+{
+  // these were generated with the original quadratic line breaking
+  struct
+  {
+    const char *fixture;
+    int page_width;
+    uint32_t hash;
+  } goldens[] = {
+      {"fixtures/no_oebps.epub", 100, 0xffc98a3b},
+      {"fixtures/no_oebps.epub", 40, 0x1f3468a2},
+      {"fixtures/oebps.epub", 100, 0x09429c12},
+      {"fixtures/oebps.epub", 40, 0x098e66ff},
+      {"fixtures/relative_paths.epub", 100, 0x4eff8311},
+      {"fixtures/relative_paths.epub", 40, 0xd93af5cb},
+  };
+  for (auto &golden : goldens)
+  {
+    uint32_t hash = hash_fixture(golden.fixture, golden.page_width);
+    TEST_ASSERT_EQUAL_UINT32(golden.hash, hash);
+  }
+}
+
+// a paragraph of pseudo random words with lengths between min_length and max_length
+static std::string make_paragraph(int word_count, int min_length, int max_length)
+{
+  std::string paragraph;
+  uint32_t seed = 12345;
+  for (int i = 0; i < word_count; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    int length = min_length + (seed >> 16) % (max_length - min_length + 1);
+    paragraph.append(length, 'a' + i % 26);
+    paragraph += ' ';
+  }
+  return paragraph;
+}
+
+void benchmark_line_breaking(void)
+{
+  struct
+  {
+    const char *name;
+    int min_length;
+    int max_length;
+    int page_width;
+  } paragraphs[] = {
+      {"normal words", 1, 12, 60},
+      {"short words on a wide page", 1, 2, 540},
+  };
+  const int word_count = 10000;
+  for (auto &paragraph : paragraphs)
+  {
+    std::string text = make_paragraph(word_count, paragraph.min_length, paragraph.max_length);
+    RecordingRenderer renderer(paragraph.page_width, 100);
+    Arena arena;
+    TextBlock *block = new (&arena) TextBlock(JUSTIFIED, &arena);
+    block->add_span(text.c_str(), false, false);
+    BenchmarkTimer timer;
+    block->layout(&renderer, nullptr);
+    double elapsed = timer.elapsed_ms();
+    // every word should end up on a line
+    TEST_ASSERT_EQUAL(word_count, block->line_breaks.back());
+    BENCHMARK_REPORT("line breaking %d words (%s): %zu lines in %.2f ms, %.0f words/ms",
+                     word_count, paragraph.name, block->line_breaks.size(), elapsed, word_count / elapsed);
+    delete block;
+  }
+}
+
+void test_line_breaking_huge_paragraph(void)
+{
+  // more words than fit in 16 bits
+  const int word_count = 70000;
+  std::string text = make_paragraph(word_count, 1, 8);
+  RecordingRenderer renderer(60, 100);
+  Arena arena;
+  TextBlock *block = new (&arena) TextBlock(JUSTIFIED, &arena);
+  block->add_span(text.c_str(), false, false);
+  block->layout(&renderer, nullptr);
+  TEST_ASSERT_EQUAL(word_count, block->get_word_count());
+  TEST_ASSERT_EQUAL(word_count, block->line_breaks.back());
+  // every line moves forward and fits on the page
+  uint32_t start = 0;
+  for (auto line_break : block->line_breaks)
+  {
+    TEST_ASSERT_GREATER_THAN(start, line_break);
+    start = line_break;
+  }
+  TEST_ASSERT_LESS_THAN(word_count, block->line_breaks.size());
+  delete block;
+}
+
+void test_line_breaking_long_word(void)
+{
+  // a word that is too wide for the page gets a line of its own
+  RecordingRenderer renderer(10, 100);
+  TextBlock block(LEFT_ALIGN);
+  block.add_span("one two averyveryverylongword three four", false, false);
+  block.layout(&renderer, nullptr);
+  TEST_ASSERT_EQUAL(3, block.line_breaks.size());
+  TEST_ASSERT_EQUAL(2, block.line_breaks[0]);
+  TEST_ASSERT_EQUAL(3, block.line_breaks[1]);
+  TEST_ASSERT_EQUAL(5, block.line_breaks[2]);
+}
@@ -0,0 +1,163 @@
+#include <unity.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <EpubList/Epub.h>
+#include <RubbishHtmlParser/RubbishHtmlParser.h>
+#include <Renderer/MemoryFrameBufferRenderer.h>
+#include "glyph_drawing_renderer.h"
+#include "benchmark.h"
+
+static uint32_t hash_frame(const std::vector<uint8_t> &frame)
+{
+  uint32_t hash = 2166136261u;
+  for (uint8_t value : frame)
+  {
+    hash = (hash ^ value) * 16777619u;
+  }
+  return hash;
+}
+
+static RubbishHtmlParser *layout_section(Epub &epub, int section, Renderer *renderer)
+{
+  std::string item = epub.get_spine_item(section);
+  RubbishHtmlParser *parser = new RubbishHtmlParser(&epub, item, item.substr(0, item.find_last_of('/') + 1));
+  parser->layout(renderer, &epub);
+  return parser;
+}
+
+void test_memory_frame_buffer_renderer_pages(void)
+{
+  Epub epub("fixtures/oebps.epub");
+  TEST_ASSERT_TRUE(epub.load());
+  MemoryFrameBufferRenderer renderer(&regular_font, &bold_font, &italic_font, &bold_italic_font);
+  GlyphDrawingRenderer reference;
+  RubbishHtmlParser *parser = layout_section(epub, 1, &renderer);
+  RubbishHtmlParser *reference_parser = layout_section(epub, 1, &reference);
+  // the same fonts give the same layout and the same pixels as drawing the glyphs ourselves
+  TEST_ASSERT_EQUAL(reference_parser->get_page_count(), parser->get_page_count());
+  // pixel exact golden results - if the drawing changes on purpose the new pages are in /tmp to look at
+  const uint32_t golden[] = {0x3e161251, 0x426b2cdf, 0x524ffe1c};
+  TEST_ASSERT_EQUAL(sizeof(golden) / sizeof(golden[0]), parser->get_page_count());
+  for (int i = 0; i < parser->get_page_count(); i++)
+  {
+    renderer.clear_screen();
+    parser->render_page(i, &renderer, &epub);
+    reference.clear_screen();
+    reference_parser->render_page(i, &reference, &epub);
+    TEST_ASSERT_TRUE(renderer.get_frame_buffer() == reference.frame_buffer);
+    uint32_t hash = hash_frame(renderer.get_frame_buffer());
+    if (hash != golden[i])
+    {
+      std::string filename = "/tmp/oebps_1_" + std::to_string(i) + ".png";
+      renderer.dump_png(filename.c_str());
+      printf("page %d hash 0x%08x written to %s\n", i, hash, filename.c_str());
+    }
+    TEST_ASSERT_EQUAL_UINT32(golden[i], hash);
+  }
+  delete parser;
+  delete reference_parser;
+}
+
+void test_memory_frame_buffer_renderer_drawing(void)
+{
+  MemoryFrameBufferRenderer renderer(&regular_font, &bold_font, &italic_font, &bold_italic_font, 40, 20);
+  renderer.set_margin_left(2);
+  renderer.set_margin_top(1);
+  TEST_ASSERT_EQUAL(38, renderer.get_page_width());
+  TEST_ASSERT_EQUAL(19, renderer.get_page_height());
+  // the rectangles are inside the margins and anything off the edge is clipped
+  renderer.fill_rect(0, 0, 2, 2, 0);
+  TEST_ASSERT_EQUAL(15, renderer.get_pixel(1, 1));
+  TEST_ASSERT_EQUAL(0, renderer.get_pixel(2, 1));
+  TEST_ASSERT_EQUAL(0, renderer.get_pixel(3, 2));
+  TEST_ASSERT_EQUAL(15, renderer.get_pixel(4, 2));
+  TEST_ASSERT_FALSE(renderer.has_gray());
+  renderer.fill_rect(30, 10, 100, 100, 0x80);
+  TEST_ASSERT_EQUAL(8, renderer.get_pixel(39, 19));
+  TEST_ASSERT_TRUE(renderer.has_gray());
+  renderer.flush_display();
+  TEST_ASSERT_FALSE(renderer.has_gray());
+  renderer.clear_screen();
+  renderer.draw_rect(0, 0, 5, 4, 0);
+  TEST_ASSERT_EQUAL(0, renderer.get_pixel(6, 1));
+  TEST_ASSERT_EQUAL(0, renderer.get_pixel(6, 4));
+  TEST_ASSERT_EQUAL(15, renderer.get_pixel(4, 2));
+  // circles and triangles go where they are told
+  renderer.clear_screen();
+  renderer.draw_circle(10, 10, 3, 0);
+  TEST_ASSERT_EQUAL(0, renderer.get_pixel(13, 10));
+  TEST_ASSERT_EQUAL(15, renderer.get_pixel(10, 10));
+  renderer.fill_circle(10, 10, 3, 0);
+  TEST_ASSERT_EQUAL(0, renderer.get_pixel(10, 10));
+  renderer.fill_triangle(20, 2, 30, 2, 20, 12, 0);
+  TEST_ASSERT_EQUAL(0, renderer.get_pixel(22, 4));
+  TEST_ASSERT_EQUAL(15, renderer.get_pixel(29, 11));
+  // images leave the transparent pixels alone
+  renderer.clear_screen();
+  const uint8_t image[] = {0xE0, 0x5E};
+  renderer.show_img(0, 0, 2, 2, image);
+  TEST_ASSERT_EQUAL(0, renderer.get_pixel(0, 0));
+  TEST_ASSERT_EQUAL(15, renderer.get_pixel(1, 0));
+  TEST_ASSERT_EQUAL(15, renderer.get_pixel(0, 1));
+  TEST_ASSERT_EQUAL(5, renderer.get_pixel(1, 1));
+  renderer.show_busy();
+  TEST_ASSERT_EQUAL(1, renderer.get_busy_count());
+  // odd widths keep the last column of each row to themselves
+  MemoryFrameBufferRenderer odd(&regular_font, &bold_font, &italic_font, &bold_italic_font, 5, 3);
+  TEST_ASSERT_EQUAL(9, odd.get_frame_buffer().size());
+  odd.fill_rect(4, 0, 1, 3, 0);
+  TEST_ASSERT_EQUAL(0, odd.get_pixel(4, 0));
+  TEST_ASSERT_EQUAL(0, odd.get_pixel(4, 2));
+  TEST_ASSERT_EQUAL(15, odd.get_pixel(0, 1));
+  TEST_ASSERT_EQUAL(15, odd.get_pixel(0, 2));
+  // and the frame can be written out to look at
+  TEST_ASSERT_TRUE(renderer.dump_pgm("/tmp/memory_renderer.pgm"));
+  FILE *fp = fopen("/tmp/memory_renderer.pgm", "rb");
+  TEST_ASSERT_NOT_NULL(fp);
+  char header[16] = {0};
+  TEST_ASSERT_EQUAL(13, fread(header, 1, 13, fp));
+  TEST_ASSERT_EQUAL_STRING("P5\n40 20\n255\n", header);
+  uint8_t pixels[2];
+  TEST_ASSERT_EQUAL(2, fread(pixels, 1, 2, fp));
+  TEST_ASSERT_EQUAL(0, pixels[0]);
+  TEST_ASSERT_EQUAL(255, pixels[1]);
+  fseek(fp, 0, SEEK_END);
+  TEST_ASSERT_EQUAL(13 + 40 * 20, ftell(fp));
+  fclose(fp);
+  remove("/tmp/memory_renderer.pgm");
+  TEST_ASSERT_TRUE(renderer.dump_png("/tmp/memory_renderer.png"));
+  fp = fopen("/tmp/memory_renderer.png", "rb");
+  TEST_ASSERT_NOT_NULL(fp);
+  TEST_ASSERT_EQUAL(4, fread(header, 1, 4, fp));
+  TEST_ASSERT_EQUAL(0, memcmp(header, "\x89PNG", 4));
+  fclose(fp);
+  remove("/tmp/memory_renderer.png");
+}
+
+void benchmark_page_render(void)
+{
+  Epub epub("fixtures/oebps.epub");
+  TEST_ASSERT_TRUE(epub.load());
+  MemoryFrameBufferRenderer renderer(&regular_font, &bold_font, &italic_font, &bold_italic_font);
+  renderer.set_margin_left(10);
+  renderer.set_margin_right(10);
+  renderer.set_margin_top(35);
+  int pages = 0;
+  double render_ms = 0;
+  for (int section = 0; section < epub.get_spine_items_count(); section++)
+  {
+    RubbishHtmlParser *parser = layout_section(epub, section, &renderer);
+    for (int i = 0; i < parser->get_page_count(); i++)
+    {
+      BenchmarkTimer timer;
+      renderer.clear_screen();
+      parser->render_page(i, &renderer, &epub);
+      render_ms += timer.elapsed_ms();
+      pages++;
+    }
+    delete parser;
+  }
+  BENCHMARK_REPORT("oebps.epub %d pages rendered to a 540x960 frame: %.3f ms per page, glyph cache %zu hits %zu misses",
+                   pages, render_ms / pages, renderer.get_glyph_cache_hits(), renderer.get_glyph_cache_misses());
+}
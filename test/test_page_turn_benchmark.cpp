@@ -0,0 +1,181 @@
+#include <unity.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <EpubList/Epub.h>
+#include <RubbishHtmlParser/RubbishHtmlParser.h>
+#include <Renderer/MemoryFrameBufferRenderer.h>
+#include <regular_font.h>
+#include <bold_font.h>
+#include <italic_font.h>
+#include <bold_italic_font.h>
+#include "epub_builder.h"
+#include "heap_tracker.h"
+#include "benchmark.h"
+
+// where the results go - set PAGE_TURN_BENCHMARK_JSON to put them somewhere else
+static const char *DEFAULT_JSON_PATH = "/tmp/page_turn_benchmark.json";
+// bump this if the stages or what they measure change so old results aren't compared with new ones
+static const int RESULTS_VERSION = 1;
+
+// the timings and heap use of one stage of the pipeline over all the times it was run
+class StageResults
+{
+private:
+  std::vector<double> m_samples_ms;
+  size_t m_allocations = 0;
+  size_t m_peak_heap = 0;
+  size_t m_start_heap = 0;
+  BenchmarkTimer m_timer;
+
+public:
+  const char *name;
+
+  StageResults(const char *name) : name(name) {}
+  void start()
+  {
+    heap_tracker_reset();
+    m_start_heap = heap_tracker_current();
+    m_timer.reset();
+  }
+  void stop()
+  {
+    m_samples_ms.push_back(m_timer.elapsed_ms());
+    m_allocations += heap_tracker_allocations();
+    m_peak_heap = std::max(m_peak_heap, heap_tracker_peak() - m_start_heap);
+  }
+  size_t get_count() { return m_samples_ms.size(); }
+  double get_percentile(int percentile)
+  {
+    if (m_samples_ms.empty())
+    {
+      return 0;
+    }
+    std::vector<double> sorted = m_samples_ms;
+    std::sort(sorted.begin(), sorted.end());
+    return sorted[std::min(sorted.size() - 1, sorted.size() * percentile / 100)];
+  }
+  double get_total()
+  {
+    double total = 0;
+    for (double sample : m_samples_ms)
+    {
+      total += sample;
+    }
+    return total;
+  }
+  size_t get_allocations() { return m_allocations; }
+  size_t get_peak_heap() { return m_peak_heap; }
+  std::string to_json()
+  {
+    char json[256];
+    snprintf(json, sizeof(json), "\"%s\": {\"count\": %zu, \"p50_ms\": %.4f, \"p99_ms\": %.4f, \"total_ms\": %.3f, \"allocations\": %zu, \"peak_heap\": %zu}",
+             name, get_count(), get_percentile(50), get_percentile(99), get_total(), m_allocations, m_peak_heap);
+    return json;
+  }
+};
+
+// run every stage of reading a book from opening it to drawing each page - returns the results as json
+static std::string benchmark_book(const char *path)
+{
+  StageResults open("open"), opf("opf"), toc("toc"), extract("extract"), parse("parse"), layout("layout"), render("render");
+  MemoryFrameBufferRenderer renderer(&regular_font, &bold_font, &italic_font, &bold_italic_font);
+  // the same margins as the device
+  renderer.set_margin_top(35);
+  renderer.set_margin_left(10);
+  renderer.set_margin_right(10);
+  // opening is just the zip directory and the metadata for the library
+  open.start();
+  Epub *epub = new Epub(path);
+  TEST_ASSERT_TRUE(epub->load(EPUB_LOAD_METADATA));
+  open.stop();
+  opf.start();
+  TEST_ASSERT_TRUE(epub->load(EPUB_LOAD_SPINE));
+  opf.stop();
+  toc.start();
+  TEST_ASSERT_TRUE(epub->load(EPUB_LOAD_TOC));
+  toc.stop();
+  int page_count = 0;
+  for (int section = 0; section < epub->get_spine_items_count(); section++)
+  {
+    std::string item = epub->get_spine_item(section);
+    extract.start();
+    size_t size = 0;
+    uint8_t *html = epub->get_item_contents(item, &size);
+    extract.stop();
+    TEST_ASSERT_NOT_NULL(html);
+    parse.start();
+    RubbishHtmlParser *parser = new RubbishHtmlParser((const char *)html, size, item.substr(0, item.find_last_of('/') + 1));
+    parse.stop();
+    layout.start();
+    parser->layout(&renderer, epub);
+    layout.stop();
+    for (int page = 0; page < parser->get_page_count(); page++)
+    {
+      render.start();
+      renderer.clear_screen();
+      parser->render_page(page, &renderer, epub);
+      render.stop();
+    }
+    page_count += parser->get_page_count();
+    delete parser;
+    free(html);
+  }
+  std::string json = "{\"book\": \"" + std::string(path) + "\", \"sections\": " + std::to_string(epub->get_spine_items_count()) +
+                     ", \"pages\": " + std::to_string(page_count) + ", \"page_width\": " + std::to_string(renderer.get_page_width()) +
+                     ", \"page_height\": " + std::to_string(renderer.get_page_height()) + ", \"stages\": {";
+  StageResults *stages[] = {&open, &opf, &toc, &extract, &parse, &layout, &render};
+  for (auto stage : stages)
+  {
+    json += (stage == stages[0] ? "" : ", ") + stage->to_json();
+    BENCHMARK_REPORT("%s %s: %zu runs, p50 %.3f ms, p99 %.3f ms, total %.1f ms, %zu allocations, %zu bytes peak heap",
+                     path, stage->name, stage->get_count(), stage->get_percentile(50), stage->get_percentile(99),
+                     stage->get_total(), stage->get_allocations(), stage->get_peak_heap());
+  }
+  delete epub;
+  return json + "}}";
+}
+
+void benchmark_page_turn_pipeline(void)
+{
+  if (!heap_tracker_supported())
+  {
+    TEST_IGNORE_MESSAGE("Heap tracking is not supported on this platform");
+  }
+  // made up books to see how things scale past the fixtures - bigger ones when it's run on its own
+#ifdef BENCHMARKS_ONLY
+  const int synthetic_chapters[] = {20, 200, 1000};
+  const int synthetic_words = 3000;
+#else
+  const int synthetic_chapters[] = {10, 100};
+  const int synthetic_words = 1000;
+#endif
+  std::vector<std::string> books = {"fixtures/no_oebps.epub", "fixtures/oebps.epub", "fixtures/relative_paths.epub"};
+  for (int chapters : synthetic_chapters)
+  {
+    EpubBuilder builder("Synthetic", "Benchmark");
+    builder.add_generated_chapters(chapters, synthetic_words);
+    std::string path = "/tmp/synthetic_" + std::to_string(chapters) + ".epub";
+    TEST_ASSERT_TRUE(builder.write(path));
+    books.push_back(path);
+  }
+  std::string json = "{\"version\": " + std::to_string(RESULTS_VERSION) + ", \"books\": [";
+  for (size_t i = 0; i < books.size(); i++)
+  {
+    json += (i == 0 ? "" : ", ") + benchmark_book(books[i].c_str());
+  }
+  json += "]}\n";
+  for (int chapters : synthetic_chapters)
+  {
+    remove(("/tmp/synthetic_" + std::to_string(chapters) + ".epub").c_str());
+  }
+  const char *json_path = getenv("PAGE_TURN_BENCHMARK_JSON");
+  json_path = json_path ? json_path : DEFAULT_JSON_PATH;
+  FILE *fp = fopen(json_path, "w");
+  TEST_ASSERT_NOT_NULL(fp);
+  fputs(json.c_str(), fp);
+  fclose(fp);
+  BENCHMARK_REPORT("page turn results written to %s", json_path);
+}
@@ -0,0 +1,232 @@
+#include <unity.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <Renderer/Dither.h>
+#include <Renderer/ImageScaler.h>
+#include <Renderer/ImageRowWriter.h>
+#include <Renderer/PNGLine.h>
+#include "glyph_drawing_renderer.h"
+#include "benchmark.h"
+
+void test_png_line_to_gray(void)
+{
+  uint8_t gray[8];
+  // 1 bit gray scale is packed with the first pixel in the top bit
+  uint8_t one_bit[] = {0xA5};
+  TEST_ASSERT_TRUE(png_line_to_gray(one_bit, 8, PNG_LINE_GRAYSCALE, 1, nullptr, gray));
+  uint8_t one_bit_expected[] = {255, 0, 255, 0, 0, 255, 0, 255};
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(one_bit_expected, gray, 8);
+  // 4 bit samples get stretched to the full range
+  uint8_t four_bit[] = {0x0F, 0x83};
+  TEST_ASSERT_TRUE(png_line_to_gray(four_bit, 4, PNG_LINE_GRAYSCALE, 4, nullptr, gray));
+  uint8_t four_bit_expected[] = {0, 255, 136, 51};
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(four_bit_expected, gray, 4);
+  // 16 bit samples just use the top byte
+  uint8_t sixteen_bit[] = {0x12, 0x34, 0xFF, 0x00};
+  TEST_ASSERT_TRUE(png_line_to_gray(sixteen_bit, 2, PNG_LINE_GRAYSCALE, 16, nullptr, gray));
+  TEST_ASSERT_EQUAL(0x12, gray[0]);
+  TEST_ASSERT_EQUAL(0xFF, gray[1]);
+  // colours use the same weights as the jpeg decoding and transparent pixels go white
+  uint8_t rgba[] = {255, 255, 255, 255, 0, 0, 0, 255, 0, 0, 0, 0, 0, 0, 0, 128};
+  TEST_ASSERT_TRUE(png_line_to_gray(rgba, 4, PNG_LINE_TRUECOLOR_ALPHA, 8, nullptr, gray));
+  uint8_t rgba_expected[] = {255, 0, 255, 127};
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(rgba_expected, gray, 4);
+  uint8_t gray_alpha[] = {100, 255, 100, 0};
+  TEST_ASSERT_TRUE(png_line_to_gray(gray_alpha, 2, PNG_LINE_GRAY_ALPHA, 8, nullptr, gray));
+  TEST_ASSERT_EQUAL(100, gray[0]);
+  TEST_ASSERT_EQUAL(255, gray[1]);
+  // palettes are converted once up front - including their transparency
+  uint8_t palette[1024] = {0};
+  palette[3 * 1] = 255;
+  palette[3 * 1 + 1] = 255;
+  palette[3 * 1 + 2] = 255;
+  palette[768 + 0] = 0;
+  palette[768 + 1] = 255;
+  palette[768 + 2] = 255;
+  uint8_t palette_gray[256];
+  png_palette_to_gray(palette, true, palette_gray);
+  uint8_t indexed[] = {0x06};
+  TEST_ASSERT_TRUE(png_line_to_gray(indexed, 4, PNG_LINE_INDEXED, 2, palette_gray, gray));
+  uint8_t indexed_expected[] = {255, 255, 255, 0};
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(indexed_expected, gray, 4);
+  // and we need the palette for indexed images
+  TEST_ASSERT_FALSE(png_line_to_gray(indexed, 4, PNG_LINE_INDEXED, 2, nullptr, gray));
+  TEST_ASSERT_FALSE(png_line_to_gray(indexed, 4, 1, 8, nullptr, gray));
+}
+
+void test_dither_keeps_average(void)
+{
+  uint8_t levels[16];
+  for (int i = 0; i < 16; i++)
+  {
+    levels[i] = i * 17;
+  }
+  const int width = 64;
+  const int height = 64;
+  // every gray value should come out as a mix of levels that averages out to the same value
+  for (int value = 0; value < 256; value += 5)
+  {
+    Dither dither(width, levels, 16);
+    std::vector<uint8_t> row(width, value);
+    long total = 0;
+    for (int y = 0; y < height; y++)
+    {
+      const uint8_t *output = dither.dither_row(row.data());
+      for (int x = 0; x < width; x++)
+      {
+        TEST_ASSERT_EQUAL(0, output[x] % 17);
+        total += output[x];
+      }
+    }
+    double average = double(total) / (width * height);
+    TEST_ASSERT_TRUE(fabs(average - value) < 1.0);
+  }
+  // exact levels go straight through
+  Dither dither(4, levels, 16);
+  uint8_t exact[] = {0, 17, 136, 255};
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(exact, dither.dither_row(exact), 4);
+}
+
+// a large illustration - a smooth radial gradient with some solid shapes and fine lines on top
+static uint8_t illustration_pixel(int x, int y, int width, int height)
+{
+  if ((x / 40 + y / 40) % 23 == 0)
+  {
+    return 0;
+  }
+  if (y % 97 == 0)
+  {
+    return 0;
+  }
+  double dx = double(x) / width - 0.5;
+  double dy = double(y) / height - 0.5;
+  return uint8_t(255 * std::min(1.0, sqrt(dx * dx + dy * dy) * 1.6));
+}
+
+// how far the local average brightness of the picture is from what it should be - banding
+// shows up here as large areas that are all too dark or too light
+static double local_average_error(const std::vector<double> &reference, GlyphDrawingRenderer &renderer, int width, int height)
+{
+  const int block = 4;
+  double total_error = 0;
+  int blocks = 0;
+  for (int by = 0; by + block <= height; by += block)
+  {
+    for (int bx = 0; bx + block <= width; bx += block)
+    {
+      double expected = 0;
+      double actual = 0;
+      for (int y = by; y < by + block; y++)
+      {
+        for (int x = bx; x < bx + block; x++)
+        {
+          uint8_t pixel = renderer.frame_buffer[y * renderer.get_page_width() / 2 + x / 2];
+          actual += (x & 1 ? pixel >> 4 : pixel & 0x0F) * 17;
+          expected += reference[y * width + x];
+        }
+      }
+      total_error += fabs(expected - actual) / (block * block);
+      blocks++;
+    }
+  }
+  return total_error / blocks;
+}
+
+void benchmark_png_scale_and_dither(void)
+{
+  const int source_width = 2400;
+  const int source_height = 3200;
+  const int width = 540;
+  const int height = 720;
+  // PNGdec hands us the image a line at a time in the image's own format - 8 bit palette
+  // images are the common case for illustrations
+  std::vector<uint8_t> palette(1024, 255);
+  for (int i = 0; i < 256; i++)
+  {
+    palette[i * 3] = i;
+    palette[i * 3 + 1] = i;
+    palette[i * 3 + 2] = i;
+  }
+  std::vector<uint8_t> image(source_width * source_height);
+  for (int y = 0; y < source_height; y++)
+  {
+    for (int x = 0; x < source_width; x++)
+    {
+      image[y * source_width + x] = illustration_pixel(x, y, source_width, source_height);
+    }
+  }
+  // what the picture should look like at the output size
+  std::vector<double> reference(width * height, 0);
+  for (int y = 0; y < source_height; y++)
+  {
+    for (int x = 0; x < source_width; x++)
+    {
+      // the sizes divide exactly so each source pixel is in a single output pixel
+      reference[(y * height / source_height) * width + x * width / source_width] += image[y * source_width + x];
+    }
+  }
+  double pixels_per_output = double(source_width) * source_height / (width * height);
+  for (auto &value : reference)
+  {
+    value /= pixels_per_output;
+  }
+
+  // the old way - convert each line to RGB565 and back, pick the nearest pixels and draw them one at a time
+  GlyphDrawingRenderer old_renderer;
+  BenchmarkTimer timer;
+  std::vector<uint16_t> rgb565(source_width);
+  int last_y = -1;
+  float x_scale = float(width) / source_width;
+  float y_scale = float(height) / source_height;
+  for (int y = 0; y < source_height; y++)
+  {
+    int output_y = y * y_scale;
+    if (output_y == last_y)
+    {
+      continue;
+    }
+    const uint8_t *line = &image[y * source_width];
+    for (int x = 0; x < source_width; x++)
+    {
+      const uint8_t *rgb = &palette[line[x] * 3];
+      rgb565[x] = ((rgb[0] >> 3) << 11) | ((rgb[1] >> 2) << 5) | (rgb[2] >> 3);
+    }
+    for (int x = 0; x < source_width * x_scale; x++)
+    {
+      uint16_t pixel = rgb565[int(x / x_scale)];
+      uint8_t r = ((pixel >> 11) & 0x1F) << 3;
+      uint8_t g = ((pixel >> 5) & 0x3F) << 2;
+      uint8_t b = (pixel & 0x1F) << 3;
+      old_renderer.draw_pixel(x, output_y, (r * 38 + g * 75 + b * 15) >> 7);
+    }
+    last_y = output_y;
+  }
+  double old_ms = timer.elapsed_ms();
+  double old_error = local_average_error(reference, old_renderer, width, height);
+
+  // and the new way - straight to gray, area averaged, dithered and drawn a row at a time
+  GlyphDrawingRenderer new_renderer;
+  timer.reset();
+  uint8_t palette_gray[256];
+  png_palette_to_gray(palette.data(), false, palette_gray);
+  std::vector<uint8_t> gray(source_width);
+  ImageRowWriter writer(&new_renderer, 0, 0);
+  ImageScaler scaler(source_width, source_height, width, height,
+                     [&writer](int y, const uint8_t *row, int row_width)
+                     {
+                       writer.write_row(y, row, row_width);
+                     });
+  for (int y = 0; y < source_height; y++)
+  {
+    TEST_ASSERT_TRUE(png_line_to_gray(&image[y * source_width], source_width, PNG_LINE_INDEXED, 8, palette_gray, gray.data()));
+    scaler.add_row(gray.data());
+  }
+  double new_ms = timer.elapsed_ms();
+  TEST_ASSERT_EQUAL(height, scaler.get_rows_written());
+  double new_error = local_average_error(reference, new_renderer, width, height);
+  BENCHMARK_REPORT("%dx%d palette PNG to %dx%d 4bpp: RGB565 + nearest pixel %.2f ms (local brightness error %.2f), gray + area average + dither %.2f ms (local brightness error %.2f)",
+                   source_width, source_height, width, height, old_ms, old_error, new_ms, new_error);
+  TEST_ASSERT_TRUE(new_error < old_error);
+}
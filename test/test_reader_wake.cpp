@@ -0,0 +1,141 @@
+#include <unity.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <EpubList/Epub.h>
+#include <EpubList/EpubReader.h>
+#include <EpubList/State.h>
+#include <RubbishHtmlParser/RubbishHtmlParser.h>
+#include <LayoutCache/LayoutCache.h>
+#include "recording_renderer.h"
+#include "benchmark.h"
+
+// a cache of our own so we know exactly what's in it
+static const char *WAKE_CACHE_PATH = "/tmp/wake_cache/";
+
+static void clear_cache(const char *path)
+{
+  mkdir(WAKE_CACHE_PATH, 0755);
+  Epub epub(path);
+  TEST_ASSERT_TRUE(epub.load(EPUB_LOAD_SPINE));
+  LayoutCache cache(WAKE_CACHE_PATH);
+  for (int i = 0; i < epub.get_spine_items_count(); i++)
+  {
+    cache.remove(&epub, i);
+  }
+  remove((std::string(WAKE_CACHE_PATH) + "reader.snp").c_str());
+}
+
+static void init_state(EpubListItem &state, const char *path, int section)
+{
+  memset(&state, 0, sizeof(state));
+  strcpy(state.path, path);
+  state.current_section = section;
+}
+
+// read the book up to the section and then go to sleep
+static void read_and_sleep(EpubListItem &state, RecordingRenderer &renderer)
+{
+  EpubReader reader(state, &renderer, WAKE_CACHE_PATH);
+  reader.load();
+  reader.render();
+  reader.get_prefetcher().wait_until_idle();
+  TEST_ASSERT_TRUE(reader.dehydrate());
+}
+
+void test_reader_wake_snapshot(void)
+{
+  clear_cache("fixtures/oebps.epub");
+  EpubListItem state;
+  init_state(state, "fixtures/oebps.epub", 1);
+  // short pages so there are a few of them to turn
+  RecordingRenderer renderer(100, 8);
+  read_and_sleep(state, renderer);
+  TEST_ASSERT_GREATER_THAN(1, state.pages_in_current_section);
+  // wake up and turn the page - nothing gets parsed and the book isn't loaded
+  uint32_t parse_count = RubbishHtmlParser::get_parse_count();
+  int busy_count = renderer.busy_count;
+  EpubReader *reader = new EpubReader(state, &renderer, WAKE_CACHE_PATH);
+  TEST_ASSERT_TRUE(reader->hydrate());
+  reader->next();
+  renderer.output.clear();
+  reader->render();
+  TEST_ASSERT_EQUAL(parse_count, RubbishHtmlParser::get_parse_count());
+  TEST_ASSERT_EQUAL(busy_count, renderer.busy_count);
+  TEST_ASSERT_EQUAL(1, state.current_page);
+  std::string woken = renderer.output;
+  // and the page is the same as reading it the long way
+  EpubListItem loaded_state = state;
+  EpubReader loaded(loaded_state, &renderer, WAKE_CACHE_PATH);
+  loaded.load();
+  renderer.output.clear();
+  loaded.render();
+  TEST_ASSERT_EQUAL_STRING(renderer.output.c_str(), woken.c_str());
+  // going back to the previous section still works once the spine is needed
+  reader->prev();
+  reader->prev();
+  reader->render();
+  TEST_ASSERT_EQUAL(0, state.current_section);
+  TEST_ASSERT_EQUAL(state.pages_in_current_section - 1, state.current_page);
+  delete reader;
+  loaded.get_prefetcher().cancel();
+
+  // the snapshot is only used for the section and page layout it was taken with
+  init_state(state, "fixtures/oebps.epub", 1);
+  read_and_sleep(state, renderer);
+  state.current_section = 2;
+  TEST_ASSERT_FALSE(EpubReader(state, &renderer, WAKE_CACHE_PATH).hydrate());
+  state.current_section = 1;
+  RecordingRenderer other_renderer(100, 9);
+  TEST_ASSERT_FALSE(EpubReader(state, &other_renderer, WAKE_CACHE_PATH).hydrate());
+  strcpy(state.path, "fixtures/no_oebps.epub");
+  TEST_ASSERT_FALSE(EpubReader(state, &renderer, WAKE_CACHE_PATH).hydrate());
+  // or if the layout it points at has gone
+  strcpy(state.path, "fixtures/oebps.epub");
+  Epub epub(state.path);
+  TEST_ASSERT_TRUE(epub.load(EPUB_LOAD_SPINE));
+  TEST_ASSERT_TRUE(EpubReader(state, &renderer, WAKE_CACHE_PATH).hydrate());
+  LayoutCache(WAKE_CACHE_PATH).remove(&epub, 1);
+  TEST_ASSERT_FALSE(EpubReader(state, &renderer, WAKE_CACHE_PATH).hydrate());
+  clear_cache("fixtures/oebps.epub");
+  TEST_ASSERT_FALSE(EpubReader(state, &renderer, WAKE_CACHE_PATH).hydrate());
+}
+
+void benchmark_reader_wake(void)
+{
+  const char *path = "fixtures/relative_paths.epub";
+  const char *names[] = {"snapshot", "layout cache", "no cache"};
+  for (int mode = 0; mode < 3; mode++)
+  {
+    clear_cache(path);
+    EpubListItem state;
+    init_state(state, path, 10);
+    RecordingRenderer renderer(100, 8);
+    read_and_sleep(state, renderer);
+    if (mode == 2)
+    {
+      clear_cache(path);
+    }
+    uint32_t parse_count = RubbishHtmlParser::get_parse_count();
+    // waking up and turning the page
+    BenchmarkTimer timer;
+    EpubReader *reader = new EpubReader(state, &renderer, WAKE_CACHE_PATH);
+    if (mode != 0 || !reader->hydrate())
+    {
+      reader->load();
+    }
+    reader->next();
+    reader->render();
+    double wake_ms = timer.elapsed_ms();
+    // the prefetcher parses on its own - only count what the page turn waited for
+    reader->get_prefetcher().cancel();
+    uint32_t parses = RubbishHtmlParser::get_parse_count() - parse_count;
+    BENCHMARK_REPORT("%s wake and turn page from %s: %.2f ms, %u sections parsed", path, names[mode], wake_ms, parses);
+    if (mode == 0)
+    {
+      TEST_ASSERT_EQUAL(0, parses);
+    }
+    delete reader;
+  }
+  clear_cache(path);
+}
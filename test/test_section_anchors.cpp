@@ -0,0 +1,138 @@
+#include <unity.h>
+#include <string.h>
+#include <string>
+#include <EpubList/Epub.h>
+#include <EpubList/EpubReader.h>
+#include <EpubList/State.h>
+#include <RubbishHtmlParser/RubbishHtmlParser.h>
+#include <LayoutCache/LayoutCache.h>
+#include "recording_renderer.h"
+#include "test_files.h"
+
+static const char *CACHE_PATH = "/tmp/";
+
+static std::string render_page(RubbishHtmlParser *parser, int page, RecordingRenderer *renderer, Epub *epub)
+{
+  renderer->output.clear();
+  parser->render_page(page, renderer, epub);
+  return renderer->output;
+}
+
+// does the rendered output have the word on it - each word is recorded on its own line
+static bool has_word(const std::string &output, const std::string &word)
+{
+  return output.find(" " + word + "\n") != std::string::npos;
+}
+
+static std::string last_word(const std::string &title)
+{
+  return title.substr(title.find_last_of(' ') + 1);
+}
+
+void test_section_anchor_pages(void)
+{
+  LayoutCache cache(CACHE_PATH);
+  Epub epub("fixtures/oebps.epub");
+  TEST_ASSERT_TRUE(epub.load());
+  // short pages so the first chapter is split over a few of them
+  RecordingRenderer renderer(100, 8);
+  // the first two entries are both in the first chapter - the second one is after the licence text
+  TEST_ASSERT_EQUAL(epub.get_spine_index_for_toc_index(0), epub.get_spine_index_for_toc_index(1));
+  for (int toc_index = 0; toc_index < epub.get_toc_items_count(); toc_index++)
+  {
+    std::string title = epub.get_toc_item_title(toc_index);
+    std::string anchor = epub.get_toc_item_anchor(toc_index);
+    int section = epub.get_spine_index_for_toc_index(toc_index);
+    std::string item = epub.get_spine_item(section);
+    RubbishHtmlParser parser(&epub, item, get_base_path(item));
+    parser.layout(&renderer, &epub);
+    int page = parser.get_anchor_page(anchor);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, page);
+    TEST_ASSERT_LESS_THAN(parser.get_page_count(), page);
+    // the heading the entry points at is on the page
+    TEST_ASSERT_TRUE_MESSAGE(has_word(render_page(&parser, page, &renderer, &epub), last_word(title)), title.c_str());
+    if (anchor == "pgepubid00001")
+    {
+      TEST_ASSERT_GREATER_THAN(0, page);
+      TEST_ASSERT_FALSE(has_word(render_page(&parser, page - 1, &renderer, &epub), "Contents"));
+    }
+    TEST_ASSERT_EQUAL(-1, parser.get_anchor_page("not-an-anchor"));
+    // the cached layout knows where the anchors are without parsing the section again
+    TEST_ASSERT_TRUE(cache.save(&epub, &renderer, section, &parser));
+    CachedSection *cached = cache.load(&epub, &renderer, section);
+    TEST_ASSERT_NOT_NULL(cached);
+    for (int i = 0; i < parser.get_anchor_count(); i++)
+    {
+      int anchor_page = 0;
+      const char *anchor = parser.get_anchor(i, &anchor_page);
+      TEST_ASSERT_EQUAL(parser.get_anchor_page(anchor), cached->get_anchor_page(anchor));
+    }
+    TEST_ASSERT_EQUAL(page, cached->get_anchor_page(anchor));
+    TEST_ASSERT_EQUAL(-1, cached->get_anchor_page("not-an-anchor"));
+    delete cached;
+    cache.remove(&epub, section);
+  }
+}
+
+void test_section_anchor_images_and_skipped_elements(void)
+{
+  // ids on images, on elements we don't display and on empty elements all go somewhere sensible
+  const char *html = "<html><head><title id=\"title\">Title</title></head><body>"
+                     "<p id=\"first\">one two three</p>"
+                     "<p>four <a id=\"inline\"/>five</p>"
+                     "<img id=\"image\" src=\"image.png\"/>"
+                     "<table id=\"table\"><tr><td>skipped</td></tr></table>"
+                     "<p id=\"last\">six</p><p id=\"empty\"></p>"
+                     "<p id=\"first\">duplicate</p>"
+                     "</body></html>";
+  // the image doesn't exist so it gets a placeholder
+  Epub epub("fixtures/oebps.epub");
+  TEST_ASSERT_TRUE(epub.load());
+  // a page is one line high so every line and the image go on a page of their own
+  RecordingRenderer renderer(100, 1);
+  RubbishHtmlParser parser(html, strlen(html), "");
+  parser.layout(&renderer, &epub);
+  TEST_ASSERT_EQUAL(5, parser.get_page_count());
+  TEST_ASSERT_EQUAL(0, parser.get_anchor_page("title"));
+  TEST_ASSERT_EQUAL(0, parser.get_anchor_page("first"));
+  TEST_ASSERT_EQUAL(1, parser.get_anchor_page("inline"));
+  TEST_ASSERT_EQUAL(2, parser.get_anchor_page("image"));
+  TEST_ASSERT_EQUAL(3, parser.get_anchor_page("table"));
+  TEST_ASSERT_EQUAL(3, parser.get_anchor_page("last"));
+  TEST_ASSERT_EQUAL(4, parser.get_anchor_page("empty"));
+  TEST_ASSERT_EQUAL(-1, parser.get_anchor_page("missing"));
+}
+
+void test_section_anchor_epub_reader(void)
+{
+  EpubListItem state;
+  memset(&state, 0, sizeof(state));
+  strcpy(state.path, "fixtures/oebps.epub");
+  state.current_page = 5;
+  Epub epub(state.path);
+  TEST_ASSERT_TRUE(epub.load());
+  int section = epub.get_spine_index_for_toc_index(1);
+  // once when the section is layed out and again when it comes from the cache
+  int expected_page = -1;
+  for (int run = 0; run < 2; run++)
+  {
+    RecordingRenderer renderer(100, 8);
+    EpubReader reader(state, &renderer, CACHE_PATH);
+    reader.load();
+    reader.set_state_section(section, epub.get_toc_item_anchor(1));
+    reader.render();
+    TEST_ASSERT_TRUE(has_word(renderer.output, "Contents"));
+    TEST_ASSERT_GREATER_THAN(0, state.current_page);
+    if (run == 0)
+    {
+      expected_page = state.current_page;
+    }
+    TEST_ASSERT_EQUAL(expected_page, state.current_page);
+    // a section without an anchor starts at the top
+    reader.set_state_section(section);
+    reader.render();
+    TEST_ASSERT_EQUAL(0, state.current_page);
+    reader.get_prefetcher().cancel();
+  }
+  LayoutCache(CACHE_PATH).remove(&epub, section);
+}
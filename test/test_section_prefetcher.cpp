@@ -0,0 +1,230 @@
+#include <unity.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <EpubList/Epub.h>
+#include <EpubList/EpubReader.h>
+#include <EpubList/SectionPrefetcher.h>
+#include <EpubList/State.h>
+#include <RubbishHtmlParser/RubbishHtmlParser.h>
+#include <LayoutCache/LayoutCache.h>
+#include "recording_renderer.h"
+#include "benchmark.h"
+
+// somewhere that doesn't exist so nothing gets cached between the tests
+static const char *NO_CACHE_PATH = "/tmp/no_such_layout_cache/";
+
+static std::string render_all_pages(RubbishHtmlParser *parser, RecordingRenderer *renderer, Epub *epub)
+{
+  renderer->output.clear();
+  for (int i = 0; i < parser->get_page_count(); i++)
+  {
+    parser->render_page(i, renderer, epub);
+  }
+  return renderer->output;
+}
+
+static std::string layout_and_render(Epub *epub, int section, RecordingRenderer *renderer)
+{
+  std::string item = epub->get_spine_item(section);
+  RubbishHtmlParser parser(epub, item, item.substr(0, item.find_last_of('/') + 1));
+  parser.layout(renderer, epub);
+  return render_all_pages(&parser, renderer, epub);
+}
+
+void test_section_prefetcher_prepares_adjacent_sections(void)
+{
+  Epub epub("fixtures/oebps.epub");
+  TEST_ASSERT_TRUE(epub.load());
+  RecordingRenderer renderer;
+  SectionPrefetcher prefetcher(&renderer, NO_CACHE_PATH);
+  prefetcher.prefetch(epub.get_path(), 1, epub.get_spine_items_count());
+  prefetcher.wait_until_idle();
+  TEST_ASSERT_EQUAL(2, prefetcher.get_prepared_count());
+  // the prefetched sections are exactly the same as laying them out ourselves
+  for (int section : {0, 2})
+  {
+    RubbishHtmlParser *parser = prefetcher.take(epub.get_path(), section);
+    TEST_ASSERT_NOT_NULL(parser);
+    std::string prefetched = render_all_pages(parser, &renderer, &epub);
+    delete parser;
+    TEST_ASSERT_EQUAL_STRING(layout_and_render(&epub, section, &renderer).c_str(), prefetched.c_str());
+  }
+  // and they can only be taken once
+  TEST_ASSERT_NULL(prefetcher.take(epub.get_path(), 2));
+  // nothing for other sections or books
+  prefetcher.prefetch(epub.get_path(), 1, epub.get_spine_items_count());
+  prefetcher.wait_until_idle();
+  TEST_ASSERT_NULL(prefetcher.take(epub.get_path(), 3));
+  TEST_ASSERT_NULL(prefetcher.take("fixtures/no_oebps.epub", 2));
+  // moving on throws away the sections that aren't next to the current one
+  prefetcher.prefetch(epub.get_path(), 3, epub.get_spine_items_count());
+  prefetcher.wait_until_idle();
+  TEST_ASSERT_NULL(prefetcher.take(epub.get_path(), 0));
+  RubbishHtmlParser *parser = prefetcher.take(epub.get_path(), 2);
+  TEST_ASSERT_NOT_NULL(parser);
+  delete parser;
+}
+
+void test_section_prefetcher_memory_limit(void)
+{
+  Epub epub("fixtures/oebps.epub");
+  TEST_ASSERT_TRUE(epub.load());
+  RecordingRenderer renderer;
+  // not enough memory to hold onto anything
+  SectionPrefetcher prefetcher(&renderer, NO_CACHE_PATH, 1);
+  prefetcher.prefetch(epub.get_path(), 1, epub.get_spine_items_count());
+  prefetcher.wait_until_idle();
+  TEST_ASSERT_EQUAL(0, prefetcher.get_prepared_count());
+  TEST_ASSERT_EQUAL(2, prefetcher.get_dropped_count());
+  TEST_ASSERT_NULL(prefetcher.take(epub.get_path(), 2));
+}
+
+void test_section_prefetcher_cancel(void)
+{
+  RecordingRenderer renderer;
+  const char *books[] = {"fixtures/oebps.epub", "fixtures/no_oebps.epub", "fixtures/relative_paths.epub"};
+  // keep changing our minds while the worker is busy - nothing should be handed over for the wrong book
+  for (int i = 0; i < 50; i++)
+  {
+    SectionPrefetcher prefetcher(&renderer, NO_CACHE_PATH);
+    const char *book = books[i % 3];
+    prefetcher.prefetch(book, 1, 3);
+    if (i % 2)
+    {
+      prefetcher.cancel();
+      TEST_ASSERT_NULL(prefetcher.take(book, 2));
+    }
+    else
+    {
+      prefetcher.prefetch(books[(i + 1) % 3], 1, 3);
+      TEST_ASSERT_NULL(prefetcher.take(book, 2));
+      RubbishHtmlParser *parser = prefetcher.take(books[(i + 1) % 3], 2);
+      delete parser;
+    }
+    // and the prefetcher can be destroyed while it is working
+  }
+}
+
+// holds the worker up part way through laying out a section until the test lets it carry on
+class GatedRenderer : public RecordingRenderer
+{
+public:
+  std::thread::id main_thread = std::this_thread::get_id();
+  std::atomic<bool> worker_waiting{false};
+  std::atomic<bool> open{false};
+
+  virtual int get_text_width(const char *text, bool bold = false, bool italic = false)
+  {
+    while (std::this_thread::get_id() != main_thread && !open)
+    {
+      worker_waiting = true;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return RecordingRenderer::get_text_width(text, bold, italic);
+  }
+};
+
+void test_section_prefetcher_prefetch_after_cancel(void)
+{
+  Epub epub("fixtures/oebps.epub");
+  TEST_ASSERT_TRUE(epub.load());
+  GatedRenderer renderer;
+  SectionPrefetcher prefetcher(&renderer, NO_CACHE_PATH);
+  prefetcher.prefetch(epub.get_path(), 1, epub.get_spine_items_count());
+  while (!renderer.worker_waiting)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  // the worker is busy with a section when we change our minds and then ask for the same ones again
+  prefetcher.cancel();
+  prefetcher.prefetch(epub.get_path(), 1, epub.get_spine_items_count());
+  renderer.open = true;
+  prefetcher.wait_until_idle();
+  // the work that was cancelled gets thrown away so it has to be done again
+  for (int section : {0, 2})
+  {
+    RubbishHtmlParser *parser = prefetcher.take(epub.get_path(), section);
+    TEST_ASSERT_NOT_NULL(parser);
+    delete parser;
+  }
+}
+
+void test_section_prefetcher_epub_reader(void)
+{
+  EpubListItem state;
+  memset(&state, 0, sizeof(state));
+  strcpy(state.path, "fixtures/oebps.epub");
+  state.current_section = 1;
+  RecordingRenderer renderer;
+  EpubReader *reader = new EpubReader(state, &renderer, NO_CACHE_PATH);
+  reader->load();
+  reader->render();
+  // loading the book and laying out the first section
+  TEST_ASSERT_EQUAL(2, renderer.busy_count);
+  reader->get_prefetcher().wait_until_idle();
+  // turning the page into the next section doesn't need to do any work
+  int pages = state.pages_in_current_section;
+  for (int i = 0; i < pages; i++)
+  {
+    reader->next();
+  }
+  TEST_ASSERT_EQUAL(2, state.current_section);
+  renderer.output.clear();
+  reader->render();
+  TEST_ASSERT_EQUAL(2, renderer.busy_count);
+  std::string prefetched = renderer.output;
+  delete reader;
+  // and it looks the same as laying the section out in the reader
+  renderer.output.clear();
+  reader = new EpubReader(state, &renderer, NO_CACHE_PATH);
+  reader->load();
+  reader->render();
+  TEST_ASSERT_EQUAL(4, renderer.busy_count);
+  TEST_ASSERT_EQUAL_STRING(renderer.output.c_str(), prefetched.c_str());
+  delete reader;
+}
+
+void benchmark_section_prefetcher(void)
+{
+  Epub epub("fixtures/no_oebps.epub");
+  TEST_ASSERT_TRUE(epub.load());
+  // find the biggest chapter in the book - that's the worst stall
+  int largest_section = 0;
+  size_t largest_size = 0;
+  for (int i = 0; i < epub.get_spine_items_count(); i++)
+  {
+    size_t size = 0;
+    uint8_t *data = epub.get_item_contents(epub.get_spine_item(i), &size);
+    free(data);
+    if (size > largest_size)
+    {
+      largest_size = size;
+      largest_section = i;
+    }
+  }
+  RecordingRenderer renderer;
+  // crossing into the section without any help
+  BenchmarkTimer timer;
+  std::string item = epub.get_spine_item(largest_section);
+  RubbishHtmlParser *parser = new RubbishHtmlParser(&epub, item, item.substr(0, item.find_last_of('/') + 1));
+  parser->layout(&renderer, &epub);
+  parser->render_page(0, &renderer, &epub);
+  double stall_ms = timer.elapsed_ms();
+  delete parser;
+  // and when it's been prefetched while we were reading the section before it - there's more
+  // memory to play with here than on the device
+  SectionPrefetcher prefetcher(&renderer, NO_CACHE_PATH, 16 * 1024 * 1024);
+  prefetcher.prefetch(epub.get_path(), largest_section - 1, epub.get_spine_items_count());
+  prefetcher.wait_until_idle();
+  timer.reset();
+  parser = prefetcher.take(epub.get_path(), largest_section);
+  TEST_ASSERT_NOT_NULL(parser);
+  parser->render_page(0, &renderer, &epub);
+  double prefetched_ms = timer.elapsed_ms();
+  delete parser;
+  BENCHMARK_REPORT("%s: turning into the largest section (%zu bytes) without prefetch %.2f ms, with prefetch %.2f ms",
+                   epub.get_path().c_str(), largest_size, stall_ms, prefetched_ms);
+}
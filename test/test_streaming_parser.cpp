@@ -0,0 +1,101 @@
+#include <unity.h>
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+#include <EpubList/Epub.h>
+#include <RubbishHtmlParser/RubbishHtmlParser.h>
+#include "recording_renderer.h"
+#include "heap_tracker.h"
+#include "benchmark.h"
+#include "test_files.h"
+
+static const char *fixtures[] = {
+    "fixtures/no_oebps.epub",
+    "fixtures/oebps.epub",
+    "fixtures/relative_paths.epub",
+};
+
+static std::string render_all_pages(RubbishHtmlParser &parser, Epub *epub)
+{
+  RecordingRenderer renderer;
+  parser.layout(&renderer, epub);
+  for (int i = 0; i < parser.get_page_count(); i++)
+  {
+    parser.render_page(i, &renderer, epub);
+  }
+  return renderer.output;
+}
+
+void test_streaming_parser_matches_in_memory(void)
+{
+  for (auto fixture : fixtures)
+  {
+    Epub epub(fixture);
+    TEST_ASSERT_TRUE(epub.load());
+    for (int i = 0; i < epub.get_spine_items_count(); i++)
+    {
+      std::string item = epub.get_spine_item(i);
+      size_t size = 0;
+      char *html = (char *)epub.get_item_contents(item, &size);
+      TEST_ASSERT_NOT_NULL(html);
+      RubbishHtmlParser in_memory(html, size, get_base_path(item));
+      free(html);
+      RubbishHtmlParser streamed(&epub, item, get_base_path(item));
+      TEST_ASSERT_EQUAL(in_memory.get_blocks().size(), streamed.get_blocks().size());
+      TEST_ASSERT_EQUAL_STRING(render_all_pages(in_memory, &epub).c_str(), render_all_pages(streamed, &epub).c_str());
+    }
+  }
+}
+
+void benchmark_streaming_parser_peak_heap(void)
+{
+  if (!heap_tracker_supported())
+  {
+    TEST_IGNORE_MESSAGE("Heap tracking is not supported on this platform");
+  }
+  for (auto fixture : fixtures)
+  {
+    Epub epub(fixture);
+    TEST_ASSERT_TRUE(epub.load());
+    // find the biggest chapter in the book
+    std::string largest_item;
+    size_t largest_size = 0;
+    for (int i = 0; i < epub.get_spine_items_count(); i++)
+    {
+      size_t size = 0;
+      uint8_t *data = epub.get_item_contents(epub.get_spine_item(i), &size);
+      free(data);
+      if (size > largest_size)
+      {
+        largest_size = size;
+        largest_item = epub.get_spine_item(i);
+      }
+    }
+    // read the whole chapter into memory and then parse it
+    heap_tracker_reset();
+    size_t base = heap_tracker_current();
+    BenchmarkTimer timer;
+    size_t size = 0;
+    char *html = (char *)epub.get_item_contents(largest_item, &size);
+    RubbishHtmlParser *in_memory = new RubbishHtmlParser(html, size, get_base_path(largest_item));
+    free(html);
+    double in_memory_ms = timer.elapsed_ms();
+    size_t in_memory_peak = heap_tracker_peak() - base;
+    delete in_memory;
+    // stream the chapter straight into the parser
+    heap_tracker_reset();
+    base = heap_tracker_current();
+    timer.reset();
+    RubbishHtmlParser *streamed = new RubbishHtmlParser(&epub, largest_item, get_base_path(largest_item));
+    double streamed_ms = timer.elapsed_ms();
+    size_t streamed_peak = heap_tracker_peak() - base;
+    delete streamed;
+    BENCHMARK_REPORT("%s: largest chapter %zu bytes, peak heap in memory %zu bytes (%.2f ms), streamed %zu bytes (%.2f ms)",
+                     fixture, largest_size, in_memory_peak, in_memory_ms, streamed_peak, streamed_ms);
+    // streaming has a fixed overhead for the decompressor so it only wins for bigger chapters
+    if (largest_size > 64 * 1024)
+    {
+      TEST_ASSERT_LESS_THAN(in_memory_peak, streamed_peak);
+    }
+  }
+}
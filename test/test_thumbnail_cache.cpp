@@ -0,0 +1,196 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <string>
+#include <vector>
+#include <EpubList/Epub.h>
+#include <EpubList/EpubList.h>
+#include <EpubList/State.h>
+#include <ThumbnailCache/ThumbnailCache.h>
+#include <LibraryIndex/LibraryIndex.h>
+#include "glyph_drawing_renderer.h"
+#include "heap_tracker.h"
+#include "benchmark.h"
+#include "test_files.h"
+
+static const char *CACHE_PATH = "/tmp/";
+static const char *LIBRARY_PATH = "/tmp/thumbnail_library/";
+
+// the size covers are drawn at in the library list
+static const int THUMBNAIL_WIDTH = 101;
+static const int THUMBNAIL_HEIGHT = 152;
+
+// the area of the frame buffer the thumbnail was drawn into
+static std::vector<uint8_t> get_area(GlyphDrawingRenderer &renderer, int x, int y, int width, int height)
+{
+  std::vector<uint8_t> area;
+  for (int row = y; row < y + height; row++)
+  {
+    const uint8_t *start = &renderer.frame_buffer[row * renderer.get_page_width() / 2 + x / 2];
+    area.insert(area.end(), start, start + width / 2);
+  }
+  return area;
+}
+
+void test_thumbnail_cache_generate_and_load(void)
+{
+  const char *book = "fixtures/relative_paths.epub";
+  // the first time round the cover is decoded and saved
+  GlyphDrawingRenderer cold;
+  ThumbnailCache cold_cache(&cold, CACHE_PATH);
+  cold_cache.remove(book);
+  TEST_ASSERT_FALSE(cold_cache.is_cached(book, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT));
+  cold_cache.draw(book, 20, 20, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT);
+  TEST_ASSERT_TRUE(cold_cache.is_cached(book, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT));
+  // and after that it comes straight from the file and looks exactly the same
+  GlyphDrawingRenderer warm;
+  ThumbnailCache warm_cache(&warm, CACHE_PATH);
+  warm_cache.draw(book, 20, 20, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT);
+  TEST_ASSERT_TRUE(cold.frame_buffer == warm.frame_buffer);
+  // which is what decoding the cover straight onto the screen would have given us
+  Epub epub(book);
+  TEST_ASSERT_TRUE(epub.load());
+  size_t size = 0;
+  uint8_t *data = epub.get_item_contents(epub.get_cover_image_item(), &size);
+  TEST_ASSERT_NOT_NULL(data);
+  GlyphDrawingRenderer direct;
+  direct.Renderer::draw_image(epub.get_cover_image_item(), data, size, 20, 20, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT);
+  free(data);
+  TEST_ASSERT_TRUE(get_area(direct, 20, 20, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT) == get_area(warm, 20, 20, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT));
+  Thumbnail thumbnail;
+  TEST_ASSERT_TRUE(warm_cache.load(book, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, &thumbnail));
+  TEST_ASSERT_EQUAL(THUMBNAIL_WIDTH, thumbnail.width);
+  TEST_ASSERT_EQUAL((THUMBNAIL_WIDTH + 1) / 2 * thumbnail.height, thumbnail.pixels.size());
+  // books without a cover get a placeholder - and that's remembered too
+  const char *no_cover = "fixtures/no_oebps.epub";
+  warm_cache.remove(no_cover);
+  warm_cache.draw(no_cover, 0, 0, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT);
+  TEST_ASSERT_TRUE(warm_cache.load(no_cover, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, &thumbnail));
+  TEST_ASSERT_EQUAL(0, thumbnail.width);
+}
+
+void test_thumbnail_cache_invalidation(void)
+{
+  std::string book = std::string(CACHE_PATH) + "thumbnail_book.epub";
+  TEST_ASSERT_TRUE(copy_file("fixtures/oebps.epub", book));
+  GlyphDrawingRenderer renderer;
+  ThumbnailCache cache(&renderer, CACHE_PATH);
+  cache.remove(book);
+  cache.draw(book, 0, 0, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT);
+  TEST_ASSERT_TRUE(cache.is_cached(book, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT));
+  // a different size needs a new thumbnail
+  TEST_ASSERT_FALSE(cache.is_cached(book, THUMBNAIL_WIDTH * 2, THUMBNAIL_HEIGHT * 2));
+  // as does a book that has changed
+  struct timeval times[2] = {{1000, 0}, {1000, 0}};
+  TEST_ASSERT_EQUAL(0, utimes(book.c_str(), times));
+  TEST_ASSERT_FALSE(cache.is_cached(book, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT));
+  cache.draw(book, 0, 0, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT);
+  TEST_ASSERT_TRUE(cache.is_cached(book, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT));
+  // and a file that didn't get finished is ignored
+  std::string filename = cache.get_filename(book);
+  FILE *fp = fopen(filename.c_str(), "r+b");
+  TEST_ASSERT_NOT_NULL(fp);
+  fwrite("\0\0\0\0", 1, 4, fp);
+  fclose(fp);
+  TEST_ASSERT_FALSE(cache.is_cached(book, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT));
+  // a missing book can't have a thumbnail
+  remove(book.c_str());
+  TEST_ASSERT_FALSE(cache.is_cached(book, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT));
+  cache.remove(book);
+}
+
+void test_thumbnail_cache_prefetch(void)
+{
+  GlyphDrawingRenderer renderer;
+  ThumbnailCache cache(&renderer, CACHE_PATH);
+  std::vector<std::string> books = {"fixtures/oebps.epub", "fixtures/relative_paths.epub", "fixtures/no_oebps.epub"};
+  for (auto &book : books)
+  {
+    cache.remove(book);
+  }
+  cache.prefetch(books, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT);
+  cache.wait_until_idle();
+  TEST_ASSERT_EQUAL(3, cache.get_generated_count());
+  for (auto &book : books)
+  {
+    TEST_ASSERT_TRUE(cache.is_cached(book, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT));
+  }
+  // anything that's already there is skipped
+  cache.prefetch(books, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT);
+  cache.wait_until_idle();
+  TEST_ASSERT_EQUAL(3, cache.get_generated_count());
+  // and drawing while the worker is busy gives the same result as drawing on our own
+  for (auto &book : books)
+  {
+    cache.remove(book);
+  }
+  cache.prefetch(books, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT);
+  for (auto &book : books)
+  {
+    cache.draw(book, 0, 0, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT);
+  }
+  cache.wait_until_idle();
+  Thumbnail thumbnail;
+  TEST_ASSERT_TRUE(cache.load(books[1], THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, &thumbnail));
+  TEST_ASSERT_EQUAL(THUMBNAIL_WIDTH, thumbnail.width);
+}
+
+// a page of the library list with five books on it
+static const char *library_books[] = {
+    "fixtures/oebps.epub",
+    "fixtures/relative_paths.epub",
+    "fixtures/no_oebps.epub",
+    "fixtures/relative_paths.epub",
+    "fixtures/oebps.epub",
+};
+
+void benchmark_thumbnail_cache_library_page(void)
+{
+  if (!heap_tracker_supported())
+  {
+    TEST_IGNORE_MESSAGE("Heap tracking is not supported on this platform");
+  }
+  mkdir(LIBRARY_PATH, 0755);
+  for (int i = 0; i < 5; i++)
+  {
+    std::string book = std::string(LIBRARY_PATH) + "book" + std::to_string(i) + ".epub";
+    TEST_ASSERT_TRUE(copy_file(library_books[i], book));
+  }
+  EpubListState state;
+  memset(&state, 0, sizeof(state));
+  GlyphDrawingRenderer renderer;
+  EpubList list(&renderer, state, LIBRARY_PATH);
+  TEST_ASSERT_TRUE(list.load(LIBRARY_PATH));
+  TEST_ASSERT_EQUAL(5, state.num_epubs);
+  ThumbnailCache cache(&renderer, LIBRARY_PATH);
+  LibraryIndex index(std::string(LIBRARY_PATH) + "library.idx");
+  std::vector<LibraryEntry> books;
+  TEST_ASSERT_TRUE(index.read_entries(0, 5, books));
+  for (auto &book : books)
+  {
+    cache.remove(book.path);
+  }
+  // the first time every cover has to be decoded - the second time they're just copied from the cache
+  const char *passes[] = {"cold", "warm"};
+  for (auto pass : passes)
+  {
+    list.set_needs_redraw();
+    heap_tracker_reset();
+    size_t start_heap = heap_tracker_current();
+    BenchmarkTimer timer;
+    list.render();
+    double ms = timer.elapsed_ms();
+    BENCHMARK_REPORT("library page of 5 books (%s thumbnails): %.2f ms, %zu allocations, %zu bytes peak heap",
+                     pass, ms, heap_tracker_allocations(), heap_tracker_peak() - start_heap);
+  }
+  for (auto &book : books)
+  {
+    TEST_ASSERT_TRUE(cache.is_cached(book.path, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT));
+    cache.remove(book.path);
+    remove(book.path.c_str());
+  }
+  remove((std::string(LIBRARY_PATH) + "library.idx").c_str());
+}
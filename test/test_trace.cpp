@@ -0,0 +1,175 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string>
+#include <EpubList/Epub.h>
+#include <RubbishHtmlParser/RubbishHtmlParser.h>
+#include <Renderer/MemoryFrameBufferRenderer.h>
+#include <Trace/Trace.h>
+#include <regular_font.h>
+#include <bold_font.h>
+#include <italic_font.h>
+#include <bold_italic_font.h>
+#include "heap_tracker.h"
+#include "benchmark.h"
+
+#ifdef TRACE_ENABLED
+static TraceHeapSample fake_heap = {0, 0};
+
+static void sample_fake_heap(TraceHeapSample *sample)
+{
+  *sample = fake_heap;
+}
+
+// pretend there's the same amount of memory to play with as the device and that none of it is fragmented
+static void sample_heap_tracker(TraceHeapSample *sample)
+{
+  const size_t budget = 4 * 1024 * 1024;
+  size_t current = heap_tracker_current();
+  sample->free = current < budget ? budget - current : 0;
+  sample->largest_free_block = sample->free;
+}
+
+static std::string read_file(const char *filename)
+{
+  std::string contents;
+  FILE *fp = fopen(filename, "r");
+  TEST_ASSERT_NOT_NULL(fp);
+  char buffer[256];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+  {
+    contents.append(buffer, length);
+  }
+  fclose(fp);
+  return contents;
+}
+#endif
+
+void test_trace_scopes_and_counters(void)
+{
+#ifndef TRACE_ENABLED
+  TEST_IGNORE_MESSAGE("Tracing is not enabled");
+#else
+  trace_reset();
+  trace_set_heap_sampler(sample_fake_heap);
+  fake_heap = {1000, 800};
+  {
+    TRACE_STAGE("outer");
+    {
+      TRACE_SCOPE("inner");
+    }
+    // the heap gets used up and broken up while the stage runs
+    fake_heap = {500, 250};
+  }
+  TRACE_COUNTER("pages", 3);
+  TEST_ASSERT_EQUAL(3, trace_get_event_count());
+  TEST_ASSERT_EQUAL(0, trace_get_dropped_count());
+  TraceStage stage;
+  TEST_ASSERT_TRUE(trace_get_stage("outer", &stage));
+  TEST_ASSERT_EQUAL(1, stage.calls);
+  TEST_ASSERT_EQUAL(2, stage.heap_samples);
+  TEST_ASSERT_EQUAL(500, stage.lowest_free);
+  TEST_ASSERT_EQUAL(250, stage.lowest_largest_free_block);
+  TEST_ASSERT_EQUAL(50, stage.worst_fragmentation);
+  // plain scopes don't touch the heap
+  TEST_ASSERT_TRUE(trace_get_stage("inner", &stage));
+  TEST_ASSERT_EQUAL(1, stage.calls);
+  TEST_ASSERT_EQUAL(0, stage.heap_samples);
+  TEST_ASSERT_FALSE(trace_get_stage("missing", &stage));
+
+  // chrome trace events for the scopes, the counter and the heap
+  TEST_ASSERT_TRUE(trace_write_chrome_json("/tmp/trace_test.json"));
+  std::string json = read_file("/tmp/trace_test.json");
+  remove("/tmp/trace_test.json");
+  TEST_ASSERT_EQUAL(0, json.find("{\"displayTimeUnit\": \"ms\", \"traceEvents\": ["));
+  TEST_ASSERT_NOT_EQUAL(std::string::npos, json.find("{\"name\": \"inner\", \"ph\": \"X\""));
+  TEST_ASSERT_NOT_EQUAL(std::string::npos, json.find("{\"name\": \"outer\", \"ph\": \"X\""));
+  TEST_ASSERT_NOT_EQUAL(std::string::npos, json.find("\"args\": {\"free\": 500, \"largest_free_block\": 250}"));
+  TEST_ASSERT_NOT_EQUAL(std::string::npos, json.find("{\"name\": \"pages\", \"ph\": \"C\""));
+  TEST_ASSERT_NOT_EQUAL(std::string::npos, json.find("\"args\": {\"value\": 3}"));
+  TEST_ASSERT_EQUAL(json.size() - 4, json.find("\n]}\n"));
+
+  // the ring buffer keeps the most recent events but the stages count everything
+  for (int i = 0; i < TRACE_BUFFER_SIZE + 10; i++)
+  {
+    TRACE_SCOPE("loop");
+  }
+  TEST_ASSERT_EQUAL(TRACE_BUFFER_SIZE, trace_get_event_count());
+  TEST_ASSERT_EQUAL(13, trace_get_dropped_count());
+  TEST_ASSERT_TRUE(trace_get_stage("loop", &stage));
+  TEST_ASSERT_EQUAL(TRACE_BUFFER_SIZE + 10, stage.calls);
+
+  // the dump has the stage totals and the events
+  FILE *fp = fopen("/tmp/trace_test.txt", "w");
+  TEST_ASSERT_NOT_NULL(fp);
+  trace_dump(fp);
+  fclose(fp);
+  std::string dump = read_file("/tmp/trace_test.txt");
+  remove("/tmp/trace_test.txt");
+  TEST_ASSERT_EQUAL(0, dump.find("TRACE: " + std::to_string(TRACE_BUFFER_SIZE) + " events, 13 dropped\n"));
+  TEST_ASSERT_NOT_EQUAL(std::string::npos, dump.find("TRACE: outer "));
+  TEST_ASSERT_NOT_EQUAL(std::string::npos, dump.find("] loop "));
+
+  trace_reset();
+  TEST_ASSERT_EQUAL(0, trace_get_event_count());
+  TEST_ASSERT_FALSE(trace_get_stage("loop", &stage));
+  trace_set_heap_sampler(nullptr);
+#endif
+}
+
+void benchmark_trace_page_turn(void)
+{
+#ifndef TRACE_ENABLED
+  TEST_IGNORE_MESSAGE("Tracing is not enabled");
+#else
+  if (!heap_tracker_supported())
+  {
+    TEST_IGNORE_MESSAGE("Heap tracking is not supported on this platform");
+  }
+  // what a scope costs on its own
+  const int iterations = 100000;
+  trace_reset();
+  BenchmarkTimer timer;
+  for (int i = 0; i < iterations; i++)
+  {
+    TRACE_SCOPE("overhead");
+  }
+  double scope_ns = timer.elapsed_ms() * 1000000 / iterations;
+  trace_set_heap_sampler(sample_heap_tracker);
+  timer.reset();
+  for (int i = 0; i < iterations; i++)
+  {
+    TRACE_STAGE("overhead");
+  }
+  double stage_ns = timer.elapsed_ms() * 1000000 / iterations;
+  BENCHMARK_REPORT("trace overhead: %.1f ns per scope, %.1f ns per stage", scope_ns, stage_ns);
+
+  // trace reading the whole of a book
+  trace_reset();
+  Epub epub("fixtures/oebps.epub");
+  TEST_ASSERT_TRUE(epub.load());
+  MemoryFrameBufferRenderer renderer(&regular_font, &bold_font, &italic_font, &bold_italic_font);
+  for (int section = 0; section < epub.get_spine_items_count(); section++)
+  {
+    std::string item = epub.get_spine_item(section);
+    RubbishHtmlParser parser(&epub, item, item.substr(0, item.find_last_of('/') + 1));
+    parser.layout(&renderer, &epub);
+    for (int page = 0; page < parser.get_page_count(); page++)
+    {
+      parser.render_page(page, &renderer, &epub);
+    }
+  }
+  const char *names[] = {"zip extract", "parse", "layout", "image size", "image decode", "render page", "glyph draw"};
+  for (const char *name : names)
+  {
+    TraceStage stage;
+    TEST_ASSERT_TRUE(trace_get_stage(name, &stage));
+    BENCHMARK_REPORT("oebps.epub %s: %u calls, %.3f ms total, %.3f ms max, lowest free heap %u",
+                     name, stage.calls, stage.total_us / 1000.0, stage.max_us / 1000.0, stage.heap_samples ? stage.lowest_free : 0);
+  }
+  TEST_ASSERT_TRUE(trace_write_chrome_json("/tmp/trace.json"));
+  BENCHMARK_REPORT("last %zu trace events written to /tmp/trace.json", trace_get_event_count());
+  trace_set_heap_sampler(nullptr);
+  trace_reset();
+#endif
+}
@@ -0,0 +1,86 @@
+#include <unity.h>
+#include <stdlib.h>
+#include <vector>
+#include <string>
+#include <EpubList/Epub.h>
+#include <ZipFile/ZipFile.h>
+#include "benchmark.h"
+
+static std::vector<std::string> get_spine_items(const char *path)
+{
+  std::vector<std::string> items;
+  Epub epub(path);
+  TEST_ASSERT_TRUE(epub.load());
+  for (int i = 0; i < epub.get_spine_items_count(); i++)
+  {
+    items.push_back(epub.get_spine_item(i));
+  }
+  return items;
+}
+
+void test_zip_file_reuses_archive(void)
+{
+  ZipFile zip("fixtures/relative_paths.epub");
+  // read the same file several times from the one archive
+  for (int i = 0; i < 3; i++)
+  {
+    size_t size = 0;
+    uint8_t *data = zip.read_file_to_memory("META-INF/container.xml", &size);
+    TEST_ASSERT_NOT_NULL(data);
+    TEST_ASSERT_EQUAL(265, size);
+    free(data);
+  }
+  // missing files should not break the archive for later reads
+  TEST_ASSERT_NULL(zip.read_file_to_memory("does/not/exist.html"));
+  uint8_t *data = zip.read_file_to_memory("OEBPS/content.opf");
+  TEST_ASSERT_NOT_NULL(data);
+  free(data);
+  // closing the archive should reopen it on demand
+  zip.close();
+  data = zip.read_file_to_memory("OEBPS/toc.ncx");
+  TEST_ASSERT_NOT_NULL(data);
+  free(data);
+}
+
+void test_zip_file_missing_archive(void)
+{
+  ZipFile zip("fixtures/missing.epub");
+  TEST_ASSERT_NULL(zip.read_file_to_memory("META-INF/container.xml"));
+  TEST_ASSERT_FALSE(zip.read_file_to_file("META-INF/container.xml", "/tmp/container.xml"));
+}
+
+void benchmark_zip_file_extract(void)
+{
+  const char *path = "fixtures/relative_paths.epub";
+  std::vector<std::string> items = get_spine_items(path);
+  TEST_ASSERT_EQUAL(373, items.size());
+  // before - every extract opens the archive and re-reads the central directory
+  size_t reopen_bytes = 0;
+  BenchmarkTimer timer;
+  for (auto &item : items)
+  {
+    ZipFile zip(path);
+    size_t size = 0;
+    uint8_t *data = zip.read_file_to_memory(item.c_str(), &size);
+    TEST_ASSERT_NOT_NULL(data);
+    reopen_bytes += size;
+    free(data);
+  }
+  double reopen_ms = timer.elapsed_ms();
+  // after - a single archive serves every extract
+  size_t persistent_bytes = 0;
+  timer.reset();
+  ZipFile zip(path);
+  for (auto &item : items)
+  {
+    size_t size = 0;
+    uint8_t *data = zip.read_file_to_memory(item.c_str(), &size);
+    TEST_ASSERT_NOT_NULL(data);
+    persistent_bytes += size;
+    free(data);
+  }
+  double persistent_ms = timer.elapsed_ms();
+  TEST_ASSERT_EQUAL(reopen_bytes, persistent_bytes);
+  BENCHMARK_REPORT("zip extract (%d items): reopen per extract %.3f ms/item, persistent archive %.3f ms/item",
+                   (int)items.size(), reopen_ms / items.size(), persistent_ms / items.size());
+}
@@ -2,22 +2,185 @@
 
 void test_xml_parser(void);
 void test_parser(void);
+void test_parser_malformed_html(void);
 void test_epub_no_oebps_load(void);
 void test_epub_load(void);
 void test_epub_relative_image_paths(void);
 void test_html_entity_replacement(void);
 void test_epub_toc_load(void);
+void test_zip_file_reuses_archive(void);
+void test_zip_file_missing_archive(void);
+void benchmark_zip_file_extract(void);
+void test_html_tokenizer_events(void);
+void test_html_tokenizer_long_text(void);
+void test_html_tokenizer_in_place(void);
+void test_html_tokenizer_malformed(void);
+void benchmark_html_parser_throughput(void);
+void test_streaming_parser_matches_in_memory(void);
+void benchmark_streaming_parser_peak_heap(void);
+void test_layout_cache_matches_fresh_layout(void);
+void test_layout_cache_invalidation(void);
+void test_layout_cache_budget(void);
+void test_layout_cache_epub_reader(void);
+void benchmark_layout_cache(void);
+void test_arena_allocations(void);
+void test_arena_objects(void);
+void benchmark_arena_section_allocations(void);
+void test_line_breaking_golden(void);
+void test_line_breaking_long_word(void);
+void test_line_breaking_huge_paragraph(void);
+void benchmark_line_breaking(void);
+void test_glyph_width_cache_matches_text_bounds(void);
+void benchmark_glyph_width_cache(void);
+void test_glyph_bitmap_cache_lru(void);
+void benchmark_glyph_bitmap_cache(void);
+void test_section_prefetcher_prepares_adjacent_sections(void);
+void test_section_prefetcher_memory_limit(void);
+void test_section_prefetcher_cancel(void);
+void test_section_prefetcher_prefetch_after_cancel(void);
+void test_section_prefetcher_epub_reader(void);
+void benchmark_section_prefetcher(void);
+void test_frame_diff_regions(void);
+void benchmark_frame_diff_page_turns(void);
+void test_image_scaler_area_average(void);
+void test_image_scaler_jpeg_quality(void);
+void benchmark_image_scaler_jpeg(void);
+void test_png_line_to_gray(void);
+void test_dither_keeps_average(void);
+void benchmark_png_scale_and_dither(void);
+void test_image_size_from_headers(void);
+void benchmark_image_page(void);
+void test_thumbnail_cache_generate_and_load(void);
+void test_thumbnail_cache_invalidation(void);
+void test_thumbnail_cache_prefetch(void);
+void benchmark_thumbnail_cache_library_page(void);
+void test_library_index_update(void);
+void test_library_index_failed_books(void);
+void test_library_index_entities(void);
+void test_library_index_interrupted_write(void);
+void test_library_index_update_in_pages(void);
+void test_library_index_epub_list(void);
+void benchmark_library_index(void);
+void test_epub_load_levels(void);
+void benchmark_epub_load_levels(void);
+void benchmark_epub_lookups(void);
+void test_section_anchor_pages(void);
+void test_section_anchor_images_and_skipped_elements(void);
+void test_section_anchor_epub_reader(void);
+void test_epub_toc_nested_ncx(void);
+void test_epub_toc_relative_manifest(void);
+void test_epub_toc_nested_builder(void);
+void test_epub_toc_handlers(void);
+void test_epub_toc_render(void);
+void benchmark_epub_toc_load(void);
+void test_reader_wake_snapshot(void);
+void benchmark_reader_wake(void);
+void test_frame_codec_round_trip(void);
+void benchmark_frame_codec(void);
+void test_memory_frame_buffer_renderer_pages(void);
+void test_memory_frame_buffer_renderer_drawing(void);
+void benchmark_page_render(void);
+void benchmark_page_turn_pipeline(void);
+void test_trace_scopes_and_counters(void);
+void benchmark_trace_page_turn(void);
+void test_incremental_layout_matches_full_layout(void);
+void test_incremental_layout_epub_reader(void);
+void benchmark_time_to_first_page(void);
 
 int main(int argc, char **argv)
 {
   UNITY_BEGIN();
+#ifdef BENCHMARKS_ONLY
+  // pio test -e native_benchmark - just the end to end timings
+  RUN_TEST(benchmark_page_turn_pipeline);
+#else
   RUN_TEST(test_xml_parser);
   RUN_TEST(test_parser);
+  RUN_TEST(test_parser_malformed_html);
   RUN_TEST(test_epub_no_oebps_load);
   RUN_TEST(test_epub_load);
   RUN_TEST(test_epub_relative_image_paths);
   RUN_TEST(test_html_entity_replacement);
   RUN_TEST(test_epub_toc_load);
+  RUN_TEST(test_zip_file_reuses_archive);
+  RUN_TEST(test_zip_file_missing_archive);
+  RUN_TEST(benchmark_zip_file_extract);
+  RUN_TEST(test_html_tokenizer_events);
+  RUN_TEST(test_html_tokenizer_long_text);
+  RUN_TEST(test_html_tokenizer_in_place);
+  RUN_TEST(test_html_tokenizer_malformed);
+  RUN_TEST(benchmark_html_parser_throughput);
+  RUN_TEST(test_streaming_parser_matches_in_memory);
+  RUN_TEST(benchmark_streaming_parser_peak_heap);
+  RUN_TEST(test_layout_cache_matches_fresh_layout);
+  RUN_TEST(test_layout_cache_invalidation);
+  RUN_TEST(test_layout_cache_budget);
+  RUN_TEST(test_layout_cache_epub_reader);
+  RUN_TEST(benchmark_layout_cache);
+  RUN_TEST(test_arena_allocations);
+  RUN_TEST(test_arena_objects);
+  RUN_TEST(benchmark_arena_section_allocations);
+  RUN_TEST(test_line_breaking_golden);
+  RUN_TEST(test_line_breaking_long_word);
+  RUN_TEST(test_line_breaking_huge_paragraph);
+  RUN_TEST(benchmark_line_breaking);
+  RUN_TEST(test_glyph_width_cache_matches_text_bounds);
+  RUN_TEST(benchmark_glyph_width_cache);
+  RUN_TEST(test_glyph_bitmap_cache_lru);
+  RUN_TEST(benchmark_glyph_bitmap_cache);
+  RUN_TEST(test_section_prefetcher_prepares_adjacent_sections);
+  RUN_TEST(test_section_prefetcher_memory_limit);
+  RUN_TEST(test_section_prefetcher_cancel);
+  RUN_TEST(test_section_prefetcher_prefetch_after_cancel);
+  RUN_TEST(test_section_prefetcher_epub_reader);
+  RUN_TEST(benchmark_section_prefetcher);
+  RUN_TEST(test_frame_diff_regions);
+  RUN_TEST(benchmark_frame_diff_page_turns);
+  RUN_TEST(test_image_scaler_area_average);
+  RUN_TEST(test_image_scaler_jpeg_quality);
+  RUN_TEST(benchmark_image_scaler_jpeg);
+  RUN_TEST(test_png_line_to_gray);
+  RUN_TEST(test_dither_keeps_average);
+  RUN_TEST(benchmark_png_scale_and_dither);
+  RUN_TEST(test_image_size_from_headers);
+  RUN_TEST(benchmark_image_page);
+  RUN_TEST(test_thumbnail_cache_generate_and_load);
+  RUN_TEST(test_thumbnail_cache_invalidation);
+  RUN_TEST(test_thumbnail_cache_prefetch);
+  RUN_TEST(benchmark_thumbnail_cache_library_page);
+  RUN_TEST(test_library_index_update);
+  RUN_TEST(test_library_index_failed_books);
+  RUN_TEST(test_library_index_entities);
+  RUN_TEST(test_library_index_interrupted_write);
+  RUN_TEST(test_library_index_update_in_pages);
+  RUN_TEST(test_library_index_epub_list);
+  RUN_TEST(benchmark_library_index);
+  RUN_TEST(test_epub_load_levels);
+  RUN_TEST(benchmark_epub_load_levels);
+  RUN_TEST(benchmark_epub_lookups);
+  RUN_TEST(test_section_anchor_pages);
+  RUN_TEST(test_section_anchor_images_and_skipped_elements);
+  RUN_TEST(test_section_anchor_epub_reader);
+  RUN_TEST(test_epub_toc_nested_ncx);
+  RUN_TEST(test_epub_toc_relative_manifest);
+  RUN_TEST(test_epub_toc_nested_builder);
+  RUN_TEST(test_epub_toc_handlers);
+  RUN_TEST(test_epub_toc_render);
+  RUN_TEST(benchmark_epub_toc_load);
+  RUN_TEST(test_reader_wake_snapshot);
+  RUN_TEST(benchmark_reader_wake);
+  RUN_TEST(test_frame_codec_round_trip);
+  RUN_TEST(benchmark_frame_codec);
+  RUN_TEST(test_memory_frame_buffer_renderer_pages);
+  RUN_TEST(test_memory_frame_buffer_renderer_drawing);
+  RUN_TEST(benchmark_page_render);
+  RUN_TEST(benchmark_page_turn_pipeline);
+  RUN_TEST(test_trace_scopes_and_counters);
+  RUN_TEST(benchmark_trace_page_turn);
+  RUN_TEST(test_incremental_layout_matches_full_layout);
+  RUN_TEST(test_incremental_layout_epub_reader);
+  RUN_TEST(benchmark_time_to_first_page);
+#endif
   UNITY_END();
 
   return 0;